@@ -21,6 +21,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "client.h"
 
+// the particle update, switched by cl_simd
+#if !id386 && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define CL_SSE2
+#include <emmintrin.h>
+#endif
+
 void CL_LogoutEffect (vec3_t org, int type);
 void CL_ItemRespawnParticles (vec3_t org);
 
@@ -862,31 +868,81 @@ PARTICLE MANAGEMENT
 */
 
 /*
-// THIS HAS BEEN RELOCATED TO CLIENT.H
-typedef struct particle_s
+Live particles are kept as a structure of arrays so CL_AddParticles
+can move and fade four at a time.  Effects don't touch the arrays,
+CL_NewParticle hands out cparticle_t records from a spawn buffer that
+is moved into the arrays in one go at the start of CL_AddParticles.
+*/
+
+typedef struct
 {
-	struct particle_s	*next;
+	int			max;			// cl_maxparticles, rounded up to a multiple of 4
+	int			num;			// live particles
+	void		*block;			// the arrays, 16 byte aligned
+	float		*time;
+	float		*org[3];
+	float		*vel[3];
+	float		*accel[3];
+	float		*color;
+	float		*alpha;
+	float		*alphavel;
 
-	float		time;
+	cparticle_t	*spawned;		// [max], added since the last CL_AddParticles
+	int			numspawned;
+} particlestore_t;
 
-	vec3_t		org;
-	vec3_t		vel;
-	vec3_t		accel;
-	float		color;
-	float		colorvel;
-	float		alpha;
-	float		alphavel;
-} cparticle_t;
+static particlestore_t	cl_particles;
+
+#define	PARTICLE_ARRAYS		13	// floats per particle in the store
 
+/*
+===============
+CL_AllocParticles
 
-#define	PARTICLE_GRAVITY	40
+(Re)sizes the store and the refdef's particle list for cl_maxparticles
+===============
 */
+static void CL_AllocParticles (void)
+{
+	particlestore_t	*s;
+	float			*f;
+	int				max, j;
+
+	s = &cl_particles;
+	cl_maxparticles->modified = false;
+
+	max = cl_maxparticles->intValue;
+	if (max < 256)
+		max = 256;
+	else if (max > 262144)
+		max = 262144;
+	max = (max + 3) & ~3;
+	if (max == s->max)
+		return;
 
-cparticle_t	*active_particles, *free_particles;
+	if (s->block)
+	{
+		Z_Free (s->block);
+		Z_Free (s->spawned);
+	}
+	s->max = max;
+	s->block = Z_Malloc (max * PARTICLE_ARRAYS * sizeof(float) + 16);
+	s->spawned = Z_Malloc (max * sizeof(cparticle_t));
 
-cparticle_t	particles[MAX_PARTICLES];
-int			cl_numparticles = MAX_PARTICLES;
+	f = (float *)(((size_t)s->block + 15) & ~(size_t)15);
+	s->time = f;		f += max;
+	for (j=0 ; j<3 ; j++)
+	{
+		s->org[j] = f;		f += max;
+		s->vel[j] = f;		f += max;
+		s->accel[j] = f;	f += max;
+	}
+	s->color = f;		f += max;
+	s->alpha = f;		f += max;
+	s->alphavel = f;
 
+	V_AllocParticles (max);
+}
 
 /*
 ===============
@@ -895,14 +951,88 @@ CL_ClearParticles
 */
 void CL_ClearParticles (void)
 {
-	int		i;
-	
-	free_particles = &particles[0];
-	active_particles = NULL;
+	if (cl_maxparticles->modified || !cl_particles.block)
+		CL_AllocParticles ();
 
-	for (i=0 ;i<cl_numparticles ; i++)
-		particles[i].next = &particles[i+1];
-	particles[cl_numparticles-1].next = NULL;
+	cl_particles.num = 0;
+	cl_particles.numspawned = 0;
+}
+
+/*
+===============
+CL_NewParticles
+
+Reserves up to count particles for an effect to fill in, *p points at
+the first of them.  Returns how many there are room for.
+===============
+*/
+int CL_NewParticles (int count, cparticle_t **p)
+{
+	particlestore_t	*s;
+	int				room;
+
+	s = &cl_particles;
+	room = s->max - s->num - s->numspawned;
+	if (count > room)
+		count = room;
+	if (count <= 0)
+	{
+		*p = NULL;
+		return 0;
+	}
+
+	*p = s->spawned + s->numspawned;
+	s->numspawned += count;
+	return count;
+}
+
+/*
+===============
+CL_NewParticle
+
+Returns a particle for an effect to fill in, NULL if the store is full
+===============
+*/
+cparticle_t *CL_NewParticle (void)
+{
+	particlestore_t	*s;
+
+	s = &cl_particles;
+	if (s->num + s->numspawned >= s->max)
+		return NULL;
+	return s->spawned + s->numspawned++;
+}
+
+/*
+===============
+CL_StoreSpawnedParticles
+
+Moves what the effects spawned since the last frame into the arrays
+===============
+*/
+static void CL_StoreSpawnedParticles (void)
+{
+	particlestore_t	*s;
+	cparticle_t		*p;
+	int				i, j, n;
+
+	s = &cl_particles;
+	n = s->num;
+	for (i=0, p=s->spawned ; i<s->numspawned ; i++, p++, n++)
+	{
+		s->time[n] = p->time;
+		for (j=0 ; j<3 ; j++)
+		{
+			s->org[j][n] = p->org[j];
+			s->vel[j][n] = p->vel[j];
+			s->accel[j][n] = p->accel[j];
+		}
+		s->color[n] = p->color;
+		s->alpha[n] = p->alpha;
+		s->alphavel[n] = p->alphavel;
+	}
+	s->num = n;
+	s->numspawned = 0;
 }
 
 
@@ -919,15 +1049,9 @@ void CL_ParticleEffect (vec3_t org, vec3_t dir, int color, int count)
 	cparticle_t	*p;
 	float		d;
 
-	for (i=0 ; i<count ; i++)
+	count = CL_NewParticles (count, &p);
+	for (i=0 ; i<count ; i++, p++)
 	{
-		if (!free_particles)
-			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
 		p->time = cl.time;
 		p->color = color + (rand()&7);
 
@@ -958,15 +1082,9 @@ void CL_ParticleEffect2 (vec3_t org, vec3_t dir, int color, int count)
 	cparticle_t	*p;
 	float		d;
 
-	for (i=0 ; i<count ; i++)
+	count = CL_NewParticles (count, &p);
+	for (i=0 ; i<count ; i++, p++)
 	{
-		if (!free_particles)
-			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
 		p->time = cl.time;
 		p->color = color;
 
@@ -998,15 +1116,9 @@ void CL_ParticleEffect3 (vec3_t org, vec3_t dir, int color, int count)
 	cparticle_t	*p;
 	float		d;
 
-	for (i=0 ; i<count ; i++)
+	count = CL_NewParticles (count, &p);
+	for (i=0 ; i<count ; i++, p++)
 	{
-		if (!free_particles)
-			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
 		p->time = cl.time;
 		p->color = color;
 
@@ -1037,12 +1149,9 @@ void CL_TeleporterParticles (entity_state_t *ent)
 
 	for (i=0 ; i<8 ; i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->time = cl.time;
 		p->color = 0xdb;
@@ -1078,12 +1187,9 @@ void CL_LogoutEffect (vec3_t org, int type)
 
 	for (i=0 ; i<500 ; i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->time = cl.time;
 
@@ -1123,12 +1229,9 @@ void CL_ItemRespawnParticles (vec3_t org)
 
 	for (i=0 ; i<64 ; i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->time = cl.time;
 
@@ -1162,12 +1265,9 @@ void CL_ExplosionParticles (vec3_t org)
 
 	for (i=0 ; i<256 ; i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->time = cl.time;
 		p->color = 0xe0 + (rand()&7);
@@ -1201,12 +1301,9 @@ void CL_BigTeleportParticles (vec3_t org)
 
 	for (i=0 ; i<4096 ; i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->time = cl.time;
 
@@ -1248,15 +1345,9 @@ void CL_BlasterParticles (vec3_t org, vec3_t dir, unsigned int color)
 	int			count;
 
 	count = 40;
-	for (i=0 ; i<count ; i++)
+	count = CL_NewParticles (count, &p);
+	for (i=0 ; i<count ; i++, p++)
 	{
-		if (!free_particles)
-			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
 		p->time = cl.time;
 	//	p->color = 0xe0 + (rand()&7);
 		p->color = color + (rand()&7);
@@ -1305,12 +1396,9 @@ void CL_BlasterTrail (vec3_t start, vec3_t end, float color)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -1355,12 +1443,9 @@ void CL_QuadTrail (vec3_t start, vec3_t end)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -1405,12 +1490,9 @@ void CL_FlagTrail (vec3_t start, vec3_t end, float color)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -1473,16 +1555,12 @@ void CL_DiminishingTrail (vec3_t start, vec3_t end, centity_t *old, int flags)
 	{
 		len -= dec;
 
-		if (!free_particles)
-			return;
-
 		// drop less particles as it flies
 		if ((rand()&1023) < old->trailcount)
 		{
-			p = free_particles;
-			free_particles = p->next;
-			p->next = active_particles;
-			active_particles = p;
+			p = CL_NewParticle ();
+			if (!p)
+				return;
 			VectorClear (p->accel);
 		
 			p->time = cl.time;
@@ -1580,15 +1658,11 @@ void CL_RocketTrail (vec3_t start, vec3_t end, centity_t *old)
 	{
 		len -= dec;
 
-		if (!free_particles)
-			return;
-
 		if ( (rand()&7) == 0)
 		{
-			p = free_particles;
-			free_particles = p->next;
-			p->next = active_particles;
-			active_particles = p;
+			p = CL_NewParticle ();
+			if (!p)
+				return;
 			
 			VectorClear (p->accel);
 			p->time = cl.time;
@@ -1635,13 +1709,9 @@ void CL_RailTrail (vec3_t start, vec3_t end)
 
 	for (i=0 ; i<len ; i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		
 		p->time = cl.time;
 		VectorClear (p->accel);
@@ -1673,12 +1743,9 @@ void CL_RailTrail (vec3_t start, vec3_t end)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->time = cl.time;
 		VectorClear (p->accel);
@@ -1725,12 +1792,9 @@ void CL_IonripperTrail (vec3_t start, vec3_t ent)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		VectorClear (p->accel);
 
 		p->time = cl.time;
@@ -1786,14 +1850,10 @@ void CL_BubbleTrail (vec3_t start, vec3_t end)
 
 	for (i=0 ; i<len ; i+=dec)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
 
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
 		VectorClear (p->accel);
 		p->time = cl.time;
 
@@ -1859,12 +1919,9 @@ void CL_FlyParticles (vec3_t origin, int count)
 		forward[1] = cp*sy;
 		forward[2] = -sp;
 
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->time = cl.time;
 
@@ -1960,12 +2017,9 @@ void CL_BfgParticles (entity_t *ent)
 		forward[1] = cp*sy;
 		forward[2] = -sp;
 
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->time = cl.time;
 
@@ -2021,12 +2075,9 @@ void CL_TrapParticles (entity_t *ent)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -2063,12 +2114,9 @@ void CL_TrapParticles (entity_t *ent)
 		for (j=-2 ; j<=2 ; j+=4)
 			for (k=-2 ; k<=4 ; k+=4)
 			{
-				if (!free_particles)
+				p = CL_NewParticle ();
+				if (!p)
 					return;
-				p = free_particles;
-				free_particles = p->next;
-				p->next = active_particles;
-				active_particles = p;
 
 				p->time = cl.time;
 				p->color = 0xe0 + (rand()&3);
@@ -2108,12 +2156,9 @@ void CL_BFGExplosionParticles (vec3_t org)
 
 	for (i=0 ; i<256 ; i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->time = cl.time;
 		p->color = 0xd0 + (rand()&7);
@@ -2150,12 +2195,9 @@ void CL_TeleportParticles (vec3_t org)
 		for (j=-16 ; j<=16 ; j+=4)
 			for (k=-16 ; k<=32 ; k+=4)
 			{
-				if (!free_particles)
+				p = CL_NewParticle ();
+				if (!p)
 					return;
-				p = free_particles;
-				free_particles = p->next;
-				p->next = active_particles;
-				active_particles = p;
 
 				p->time = cl.time;
 				p->color = 7 + (rand()&7);
@@ -2181,74 +2223,163 @@ void CL_TeleportParticles (vec3_t org)
 }
 
 
+/*
+===============
+CL_MoveParticle
+
+Fades and moves particle i of the store to its place at time t,
+appending it to out.  Returns false once it has faded out.
+===============
+*/
+static qboolean CL_MoveParticle (particlestore_t *s, int i, float t, particle_t *out)
+{
+	float	alpha, t2;
+
+	// an instant particle has no time and is drawn once at its alpha
+	alpha = s->alpha[i] + t*s->alphavel[i];
+	if (alpha <= 0 && s->alphavel[i] != INSTANT_PARTICLE)
+		return false;
+
+	if (out)
+	{
+		t2 = t*t;
+		out->origin[0] = s->org[0][i] + s->vel[0][i]*t + s->accel[0][i]*t2;
+		out->origin[1] = s->org[1][i] + s->vel[1][i]*t + s->accel[1][i]*t2;
+		out->origin[2] = s->org[2][i] + s->vel[2][i]*t + s->accel[2][i]*t2;
+		out->color = s->color[i];
+		out->alpha = alpha > 1 ? 1 : alpha;
+	}
+	return true;
+}
+
+/*
+===============
+CL_KeepParticle
+
+Moves a surviving particle down over the ones that faded out
+===============
+*/
+static void CL_KeepParticle (particlestore_t *s, int from, int to)
+{
+	int		j;
+
+	if (s->alphavel[from] == INSTANT_PARTICLE)
+	{	// PMM - gone next frame
+		s->alphavel[from] = 0.0;
+		s->alpha[from] = 0.0;
+	}
+
+	if (from == to)
+		return;
+
+	s->time[to] = s->time[from];
+	for (j=0 ; j<3 ; j++)
+	{
+		s->org[j][to] = s->org[j][from];
+		s->vel[j][to] = s->vel[j][from];
+		s->accel[j][to] = s->accel[j][from];
+	}
+	s->color[to] = s->color[from];
+	s->alpha[to] = s->alpha[from];
+	s->alphavel[to] = s->alphavel[from];
+}
+
 /*
 ===============
 CL_AddParticles
+
+Writes the live particles straight into the refdef's list and drops
+the ones that have faded out
 ===============
 */
 void CL_AddParticles (void)
 {
-	cparticle_t		*p, *next;
-	float			alpha;
-	float			time, time2;
-	vec3_t			org;
-	int				color;
-	cparticle_t		*active, *tail;
-
-	time = 0; /* FS: Compiler warning */
-	active = NULL;
-	tail = NULL;
-
-	for (p=active_particles ; p ; p=next)
+	particlestore_t	*s;
+	particle_t		*out;
+	float			t;
+	int				i, live, room;
+#ifdef CL_SSE2
+	__m128			now, msec, instant, zero, one;
+	__m128			tv, t2, av, a, keep;
+	float			ox[4], oy[4], oz[4], oa[4];
+	int				mask, k;
+#endif
+
+	if (cl_maxparticles->modified)
+		CL_ClearParticles ();
+
+	s = &cl_particles;
+	CL_StoreSpawnedParticles ();
+
+	out = r_particles + r_numparticles;
+	room = r_maxparticles - r_numparticles;
+	live = 0;
+	i = 0;
+
+#ifdef CL_SSE2
+	if (cl_simd->intValue)
 	{
-		next = p->next;
+		now = _mm_set1_ps ((float)cl.time);
+		msec = _mm_set1_ps (0.001f);
+		instant = _mm_set1_ps (INSTANT_PARTICLE);
+		zero = _mm_setzero_ps ();
+		one = _mm_set1_ps (1.0f);
 
-		// PMM - added INSTANT_PARTICLE handling for heat beam
-		if (p->alphavel != INSTANT_PARTICLE)
+		for ( ; i+4 <= s->num ; i+=4)
 		{
-			time = (cl.time - p->time)*0.001;
-			alpha = p->alpha + time*p->alphavel;
-			if (alpha <= 0)
-			{	// faded out
-				p->next = free_particles;
-				free_particles = p;
+			av = _mm_load_ps (s->alphavel + i);
+			tv = _mm_mul_ps (_mm_sub_ps (now, _mm_load_ps (s->time + i)), msec);
+			tv = _mm_andnot_ps (_mm_cmpeq_ps (av, instant), tv);
+			a = _mm_add_ps (_mm_load_ps (s->alpha + i), _mm_mul_ps (tv, av));
+			keep = _mm_or_ps (_mm_cmpgt_ps (a, zero), _mm_cmpeq_ps (av, instant));
+			mask = _mm_movemask_ps (keep);
+			if (!mask)
 				continue;
-			}
-		}
-		else
-		{
-			alpha = p->alpha;
-		}
 
-		p->next = NULL;
-		if (!tail)
-			active = tail = p;
-		else
-		{
-			tail->next = p;
-			tail = p;
-		}
+			t2 = _mm_mul_ps (tv, tv);
+			_mm_storeu_ps (ox, _mm_add_ps (_mm_load_ps (s->org[0] + i), _mm_add_ps (
+				_mm_mul_ps (_mm_load_ps (s->vel[0] + i), tv), _mm_mul_ps (_mm_load_ps (s->accel[0] + i), t2))));
+			_mm_storeu_ps (oy, _mm_add_ps (_mm_load_ps (s->org[1] + i), _mm_add_ps (
+				_mm_mul_ps (_mm_load_ps (s->vel[1] + i), tv), _mm_mul_ps (_mm_load_ps (s->accel[1] + i), t2))));
+			_mm_storeu_ps (oz, _mm_add_ps (_mm_load_ps (s->org[2] + i), _mm_add_ps (
+				_mm_mul_ps (_mm_load_ps (s->vel[2] + i), tv), _mm_mul_ps (_mm_load_ps (s->accel[2] + i), t2))));
+			_mm_storeu_ps (oa, _mm_min_ps (a, one));
 
-		if (alpha > 1.0)
-			alpha = 1;
-		color = p->color;
-
-		time2 = time*time;
-
-		org[0] = p->org[0] + p->vel[0]*time + p->accel[0]*time2;
-		org[1] = p->org[1] + p->vel[1]*time + p->accel[1]*time2;
-		org[2] = p->org[2] + p->vel[2]*time + p->accel[2]*time2;
+			for (k=0 ; k<4 ; k++)
+			{
+				if (!(mask & (1<<k)))
+					continue;
+				if (room > 0)
+				{
+					out->origin[0] = ox[k];
+					out->origin[1] = oy[k];
+					out->origin[2] = oz[k];
+					out->color = s->color[i+k];
+					out->alpha = oa[k];
+					out++;
+					room--;
+				}
+				CL_KeepParticle (s, i+k, live++);
+			}
+		}
+	}
+#endif
 
-		V_AddParticle (org, color, alpha);
-		// PMM
-		if (p->alphavel == INSTANT_PARTICLE)
+	for ( ; i<s->num ; i++)
+	{
+		t = (s->alphavel[i] == INSTANT_PARTICLE) ? 0 : (cl.time - s->time[i])*0.001f;
+		if (!CL_MoveParticle (s, i, t, room > 0 ? out : NULL))
+			continue;
+		if (room > 0)
 		{
-			p->alphavel = 0.0;
-			p->alpha = 0.0;
+			out++;
+			room--;
 		}
+		CL_KeepParticle (s, i, live++);
 	}
 
-	active_particles = active;
+	s->num = live;
+	r_numparticles = out - r_particles;
 }
 
 
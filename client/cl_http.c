@@ -990,6 +990,7 @@ static void CL_FinishHTTPDownload (void)
 
 			if (rename (dl->filePath, tempName))
 				Com_Printf ("Failed to rename %s for some odd reason...", dl->filePath);
+			FS_InvalidateIndexPath (tempName);
 
 			//a pak file is very special...
 			i = strlen (tempName);
@@ -605,8 +605,10 @@ void CL_SendCmd_Async (void)
 
 	if (cls.state == ca_connected)
 	{
-		if (cls.netchan.message.cursize	|| curtime - cls.netchan.last_sent > 1000 )
-			Netchan_Transmit (&cls.netchan, 0, buf.data);	
+		SZ_Init (&buf, data, sizeof(data));
+		CL_WriteDownloadAck (&buf);
+		if (buf.cursize || cls.netchan.message.cursize || curtime - cls.netchan.last_sent > 1000 )
+			Netchan_Transmit (&cls.netchan, buf.cursize, buf.data);
 		return;
 	}
 
@@ -663,6 +665,8 @@ void CL_SendCmd_Async (void)
 		buf.data + checksumIndex + 1, buf.cursize - checksumIndex - 1,
 		cls.netchan.outgoing_sequence);
 
+	CL_WriteDownloadAck (&buf);
+
 	//
 	// deliver the message
 	//
@@ -708,8 +712,10 @@ void CL_SendCmd (void)
 
 	if ( cls.state == ca_connected)
 	{
-		if (cls.netchan.message.cursize	|| curtime - cls.netchan.last_sent > 1000 )
-			Netchan_Transmit (&cls.netchan, 0, buf.data);	
+		SZ_Init (&buf, data, sizeof(data));
+		CL_WriteDownloadAck (&buf);
+		if (buf.cursize || cls.netchan.message.cursize || curtime - cls.netchan.last_sent > 1000 )
+			Netchan_Transmit (&cls.netchan, buf.cursize, buf.data);
 		return;
 	}
 
@@ -766,6 +772,8 @@ void CL_SendCmd (void)
 		buf.data + checksumIndex + 1, buf.cursize - checksumIndex - 1,
 		cls.netchan.outgoing_sequence);
 
+	CL_WriteDownloadAck (&buf);
+
 	//
 	// deliver the message
 	//
@@ -53,6 +53,9 @@ cvar_t	*cl_timeout;
 cvar_t	*cl_predict;
 //cvar_t	*cl_minfps;
 cvar_t	*cl_maxfps;
+cvar_t	*cl_demo_compress;
+cvar_t	*cl_download_window;
+cvar_t	*cl_download_compress;
 
 // Knightmare
 #ifdef CLIENT_SPLIT_NETFRAME
@@ -70,6 +73,9 @@ cvar_t	*cl_xatrix_music; // whether to play Xatrix tracks
 cvar_t	*cl_wav_music;
 
 cvar_t	*cl_add_particles;
+cvar_t	*cl_maxparticles;
+cvar_t	*cl_simd;
+cvar_t	*cl_loadthreads;
 cvar_t	*cl_add_lights;
 cvar_t	*cl_add_entities;
 cvar_t	*cl_add_blend;
@@ -187,8 +193,8 @@ void CL_WriteDemoMessage (void)
 	// the first eight bytes are just packet sequencing stuff
 	len = net_message.cursize-8;
 	swlen = LittleLong(len);
-	fwrite (&swlen, 4, 1, cls.demofile);
-	fwrite (net_message.data+8,	len, 1, cls.demofile);
+	FS_WriteStream (cls.demofile, &swlen, 4);
+	FS_WriteStream (cls.demofile, net_message.data+8, len);
 }
 
 
@@ -211,8 +217,9 @@ void CL_Stop_f (void)
 
 // finish up
 	len = -1;
-	fwrite (&len, 4, 1, cls.demofile);
-	fclose (cls.demofile);
+	FS_WriteStream (cls.demofile, &len, 4);
+	if (!FS_CloseWriter (cls.demofile))
+		Com_Printf ("ERROR: couldn't write all of the demo.\n");
 	cls.demofile = NULL;
 	cls.demorecording = false;
 	Com_Printf ("Stopped demo.\n");
@@ -262,7 +269,7 @@ void CL_Record_f (void)
 
 	Com_Printf ("recording to %s.\n", name);
 	FS_CreatePath (name);
-	cls.demofile = fopen (name, "wb");
+	cls.demofile = FS_OpenWriter (name, cl_demo_compress->intValue);
 	if (!cls.demofile)
 	{
 		Com_Printf ("ERROR: couldn't open.\n");
@@ -296,8 +303,8 @@ void CL_Record_f (void)
 			if (buf.cursize + strlen (cl.configstrings[i]) + 32 > buf.maxsize)
 			{	// write it out
 				len = LittleLong (buf.cursize);
-				fwrite (&len, 4, 1, cls.demofile);
-				fwrite (buf.data, buf.cursize, 1, cls.demofile);
+				FS_WriteStream (cls.demofile, &len, 4);
+				FS_WriteStream (cls.demofile, buf.data, buf.cursize);
 				buf.cursize = 0;
 			}
 
@@ -318,8 +325,8 @@ void CL_Record_f (void)
 		if (buf.cursize + 64 > buf.maxsize)
 		{	// write it out
 			len = LittleLong (buf.cursize);
-			fwrite (&len, 4, 1, cls.demofile);
-			fwrite (buf.data, buf.cursize, 1, cls.demofile);
+			FS_WriteStream (cls.demofile, &len, 4);
+			FS_WriteStream (cls.demofile, buf.data, buf.cursize);
 			buf.cursize = 0;
 		}
 
@@ -333,8 +340,8 @@ void CL_Record_f (void)
 	// write it to the demo file
 
 	len = LittleLong (buf.cursize);
-	fwrite (&len, 4, 1, cls.demofile);
-	fwrite (buf.data, buf.cursize, 1, cls.demofile);
+	FS_WriteStream (cls.demofile, &len, 4);
+	FS_WriteStream (cls.demofile, buf.data, buf.cursize);
 
 	// the rest of the demo file will be individual frames
 }
@@ -697,6 +704,13 @@ void CL_Disconnect (void)
 		if (time > 0)
 			Com_Printf ("%i frames, %3.1f seconds: %3.1f fps\n", cl.timedemo_frames,
 			time/1000.0, cl.timedemo_frames*1000.0 / time);
+
+		if (cl_timedemo->intValue == 2 && cl.attractloop)
+		{	// unattended benchmark run, report and exit
+			if (Cmd_Exists ("sw_benchstats"))
+				Cbuf_AddText ("sw_benchstats\n");
+			Cbuf_AddText ("quit\n");
+		}
 	}
 
 	VectorClear (cl.refdef.blend);
@@ -1659,6 +1673,12 @@ void CL_InitLocal (void)
 	cl_add_blend = Cvar_Get ("cl_blend", "1", 0);
 	cl_add_lights = Cvar_Get ("cl_lights", "1", 0);
 	cl_add_particles = Cvar_Get ("cl_particles", "1", 0);
+	cl_maxparticles = Cvar_Get ("cl_maxparticles", "4096", CVAR_ARCHIVE);
+	Cvar_SetDescription("cl_maxparticles", "Most particles that can be alive at once, from 256 to 262144.  Changing it clears the particles on screen.");
+	cl_simd = Cvar_Get ("cl_simd", "1", 0);
+	Cvar_SetDescription("cl_simd", "Use SSE2 to move and fade particles.  Has no effect on builds without it.");
+	cl_loadthreads = Cvar_Get ("cl_loadthreads", "0", CVAR_ARCHIVE);
+	Cvar_SetDescription("cl_loadthreads", "Number of threads used to decode sounds and textures when a map loads.  0 or 1 does it all on the main thread.");
 	cl_add_entities = Cvar_Get ("cl_entities", "1", 0);
 	cl_gun = Cvar_Get ("cl_gun", "1", 0);
 	Cvar_SetDescription("cl_gun", "Set to 0 to disable rendering of the gun model.  Useful for screenshots.");
@@ -1671,6 +1691,12 @@ void CL_InitLocal (void)
 //	cl_minfps = Cvar_Get ("cl_minfps", "5", 0);
 	cl_maxfps = Cvar_Get ("cl_maxfps", "90", CVAR_ARCHIVE);
 	Cvar_SetDescription("cl_maxfps", "Maximum number of frames to render ahead when cl_async (asynchronous frames) is set to 0.");
+	cl_demo_compress = Cvar_Get ("cl_demo_compress", "0", CVAR_ARCHIVE);
+	Cvar_SetDescription("cl_demo_compress", "Compress recorded demos.  Only engines that understand the compressed format can play them back.");
+	cl_download_window = Cvar_Get ("cl_download_window", "1", CVAR_ARCHIVE);
+	Cvar_SetDescription("cl_download_window", "Ask servers for windowed downloads, which keep many blocks in flight instead of one per round trip.  The speed follows your rate.");
+	cl_download_compress = Cvar_Get ("cl_download_compress", "1", CVAR_ARCHIVE);
+	Cvar_SetDescription("cl_download_compress", "Ask servers to compress windowed downloads.");
 
 #ifdef CLIENT_SPLIT_NETFRAME
 	cl_async = Cvar_Get ("cl_async", "0", CVAR_ARCHIVE);
@@ -1729,7 +1755,7 @@ void CL_InitLocal (void)
 	cl_paused = Cvar_Get ("paused", "0", 0);
 	Cvar_SetDescription("paused", "If enabled in Single Player then the game is currently paused.  Only works in multiplayer if cheats are enabled.");
 	cl_timedemo = Cvar_Get ("timedemo", "0", 0);
-	Cvar_SetDescription("timedemo", "Set to 1 for timing playback of demos.  Useful for bencmarking.");
+	Cvar_SetDescription("timedemo", "Set to 1 for timing playback of demos.  Useful for bencmarking.  Set to 2 to also print sw_benchstats and quit when the demo ends.");
 
 	rcon_client_password = Cvar_Get ("rcon_password", "", 0);
 	rcon_address = Cvar_Get ("rcon_address", "", 0);
@@ -1824,6 +1850,8 @@ void CL_InitLocal (void)
 
 	Cmd_AddCommand ("precache", CL_Precache_f);
 
+	Cmd_AddCommand ("loadstats", CL_LoadStats_f);
+
 	Cmd_AddCommand ("download", CL_Download_f);
 
 	Cmd_AddCommand ("writeconfig", CL_WriteConfig_f);	// Knightmare- added writeconfig command
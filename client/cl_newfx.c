@@ -21,9 +21,6 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "client.h"
 
-extern cparticle_t	*active_particles, *free_particles;
-extern cparticle_t	particles[MAX_PARTICLES];
-extern int			cl_numparticles;
 extern cvar_t		*vid_ref;
 
 extern void MakeNormalVectors (vec3_t forward, vec3_t right, vec3_t up);
@@ -153,12 +150,9 @@ void CL_DebugTrail (vec3_t start, vec3_t end)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->time = cl.time;
 		VectorClear (p->accel);
@@ -205,12 +199,9 @@ void CL_SmokeTrail (vec3_t start, vec3_t end, int colorStart, int colorRun, int
 	{
 		len -= spacing;
 
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -248,15 +239,11 @@ void CL_ForceWall (vec3_t start, vec3_t end, int color)
 	{
 		len -= 4;
 
-		if (!free_particles)
-			return;
-		
 		if (frand() > 0.3)
 		{
-			p = free_particles;
-			free_particles = p->next;
-			p->next = active_particles;
-			active_particles = p;
+			p = CL_NewParticle ();
+			if (!p)
+				return;
 			VectorClear (p->accel);
 			
 			p->time = cl.time;
@@ -288,13 +275,9 @@ void CL_FlameEffects (centity_t *ent, vec3_t origin)
 
 	for(n=0;n<count;n++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-			
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		
 		VectorClear (p->accel);
 		p->time = cl.time;
@@ -315,12 +298,9 @@ void CL_FlameEffects (centity_t *ent, vec3_t origin)
 
 	for(n=0;n<count;n++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -349,15 +329,9 @@ void CL_GenericParticleEffect (vec3_t org, vec3_t dir, int color, int count, int
 	cparticle_t	*p;
 	float		d;
 
-	for (i=0 ; i<count ; i++)
+	count = CL_NewParticles (count, &p);
+	for (i=0 ; i<count ; i++, p++)
 	{
-		if (!free_particles)
-			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
 		p->time = cl.time;
 		if (numcolors > 1)
 			p->color = color + (rand() & numcolors);
@@ -405,14 +379,10 @@ void CL_BubbleTrail2 (vec3_t start, vec3_t end, int dist)
 
 	for (i=0 ; i<len ; i+=dec)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
 
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
 		VectorClear (p->accel);
 		p->time = cl.time;
 
@@ -477,13 +447,10 @@ void CL_Heatbeam (vec3_t start, vec3_t end)
 #else
 		k=1;
 #endif
-			if (!free_particles)
-				return;
 
-			p = free_particles;
-			free_particles = p->next;
-			p->next = active_particles;
-			active_particles = p;
+			p = CL_NewParticle ();
+			if (!p)
+				return;
 			
 			p->time = cl.time;
 			VectorClear (p->accel);
@@ -575,13 +542,9 @@ void CL_Heatbeam (vec3_t start, vec3_t forward)
 		for (rot = 0; rot < M_PI*2; rot += rstep)
 		{
 
-			if (!free_particles)
+			p = CL_NewParticle ();
+			if (!p)
 				return;
-
-			p = free_particles;
-			free_particles = p->next;
-			p->next = active_particles;
-			active_particles = p;
 			
 			p->time = cl.time;
 			VectorClear (p->accel);
@@ -651,13 +614,9 @@ void CL_Heatbeam (vec3_t start, vec3_t end)
 
 	for (i=0; i<8; i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		
 		p->time = cl.time;
 		VectorClear (p->accel);
@@ -695,13 +654,9 @@ void CL_Heatbeam (vec3_t start, vec3_t end)
 
 		for (rot = 0; rot < M_PI*2; rot += rstep)
 		{
-			if (!free_particles)
+			p = CL_NewParticle ();
+			if (!p)
 				return;
-
-			p = free_particles;
-			free_particles = p->next;
-			p->next = active_particles;
-			active_particles = p;
 			
 			p->time = cl.time;
 			VectorClear (p->accel);
@@ -760,15 +715,9 @@ void CL_ParticleSteamEffect (vec3_t org, vec3_t dir, int color, int count, int m
 
 	MakeNormalVectors (dir, r, u);
 
-	for (i=0 ; i<count ; i++)
+	count = CL_NewParticles (count, &p);
+	for (i=0 ; i<count ; i++, p++)
 	{
-		if (!free_particles)
-			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
 		p->time = cl.time;
 		p->color = color + (rand()&7);
 
@@ -808,12 +757,9 @@ void CL_ParticleSteamEffect2 (cl_sustain_t *self)
 
 	for (i=0 ; i<self->count ; i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->time = cl.time;
 		p->color = self->color + (rand()&7);
@@ -870,12 +816,9 @@ void CL_TrackerTrail (vec3_t start, vec3_t end, int particleColor)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -905,12 +848,9 @@ void CL_Tracker_Shell(vec3_t origin)
 
 	for(i=0;i<300;i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -936,12 +876,9 @@ void CL_MonsterPlasma_Shell(vec3_t origin)
 
 	for(i=0;i<40;i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -972,12 +909,9 @@ void CL_Widowbeamout (cl_sustain_t *self)
 
 	for(i=0;i<300;i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -1008,12 +942,9 @@ void CL_Nukeblast (cl_sustain_t *self)
 
 	for(i=0;i<700;i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -1041,12 +972,9 @@ void CL_WidowSplash (vec3_t org)
 
 	for (i=0 ; i<256 ; i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->time = cl.time;
 		p->color = colortable[rand()&3];
@@ -1074,12 +1002,9 @@ void CL_Tracker_Explode(vec3_t	origin)
 
 	for(i=0;i<300;i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -1126,12 +1051,9 @@ void CL_TagTrail (vec3_t start, vec3_t end, float color)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -1162,12 +1084,9 @@ void CL_ColorExplosionParticles (vec3_t org, int color, int run)
 
 	for (i=0 ; i<128 ; i++)
 	{
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->time = cl.time;
 		p->color = color + (rand() % run);
@@ -1200,15 +1119,9 @@ void CL_ParticleSmokeEffect (vec3_t org, vec3_t dir, int color, int count, int m
 
 	MakeNormalVectors (dir, r, u);
 
-	for (i=0 ; i<count ; i++)
+	count = CL_NewParticles (count, &p);
+	for (i=0 ; i<count ; i++, p++)
 	{
-		if (!free_particles)
-			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
 		p->time = cl.time;
 		p->color = color + (rand()&7);
 
@@ -1246,15 +1159,9 @@ void CL_BlasterParticles2 (vec3_t org, vec3_t dir, unsigned int color)
 	int			count;
 
 	count = 40;
-	for (i=0 ; i<count ; i++)
+	count = CL_NewParticles (count, &p);
+	for (i=0 ; i<count ; i++, p++)
 	{
-		if (!free_particles)
-			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
 		p->time = cl.time;
 		p->color = color + (rand()&7);
 
@@ -1301,12 +1208,9 @@ void CL_BlasterTrail2 (vec3_t start, vec3_t end)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		p = CL_NewParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
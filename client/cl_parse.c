@@ -74,6 +74,7 @@ qboolean	CL_CheckOrDownloadFile (char *filename)
 	static char lastfilename[MAX_OSPATH] = {0};
 	int	length = 0; /* FS: MSVC4 hates it elsewhere */
 	char	*p = NULL; /* FS: MSVC4 hates it elsewhere */
+	int		flags;
 
 	//r1: don't attempt same file many times
 	if (!strcmp (filename, lastfilename))
@@ -150,6 +151,10 @@ qboolean	CL_CheckOrDownloadFile (char *filename)
 	COM_StripExtension (cls.downloadname, cls.downloadtempname);
 	strcat (cls.downloadtempname, ".tmp");
 
+	// servers that don't know the windowed protocol ignore the flags
+	flags = cl_download_window->intValue ? DLF_WINDOWED : 0;
+	cls.downloadwindowed = false;
+
 //ZOID
 	// check to see if we already have a tmp for this file, if so, try to resume
 	// open the file if not opened yet
@@ -168,14 +173,22 @@ qboolean	CL_CheckOrDownloadFile (char *filename)
 		// give the server an offset to start the download
 		Com_Printf ("Resuming %s\n", cls.downloadname);
 		MSG_WriteByte (&cls.netchan.message, clc_stringcmd);
-		MSG_WriteString (&cls.netchan.message, va("download \"%s\" %i", cls.downloadname, len));
+		if (flags)
+			MSG_WriteString (&cls.netchan.message, va("download \"%s\" %i %i", cls.downloadname, len, flags));
+		else
+			MSG_WriteString (&cls.netchan.message, va("download \"%s\" %i", cls.downloadname, len));
 	}
 	else
 	{
 		Com_Printf ("Downloading %s\n", cls.downloadname);
 		MSG_WriteByte (&cls.netchan.message, clc_stringcmd);
-		MSG_WriteString (&cls.netchan.message,
-		va("download %s", cls.downloadname));
+		if (flags && cl_download_compress->intValue)
+			flags |= DLF_COMPRESSED;		// a packed stream can't be resumed, so only from the start
+		if (flags)
+			MSG_WriteString (&cls.netchan.message, va("download %s 0 %i", cls.downloadname, flags));
+		else
+			MSG_WriteString (&cls.netchan.message,
+			va("download %s", cls.downloadname));
 	}
 
 	cls.forcePacket = true;
@@ -241,6 +254,208 @@ void CL_RegisterSounds (void)
 }
 
 
+/*
+=====================
+CL_OpenDownload
+
+Creates the temp file for a download that isn't being resumed
+=====================
+*/
+static qboolean CL_OpenDownload (void)
+{
+	char	name[MAX_OSPATH];
+
+	CL_Download_Reset_KBps_counter ();	// Knightmare- for KB/s counter
+
+	CL_DownloadFileName(name, sizeof(name), cls.downloadtempname);
+
+	FS_CreatePath (name);
+
+	cls.download = fopen (name, "wb");
+	if (!cls.download)
+	{
+		Com_Printf ("Failed to open %s\n", cls.downloadtempname);
+		return false;
+	}
+	return true;
+}
+
+/*
+=====================
+CL_FinishDownload
+
+Moves a completed download to its real name and goes on
+to the next file
+=====================
+*/
+static void CL_FinishDownload (void)
+{
+	char	oldn[MAX_OSPATH];
+	char	newn[MAX_OSPATH];
+	void	*data;
+	FILE	*f;
+	int		len, r;
+
+//	Com_Printf ("100%%\n");
+
+	fclose (cls.download);
+	cls.download = NULL;
+
+	if (cls.downloadwindowed)
+	{	// let the server know it can let go of the file
+		MSG_WriteByte (&cls.netchan.message, clc_stringcmd);
+		MSG_WriteString (&cls.netchan.message, va("nextdl %i", cls.downloadsize));
+		cls.downloadwindowed = false;
+		cls.downloadack = false;
+	}
+
+	CL_DownloadFileName(oldn, sizeof(oldn), cls.downloadtempname);
+	CL_DownloadFileName(newn, sizeof(newn), cls.downloadname);
+
+	if (cls.downloadcompressed)
+	{
+		cls.downloadcompressed = false;
+		len = FS_LoadStreamFile (oldn, &data);
+		f = NULL;
+		if (len >= 0)
+		{
+			f = fopen (newn, "wb");
+			if (f && (int)fwrite (data, 1, len, f) != len)
+			{
+				fclose (f);
+				remove (newn);
+				f = NULL;
+			}
+			FS_FreeFile (data);
+		}
+		if (f)
+			fclose (f);
+		else
+			Com_Printf ("failed to unpack.\n");
+		remove (oldn);
+	}
+	else
+	{
+		// rename the temp file to it's final name
+		r = rename (oldn, newn);
+		if (r)
+			Com_Printf ("failed to rename.\n");
+	}
+	FS_InvalidateIndexPath (newn);
+
+	cls.downloadpercent = 0;
+
+	// get another file if needed
+
+	CL_RequestNextDownload ();
+}
+
+/*
+=====================
+CL_ParseWindowedDownload
+
+The server agreed to push the file to us
+=====================
+*/
+static void CL_ParseWindowedDownload (void)
+{
+	int		flags, size, offset;
+
+	flags = MSG_ReadByte (&net_message);
+	size = MSG_ReadLong (&net_message);
+	offset = MSG_ReadLong (&net_message);
+
+	if (!cls.downloadname[0])
+		return;		// we didn't ask for anything
+
+	if (flags & DLF_COMPRESSED)
+	{	// keep it apart from a .tmp that a plain download could resume
+		if (cls.download)
+		{
+			fclose (cls.download);
+			cls.download = NULL;
+		}
+		COM_StripExtension (cls.downloadname, cls.downloadtempname);
+		strcat (cls.downloadtempname, ".tmz");
+	}
+
+	if (!cls.download && !CL_OpenDownload ())
+	{
+		MSG_WriteByte (&cls.netchan.message, clc_stringcmd);
+		MSG_WriteString (&cls.netchan.message, "nextdl -1");
+		CL_RequestNextDownload ();
+		return;
+	}
+
+	//r1: downloading something, drop to console to show status bar
+	SCR_EndLoadingPlaque();
+
+	cls.downloadwindowed = true;
+	cls.downloadcompressed = (flags & DLF_COMPRESSED) != 0;
+	cls.downloadsize = size;
+	cls.downloadoffset = offset;
+	cls.downloadack = false;
+
+	if (offset >= size)
+		CL_FinishDownload ();
+}
+
+/*
+=====================
+CL_ParseDownloadChunk
+
+Anything but the next chunk is dropped, the server goes back and
+sends it all again when it stops hearing about progress
+=====================
+*/
+static void CL_ParseDownloadChunk (void)
+{
+	int		offset, size;
+	byte	*data;
+
+	offset = MSG_ReadLong (&net_message);
+	size = MSG_ReadShort (&net_message);
+	if (size < 0 || net_message.readcount + size > net_message.cursize)
+		Com_Error (ERR_DROP, "CL_ParseDownloadChunk: bad chunk size %i", size);
+	data = net_message.data + net_message.readcount;
+	net_message.readcount += size;
+
+	if (!cls.download || !cls.downloadwindowed)
+		return;
+
+	// repeat where we are even for a stray, in case the last word got lost
+	cls.downloadack = true;
+	if (offset != cls.downloadoffset || offset + size > cls.downloadsize)
+		return;
+
+	fwrite (data, 1, size, cls.download);
+	cls.downloadoffset += size;
+
+	CL_Download_Calculate_KBps (size, 0);	// Knightmare- for KB/s counter
+	cls.downloadpercent = cls.downloadsize ? (int)((double)cls.downloadoffset * 100 / cls.downloadsize) : 100;
+
+	if (cls.downloadoffset == cls.downloadsize)
+		CL_FinishDownload ();
+}
+
+/*
+=====================
+CL_WriteDownloadAck
+
+Tells the server how far a windowed download has got.  It rides in
+the unreliable part of a packet, the next one makes up for a loss.
+=====================
+*/
+void CL_WriteDownloadAck (sizebuf_t *buf)
+{
+	if (!cls.downloadack)
+		return;
+
+	cls.downloadack = false;
+	MSG_WriteByte (buf, clc_stringcmd);
+	MSG_WriteString (buf, va("nextdl %i", cls.downloadoffset));
+}
+
 /*
 =====================
 CL_ParseDownload
@@ -251,11 +466,19 @@ A download message has been received from the server
 void CL_ParseDownload (void)
 {
 	int		size, percent;
-	char	name[MAX_OSPATH];
-	int		r;
 
 	// read the data
 	size = MSG_ReadShort (&net_message);
+	if (size == DOWNLOAD_WINDOWED)
+	{
+		CL_ParseWindowedDownload ();
+		return;
+	}
+	if (size == DOWNLOAD_CHUNK)
+	{
+		CL_ParseDownloadChunk ();
+		return;
+	}
 	percent = MSG_ReadByte (&net_message);
 	if (size < 0)
 	{
@@ -279,22 +502,11 @@ void CL_ParseDownload (void)
 	}
 
 	// open the file if not opened yet
-	if (!cls.download)
+	if (!cls.download && !CL_OpenDownload ())
 	{
-		CL_Download_Reset_KBps_counter ();	// Knightmare- for KB/s counter
-
-		CL_DownloadFileName(name, sizeof(name), cls.downloadtempname);
-
-		FS_CreatePath (name);
-
-		cls.download = fopen (name, "wb");
-		if (!cls.download)
-		{
-			net_message.readcount += size;
-			Com_Printf ("Failed to open %s\n", cls.downloadtempname);
-			CL_RequestNextDownload ();
-			return;
-		}
+		net_message.readcount += size;
+		CL_RequestNextDownload ();
+		return;
 	}
 
 	//r1: downloading something, drop to console to show status bar
@@ -315,28 +527,7 @@ void CL_ParseDownload (void)
 		cls.forcePacket = true;
 	}
 	else
-	{
-		char	oldn[MAX_OSPATH];
-		char	newn[MAX_OSPATH];
-
-//		Com_Printf ("100%%\n");
-
-		fclose (cls.download);
-
-		// rename the temp file to it's final name
-		CL_DownloadFileName(oldn, sizeof(oldn), cls.downloadtempname);
-		CL_DownloadFileName(newn, sizeof(newn), cls.downloadname);
-		r = rename (oldn, newn);
-		if (r)
-			Com_Printf ("failed to rename.\n");
-
-		cls.download = NULL;
-		cls.downloadpercent = 0;
-
-		// get another file if needed
-
-		CL_RequestNextDownload ();
-	}
+		CL_FinishDownload ();
 }
 
 
@@ -47,7 +47,8 @@ int			r_numentities;
 entity_t	r_entities[MAX_ENTITIES];
 
 int			r_numparticles;
-particle_t	r_particles[MAX_PARTICLES];
+int			r_maxparticles;
+particle_t	*r_particles;		// [r_maxparticles], CL_AddParticles writes into it directly
 
 lightstyle_t	r_lightstyles[MAX_LIGHTSTYLES];
 
@@ -102,7 +103,7 @@ void V_AddParticle (vec3_t org, int color, float alpha)
 {
 	particle_t	*p;
 
-	if (r_numparticles >= MAX_PARTICLES)
+	if (r_numparticles >= r_maxparticles)
 		return;
 	p = &r_particles[r_numparticles++];
 	VectorCopy (org, p->origin);
@@ -110,6 +111,27 @@ void V_AddParticle (vec3_t org, int color, float alpha)
 	p->alpha = alpha;
 }
 
+/*
+=====================
+V_AllocParticles
+
+Makes room for count particles a frame, never less than MAX_PARTICLES
+=====================
+*/
+void V_AllocParticles (int count)
+{
+	if (count < MAX_PARTICLES)
+		count = MAX_PARTICLES;
+	if (count == r_maxparticles)
+		return;
+
+	if (r_particles)
+		Z_Free (r_particles);
+	r_particles = Z_Malloc (count * sizeof(particle_t));
+	r_maxparticles = count;
+	r_numparticles = 0;
+}
+
 /*
 =====================
 V_AddLight
@@ -164,7 +186,7 @@ void V_TestParticles (void)
 	int			i, j;
 	float		d, r, u;
 
-	r_numparticles = MAX_PARTICLES;
+	r_numparticles = min(MAX_PARTICLES, r_maxparticles);
 	for (i=0 ; i<r_numparticles ; i++)
 	{
 		d = i*0.25;
@@ -248,6 +270,8 @@ void V_TestLights (void)
 
 //===================================================================
 
+static unsigned	cl_preptime;	// microseconds the last CL_PrepRefresh took
+
 /*
 =================
 CL_PrepRefresh
@@ -262,10 +286,13 @@ void CL_PrepRefresh (void)
 	char		name[MAX_QPATH];
 	float		rotate;
 	vec3_t		axis;
+	unsigned	start;
 
 	if (!cl.configstrings[CS_MODELS+1][0])
 		return;		// no map loaded
 
+	start = Sys_Microseconds ();
+
 	SCR_AddDirtyPoint (0, 0);
 	SCR_AddDirtyPoint (viddef.width-1, viddef.height-1);
 
@@ -357,6 +384,9 @@ void CL_PrepRefresh (void)
 
 	// the renderer can now free unneeded stuff
 	re.EndRegistration ();
+	FS_CheckCache ();
+
+	cl_preptime = Sys_Microseconds () - start;
 
 	// clear any lines of console text
 	Con_ClearNotify ();
@@ -377,6 +407,27 @@ void CL_PrepRefresh (void)
 		Cvar_Set ("paused", "0");
 }
 
+/*
+=================
+CL_LoadStats_f
+
+Reports where the time of the last map load went
+=================
+*/
+void CL_LoadStats_f (void)
+{
+	if (!cl_preptime)
+	{
+		Com_Printf ("No map has been loaded yet.\n");
+		return;
+	}
+
+	S_LoadStats ();
+	if (Cmd_Exists ("gl_loadstats"))
+		Cmd_ExecuteString ("gl_loadstats");
+	Com_Printf ("models, images and skins registered in %.1f ms\n", cl_preptime * 0.001f);
+}
+
 /*
 ====================
 CalcFov
@@ -313,6 +313,11 @@ typedef struct
 	size_t		downloadposition;	// added for HTTP downloads
 	int			downloadpercent;
 	float		downloadrate;		/* Knightmare- to display KB/s */
+	qboolean	downloadwindowed;	// the server pushes chunks, we acknowledge them
+	qboolean	downloadcompressed;	// unpacked once the last chunk is in
+	int			downloadoffset;		// bytes of a windowed download written so far
+	int			downloadsize;		// bytes of it the server is sending
+	qboolean	downloadack;		// downloadoffset moved since the last "nextdl"
 
 #ifdef GAMESPY /* FS: For gamespy */
 	int			gamespypercent;
@@ -324,7 +329,7 @@ typedef struct
 // demo recording info must be here, so it isn't cleared on level change
 	qboolean	demorecording;
 	qboolean	demowaiting;	// don't record until a non-delta message is received
-	FILE		*demofile;
+	fswriter_t	*demofile;
 
 #ifdef USE_CURL /* HTTP downloading from R1Q2 */
 	dlqueue_t		downloadQueue;			//queue of paths we need
@@ -357,8 +362,13 @@ extern	cvar_t	*cl_gun;
 extern	cvar_t	*cl_add_blend;
 extern	cvar_t	*cl_add_lights;
 extern	cvar_t	*cl_add_particles;
+extern	cvar_t	*cl_maxparticles;
+extern	cvar_t	*cl_simd;
+extern	cvar_t	*cl_loadthreads;
 extern	cvar_t	*cl_add_entities;
 extern	cvar_t	*cl_predict;
+extern	cvar_t	*cl_download_window;
+extern	cvar_t	*cl_download_compress;
 extern	cvar_t	*cl_footsteps;
 extern	cvar_t	*cl_noskins;
 
@@ -482,10 +492,9 @@ void CL_ParticleEffect3 (vec3_t org, vec3_t dir, int color, int count);
 
 // ========
 // PGM
+// what an effect fills in for a new particle, see CL_NewParticle
 typedef struct particle_s
 {
-	struct particle_s	*next;
-
 	float		time;
 
 	vec3_t		org;
@@ -570,6 +579,7 @@ void CL_AddLightStyles (void);
 //=================================================
 
 void CL_PrepRefresh (void);
+void CL_LoadStats_f (void);
 void CL_RegisterSounds (void);
 
 void CL_Quit_f (void);
@@ -594,6 +604,7 @@ void CL_GetChallengePacket (void);
 void CL_PingServers_f (void);
 void CL_Snd_Restart_f (void);
 void CL_RequestNextDownload (void);
+void CL_WriteDownloadAck (sizebuf_t *buf);
 void CL_WriteConfig_f (void);	/* Knightmare- added writeconfig command */
 
 //
@@ -665,6 +676,11 @@ void V_Init (void);
 void V_RenderView( float stereo_separation );
 void V_AddEntity (entity_t *ent);
 void V_AddParticle (vec3_t org, int color, float alpha);
+void V_AllocParticles (int count);
+
+extern	int			r_numparticles;
+extern	int			r_maxparticles;
+extern	particle_t	*r_particles;
 void V_AddLight (vec3_t org, float intensity, float r, float g, float b);
 void V_AddLightStyle (int style, float r, float g, float b);
 
@@ -693,6 +709,8 @@ void CL_DiminishingTrail (vec3_t start, vec3_t end, centity_t *old, int flags);
 void CL_FlyEffect (centity_t *ent, vec3_t origin);
 void CL_BfgParticles (entity_t *ent);
 void CL_AddParticles (void);
+cparticle_t *CL_NewParticle (void);
+int CL_NewParticles (int count, cparticle_t **p);
 void CL_EntityEvent (entity_state_t *ent);
 // RAFAEL
 void CL_TrapParticles (entity_t *ent);
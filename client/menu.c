@@ -2332,7 +2332,7 @@ const char *M_Credits_Key( int key )
 	{
 	case K_ESCAPE:
 		if (creditsBuffer)
-			FS_FreeFile (creditsBuffer);
+			Z_Free (creditsBuffer);
 		M_PopMenu ();
 		break;
 	}
@@ -2351,9 +2351,13 @@ void M_Menu_Credits_f( void )
 	int		isdeveloper = 0;
 
 	creditsBuffer = NULL;
-	count = FS_LoadFile ("credits", (void **)&creditsBuffer); /* FS: Compiler warning */
+	count = FS_LoadFile ("credits", (void **)&p); /* FS: Compiler warning */
 	if (count != -1)
 	{
+		// the lines get terminated in place, so work on a copy
+		creditsBuffer = Z_Malloc (count + 1);
+		memcpy (creditsBuffer, p, count);
+		FS_FreeFile (p);
 		p = creditsBuffer;
 		for (n = 0; n < 255; n++)
 		{
@@ -2623,6 +2627,7 @@ void Create_Savestrings (void)
 	FILE	*f;
 	char	name[MAX_OSPATH];
 
+	FS_FlushWrites ();
 	for (i=0 ; i<MAX_SAVEGAMES ; i++)
 	{
 		Com_sprintf (name, sizeof(name), "%s/save/dossv%i/server.ssv", FS_Gamedir(), i);
@@ -125,7 +125,7 @@ typedef struct
 
 
 
-#define	API_VERSION		3
+#define	API_VERSION		4
 
 //
 // these are the functions exported by the refresh module
@@ -220,6 +220,14 @@ typedef struct
 	qboolean	(*Vid_GetModeInfo)( int *width, int *height, int mode );
 	void		(*Vid_MenuInit)( void );
 	void		(*Vid_NewWindow)( int width, int height );
+
+	// Com_RunJobs
+	void	(*RunJobs) (int numjobs, void (*func)(int job, void *arg), void *arg, int numthreads);
+
+	// the asset cache, see FS_LoadCache
+	void	*(*FS_LoadCache) (char *name, const void *key, int keylen, int *len);
+	void	(*FS_FreeCache) (void *data);
+	void	(*FS_WriteCache) (char *name, const void *key, int keylen, const void *data, int len);
 } refimport_t;
 
 
@@ -60,7 +60,6 @@ int			paintedtime;		// sample PAIRS
 // than could actually be referenced during gameplay,
 // because we don't want to free anything until we are
 // sure we won't need it.
-#define		MAX_SFX		(MAX_SOUNDS*2)
 sfx_t		known_sfx[MAX_SFX];
 int			num_sfx;
 
@@ -79,6 +78,7 @@ cvar_t		*s_show;
 cvar_t		*s_mixahead;
 cvar_t		*s_primary;
 cvar_t		*s_musicvolume;
+cvar_t		*s_mixsimd;
 
 int		s_rawend;
 portable_samplepair_t	s_rawsamples[MAX_RAW_SAMPLES];
@@ -136,6 +136,8 @@ void S_Init (void)
 		s_primary = Cvar_Get ("s_primary", "0", CVAR_ARCHIVE);	// win32 specific
 		s_musicvolume = Cvar_Get ("s_musicvolume", "1.0", CVAR_ARCHIVE); // Knightmare added
 		Cvar_SetDescription("s_musicvolume", "Volume for music played from WAV and OGG files.");
+		s_mixsimd = Cvar_Get ("s_mixsimd", "1", CVAR_ARCHIVE);
+		Cvar_SetDescription("s_mixsimd", "Use SSE2 for mixing and clipping where the build supports it.  s_mixbench compares it against the plain C mixer.");
 
 		if (s_khz->value < 7000) /* FS: Old config, fix it up */
 			Cvar_SetValue("s_khz", 11025);
@@ -149,6 +151,7 @@ void S_Init (void)
 		Cmd_AddCommand("stopsound", S_StopAllSounds);
 		Cmd_AddCommand("soundlist", S_SoundList);
 		Cmd_AddCommand("soundinfo", S_SoundInfo_f);
+		Cmd_AddCommand("s_mixbench", S_MixBench_f);
 #ifdef OGG_SUPPORT
 		Cmd_AddCommand("ogg_restart", S_OGG_Restart); /* Knightmare added */
 #endif
@@ -204,6 +207,7 @@ void S_Shutdown(void)
 	Cmd_RemoveCommand("stopsound");
 	Cmd_RemoveCommand("soundlist");
 	Cmd_RemoveCommand("soundinfo");
+	Cmd_RemoveCommand("s_mixbench");
 #ifdef OGG_SUPPORT
 	Cmd_RemoveCommand("ogg_restart"); // Knightmare added
 #endif
@@ -373,8 +377,9 @@ S_EndRegistration
 */
 void S_EndRegistration (void)
 {
-	int		i;
+	int		i, count;
 	sfx_t	*sfx;
+	sfx_t	*list[MAX_SFX];
 	int		size;
 
 	// free any sounds not from this registration sequence
@@ -399,12 +404,12 @@ void S_EndRegistration (void)
 	}
 
 	// load everything in
-	for (i=0, sfx=known_sfx ; i < num_sfx ; i++,sfx++)
+	for (i=0, count=0, sfx=known_sfx ; i < num_sfx ; i++,sfx++)
 	{
-		if (!sfx->name[0])
-			continue;
-		S_LoadSound (sfx);
+		if (sfx->name[0])
+			list[count++] = sfx;
 	}
+	S_LoadSounds (list, count);
 
 	s_registering = false;
 
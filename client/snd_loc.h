@@ -180,12 +180,17 @@ extern cvar_t	*s_mixahead;
 extern cvar_t	*s_testsound;
 extern cvar_t	*s_primary;
 extern cvar_t	*s_musicvolume;	// Knightmare added
+extern cvar_t	*s_mixsimd;
 
 wavinfo_t GetWavinfo (char *name, byte *wav, int wavlength);
 
 void S_InitScaletable (void);
+void S_MixBench_f (void);
+
+#define	MAX_SFX		(MAX_SOUNDS*2)
 
 sfxcache_t *S_LoadSound (sfx_t *s);
+void S_LoadSounds (sfx_t **list, int count);
 
 void S_IssuePlaysound (playsound_t *ps);
 
@@ -88,37 +88,75 @@ static void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 
 /*
 ==============
-S_LoadSound
+S_SoundPath
 ==============
 */
-sfxcache_t *S_LoadSound (sfx_t *s)
+static void S_SoundPath (sfx_t *s, char *namebuffer)
 {
-	char	namebuffer[MAX_QPATH];
-	byte	*data;
-	wavinfo_t	info;
-	int		len;
-	float	stepscale;
-	sfxcache_t	*sc;
-	int		size;
 	const char	*name;
 
-	if (s->name[0] == '*')
-		return NULL;
-
-// see if still in memory
-	sc = s->cache;
-	if (sc)
-		return sc;
-
-// load it in
 	name = (s->truename)? s->truename : s->name;
 	if (name[0] == '#')
-		Q_strncpyz(namebuffer, &name[1], sizeof(namebuffer));
+		Q_strncpyz(namebuffer, &name[1], MAX_QPATH);
 	else
-		Com_sprintf (namebuffer, sizeof(namebuffer), "sound/%s", name);
+		Com_sprintf (namebuffer, MAX_QPATH, "sound/%s", name);
+}
+
+/*
+==============
+S_CacheSize
+
+Bytes of cache a sound needs at the current output rate
+==============
+*/
+static int S_CacheSize (wavinfo_t *info)
+{
+	float	stepscale;
+	int		len;
+
+	stepscale = (float)info->rate / dma.speed;
+	len = info->samples / stepscale;
+
+	return len * info->width * info->channels;
+}
+
+/*
+==============
+S_ReadSound
+
+Reads the file for a sound and sets up its cache, leaving the samples to
+be converted by S_ResampleSound.  Returns the file data, NULL if there
+is nothing to convert, which is also the case when the converted sound
+came from the asset cache.
+==============
+*/
+static byte *S_ReadSound (sfx_t *s, wavinfo_t *info)
+{
+	char	namebuffer[MAX_QPATH];
+	byte	*data;
+	int		len, key[2];
+	sfxcache_t	*sc;
+	int		size;
+
+	S_SoundPath (s, namebuffer);
 
 //	Com_Printf ("loading %s\n",namebuffer);
 
+	key[0] = dma.speed;
+	key[1] = s_loadas8bit->intValue;
+	data = FS_LoadCache (namebuffer, key, sizeof(key), &size);
+	if (data)
+	{
+		if (size > sizeof(sfxcache_t))
+		{
+			s->cache = Z_Malloc (size);
+			memcpy (s->cache, data, size);
+		}
+		FS_FreeCache (data);
+		if (s->cache)
+			return NULL;
+	}
+
 	size = FS_LoadFile (namebuffer, (void **)&data);
 
 	if (!data)
@@ -127,33 +165,30 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 		return NULL;
 	}
 
-	info = GetWavinfo (s->name, data, size);
-/*	if (info.channels != 1)
+	*info = GetWavinfo (s->name, data, size);
+/*	if (info->channels != 1)
 	{
 		Com_Printf ("%s is a stereo sample\n",s->name);
 		FS_FreeFile (data);
 		return NULL;
 	}*/
-	if (info.channels < 1 || info.channels > 2)	//CDawg changed
+	if (info->channels < 1 || info->channels > 2)	//CDawg changed
 	{
 		Com_Printf ("%s has an invalid number of channels\n", s->name);
 		FS_FreeFile (data);
 		return NULL;
 	}
 
-	if (info.width != 1 && info.width != 2)
+	if (info->width != 1 && info->width != 2)
 	{
 		Com_Printf("%s is not 8 or 16 bit\n", s->name);
 		FS_FreeFile (data);
 		return NULL;
 	}
 
-	stepscale = (float)info.rate / dma.speed;
-	len = info.samples / stepscale;
+	len = S_CacheSize (info);
 
-	len = len * info.width * info.channels;
-
-	if (info.samples == 0 || len == 0)
+	if (info->samples == 0 || len == 0)
 	{
 		Com_Printf("%s has zero samples\n", s->name);
 		FS_FreeFile (data);
@@ -167,23 +202,246 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 		return NULL;
 	}
 
-	sc->length = info.samples;
-	sc->loopstart = info.loopstart;
-//	sc->speed = info.rate;
-	sc->speed = info.rate * info.channels;	//CDawg changed
-	sc->width = info.width;
-	sc->stereo = info.channels;
+	sc->length = info->samples;
+	sc->loopstart = info->loopstart;
+//	sc->speed = info->rate;
+	sc->speed = info->rate * info->channels;	//CDawg changed
+	sc->width = info->width;
+	sc->stereo = info->channels;
 
 	// Knightmare: force loopstart if it's a music file
 	if (!strncmp(namebuffer, "music/", 6) && (sc->loopstart == -1))
 		sc->loopstart = 0;
 	// end Knightmare
 
-	ResampleSfx (s, sc->speed, sc->width, data + info.dataofs);
+	return data;
+}
+
+/*
+==============
+S_ResampleSound
+
+Converts the samples read by S_ReadSound into the cache.  Only touches
+the sound's own cache, so it can run on a worker thread.
+==============
+*/
+static void S_ResampleSound (sfx_t *s, wavinfo_t *info, byte *data)
+{
+	ResampleSfx (s, s->cache->speed, s->cache->width, data + info->dataofs);
+}
+
+/*
+==============
+S_WriteSound
+
+Stores a freshly resampled sound in the asset cache
+==============
+*/
+static void S_WriteSound (sfx_t *s, wavinfo_t *info)
+{
+	char	namebuffer[MAX_QPATH];
+	int		key[2];
+
+	S_SoundPath (s, namebuffer);
+	key[0] = dma.speed;
+	key[1] = s_loadas8bit->intValue;
+	FS_WriteCache (namebuffer, key, sizeof(key), s->cache, S_CacheSize (info) + sizeof(sfxcache_t));
+}
+
+/*
+==============
+S_LoadSound
+==============
+*/
+sfxcache_t *S_LoadSound (sfx_t *s)
+{
+	byte	*data;
+	wavinfo_t	info;
+
+	if (s->name[0] == '*')
+		return NULL;
+
+// see if still in memory
+	if (s->cache)
+		return s->cache;
+
+// load it in
+	data = S_ReadSound (s, &info);
+	if (!data)
+		return s->cache;
+
+	S_ResampleSound (s, &info, data);
+	S_WriteSound (s, &info);
 
 	FS_FreeFile (data);
 
-	return sc;
+	return s->cache;
+}
+
+/*
+===============================================================================
+
+REGISTRATION LOADING
+
+S_EndRegistration hands every sound of the new level to S_LoadSounds,
+which reads the files and sets up their caches on the main thread, then
+resamples them on cl_loadthreads threads.  File data is held for at most
+SFX_LOAD_BYTES at a time.  Sounds found in the asset cache skip the
+resampling, and the rest are written to it afterwards.  The times of the last load are kept for the
+loadstats command.
+
+===============================================================================
+*/
+
+#define	SFX_LOAD_BYTES	(16*1024*1024)
+
+typedef struct
+{
+	char		name[MAX_QPATH];
+	sfx_t		*sfx;
+	byte		*data;
+	wavinfo_t	info;
+	int			bytes;
+	qboolean	cached;			// came from the asset cache
+	unsigned	readtime;		// microseconds on the main thread
+	unsigned	decodetime;		// microseconds on whichever thread resampled it
+} sfxload_t;
+
+static sfxload_t	s_loads[MAX_SFX];
+static int			s_numloads;
+static unsigned		s_loadtime;
+static int			s_loadthreads;
+
+/*
+==============
+S_ResampleJob
+==============
+*/
+static void S_ResampleJob (int job, void *arg)
+{
+	sfxload_t	*load;
+	unsigned	time;
+
+	load = (sfxload_t *)arg + job;
+	if (load->cached)
+		return;
+	time = Sys_Microseconds ();
+	S_ResampleSound (load->sfx, &load->info, load->data);
+	load->decodetime = Sys_Microseconds () - time;
+}
+
+/*
+==============
+S_LoadSounds
+
+Loads every sound in the list that isn't in memory yet, the list
+holding no more than MAX_SFX of them
+==============
+*/
+void S_LoadSounds (sfx_t **list, int count)
+{
+	sfxload_t	*load, *batch;
+	sfx_t		*s;
+	int			i, bytes;
+	unsigned	start, time;
+
+	start = Sys_Microseconds ();
+	s_numloads = 0;
+	s_loadthreads = max(cl_loadthreads->intValue, 1);
+
+	for (i=0 ; i<count ; )
+	{
+		// read files until the batch is full
+		batch = load = s_loads + s_numloads;
+		for (bytes=0 ; i<count && bytes<SFX_LOAD_BYTES ; i++)
+		{
+			s = list[i];
+			if (s->name[0] == '*' || s->cache)
+				continue;
+
+			time = Sys_Microseconds ();
+			load->data = S_ReadSound (s, &load->info);
+			if (!load->data && !s->cache)
+				continue;
+			load->cached = !load->data;
+			Q_strncpyz (load->name, s->name, sizeof(load->name));
+			load->sfx = s;
+			load->bytes = s->cache->length * s->cache->width;
+			load->readtime = Sys_Microseconds () - time;
+			load->decodetime = 0;
+			bytes += load->bytes;
+			load++;
+			s_numloads++;
+		}
+
+		Com_RunJobs (load - batch, S_ResampleJob, batch, s_loadthreads);
+
+		for ( ; batch<load ; batch++)
+		{
+			if (batch->cached)
+				continue;
+			S_WriteSound (batch->sfx, &batch->info);
+			FS_FreeFile (batch->data);
+			batch->data = NULL;
+		}
+	}
+
+	s_loadtime = Sys_Microseconds () - start;
+}
+
+/*
+==============
+S_LoadStats
+
+Prints the sounds of the last registration by the time they took
+==============
+*/
+static int S_LoadCompare (const void *a, const void *b)
+{
+	const sfxload_t	*la = *(const sfxload_t **)a;
+	const sfxload_t	*lb = *(const sfxload_t **)b;
+	unsigned		ta = la->readtime + la->decodetime;
+	unsigned		tb = lb->readtime + lb->decodetime;
+
+	return (ta < tb) - (ta > tb);
+}
+
+void S_LoadStats (void)
+{
+	sfxload_t	*sorted[MAX_SFX];
+	sfxload_t	*load;
+	unsigned	readtime, decodetime;
+	int			i, bytes, cached;
+
+	if (!s_numloads)
+	{
+		Com_Printf ("No sounds loaded at the last registration.\n");
+		return;
+	}
+
+	readtime = decodetime = 0;
+	bytes = cached = 0;
+	for (i=0 ; i<s_numloads ; i++)
+	{
+		load = &s_loads[i];
+		sorted[i] = load;
+		cached += load->cached;
+		readtime += load->readtime;
+		decodetime += load->decodetime;
+		bytes += load->bytes;
+	}
+	qsort (sorted, s_numloads, sizeof(sorted[0]), S_LoadCompare);
+
+	Com_Printf ("    read  decode    bytes sound\n");
+	Com_Printf ("-------- ------- -------- ----------------\n");
+	for (i=0 ; i<s_numloads ; i++)
+	{
+		load = sorted[i];
+		Com_Printf ("%8.2f %7.2f %8i %s%s\n", load->readtime * 0.001f,
+			load->decodetime * 0.001f, load->bytes, load->name, load->cached ? " (cached)" : "");
+	}
+	Com_Printf ("%i sounds, %i from the cache, %i bytes in %.1f ms with cl_loadthreads %i (%.1f ms reading, %.1f ms resampling)\n",
+		s_numloads, cached, bytes, s_loadtime * 0.001f, s_loadthreads, readtime * 0.001f, decodetime * 0.001f);
 }
 
 
@@ -22,38 +22,183 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "client.h"
 #include "snd_loc.h"
 
+// SSE2 is part of the base instruction set wherever these are defined,
+// so the kernels only have to be switched off at runtime, not detected
+#if !id386 && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SND_SSE2
+#include <emmintrin.h>
+#endif
+
 portable_samplepair_t paintbuffer[PAINTBUFFER_SIZE];
 int		snd_scaletable[32][256];
 int 	*snd_p, snd_linear_count, snd_vol;
 short	*snd_out;
+static qboolean	snd_usesimd;	// s_mixsimd, latched for each S_PaintChannels
 
 void S_WriteLinearBlastStereo16 (void);
 
-#if	!id386
-void S_WriteLinearBlastStereo16 (void)
+/*
+===============================================================================
+
+MIXING KERNELS
+
+The SSE2 versions give exactly the same results as the C ones.  They
+multiply with pmaddwd, which only takes signed 16 bit factors, so a
+volume is split into two halves that are each below 32768.  Volumes
+too big for that fall back to C.
+
+===============================================================================
+*/
+
+static void S_ClipStereo16_C (const int *in, short *out, int count)
 {
 	int		i;
 	int		val;
 
-	for (i = 0; i < snd_linear_count; i += 2)
+	for (i = 0; i < count; i += 2)
 	{
-		val = snd_p[i]>>8;
+		val = in[i]>>8;
 		if (val > 0x7fff)
-			snd_out[i] = 0x7fff;
+			out[i] = 0x7fff;
 		else if (val < (short)0x8000)
-			snd_out[i] = (short)0x8000;
+			out[i] = (short)0x8000;
 		else
-			snd_out[i] = val;
+			out[i] = val;
 
-		val = snd_p[i+1]>>8;
+		val = in[i+1]>>8;
 		if (val > 0x7fff)
-			snd_out[i+1] = 0x7fff;
+			out[i+1] = 0x7fff;
 		else if (val < (short)0x8000)
-			snd_out[i+1] = (short)0x8000;
+			out[i+1] = (short)0x8000;
 		else
-			snd_out[i+1] = val;
+			out[i+1] = val;
 	}
 }
+
+static void S_Paint8_C (portable_samplepair_t *samp, const unsigned char *sfx, int count, const int *lscale, const int *rscale)
+{
+	int 	data;
+	int		i;
+
+	for (i = 0; i < count; i++, samp++)
+	{
+		data = sfx[i];
+		samp->left += lscale[data];
+		samp->right += rscale[data];
+	}
+}
+
+static void S_Paint16_C (portable_samplepair_t *samp, const signed short *sfx, int count, int leftvol, int rightvol)
+{
+	int data;
+	int left, right;
+	int	i;
+
+	for (i = 0; i < count; i++, samp++)
+	{
+		data = sfx[i];
+		left = (data * leftvol)>>8;
+		right = (data * rightvol)>>8;
+		samp->left += left;
+		samp->right += right;
+	}
+}
+
+#ifdef SND_SSE2
+#define	SND_SSE2_MAXVOL	65534	// both halves must fit a signed short
+
+// pmaddwd factor pair that sums to vol
+static __m128i S_SplitVolume (int vol)
+{
+	int		lo;
+
+	lo = vol >> 1;
+	return _mm_set1_epi32 (((vol - lo) << 16) | lo);
+}
+
+// adds four left and four right values to four sample pairs
+static void S_AddSamples (portable_samplepair_t *samp, __m128i left, __m128i right)
+{
+	__m128i	*p;
+
+	p = (__m128i *)samp;
+	_mm_storeu_si128 (p, _mm_add_epi32 (_mm_loadu_si128 (p), _mm_unpacklo_epi32 (left, right)));
+	_mm_storeu_si128 (p + 1, _mm_add_epi32 (_mm_loadu_si128 (p + 1), _mm_unpackhi_epi32 (left, right)));
+}
+
+static void S_ClipStereo16_SSE2 (const int *in, short *out, int count)
+{
+	__m128i	a, b;
+	int		i;
+
+	// packssdw saturates exactly like the C clamp
+	for (i = 0; i + 8 <= count; i += 8)
+	{
+		a = _mm_srai_epi32 (_mm_loadu_si128 ((const __m128i *)(in + i)), 8);
+		b = _mm_srai_epi32 (_mm_loadu_si128 ((const __m128i *)(in + i + 4)), 8);
+		_mm_storeu_si128 ((__m128i *)(out + i), _mm_packs_epi32 (a, b));
+	}
+
+	S_ClipStereo16_C (in + i, out + i, count - i);
+}
+
+static void S_Paint8_SSE2 (portable_samplepair_t *samp, const unsigned char *sfx, int count, const int *lscale, const int *rscale)
+{
+	__m128i	lv, rv, d, w;
+	int		i;
+
+	// the scale tables are just the signed sample times a constant
+	lv = S_SplitVolume (lscale[1]);
+	rv = S_SplitVolume (rscale[1]);
+
+	for (i = 0; i + 8 <= count; i += 8)
+	{
+		d = _mm_loadl_epi64 ((const __m128i *)(sfx + i));
+		d = _mm_srai_epi16 (_mm_unpacklo_epi8 (d, d), 8);
+
+		w = _mm_unpacklo_epi16 (d, d);
+		S_AddSamples (samp + i, _mm_madd_epi16 (w, lv), _mm_madd_epi16 (w, rv));
+		w = _mm_unpackhi_epi16 (d, d);
+		S_AddSamples (samp + i + 4, _mm_madd_epi16 (w, lv), _mm_madd_epi16 (w, rv));
+	}
+
+	S_Paint8_C (samp + i, sfx + i, count - i, lscale, rscale);
+}
+
+static void S_Paint16_SSE2 (portable_samplepair_t *samp, const signed short *sfx, int count, int leftvol, int rightvol)
+{
+	__m128i	lv, rv, d, w;
+	int		i;
+
+	lv = S_SplitVolume (leftvol);
+	rv = S_SplitVolume (rightvol);
+
+	for (i = 0; i + 8 <= count; i += 8)
+	{
+		d = _mm_loadu_si128 ((const __m128i *)(sfx + i));
+
+		w = _mm_unpacklo_epi16 (d, d);
+		S_AddSamples (samp + i, _mm_srai_epi32 (_mm_madd_epi16 (w, lv), 8), _mm_srai_epi32 (_mm_madd_epi16 (w, rv), 8));
+		w = _mm_unpackhi_epi16 (d, d);
+		S_AddSamples (samp + i + 4, _mm_srai_epi32 (_mm_madd_epi16 (w, lv), 8), _mm_srai_epi32 (_mm_madd_epi16 (w, rv), 8));
+	}
+
+	S_Paint16_C (samp + i, sfx + i, count - i, leftvol, rightvol);
+}
+#endif /* SND_SSE2 */
+
+#if	!id386
+void S_WriteLinearBlastStereo16 (void)
+{
+#ifdef SND_SSE2
+	if (snd_usesimd)
+	{
+		S_ClipStereo16_SSE2 (snd_p, snd_out, snd_linear_count);
+		return;
+	}
+#endif
+	S_ClipStereo16_C (snd_p, snd_out, snd_linear_count);
+}
 #endif
 
 #if (id386) && defined(_MSC_VER)
@@ -229,6 +374,7 @@ void S_PaintChannels(int endtime)
 	playsound_t	*ps;
 
 	snd_vol = s_volume->value*256;
+	snd_usesimd = s_mixsimd->intValue;
 
 //Com_Printf ("%i to %i\n", paintedtime, endtime);
 	while (paintedtime < endtime)
@@ -370,10 +516,8 @@ void S_InitScaletable (void)
 #if	!id386
 void S_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int count, int offset)
 {
-	int 	data;
 	int		*lscale, *rscale;
 	unsigned char *sfx;
-	int		i;
 	portable_samplepair_t	*samp;
 
 	if (ch->leftvol > 255)
@@ -389,12 +533,13 @@ void S_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int count, int offset)
 
 	samp = &paintbuffer[offset];
 
-	for (i = 0; i < count; i++, samp++)
-	{
-		data = sfx[i];
-		samp->left += lscale[data];
-		samp->right += rscale[data];
-	}
+#ifdef SND_SSE2
+	if (snd_usesimd && lscale[1] >= 0 && lscale[1] <= SND_SSE2_MAXVOL
+		&& rscale[1] >= 0 && rscale[1] <= SND_SSE2_MAXVOL)
+		S_Paint8_SSE2 (samp, sfx, count, lscale, rscale);
+	else
+#endif
+	S_Paint8_C (samp, sfx, count, lscale, rscale);
 
 	ch->pos += count;
 }
@@ -475,11 +620,8 @@ LDone:
 
 void S_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count, int offset)
 {
-	int data;
-	int left, right;
 	int leftvol, rightvol;
 	signed short *sfx;
-	int	i;
 	portable_samplepair_t	*samp;
 
 	leftvol = ch->leftvol*snd_vol;
@@ -487,15 +629,127 @@ void S_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count, int offset)
 	sfx = (signed short *)sc->data + ch->pos;
 
 	samp = &paintbuffer[offset];
-	for (i = 0; i < count; i++, samp++)
+#ifdef SND_SSE2
+	if (snd_usesimd && leftvol >= 0 && leftvol <= SND_SSE2_MAXVOL
+		&& rightvol >= 0 && rightvol <= SND_SSE2_MAXVOL)
+		S_Paint16_SSE2 (samp, sfx, count, leftvol, rightvol);
+	else
+#endif
+	S_Paint16_C (samp, sfx, count, leftvol, rightvol);
+
+	ch->pos += count;
+}
+
+/*
+===============================================================================
+
+MIXER BENCHMARK
+
+===============================================================================
+*/
+
+#define	BENCH_CHANNELS	24
+#define	BENCH_LENGTH	(PAINTBUFFER_SIZE * 4)
+
+/*
+=================
+S_MixBenchRun
+
+Mixes a fixed set of 8 and 16 bit channels into the paint buffer and
+clips it into out, returning a checksum of everything written.
+=================
+*/
+static unsigned S_MixBenchRun (sfxcache_t **cache, short *out, int passes, int simd)
+{
+	channel_t	ch;
+	unsigned	sum;
+	int			pass, i, j;
+
+	snd_usesimd = simd;
+	snd_vol = 256 * 0.7f;
+	sum = 0;
+
+	for (pass = 0; pass < passes; pass++)
 	{
-		data = sfx[i];
-		left = (data * leftvol)>>8;
-		right = (data * rightvol)>>8;
-		samp->left += left;
-		samp->right += right;
+		memset (paintbuffer, 0, sizeof(paintbuffer));
+		for (i = 0; i < BENCH_CHANNELS; i++)
+		{
+			memset (&ch, 0, sizeof(ch));
+			ch.leftvol = (i * 37) & 255;
+			ch.rightvol = 255 - ((i * 53) & 255);
+			ch.pos = (pass * 131 + i * 17) & (BENCH_LENGTH - PAINTBUFFER_SIZE - 1);
+			if (i & 1)
+				S_PaintChannelFrom16 (&ch, cache[1], PAINTBUFFER_SIZE - i, i);
+			else
+				S_PaintChannelFrom8 (&ch, cache[0], PAINTBUFFER_SIZE - i, i);
+		}
+
+		snd_p = (int *)paintbuffer;
+		snd_out = out;
+		snd_linear_count = PAINTBUFFER_SIZE * 2;
+		S_WriteLinearBlastStereo16 ();
+
+		for (j = 0; j < PAINTBUFFER_SIZE * 2; j++)
+			sum = sum * 31 + (unsigned short)out[j];
 	}
 
-	ch->pos += count;
+	return sum;
+}
+
+/*
+=================
+S_MixBench_f
+
+Mixes into a scratch buffer instead of dma, so it can be run while
+sound is playing.
+=================
+*/
+void S_MixBench_f (void)
+{
+	sfxcache_t	*cache[2];
+	short		*out;
+	unsigned	sum[2];
+	int			time[2];
+	int			i, passes;
+
+	passes = 200;
+	if (Cmd_Argc() > 1)
+		passes = atoi (Cmd_Argv(1));
+	if (passes < 1)
+		passes = 1;
+
+	cache[0] = Z_Malloc (sizeof(sfxcache_t) + BENCH_LENGTH);
+	cache[1] = Z_Malloc (sizeof(sfxcache_t) + BENCH_LENGTH * 2);
+	out = Z_Malloc (PAINTBUFFER_SIZE * 2 * sizeof(short));
+
+	// loud noise, so the clipping gets exercised too
+	for (i = 0; i < BENCH_LENGTH; i++)
+	{
+		cache[0]->data[i] = (i * 7919) >> 3;
+		((short *)cache[1]->data)[i] = (i * 104729) & 0xffff;
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		time[i] = Sys_Milliseconds ();
+		sum[i] = S_MixBenchRun (cache, out, passes, i);
+		time[i] = Sys_Milliseconds () - time[i];
+	}
+
+	Com_Printf ("%i passes of %i channels\n", passes, BENCH_CHANNELS);
+	Com_Printf ("C:    %5i ms\n", time[0]);
+#ifdef SND_SSE2
+	Com_Printf ("SSE2: %5i ms, %s\n", time[1], sum[0] == sum[1] ? "output matches" : "OUTPUT DIFFERS");
+#else
+	Com_Printf ("SSE2: not compiled in\n");
+#endif
+
+	Z_Free (cache[0]);
+	Z_Free (cache[1]);
+	Z_Free (out);
+
+	// don't leave the bench mix in the paint buffer
+	memset (paintbuffer, 0, sizeof(paintbuffer));
+	snd_vol = s_volume->value*256;
 }
 
@@ -42,6 +42,7 @@ void S_Activate (qboolean active);
 void S_BeginRegistration (void);
 struct sfx_s *S_RegisterSound (char *sample);
 void S_EndRegistration (void);
+void S_LoadStats (void);
 
 struct sfx_s *S_FindName (char *name, qboolean create);
 
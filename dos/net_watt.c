@@ -65,6 +65,8 @@ loopback_t	loopbacks[2];
 int			ip_sockets[2];
 int			ipx_sockets[2];
 
+static int	net_syscalls;		// recvfrom and sendto calls, for stats
+
 int NET_Socket (char *net_interface, int port);
 
 //=============================================================================
@@ -332,6 +334,7 @@ qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_messag
 		}
 
 		fromlen = sizeof(from);
+		net_syscalls++;
 		ret = recvfrom(net_socket, net_message->data, net_message->maxsize, 0,
 				(struct sockaddr *)&from, &fromlen);
 
@@ -400,6 +403,7 @@ void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 
 	NetadrToSockadr (&to, &addr);
 
+	net_syscalls++;
 	ret = sendto (net_socket, data, length, 0,
 				(struct sockaddr *)&addr, sizeof(addr) );
 	if (ret == SOCKET_ERROR)
@@ -408,6 +412,26 @@ void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 	}
 }
 
+/*
+====================
+NET_BeginBatch / NET_FlushBatch
+
+Packets go straight to Watt-32 as they are sent
+====================
+*/
+void NET_BeginBatch (netsrc_t sock)
+{
+}
+
+void NET_FlushBatch (netsrc_t sock)
+{
+}
+
+int NET_SystemCalls (void)
+{
+	return net_syscalls;
+}
+
 
 //=============================================================================
 
@@ -87,6 +87,11 @@ int	Sys_Milliseconds (void)
 	return curtime;
 }
 
+unsigned Sys_Microseconds (void)
+{
+	return (unsigned)(uclock_t)((double) uclock() / (UCLOCKS_PER_SEC / 1000000.0));
+}
+
 int	Sys_DOSTime (void) /* FS: DOS needs this for random qport */
 {
 	static time_t secbase;
@@ -106,6 +111,55 @@ void	Sys_Mkdir (char *path)
 	mkdir (path, 0777);
 }
 
+/* No threads in DOS.  Callers do the work themselves when these fail. */
+void	*Sys_CreateThread (void (*func)(void *arg), void *arg)
+{
+	return NULL;
+}
+
+void	Sys_JoinThread (void *thread)
+{
+}
+
+void	*Sys_CreateMutex (void)
+{
+	return NULL;
+}
+
+void	Sys_DestroyMutex (void *mutex)
+{
+}
+
+void	Sys_LockMutex (void *mutex)
+{
+}
+
+void	Sys_UnlockMutex (void *mutex)
+{
+}
+
+void	*Sys_CreateSemaphore (int count)
+{
+	return NULL;
+}
+
+void	Sys_DestroySemaphore (void *sem)
+{
+}
+
+void	Sys_PostSemaphore (void *sem, int count)
+{
+}
+
+void	Sys_WaitSemaphore (void *sem)
+{
+}
+
+int	Sys_NumCPUs (void)
+{
+	return 1;
+}
+
 static	struct ffblk	finddata;
 static	int	findhandle = -1;
 static	char	findbase[PATH_MAX];
@@ -370,6 +370,16 @@ void Sys_Sleep (unsigned msec)
 	usleep (msec*1000);
 }
 
+// no mmap under DJGPP, paks are always read
+void *Sys_MapFile (const char *path, int *length)
+{
+	return NULL;
+}
+
+void Sys_UnmapFile (void *base, int length)
+{
+}
+
 #define	SC_UPARROW	0x48
 #define	SC_DOWNARROW	0x50
 #define	SC_LEFTARROW	0x4b
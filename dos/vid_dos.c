@@ -304,6 +304,10 @@ static qboolean VID_LoadRefresh (const char *name)
 	ri.Vid_GetModeInfo = VID_GetModeInfo;
 	ri.Vid_MenuInit = VID_MenuInit;
 	ri.Vid_NewWindow = VID_NewWindow;
+	ri.RunJobs = Com_RunJobs;
+	ri.FS_LoadCache = FS_LoadCache;
+	ri.FS_FreeCache = FS_FreeCache;
+	ri.FS_WriteCache = FS_WriteCache;
 
 	re = GetRefAPI(ri);
 
@@ -90,6 +90,7 @@ void ReadGame (char *filename);
 void WriteLevel (char *filename);
 void ReadLevel (char *filename);
 void InitGame (void);
+void FreeSaveBuffers (void);
 void G_RunFrame (void);
 
 
@@ -102,6 +103,7 @@ void ShutdownGame (void)
 
 	gi.FreeTags (TAG_LEVEL);
 	gi.FreeTags (TAG_GAME);
+	FreeSaveBuffers ();
 }
 
 
@@ -134,6 +134,22 @@ typedef struct
 	mmove_t *mmovePtr;
 } mmoveList_t;
 
+/*
+ * Savegames are built up in memory
+ * and handed to the engine in one
+ * piece, which writes them out on a
+ * background thread and may compress
+ * them. Loading gets the whole file
+ * in a single read. The layout of the
+ * data is the same as it always was.
+ */
+typedef struct
+{
+	byte *data;
+	int cursize; /* bytes written or read so far */
+	int maxsize; /* bytes allocated or loaded */
+} savefile_t;
+
 /* ========================================================= */
 
 /*
@@ -359,6 +375,113 @@ FindMmoveByName(char *name)
 }
 
 
+/* ========================================================= */
+
+static savefile_t savebuf; /* kept between saves, only grows */
+static savefile_t loadbuf; /* freed by the next load if gi.error got in the way */
+
+/*
+ * Called from ShutdownGame, the
+ * buffers are not zone memory.
+ */
+void
+FreeSaveBuffers(void)
+{
+	free(savebuf.data);
+	memset(&savebuf, 0, sizeof(savebuf));
+
+	if (loadbuf.data)
+	{
+		gi.FreeSaveFile(loadbuf.data);
+	}
+
+	memset(&loadbuf, 0, sizeof(loadbuf));
+}
+
+static savefile_t *
+BeginSave(void)
+{
+	savebuf.cursize = 0;
+	return &savebuf;
+}
+
+static void
+EndSave(savefile_t *f, const char *filename)
+{
+	gi.WriteSaveFile((char *)filename, f->data, f->cursize);
+}
+
+static void
+SaveWrite(savefile_t *f, const void *data, int len)
+{
+	int size;
+	byte *grown;
+
+	if (f->cursize + len > f->maxsize)
+	{
+		for (size = f->maxsize ? f->maxsize : 0x40000; size < f->cursize + len; size *= 2)
+		{
+		}
+
+		grown = realloc(f->data, size);
+
+		if (!grown)
+		{
+			gi.error("SaveWrite: couldn't grow the savegame to %i bytes", size);
+		}
+
+		f->data = grown;
+		f->maxsize = size;
+	}
+
+	memcpy(f->data + f->cursize, data, len);
+	f->cursize += len;
+}
+
+static savefile_t *
+BeginLoad(const char *filename)
+{
+	void *data;
+	int len;
+
+	if (loadbuf.data)
+	{
+		gi.FreeSaveFile(loadbuf.data);
+		loadbuf.data = NULL;
+	}
+
+	len = gi.LoadSaveFile((char *)filename, &data);
+
+	if (len < 0)
+	{
+		gi.error("Couldn't open %s", filename);
+	}
+
+	loadbuf.data = data;
+	loadbuf.cursize = 0;
+	loadbuf.maxsize = len;
+	return &loadbuf;
+}
+
+static void
+EndLoad(savefile_t *f)
+{
+	gi.FreeSaveFile(f->data);
+	f->data = NULL;
+}
+
+static void
+SaveRead(savefile_t *f, void *data, int len)
+{
+	if (len < 0 || len > f->maxsize - f->cursize)
+	{
+		gi.error("SaveRead: savegame is truncated");
+	}
+
+	memcpy(data, f->data + f->cursize, len);
+	f->cursize += len;
+}
+
 /* ========================================================= */
 
 /*
@@ -368,7 +491,7 @@ FindMmoveByName(char *name)
  * below this block into files.
  */
 void
-WriteField1(FILE *f, field_t *field, byte *base)
+WriteField1(savefile_t *f, field_t *field, byte *base)
 {
 	void *p;
 	int len;
@@ -491,7 +614,7 @@ WriteField1(FILE *f, field_t *field, byte *base)
 }
 
 void
-WriteField2(FILE *f, field_t *field, byte *base)
+WriteField2(savefile_t *f, field_t *field, byte *base)
 {
 	int len;
 	void *p;
@@ -512,7 +635,7 @@ WriteField2(FILE *f, field_t *field, byte *base)
 			if (*(char **)p)
 			{
 				len = strlen(*(char **)p) + 1;
-				fwrite(*(char **)p, len, 1, f);
+				SaveWrite(f, *(char **)p, len);
 			}
 
 			break;
@@ -528,7 +651,7 @@ WriteField2(FILE *f, field_t *field, byte *base)
 				}
 
 				len = strlen(func->funcStr)+1;
-				fwrite (func->funcStr, len, 1, f);
+				SaveWrite(f, func->funcStr, len);
 			}
 
 			break;
@@ -543,7 +666,7 @@ WriteField2(FILE *f, field_t *field, byte *base)
 				}
 
 				len = strlen(mmove->mmoveStr)+1;
-				fwrite (mmove->mmoveStr, len, 1, f);
+				SaveWrite(f, mmove->mmoveStr, len);
 			}
 
 			break;
@@ -562,7 +685,7 @@ WriteField2(FILE *f, field_t *field, byte *base)
  * below
  */
 void
-ReadField(FILE *f, field_t *field, byte *base)
+ReadField(savefile_t *f, field_t *field, byte *base)
 {
 	void *p;
 	int len;
@@ -595,7 +718,7 @@ ReadField(FILE *f, field_t *field, byte *base)
 			else
 			{
 				*(char **)p = gi.TagMalloc(32 + len, TAG_LEVEL);
-				fread(*(char **)p, len, 1, f);
+				SaveRead(f, *(char **)p, len);
 			}
 
 			break;
@@ -653,7 +776,7 @@ ReadField(FILE *f, field_t *field, byte *base)
 							(int)sizeof(funcStr));
 				}
 
-				fread (funcStr, len, 1, f);
+				SaveRead(f, funcStr, len);
 
 				if ( !(*(byte **)p = FindFunctionByName (funcStr)) )
 				{
@@ -677,7 +800,7 @@ ReadField(FILE *f, field_t *field, byte *base)
 							(int)sizeof(funcStr));
 				}
 
-				fread (funcStr, len, 1, f);
+				SaveRead(f, funcStr, len);
 
 				if ( !(*(mmove_t **)p = FindMmoveByName (funcStr)) )
 				{
@@ -697,7 +820,7 @@ ReadField(FILE *f, field_t *field, byte *base)
  * Write the client struct into a file.
  */
 void
-WriteClient(FILE *f, gclient_t *client)
+WriteClient(savefile_t *f, gclient_t *client)
 {
 	field_t *field;
 	gclient_t temp;
@@ -712,7 +835,7 @@ WriteClient(FILE *f, gclient_t *client)
 	}
 
 	/* write the block */
-	fwrite(&temp, sizeof(temp), 1, f);
+	SaveWrite(f, &temp, sizeof(temp));
 
 	/* now write any allocated data following the edict */
 	for (field = clientfields; field->name; field++)
@@ -725,11 +848,11 @@ WriteClient(FILE *f, gclient_t *client)
  * Read the client struct from a file
  */
 void
-ReadClient(FILE *f, gclient_t *client)
+ReadClient(savefile_t *f, gclient_t *client)
 {
 	field_t *field;
 
-	fread(client, sizeof(*client), 1, f);
+	SaveRead(f, client, sizeof(*client));
 
 	for (field = clientfields; field->name; field++)
 	{
@@ -752,7 +875,7 @@ ReadClient(FILE *f, gclient_t *client)
 void
 WriteGame(const char *filename, qboolean autosave)
 {
-	FILE *f;
+	savefile_t *f;
 	int i;
 	char str_ver[32];
 	char str_game[32];
@@ -764,12 +887,7 @@ WriteGame(const char *filename, qboolean autosave)
 		SaveClientData();
 	}
 
-	f = fopen(filename, "wb");
-
-	if (!f)
-	{
-		gi.error("Couldn't open %s", filename);
-	}
+	f = BeginSave();
 
 	/* Savegame identification */
 	memset(str_ver, 0, sizeof(str_ver));
@@ -782,13 +900,13 @@ WriteGame(const char *filename, qboolean autosave)
 	strncpy(str_os, OS, sizeof(str_os) - 1);
 	strncpy(str_arch, ARCH, sizeof(str_arch) - 1);
 
-	fwrite(str_ver, sizeof(str_ver), 1, f);
-	fwrite(str_game, sizeof(str_game), 1, f);
-	fwrite(str_os, sizeof(str_os), 1, f);
-	fwrite(str_arch, sizeof(str_arch), 1, f);
+	SaveWrite(f, str_ver, sizeof(str_ver));
+	SaveWrite(f, str_game, sizeof(str_game));
+	SaveWrite(f, str_os, sizeof(str_os));
+	SaveWrite(f, str_arch, sizeof(str_arch));
 
 	game.autosaved = autosave;
-	fwrite(&game, sizeof(game), 1, f);
+	SaveWrite(f, &game, sizeof(game));
 	game.autosaved = false;
 
 	for (i = 0; i < game.maxclients; i++)
@@ -796,7 +914,7 @@ WriteGame(const char *filename, qboolean autosave)
 		WriteClient(f, &game.clients[i]);
 	}
 
-	fclose(f);
+	EndSave(f, filename);
 }
 
 /*
@@ -807,7 +925,7 @@ WriteGame(const char *filename, qboolean autosave)
 void
 ReadGame(const char *filename)
 {
-	FILE *f;
+	savefile_t *f;
 	int i;
 	char str_ver[32];
 	char str_game[32];
@@ -816,45 +934,40 @@ ReadGame(const char *filename)
 
 	gi.FreeTags(TAG_GAME);
 
-	f = fopen(filename, "rb");
-
-	if (!f)
-	{
-		gi.error("Couldn't open %s", filename);
-	}
+	f = BeginLoad(filename);
 
 	/* Sanity checks */
-	fread(str_ver, sizeof(str_ver), 1, f);
-	fread(str_game, sizeof(str_game), 1, f);
-	fread(str_os, sizeof(str_os), 1, f);
-	fread(str_arch, sizeof(str_arch), 1, f);
+	SaveRead(f, str_ver, sizeof(str_ver));
+	SaveRead(f, str_game, sizeof(str_game));
+	SaveRead(f, str_os, sizeof(str_os));
+	SaveRead(f, str_arch, sizeof(str_arch));
 
 	if (strcmp(str_ver, SAVEGAMEVER))
 	{
-		fclose(f);
+		EndLoad(f);
 		gi.error("Savegame from an incompatible version.\n");
 	}
 	else if (strcmp(str_game, GAMEVERSION))
 	{
-		fclose(f);
+		EndLoad(f);
 		gi.error("Savegame from an other game.so.\n");
 	}
  	else if (strcmp(str_os, OS))
 	{
-		fclose(f);
+		EndLoad(f);
 		gi.error("Savegame from an other os.\n");
 	}
 
  	else if (strcmp(str_arch, ARCH))
 	{
-		fclose(f);
+		EndLoad(f);
 		gi.error("Savegame from an other architecure.\n");
 	}
 
 	g_edicts = gi.TagMalloc(game.maxentities * sizeof(g_edicts[0]), TAG_GAME);
 	globals.edicts = g_edicts;
 
-	fread(&game, sizeof(game), 1, f);
+	SaveRead(f, &game, sizeof(game));
 	game.clients = gi.TagMalloc(game.maxclients * sizeof(game.clients[0]),
 			TAG_GAME);
 
@@ -863,7 +976,7 @@ ReadGame(const char *filename)
 		ReadClient(f, &game.clients[i]);
 	}
 
-	fclose(f);
+	EndLoad(f);
 }
 
 /* ========================================================== */
@@ -874,7 +987,7 @@ ReadGame(const char *filename)
  * WriteLevel.
  */
 void
-WriteEdict(FILE *f, edict_t *ent)
+WriteEdict(savefile_t *f, edict_t *ent)
 {
 	field_t *field;
 	edict_t temp;
@@ -889,7 +1002,7 @@ WriteEdict(FILE *f, edict_t *ent)
 	}
 
 	/* write the block */
-	fwrite(&temp, sizeof(temp), 1, f);
+	SaveWrite(f, &temp, sizeof(temp));
 
 	/* now write any allocated data following the edict */
 	for (field = fields; field->name; field++)
@@ -904,7 +1017,7 @@ WriteEdict(FILE *f, edict_t *ent)
  * Called by WriteLevel.
  */
 void
-WriteLevelLocals(FILE *f)
+WriteLevelLocals(savefile_t *f)
 {
 	field_t *field;
 	level_locals_t temp;
@@ -919,7 +1032,7 @@ WriteLevelLocals(FILE *f)
 	}
 
 	/* write the block */
-	fwrite(&temp, sizeof(temp), 1, f);
+	SaveWrite(f, &temp, sizeof(temp));
 
 	/* now write any allocated data following the edict */
 	for (field = levelfields; field->name; field++)
@@ -937,18 +1050,13 @@ WriteLevel(const char *filename)
 {
 	int i;
 	edict_t *ent;
-	FILE *f;
+	savefile_t *f;
 
-	f = fopen(filename, "wb");
-
-	if (!f)
-	{
-		gi.error("Couldn't open %s", filename);
-	}
+	f = BeginSave();
 
 	/* write out edict size for checking */
 	i = sizeof(edict_t);
-	fwrite(&i, sizeof(i), 1, f);
+	SaveWrite(f, &i, sizeof(i));
 
 	/* write out level_locals_t */
 	WriteLevelLocals(f);
@@ -963,14 +1071,14 @@ WriteLevel(const char *filename)
 			continue;
 		}
 
-		fwrite(&i, sizeof(i), 1, f);
+		SaveWrite(f, &i, sizeof(i));
 		WriteEdict(f, ent);
 	}
 
 	i = -1;
-	fwrite(&i, sizeof(i), 1, f);
+	SaveWrite(f, &i, sizeof(i));
 
-	fclose(f);
+	EndSave(f, filename);
 }
 
 /* ========================================================== */
@@ -982,11 +1090,11 @@ WriteLevel(const char *filename)
  * by ReadLevel.
  */
 void
-ReadEdict(FILE *f, edict_t *ent)
+ReadEdict(savefile_t *f, edict_t *ent)
 {
 	field_t *field;
 
-	fread(ent, sizeof(*ent), 1, f);
+	SaveRead(f, ent, sizeof(*ent));
 
 	for (field = fields; field->name; field++)
 	{
@@ -1001,11 +1109,11 @@ ReadEdict(FILE *f, edict_t *ent)
  * Called by ReadLevel.
  */
 void
-ReadLevelLocals(FILE *f)
+ReadLevelLocals(savefile_t *f)
 {
 	field_t *field;
 
-	fread(&level, sizeof(level), 1, f);
+	SaveRead(f, &level, sizeof(level));
 
 	for (field = levelfields; field->name; field++)
 	{
@@ -1026,16 +1134,11 @@ void
 ReadLevel(const char *filename)
 {
 	int entnum;
-	FILE *f;
+	savefile_t *f;
 	int i;
 	edict_t *ent;
 
-	f = fopen(filename, "rb");
-
-	if (!f)
-	{
-		gi.error("Couldn't open %s", filename);
-	}
+	f = BeginLoad(filename);
 
 	/* free any dynamic memory allocated by
 	   loading the level  base state */
@@ -1046,11 +1149,11 @@ ReadLevel(const char *filename)
 	globals.num_edicts = maxclients->value + 1;
 
 	/* check edict size */
-	fread(&i, sizeof(i), 1, f);
+	SaveRead(f, &i, sizeof(i));
 
 	if (i != sizeof(edict_t))
 	{
-		fclose(f);
+		EndLoad(f);
 		gi.error("ReadLevel: mismatched edict size");
 	}
 
@@ -1060,12 +1163,14 @@ ReadLevel(const char *filename)
 	/* load all the entities */
 	while (1)
 	{
-		if (fread(&entnum, sizeof(entnum), 1, f) != 1)
+		if (f->maxsize - f->cursize < (int)sizeof(entnum))
 		{
-			fclose(f);
+			EndLoad(f);
 			gi.error("ReadLevel: failed to read entnum");
 		}
 
+		SaveRead(f, &entnum, sizeof(entnum));
+
 		if (entnum == -1)
 		{
 			break;
@@ -1084,7 +1189,7 @@ ReadLevel(const char *filename)
 		gi.linkentity(ent);
 	}
 
-	fclose(f);
+	EndLoad(f);
 
 	/* mark all clients as unconnected */
 	for (i = 0; i < maxclients->value; i++)
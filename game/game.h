@@ -39,7 +39,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 // game.h -- game dll information visible to server
 
-#define	GAME_API_VERSION	4
+#define	GAME_API_VERSION	5
+#define	GAME_API_VERSION_OLD	4	// no savegame imports, the mods still use it
 
 // edict->svflags
 
@@ -193,6 +194,13 @@ typedef struct
 	void	(*AddCommandString) (char *text);
 
 	void	(*DebugGraph) (float value, int color);
+
+	// savegame files by full path.  writes are queued to a background
+	// thread, loads come back in one buffer, unpacked if need be.
+	// new in version 5, an older server won't load a game that uses them
+	void	(*WriteSaveFile) (char *filename, void *data, int len);
+	int		(*LoadSaveFile) (char *filename, void **data);	// -1 if it can't be read
+	void	(*FreeSaveFile) (void *data);
 } game_import_t;
 
 //
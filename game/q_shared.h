@@ -350,6 +350,7 @@ SYSTEM SPECIFIC
 extern	int	curtime;		// time returned by last Sys_Milliseconds
 
 int		Sys_Milliseconds (void);
+unsigned	Sys_Microseconds (void);	// high resolution, wraps; only use differences
 int		Sys_DOSTime(void); /* FS: DOS needs this for the random qport */
 void	Sys_Mkdir (char *path);
 
@@ -359,6 +360,21 @@ void	*Hunk_Alloc (int size);
 void	Hunk_Free (void *buf);
 int		Hunk_End (void);
 
+// threads and synchronization.  Platforms without threads (DOS) return
+// NULL from the create functions, and callers must then do the work
+// themselves.  The other calls are no-ops on NULL handles.
+void	*Sys_CreateThread (void (*func)(void *arg), void *arg);
+void	Sys_JoinThread (void *thread);
+void	*Sys_CreateMutex (void);
+void	Sys_DestroyMutex (void *mutex);
+void	Sys_LockMutex (void *mutex);
+void	Sys_UnlockMutex (void *mutex);
+void	*Sys_CreateSemaphore (int count);
+void	Sys_DestroySemaphore (void *sem);
+void	Sys_PostSemaphore (void *sem, int count);
+void	Sys_WaitSemaphore (void *sem);
+int		Sys_NumCPUs (void);
+
 // directory searching
 #define SFF_ARCH    0x01
 #define SFF_HIDDEN  0x02
@@ -410,6 +426,7 @@ typedef struct cvar_s
 	char		*description; /* FS: Added */
 	int			defaultFlags; /* FS: Added */
 	struct cvar_s *next;
+	struct cvar_s *hash_next;	// engine only, must stay last
 } cvar_t;
 
 #endif		// CVAR
@@ -26,18 +26,19 @@
  */
 
 extern void ReadLevel ( const char * filename ) ;
-extern void ReadLevelLocals ( FILE * f ) ;
-extern void ReadEdict ( FILE * f , edict_t * ent ) ;
+extern void ReadLevelLocals ( savefile_t * f ) ;
+extern void ReadEdict ( savefile_t * f , edict_t * ent ) ;
 extern void WriteLevel ( const char * filename ) ;
-extern void WriteLevelLocals ( FILE * f ) ;
-extern void WriteEdict ( FILE * f , edict_t * ent ) ;
+extern void WriteLevelLocals ( savefile_t * f ) ;
+extern void WriteEdict ( savefile_t * f , edict_t * ent ) ;
 extern void ReadGame ( const char * filename ) ;
 extern void WriteGame ( const char * filename , qboolean autosave ) ;
-extern void ReadClient ( FILE * f , gclient_t * client ) ;
-extern void WriteClient ( FILE * f , gclient_t * client ) ;
-extern void ReadField ( FILE * f , field_t * field , byte * base ) ;
-extern void WriteField2 ( FILE * f , field_t * field , byte * base ) ;
-extern void WriteField1 ( FILE * f , field_t * field , byte * base ) ;
+extern void ReadClient ( savefile_t * f , gclient_t * client ) ;
+extern void WriteClient ( savefile_t * f , gclient_t * client ) ;
+extern void ReadField ( savefile_t * f , field_t * field , byte * base ) ;
+extern void WriteField2 ( savefile_t * f , field_t * field , byte * base ) ;
+extern void WriteField1 ( savefile_t * f , field_t * field , byte * base ) ;
+extern void FreeSaveBuffers ( void ) ;
 extern mmove_t * FindMmoveByName ( char * name ) ;
 extern mmoveList_t * GetMmoveByAddress ( mmove_t * adr ) ;
 extern byte * FindFunctionByName ( char * name ) ;
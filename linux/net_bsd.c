@@ -1,4 +1,7 @@
 // net_bsd.c
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE		// recvmmsg, sendmmsg
+#endif
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -25,11 +28,44 @@ typedef struct
 cvar_t		*net_shownet;
 static cvar_t	*noudp;
 static cvar_t	*noipx;
+static cvar_t	*net_mmsg;
 
 loopback_t	loopbacks[2];
 int			ip_sockets[2];
 int			ipx_sockets[2];
 
+#ifdef __linux__
+// packets read ahead by a single recvmmsg, handed out by NET_GetPacket
+#define	NET_BATCH	16
+typedef struct
+{
+	struct mmsghdr		msgs[NET_BATCH];
+	struct iovec		iovs[NET_BATCH];
+	struct sockaddr_in	from[NET_BATCH];
+	byte				data[NET_BATCH][MAX_MSGLEN];
+	int					count, next;
+} netbatch_t;
+
+static netbatch_t	net_batches[2];
+
+// packets held back between NET_BeginBatch and NET_FlushBatch
+#define	NET_SENDBATCH	64
+#define	NET_SENDSPACE	0x10000
+typedef struct
+{
+	struct mmsghdr		msgs[NET_SENDBATCH];
+	struct iovec		iovs[NET_SENDBATCH];
+	struct sockaddr_in	to[NET_SENDBATCH];
+	byte				data[NET_SENDSPACE];
+	int					count, used;
+	qboolean			active;
+} netsendbatch_t;
+
+static netsendbatch_t	net_sendbatches[2];
+#endif
+
+static int	net_syscalls;		// socket calls, for stats
+
 //=============================================================================
 
 void NetadrToSockadr (netadr_t *a, struct sockaddr *s)
@@ -236,6 +272,74 @@ void NET_SendLoopPacket (netsrc_t sock, int length, void *data, netadr_t to)
 
 //=============================================================================
 
+#ifdef NET_BATCH
+/*
+====================
+NET_GetBatchedPacket
+
+Hands out the next packet of the current batch, reading a new batch
+with a single recvmmsg when it runs out
+====================
+*/
+static qboolean NET_GetBatchedPacket (netsrc_t sock, int net_socket, netadr_t *net_from, sizebuf_t *net_message)
+{
+	netbatch_t	*b;
+	int			i, ret;
+	unsigned	len;
+
+	b = &net_batches[sock];
+	while (1)
+	{
+		if (b->next >= b->count)
+		{
+			b->next = b->count = 0;
+			for (i=0 ; i<NET_BATCH ; i++)
+			{
+				b->iovs[i].iov_base = b->data[i];
+				b->iovs[i].iov_len = sizeof(b->data[i]);
+				memset (&b->msgs[i].msg_hdr, 0, sizeof(b->msgs[i].msg_hdr));
+				b->msgs[i].msg_hdr.msg_name = &b->from[i];
+				b->msgs[i].msg_hdr.msg_namelen = sizeof(b->from[i]);
+				b->msgs[i].msg_hdr.msg_iov = &b->iovs[i];
+				b->msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			net_syscalls++;
+			ret = recvmmsg (net_socket, b->msgs, NET_BATCH, MSG_DONTWAIT, NULL);
+			if (ret == -1)
+			{
+				if (errno == EWOULDBLOCK)
+					return false;
+				if (errno == ENOSYS)
+				{	// old kernel, read them one at a time
+					Cvar_Set ("net_mmsg", "0");
+					return false;
+				}
+				if (dedicated->intValue)	// let dedicated servers continue after errors
+					Com_Printf ("NET_GetPacket: %s", NET_ErrorString());
+				else
+					Com_Error (ERR_DROP, "NET_GetPacket: %s", NET_ErrorString());
+				return false;
+			}
+			b->count = ret;
+		}
+
+		i = b->next++;
+		SockadrToNetadr ((struct sockaddr *)&b->from[i], net_from);
+
+		len = b->msgs[i].msg_len;
+		if (len >= net_message->maxsize || (b->msgs[i].msg_hdr.msg_flags & MSG_TRUNC))
+		{	// keep going, select won't wake us for the rest of the batch
+			Com_Printf ("Oversize packet from %s\n", NET_AdrToString (*net_from));
+			continue;
+		}
+		memcpy (net_message->data, b->data[i], len);
+		net_message->cursize = len;
+		return true;
+	}
+}
+#endif
+
 qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 {
 	int 	ret;
@@ -248,7 +352,12 @@ qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_messag
 	net_socket = ip_sockets[sock];
 	if (!net_socket)
 		return false;
+#ifdef NET_BATCH
+	if (net_mmsg->intValue || net_batches[sock].next < net_batches[sock].count)
+		return NET_GetBatchedPacket (sock, net_socket, net_from, net_message);
+#endif
 	fromlen = sizeof(from);
+	net_syscalls++;
 	ret = recvfrom (net_socket, (char *)net_message->data, net_message->maxsize, 0,
 			(struct sockaddr *)&from, &fromlen);
 	if (ret == -1)
@@ -274,6 +383,123 @@ qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_messag
 
 //=============================================================================
 
+/*
+====================
+NET_SendError
+
+Reports a failed send of a packet to the given address
+====================
+*/
+static void NET_SendError (netadr_t to)
+{
+	int err = errno;
+
+	// wouldblock is silent
+	if (err == EWOULDBLOCK)
+		return;
+
+	// some PPP links dont allow broadcasts
+	if ((err == EADDRNOTAVAIL) && ((to.type == NA_BROADCAST) || (to.type == NA_BROADCAST_IPX)))
+		return;
+	if (dedicated->intValue)	// let dedicated servers continue after errors
+	{
+		Com_Printf ("NET_SendPacket ERROR: %s\n", NET_ErrorString());
+	}
+	else
+	{
+		if (err == EADDRNOTAVAIL)
+		{
+			Com_DPrintf (DEVELOPER_MSG_NET, "NET_SendPacket Warning: %s : %s\n", NET_ErrorString(), NET_AdrToString (to));
+		}
+		else
+		{
+			Com_Error (ERR_DROP, "NET_SendPacket ERROR: %s\n", NET_ErrorString());
+		}
+	}
+}
+
+#ifdef NET_BATCH
+/*
+====================
+NET_SendQueued
+
+Sends everything held back on sock with as few sendmmsg calls as it takes
+====================
+*/
+static void NET_SendQueued (netsrc_t sock)
+{
+	netsendbatch_t	*b;
+	netadr_t		to;
+	int				i, count, ret;
+
+	b = &net_sendbatches[sock];
+	count = b->count;
+	b->count = b->used = 0;
+
+	for (i=0 ; i<count && ip_sockets[sock] ; )
+	{
+		if (net_mmsg->intValue)
+		{
+			net_syscalls++;
+			ret = sendmmsg (ip_sockets[sock], b->msgs + i, count - i, 0);
+			if (ret > 0)
+			{
+				i += ret;
+				continue;
+			}
+			if (errno == ENOSYS)
+			{	// old kernel, send them one at a time
+				Cvar_Set ("net_mmsg", "0");
+				continue;
+			}
+		}
+		else
+		{
+			net_syscalls++;
+			ret = sendto (ip_sockets[sock], b->iovs[i].iov_base, b->iovs[i].iov_len, 0,
+				(struct sockaddr *)&b->to[i], sizeof(b->to[i]));
+			if (ret != -1)
+			{
+				i++;
+				continue;
+			}
+		}
+
+		// skip the packet that failed
+		SockadrToNetadr ((struct sockaddr *)&b->to[i], &to);
+		i++;
+		NET_SendError (to);
+	}
+}
+
+/*
+====================
+NET_QueuePacket
+====================
+*/
+static void NET_QueuePacket (netsrc_t sock, int length, void *data, struct sockaddr *addr)
+{
+	netsendbatch_t	*b;
+	int				i;
+
+	b = &net_sendbatches[sock];
+	if (b->count == NET_SENDBATCH || b->used + length > NET_SENDSPACE)
+		NET_SendQueued (sock);
+
+	i = b->count++;
+	memcpy (b->data + b->used, data, length);
+	memcpy (&b->to[i], addr, sizeof(b->to[i]));
+	b->iovs[i].iov_base = b->data + b->used;
+	b->iovs[i].iov_len = length;
+	memset (&b->msgs[i], 0, sizeof(b->msgs[i]));
+	b->msgs[i].msg_hdr.msg_name = &b->to[i];
+	b->msgs[i].msg_hdr.msg_namelen = sizeof(b->to[i]);
+	b->msgs[i].msg_hdr.msg_iov = &b->iovs[i];
+	b->msgs[i].msg_hdr.msg_iovlen = 1;
+	b->used += length;
+}
+#endif
+
 void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 {
 	int		ret;
@@ -316,34 +542,48 @@ void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 	}
 	NetadrToSockadr (&to, &addr);
 
+#ifdef NET_BATCH
+	if (to.type == NA_IP && net_sendbatches[sock].active && net_mmsg->intValue)
+	{
+		NET_QueuePacket (sock, length, data, &addr);
+		return;
+	}
+#endif
+
+	net_syscalls++;
 	ret = sendto (net_socket, (const char *)data, length, 0, &addr, sizeof(addr));
 	if (ret == -1)
-	{
-		int err = errno;
+		NET_SendError (to);
+}
 
-		// wouldblock is silent
-		if (err == EWOULDBLOCK)
-			return;
+/*
+====================
+NET_BeginBatch
+====================
+*/
+void NET_BeginBatch (netsrc_t sock)
+{
+#ifdef NET_BATCH
+	net_sendbatches[sock].active = true;
+#endif
+}
 
-		// some PPP links dont allow broadcasts
-		if ((err == EADDRNOTAVAIL) && ((to.type == NA_BROADCAST) || (to.type == NA_BROADCAST_IPX)))
-			return;
-		if (dedicated->intValue)	// let dedicated servers continue after errors
-		{
-			Com_Printf ("NET_SendPacket ERROR: %s\n", NET_ErrorString());
-		}
-		else
-		{
-			if (err == EADDRNOTAVAIL)
-			{
-				Com_DPrintf (DEVELOPER_MSG_NET, "NET_SendPacket Warning: %s : %s\n", NET_ErrorString(), NET_AdrToString (to));
-			}
-			else
-			{
-				Com_Error (ERR_DROP, "NET_SendPacket ERROR: %s\n", NET_ErrorString());
-			}
-		}
-	}
+/*
+====================
+NET_FlushBatch
+====================
+*/
+void NET_FlushBatch (netsrc_t sock)
+{
+#ifdef NET_BATCH
+	net_sendbatches[sock].active = false;
+	NET_SendQueued (sock);
+#endif
+}
+
+int NET_SystemCalls (void)
+{
+	return net_syscalls;
 }
 
 //=============================================================================
@@ -494,6 +734,10 @@ void	NET_Config (qboolean multiplayer)
 				close (ip_sockets[i]);
 				ip_sockets[i] = 0;
 			}
+#ifdef NET_BATCH
+			net_batches[i].count = net_batches[i].next = 0;
+			net_sendbatches[i].count = net_sendbatches[i].used = 0;
+#endif
 		}
 	}
 	else
@@ -516,6 +760,9 @@ void NET_Init (void)
 	noipx = Cvar_Get ("noipx", "0", CVAR_NOSET);
 
 	net_shownet = Cvar_Get ("net_shownet", "0", 0);
+
+	net_mmsg = Cvar_Get ("net_mmsg", "1", 0);
+	Cvar_SetDescription("net_mmsg", "Move several packets per system call with recvmmsg and sendmmsg where the system has them.");
 }
 
 /*
@@ -549,6 +796,11 @@ void NET_Sleep(int msec)
 		return; // we're not a server, just run full speed
 	}
 
+#ifdef NET_BATCH
+	if (net_batches[NS_SERVER].next < net_batches[NS_SERVER].count)
+		return;	// still have packets read ahead
+#endif
+
 	FD_ZERO(&fdset);
 	FD_SET(ip_sockets[NS_SERVER], &fdset); // network socket
 	timeout.tv_sec = (long)msec/1000;
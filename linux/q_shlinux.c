@@ -10,6 +10,8 @@
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <pthread.h>
+#include <stdlib.h>
 
 #include <string.h>
 #include <ctype.h>
@@ -161,6 +163,174 @@ int Sys_Milliseconds (void)
 	return curtime;
 }
 
+unsigned Sys_Microseconds (void)
+{
+	struct timeval tp;
+
+	gettimeofday(&tp, NULL);
+
+	return (unsigned)tp.tv_sec * 1000000u + (unsigned)tp.tv_usec;
+}
+
+//===============================================================================
+
+typedef struct
+{
+	pthread_t	handle;
+	void		(*func)(void *arg);
+	void		*arg;
+} systhread_t;
+
+typedef struct
+{
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+	int				count;
+} syssem_t;
+
+static void *Sys_ThreadMain (void *arg)
+{
+	systhread_t	*t = (systhread_t *)arg;
+
+	t->func (t->arg);
+	return NULL;
+}
+
+void *Sys_CreateThread (void (*func)(void *arg), void *arg)
+{
+	systhread_t	*t;
+
+	t = malloc (sizeof(*t));
+	if (!t)
+		return NULL;
+	t->func = func;
+	t->arg = arg;
+	if (pthread_create (&t->handle, NULL, Sys_ThreadMain, t))
+	{
+		free (t);
+		return NULL;
+	}
+	return t;
+}
+
+void Sys_JoinThread (void *thread)
+{
+	systhread_t	*t = (systhread_t *)thread;
+
+	if (!t)
+		return;
+	pthread_join (t->handle, NULL);
+	free (t);
+}
+
+void *Sys_CreateMutex (void)
+{
+	pthread_mutex_t	*m;
+
+	m = malloc (sizeof(*m));
+	if (!m)
+		return NULL;
+	if (pthread_mutex_init (m, NULL))
+	{
+		free (m);
+		return NULL;
+	}
+	return m;
+}
+
+void Sys_DestroyMutex (void *mutex)
+{
+	if (!mutex)
+		return;
+	pthread_mutex_destroy ((pthread_mutex_t *)mutex);
+	free (mutex);
+}
+
+void Sys_LockMutex (void *mutex)
+{
+	if (mutex)
+		pthread_mutex_lock ((pthread_mutex_t *)mutex);
+}
+
+void Sys_UnlockMutex (void *mutex)
+{
+	if (mutex)
+		pthread_mutex_unlock ((pthread_mutex_t *)mutex);
+}
+
+// unnamed posix semaphores aren't available everywhere (OSX),
+// so build them from a mutex and a condition variable
+void *Sys_CreateSemaphore (int count)
+{
+	syssem_t	*s;
+
+	s = malloc (sizeof(*s));
+	if (!s)
+		return NULL;
+	if (pthread_mutex_init (&s->mutex, NULL))
+	{
+		free (s);
+		return NULL;
+	}
+	if (pthread_cond_init (&s->cond, NULL))
+	{
+		pthread_mutex_destroy (&s->mutex);
+		free (s);
+		return NULL;
+	}
+	s->count = count;
+	return s;
+}
+
+void Sys_DestroySemaphore (void *sem)
+{
+	syssem_t	*s = (syssem_t *)sem;
+
+	if (!s)
+		return;
+	pthread_cond_destroy (&s->cond);
+	pthread_mutex_destroy (&s->mutex);
+	free (s);
+}
+
+void Sys_PostSemaphore (void *sem, int count)
+{
+	syssem_t	*s = (syssem_t *)sem;
+
+	if (!s || count < 1)
+		return;
+	pthread_mutex_lock (&s->mutex);
+	s->count += count;
+	if (count == 1)
+		pthread_cond_signal (&s->cond);
+	else
+		pthread_cond_broadcast (&s->cond);
+	pthread_mutex_unlock (&s->mutex);
+}
+
+void Sys_WaitSemaphore (void *sem)
+{
+	syssem_t	*s = (syssem_t *)sem;
+
+	if (!s)
+		return;
+	pthread_mutex_lock (&s->mutex);
+	while (s->count <= 0)
+		pthread_cond_wait (&s->cond, &s->mutex);
+	s->count--;
+	pthread_mutex_unlock (&s->mutex);
+}
+
+int Sys_NumCPUs (void)
+{
+	long	n;
+
+	n = sysconf (_SC_NPROCESSORS_ONLN);
+	if (n < 1)
+		return 1;
+	return (int)n;
+}
+
 //===============================================================================
 
 void Sys_Mkdir (char *path)
@@ -6,6 +6,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
@@ -303,6 +305,37 @@ void Sys_Sleep (unsigned ms)
 	usleep(ms * 1000);
 }
 
+void *Sys_MapFile (const char *path, int *length)
+{
+	struct stat	st;
+	void	*base;
+	int		fd;
+
+	fd = open (path, O_RDONLY);
+	if (fd == -1)
+		return NULL;
+
+	if (fstat (fd, &st) == -1 || st.st_size <= 0 || st.st_size > INT_MAX)
+	{
+		close (fd);
+		return NULL;
+	}
+
+	// private and writable, so loaders that byte swap in place still work
+	base = mmap (NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close (fd);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	*length = (int)st.st_size;
+	return base;
+}
+
+void Sys_UnmapFile (void *base, int length)
+{
+	munmap (base, length);
+}
+
 const char* Sys_ExeDir(void)
 {
 	return exe_dir;
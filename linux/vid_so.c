@@ -275,6 +275,10 @@ qboolean VID_LoadRefresh (const char *name)
 	ri.Vid_GetModeInfo = VID_GetModeInfo;
 	ri.Vid_MenuInit = VID_MenuInit;
 	ri.Vid_NewWindow = VID_NewWindow;
+	ri.RunJobs = Com_RunJobs;
+	ri.FS_LoadCache = FS_LoadCache;
+	ri.FS_FreeCache = FS_FreeCache;
+	ri.FS_WriteCache = FS_WriteCache;
 
 #ifndef REF_HARD_LINKED
 	if (!(GetRefAPI = (GetRefAPI_t) dlsym(reflib_library, "GetRefAPI")))
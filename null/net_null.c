@@ -182,6 +182,19 @@ void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 
 }
 
+void NET_BeginBatch (netsrc_t sock)
+{
+}
+
+void NET_FlushBatch (netsrc_t sock)
+{
+}
+
+int NET_SystemCalls (void)
+{
+	return 0;
+}
+
 
 //=============================================================================
 
@@ -17,8 +17,12 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
+// swimp_null.c -- offscreen framebuffer so ref_soft can run headless
+
 #include "../ref_soft/r_local.h"
 
+static pixel_t	*swimp_buffer;
+
 void		SWimp_BeginFrame( float camera_separation )
 {
 }
@@ -29,7 +33,7 @@ void		SWimp_EndFrame (void)
 
 int			SWimp_Init( void *hInstance, void *wndProc )
 {
-	return 0;
+	return true;
 }
 
 void		SWimp_SetPalette( const unsigned char *palette)
@@ -38,11 +42,37 @@ void		SWimp_SetPalette( const unsigned char *palette)
 
 void		SWimp_Shutdown( void )
 {
+	if ( swimp_buffer )
+	{
+		free( swimp_buffer );
+		swimp_buffer = NULL;
+	}
+	vid.buffer = NULL;
 }
 
 rserr_t		SWimp_SetMode( int *pwidth, int *pheight, int mode, qboolean fullscreen )
 {
-	return rserr_unknown;
+	if ( !ri.Vid_GetModeInfo( pwidth, pheight, mode ) )
+	{
+		ri.Con_Printf( PRINT_ALL, " invalid mode\n" );
+		return rserr_invalid_mode;
+	}
+
+	ri.Con_Printf( PRINT_ALL, "setting mode %d: %d %d (offscreen)\n", mode, *pwidth, *pheight );
+
+	SWimp_Shutdown ();
+
+	swimp_buffer = malloc( *pwidth * *pheight );
+	if ( !swimp_buffer )
+		return rserr_unknown;
+	memset( swimp_buffer, 0, *pwidth * *pheight );
+
+	vid.buffer = swimp_buffer;
+	vid.rowbytes = *pwidth;
+
+	ri.Vid_NewWindow( *pwidth, *pheight );
+
+	return rserr_ok;
 }
 
 void		SWimp_AppActivate( qboolean active )
@@ -21,6 +21,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "../qcommon/qcommon.h"
 #include "errno.h"
+#include <time.h>
 
 int	curtime;
 
@@ -53,10 +54,19 @@ void	Sys_UnloadGame (void)
 {
 }
 
+#ifdef GAME_HARD_LINKED
+void *GetGameAPI (void *import);
+
+void	*Sys_GetGameAPI (void *parms)
+{
+	return GetGameAPI (parms);
+}
+#else
 void	*Sys_GetGameAPI (void *parms)
 {
 	return NULL;
 }
+#endif
 
 char *Sys_ConsoleInput (void)
 {
@@ -65,6 +75,7 @@ char *Sys_ConsoleInput (void)
 
 void	Sys_ConsoleOutput (char *string)
 {
+	fputs (string, stdout);	// so headless runs can report
 }
 
 void Sys_SendKeyEvents (void)
@@ -84,34 +95,130 @@ char *Sys_GetClipboardData( void )
 	return NULL;
 }
 
+/*
+** Hunks are plain zeroed heap blocks; nothing is given back until
+** Hunk_Free, which is fine for a porting aid and the benchmark.
+*/
+static byte	*hunkbase;
+static int	hunkmaxsize;
+static int	hunkcursize;
+
 void	*Hunk_Begin (int maxsize)
 {
-	return NULL;
+	hunkbase = calloc (1, maxsize);
+	if (!hunkbase)
+		Sys_Error ("Hunk_Begin: failed to allocate %i bytes", maxsize);
+	hunkmaxsize = maxsize;
+	hunkcursize = 0;
+
+	return hunkbase;
 }
 
 void	*Hunk_Alloc (int size)
 {
-	return NULL;
+	byte	*buf;
+
+	size = (size+31)&~31;	// round to cacheline
+	if (hunkcursize + size > hunkmaxsize)
+		Sys_Error ("Hunk_Alloc overflow");
+	buf = hunkbase + hunkcursize;
+	hunkcursize += size;
+
+	return buf;
 }
 
 void	Hunk_Free (void *buf)
 {
+	free (buf);
 }
 
 int		Hunk_End (void)
 {
-	return 0;
+	return hunkcursize;
+}
+
+// C89 only has clock(), which counts the CPU time of every thread
+// together, so use the C11 wall clock when there is one
+static double Sys_Seconds (void)
+{
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && defined(TIME_UTC)
+	static time_t	secbase;
+	struct timespec	ts;
+
+	timespec_get (&ts, TIME_UTC);
+	if (!secbase)
+		secbase = ts.tv_sec;
+
+	return (double)(ts.tv_sec - secbase) + ts.tv_nsec * 1e-9;
+#else
+	return (double)clock() / CLOCKS_PER_SEC;
+#endif
 }
 
 int		Sys_Milliseconds (void)
 {
-	return 0;
+	curtime = (int)(Sys_Seconds () * 1000.0);
+
+	return curtime;
+}
+
+unsigned	Sys_Microseconds (void)
+{
+	return (unsigned)(long long)(Sys_Seconds () * 1000000.0);
 }
 
 void	Sys_Mkdir (char *path)
 {
 }
 
+void	*Sys_CreateThread (void (*func)(void *arg), void *arg)
+{
+	return NULL;
+}
+
+void	Sys_JoinThread (void *thread)
+{
+}
+
+void	*Sys_CreateMutex (void)
+{
+	return NULL;
+}
+
+void	Sys_DestroyMutex (void *mutex)
+{
+}
+
+void	Sys_LockMutex (void *mutex)
+{
+}
+
+void	Sys_UnlockMutex (void *mutex)
+{
+}
+
+void	*Sys_CreateSemaphore (int count)
+{
+	return NULL;
+}
+
+void	Sys_DestroySemaphore (void *sem)
+{
+}
+
+void	Sys_PostSemaphore (void *sem, int count)
+{
+}
+
+void	Sys_WaitSemaphore (void *sem)
+{
+}
+
+int	Sys_NumCPUs (void)
+{
+	return 1;
+}
+
 char	*Sys_FindFirst (char *path, unsigned musthave, unsigned canthave)
 {
 	return NULL;
@@ -130,6 +237,15 @@ void Sys_Sleep (unsigned msec)
 {
 }
 
+void	*Sys_MapFile (const char *path, int *length)
+{
+	return NULL;
+}
+
+void	Sys_UnmapFile (void *base, int length)
+{
+}
+
 void	Sys_Init (void)
 {
 }
@@ -139,11 +255,20 @@ void	Sys_Init (void)
 
 int main (int argc, char **argv)
 {
+	int	time, oldtime, newtime;
+
 	Qcommon_Init (argc, argv);
 
+	oldtime = Sys_Milliseconds ();
 	while (1)
 	{
-		Qcommon_Frame (0.1);
+		do
+		{
+			newtime = Sys_Milliseconds ();
+			time = newtime - oldtime;
+		} while (time < 1);
+		Qcommon_Frame (time);
+		oldtime = newtime;
 	}
 
 	return 0;  /* NOT REACHED */
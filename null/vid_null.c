@@ -130,11 +130,16 @@ void	VID_Init (void)
     ri.FS_FreeFile = FS_FreeFile;
     ri.FS_Gamedir = FS_Gamedir;
 	ri.Vid_NewWindow = VID_NewWindow;
+	ri.RunJobs = Com_RunJobs;
+	ri.FS_LoadCache = FS_LoadCache;
+	ri.FS_FreeCache = FS_FreeCache;
+	ri.FS_WriteCache = FS_WriteCache;
     ri.Cvar_Get = Cvar_Get;
     ri.Cvar_Set = Cvar_Set;
     ri.Cvar_SetValue = Cvar_SetValue;
 	ri.Cvar_SetDescription = Cvar_SetDescription; /* FS */
     ri.Vid_GetModeInfo = VID_GetModeInfo;
+	ri.Vid_MenuInit = VID_MenuInit;
 
 #ifndef DEDICATED_ONLY
     re = GetRefAPI(ri);
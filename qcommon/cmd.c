@@ -27,6 +27,7 @@ void Cmd_ForwardToServer (void);
 #endif
 
 cmdalias_t	*cmd_alias;
+static cmdalias_t	*cmd_alias_hash[CMD_HASH_SIZE];
 
 qboolean	cmd_wait;
 
@@ -435,6 +436,7 @@ void Cmd_Alias_f (void)
 	char		cmd[1024];
 	int			i, c;
 	char		*s;
+	unsigned	hash;
 
 	if (Cmd_Argc() == 1)
 	{
@@ -452,7 +454,8 @@ void Cmd_Alias_f (void)
 	}
 
 	// if the alias already exists, reuse it
-	for (a = cmd_alias ; a ; a=a->next)
+	hash = Com_HashKey (s, CMD_HASH_SIZE);
+	for (a = cmd_alias_hash[hash] ; a ; a=a->hash_next)
 	{
 		if (!strcmp(s, a->name))
 		{
@@ -466,6 +469,8 @@ void Cmd_Alias_f (void)
 		a = Z_Malloc (sizeof(cmdalias_t));
 		a->next = cmd_alias;
 		cmd_alias = a;
+		a->hash_next = cmd_alias_hash[hash];
+		cmd_alias_hash[hash] = a;
 	}
 //	strncpy (a->name, s);	
 	Q_strncpyz (a->name, s, sizeof(a->name));	
@@ -501,6 +506,28 @@ static	char		*cmd_null_string = "";
 static	char		cmd_args[MAX_STRING_CHARS];
 
 cmd_function_t	*cmd_functions;		// possible commands to execute
+static cmd_function_t	*cmd_hash[CMD_HASH_SIZE];	// same commands, by name
+
+/*
+============
+Cmd_FindCommand
+
+Commands that only differ in case hash the same, so the chain
+keeps the same newest-first order as cmd_functions
+============
+*/
+static cmd_function_t *Cmd_FindCommand (char *cmd_name)
+{
+	cmd_function_t	*cmd;
+
+	for (cmd=cmd_hash[Com_HashKey (cmd_name, CMD_HASH_SIZE)] ; cmd ; cmd=cmd->hash_next)
+	{
+		if (!strcmp (cmd_name, cmd->name))
+			return cmd;
+	}
+
+	return NULL;
+}
 
 /*
 ============
@@ -698,6 +725,7 @@ Cmd_AddCommand
 void	Cmd_AddCommand (char *cmd_name, xcommand_t function)
 {
 	cmd_function_t	*cmd;
+	unsigned		hash;
 	
 // fail if the command is a variable name
 	if (Cvar_VariableString(cmd_name)[0])
@@ -707,13 +735,10 @@ void	Cmd_AddCommand (char *cmd_name, xcommand_t function)
 	}
 	
 // fail if the command already exists
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next)
+	if (Cmd_FindCommand (cmd_name))
 	{
-		if (!strcmp (cmd_name, cmd->name))
-		{
-			Com_Printf ("Cmd_AddCommand: %s already defined\n", cmd_name);
-			return;
-		}
+		Com_Printf ("Cmd_AddCommand: %s already defined\n", cmd_name);
+		return;
 	}
 
 	cmd = Z_Malloc (sizeof(cmd_function_t));
@@ -721,6 +746,9 @@ void	Cmd_AddCommand (char *cmd_name, xcommand_t function)
 	cmd->function = function;
 	cmd->next = cmd_functions;
 	cmd_functions = cmd;
+	hash = Com_HashKey (cmd_name, CMD_HASH_SIZE);
+	cmd->hash_next = cmd_hash[hash];
+	cmd_hash[hash] = cmd;
 }
 
 /*
@@ -732,7 +760,7 @@ void	Cmd_RemoveCommand (char *cmd_name)
 {
 	cmd_function_t	*cmd, **back;
 
-	back = &cmd_functions;
+	back = &cmd_hash[Com_HashKey (cmd_name, CMD_HASH_SIZE)];
 	while (1)
 	{
 		cmd = *back;
@@ -743,12 +771,16 @@ void	Cmd_RemoveCommand (char *cmd_name)
 		}
 		if (!strcmp (cmd_name, cmd->name))
 		{
-			*back = cmd->next;
-			Z_Free (cmd);
-			return;
+			*back = cmd->hash_next;
+			break;
 		}
-		back = &cmd->next;
+		back = &cmd->hash_next;
 	}
+
+	for (back = &cmd_functions ; *back != cmd ; back = &(*back)->next)
+		;
+	*back = cmd->next;
+	Z_Free (cmd);
 }
 
 /*
@@ -758,15 +790,7 @@ Cmd_Exists
 */
 qboolean	Cmd_Exists (char *cmd_name)
 {
-	cmd_function_t	*cmd;
-
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next)
-	{
-		if (!strcmp (cmd_name,cmd->name))
-			return true;
-	}
-
-	return false;
+	return Cmd_FindCommand (cmd_name) != NULL;
 }
 
 
@@ -828,13 +852,13 @@ char *Cmd_CompleteCommand (char *partial)
 Cmd_ExecuteString
 
 A complete command line has been parsed, so try to execute it
-FIXME: lookupnoadd the token to speed search?
 ============
 */
 void	Cmd_ExecuteString (char *text)
 {	
 	cmd_function_t	*cmd;
 	cmdalias_t		*a;
+	unsigned		hash;
 
 	Cmd_TokenizeString (text, true);
 			
@@ -842,8 +866,10 @@ void	Cmd_ExecuteString (char *text)
 	if (!Cmd_Argc())
 		return;		// no tokens
 
+	hash = Com_HashKey (cmd_argv[0], CMD_HASH_SIZE);
+
 	// check functions
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next)
+	for (cmd=cmd_hash[hash] ; cmd ; cmd=cmd->hash_next)
 	{
 		if (cmd->name && !Q_strcasecmp (cmd_argv[0],cmd->name))
 		{
@@ -858,7 +884,7 @@ void	Cmd_ExecuteString (char *text)
 	}
 
 	// check alias
-	for (a=cmd_alias ; a ; a=a->next)
+	for (a=cmd_alias_hash[hash] ; a ; a=a->hash_next)
 	{
 		if (!Q_strcasecmp (cmd_argv[0], a->name))
 		{
@@ -978,6 +1004,76 @@ void Cmd_List_f (void)
 	cmd_functions = (cmd_function_t *)head;
 }
 
+/*
+============
+Cmd_Bench_f
+
+"cmdbench [rounds]"
+Times Cmd_Exists against the linear walk of cmd_functions it replaced,
+looking up every command and a missing name for each
+============
+*/
+#define	BENCH_NAMELEN	64
+
+void Cmd_Bench_f (void)
+{
+	cmd_function_t	*cmd, *found;
+	char			*names;
+	int				i, r, count, rounds, lookups;
+	int				hashhits, linearhits;
+	unsigned		start, hashtime, lineartime;
+
+	rounds = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 1000;
+	if (rounds < 1)
+		rounds = 1;
+
+	count = GetCmdCount ();
+
+	// every name, then every name with a character appended
+	names = Z_Malloc (count * 2 * BENCH_NAMELEN);
+	for (i = 0, cmd = cmd_functions ; cmd ; cmd = cmd->next, i++)
+	{
+		Q_strncpyz (names + i * BENCH_NAMELEN, cmd->name, BENCH_NAMELEN);
+		Com_sprintf (names + (count + i) * BENCH_NAMELEN, BENCH_NAMELEN, "%s#", cmd->name);
+	}
+	lookups = count * 2 * rounds;
+
+	hashhits = 0;
+	start = Sys_Microseconds ();
+	for (r = 0 ; r < rounds ; r++)
+	{
+		for (i = 0 ; i < count * 2 ; i++)
+		{
+			if (Cmd_Exists (names + i * BENCH_NAMELEN))
+				hashhits++;
+		}
+	}
+	hashtime = Sys_Microseconds () - start;
+
+	linearhits = 0;
+	start = Sys_Microseconds ();
+	for (r = 0 ; r < rounds ; r++)
+	{
+		for (i = 0 ; i < count * 2 ; i++)
+		{
+			for (found = cmd_functions ; found ; found = found->next)
+			{
+				if (!strcmp (names + i * BENCH_NAMELEN, found->name))
+					break;
+			}
+			if (found)
+				linearhits++;
+		}
+	}
+	lineartime = Sys_Microseconds () - start;
+
+	Z_Free (names);
+
+	Com_Printf ("%i commands, %i lookups, %i / %i found\n", count, lookups, hashhits, linearhits);
+	Com_Printf ("hashed %.1f ms, %.2f M/s\n", hashtime * 0.001f, lookups / (hashtime + 1.0f));
+	Com_Printf ("linear %.1f ms, %.2f M/s\n", lineartime * 0.001f, lookups / (lineartime + 1.0f));
+}
+
 /*
 ============
 Cmd_Init
@@ -994,6 +1090,7 @@ void Cmd_Init (void)
 	Cmd_AddCommand ("alias",Cmd_Alias_f);
 	Cmd_AddCommand ("wait", Cmd_Wait_f);
 	Cmd_AddCommand ("flushlog", Cmd_Flushlog_f); /* FS: Added */
+	Cmd_AddCommand ("cmdbench", Cmd_Bench_f);
 }
 
 void Cmd_Shutdown(void)
@@ -1022,6 +1119,11 @@ void Cmd_Shutdown(void)
 		Z_Free(cmd);
 		cmd = NULL;
 	}
+
+	cmd_alias = NULL;
+	cmd_functions = NULL;
+	memset (cmd_alias_hash, 0, sizeof(cmd_alias_hash));
+	memset (cmd_hash, 0, sizeof(cmd_hash));
 }
 
 void Cmd_Flushlog_f (void) /* FS: clear the logfile */
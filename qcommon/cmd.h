@@ -3,9 +3,12 @@
 
 #define	MAX_ALIAS_NAME	32
 
+#define	CMD_HASH_SIZE	512		// must be a power of two
+
 typedef struct cmdalias_s
 {
 	struct cmdalias_s	*next;
+	struct cmdalias_s	*hash_next;
 	char	name[MAX_ALIAS_NAME];
 	char	*value;
 } cmdalias_t;
@@ -13,6 +16,7 @@ typedef struct cmdalias_s
 typedef struct cmd_function_s
 {
 	struct cmd_function_s	*next;
+	struct cmd_function_s	*hash_next;
 	char					*name;
 	xcommand_t				function;
 } cmd_function_t;
@@ -47,7 +47,6 @@ typedef struct
 	int			contents;
 	int			numsides;
 	int			firstbrushside;
-	int			checkcount;		// to avoid repeated testings
 } cbrush_t;
 
 typedef struct
@@ -58,7 +57,6 @@ typedef struct
 	int		floodvalid;
 } carea_t;
 
-int			checkcount;
 
 char		map_name[MAX_QPATH];
 
@@ -110,9 +108,12 @@ qboolean	portalopen[MAX_MAP_AREAPORTALS];
 
 
 cvar_t		*map_noareas;
+cvar_t		*cm_viscache;
 
 void	CM_InitBoxHull (void);
 void	FloodAreaConnections (void);
+void	CM_BuildVisCache (void);
+void	CM_FreeVisCache (void);
 
 
 int		c_pointcontents;
@@ -605,6 +606,8 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 	static unsigned	last_checksum;
 
 	map_noareas = Cvar_Get ("map_noareas", "0", 0);
+	cm_viscache = Cvar_Get ("cm_viscache", "8192", 0);
+	Cvar_SetDescription("cm_viscache", "Kilobytes that may be used to keep the PVS and PHS of every cluster decompressed.  0 decompresses them on every lookup.  Takes effect on the next map load.");
 	/* FS: Check to see if entfile changed.  ->modified isn't working right, so I'll half ass this. */
 	if ((sv_entfile->intValue >= 1 && entToggle == false) || (sv_entfile->intValue == 0 && entToggle == true)) // Knightmare:  Logic adjustment
 		map_name[0] = 0;
@@ -635,6 +638,7 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 	numentitychars = 0;
 	map_entitystring[0] = 0;
 	map_name[0] = 0;
+	CM_FreeVisCache ();
 
 	if (!name || !name[0])
 	{
@@ -684,6 +688,7 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 
 	FS_FreeFile (buf);
 
+	CM_BuildVisCache ();
 	CM_InitBoxHull ();
 
 	memset (portalopen, 0, sizeof(portalopen));
@@ -908,12 +913,15 @@ CM_BoxLeafnums
 Fills in a list of all the leafs touched
 =============
 */
-int		leaf_count, leaf_maxcount;
-int		*leaf_list;
-float	*leaf_mins, *leaf_maxs;
-int		leaf_topnode;
+typedef struct
+{
+	int		count, maxcount;
+	int		*list;
+	float	*mins, *maxs;
+	int		topnode;
+} leafsearch_t;
 
-void CM_BoxLeafnums_r (int nodenum)
+void CM_BoxLeafnums_r (leafsearch_t *ls, int nodenum)
 {
 	cplane_t	*plane;
 	cnode_t		*node;
@@ -923,28 +931,28 @@ void CM_BoxLeafnums_r (int nodenum)
 	{
 		if (nodenum < 0)
 		{
-			if (leaf_count >= leaf_maxcount)
+			if (ls->count >= ls->maxcount)
 			{
 //				Com_Printf ("CM_BoxLeafnums_r: overflow\n");
 				return;
 			}
-			leaf_list[leaf_count++] = -1 - nodenum;
+			ls->list[ls->count++] = -1 - nodenum;
 			return;
 		}
 	
 		node = &map_nodes[nodenum];
 		plane = node->plane;
-//		s = BoxOnPlaneSide (leaf_mins, leaf_maxs, plane);
-		s = BOX_ON_PLANE_SIDE(leaf_mins, leaf_maxs, plane);
+//		s = BoxOnPlaneSide (ls->mins, ls->maxs, plane);
+		s = BOX_ON_PLANE_SIDE(ls->mins, ls->maxs, plane);
 		if (s == 1)
 			nodenum = node->children[0];
 		else if (s == 2)
 			nodenum = node->children[1];
 		else
 		{	// go down both
-			if (leaf_topnode == -1)
-				leaf_topnode = nodenum;
-			CM_BoxLeafnums_r (node->children[0]);
+			if (ls->topnode == -1)
+				ls->topnode = nodenum;
+			CM_BoxLeafnums_r (ls, node->children[0]);
 			nodenum = node->children[1];
 		}
 
@@ -953,20 +961,22 @@ void CM_BoxLeafnums_r (int nodenum)
 
 int	CM_BoxLeafnums_headnode (vec3_t mins, vec3_t maxs, int *list, int listsize, int headnode, int *topnode)
 {
-	leaf_list = list;
-	leaf_count = 0;
-	leaf_maxcount = listsize;
-	leaf_mins = mins;
-	leaf_maxs = maxs;
+	leafsearch_t	ls;
+
+	ls.list = list;
+	ls.count = 0;
+	ls.maxcount = listsize;
+	ls.mins = mins;
+	ls.maxs = maxs;
 
-	leaf_topnode = -1;
+	ls.topnode = -1;
 
-	CM_BoxLeafnums_r (headnode);
+	CM_BoxLeafnums_r (&ls, headnode);
 
 	if (topnode)
-		*topnode = leaf_topnode;
+		*topnode = ls.topnode;
 
-	return leaf_count;
+	return ls.count;
 }
 
 int	CM_BoxLeafnums (vec3_t mins, vec3_t maxs, int *list, int listsize, int *topnode)
@@ -1042,20 +1052,53 @@ BOX TRACING
 // 1/32 epsilon to keep floating point happy
 #define	DIST_EPSILON	(0.03125)
 
-vec3_t	trace_start, trace_end;
-vec3_t	trace_mins, trace_maxs;
-vec3_t	trace_extents;
+/*
+All the state of a trace lives in a cmtrace_t, so traces through different
+contexts can run at the same time.  CM_BoxTrace and CM_TransformedBoxTrace
+use a context of their own and stay main thread only.
+*/
+struct cmtrace_s
+{
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	vec3_t		extents;
+
+	trace_t		trace;
+	int			contents;
+	qboolean	ispoint;		// optimized case
 
-trace_t	trace_trace;
-int		trace_contents;
-qboolean	trace_ispoint;		// optimized case
+	int			checkcount;
+	int			brushchecks[MAX_MAP_BRUSHES];	// to avoid repeated testings
+};
+
+static cmtrace_t	cm_trace;
+
+/*
+================
+CM_AllocTraceContext
+================
+*/
+cmtrace_t *CM_AllocTraceContext (void)
+{
+	return Z_Malloc (sizeof(cmtrace_t));
+}
+
+/*
+================
+CM_FreeTraceContext
+================
+*/
+void CM_FreeTraceContext (cmtrace_t *tr)
+{
+	Z_Free (tr);
+}
 
 /*
 ================
 CM_ClipBoxToBrush
 ================
 */
-void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
+void CM_ClipBoxToBrush (cmtrace_t *tr, vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 					  trace_t *trace, cbrush_t *brush)
 {
 	int			i, j;
@@ -1075,7 +1118,8 @@ void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 	if (!brush->numsides)
 		return;
 
-	c_brush_traces++;
+	if (tr == &cm_trace)
+		c_brush_traces++;
 
 	getout = false;
 	startout = false;
@@ -1088,7 +1132,7 @@ void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 
 		// FIXME: special case for axial
 
-		if (!trace_ispoint)
+		if (!tr->ispoint)
 		{	// general box case
 
 			// push the plane out apropriately for mins/maxs
@@ -1224,7 +1268,7 @@ void CM_TestBoxInBrush (vec3_t mins, vec3_t maxs, vec3_t p1,
 CM_TraceToLeaf
 ================
 */
-void CM_TraceToLeaf (int leafnum)
+void CM_TraceToLeaf (cmtrace_t *tr, int leafnum)
 {
 	int			k;
 	int			brushnum;
@@ -1232,21 +1276,21 @@ void CM_TraceToLeaf (int leafnum)
 	cbrush_t	*b;
 
 	leaf = &map_leafs[leafnum];
-	if ( !(leaf->contents & trace_contents))
+	if ( !(leaf->contents & tr->contents))
 		return;
 	// trace line against all brushes in the leaf
 	for (k=0 ; k<leaf->numleafbrushes ; k++)
 	{
 		brushnum = map_leafbrushes[leaf->firstleafbrush+k];
 		b = &map_brushes[brushnum];
-		if (b->checkcount == checkcount)
+		if (tr->brushchecks[brushnum] == tr->checkcount)
 			continue;	// already checked this brush in another leaf
-		b->checkcount = checkcount;
+		tr->brushchecks[brushnum] = tr->checkcount;
 
-		if ( !(b->contents & trace_contents))
+		if ( !(b->contents & tr->contents))
 			continue;
-		CM_ClipBoxToBrush (trace_mins, trace_maxs, trace_start, trace_end, &trace_trace, b);
-		if (!trace_trace.fraction)
+		CM_ClipBoxToBrush (tr, tr->mins, tr->maxs, tr->start, tr->end, &tr->trace, b);
+		if (!tr->trace.fraction)
 			return;
 	}
 
@@ -1258,7 +1302,7 @@ void CM_TraceToLeaf (int leafnum)
 CM_TestInLeaf
 ================
 */
-void CM_TestInLeaf (int leafnum)
+void CM_TestInLeaf (cmtrace_t *tr, int leafnum)
 {
 	int			k;
 	int			brushnum;
@@ -1266,21 +1310,21 @@ void CM_TestInLeaf (int leafnum)
 	cbrush_t	*b;
 
 	leaf = &map_leafs[leafnum];
-	if ( !(leaf->contents & trace_contents))
+	if ( !(leaf->contents & tr->contents))
 		return;
 	// trace line against all brushes in the leaf
 	for (k=0 ; k<leaf->numleafbrushes ; k++)
 	{
 		brushnum = map_leafbrushes[leaf->firstleafbrush+k];
 		b = &map_brushes[brushnum];
-		if (b->checkcount == checkcount)
+		if (tr->brushchecks[brushnum] == tr->checkcount)
 			continue;	// already checked this brush in another leaf
-		b->checkcount = checkcount;
+		tr->brushchecks[brushnum] = tr->checkcount;
 
-		if ( !(b->contents & trace_contents))
+		if ( !(b->contents & tr->contents))
 			continue;
-		CM_TestBoxInBrush (trace_mins, trace_maxs, trace_start, &trace_trace, b);
-		if (!trace_trace.fraction)
+		CM_TestBoxInBrush (tr->mins, tr->maxs, tr->start, &tr->trace, b);
+		if (!tr->trace.fraction)
 			return;
 	}
 
@@ -1293,7 +1337,7 @@ CM_RecursiveHullCheck
 
 ==================
 */
-void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
+void CM_RecursiveHullCheck (cmtrace_t *tr, int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 {
 	cnode_t		*node;
 	cplane_t	*plane;
@@ -1305,13 +1349,13 @@ void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	int			side;
 	float		midf;
 
-	if (trace_trace.fraction <= p1f)
+	if (tr->trace.fraction <= p1f)
 		return;		// already hit something nearer
 
 	// if < 0, we are in a leaf node
 	if (num < 0)
 	{
-		CM_TraceToLeaf (-1-num);
+		CM_TraceToLeaf (tr, -1-num);
 		return;
 	}
 
@@ -1326,36 +1370,36 @@ void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	{
 		t1 = p1[plane->type] - plane->dist;
 		t2 = p2[plane->type] - plane->dist;
-		offset = trace_extents[plane->type];
+		offset = tr->extents[plane->type];
 	}
 	else
 	{
 		t1 = DotProduct (plane->normal, p1) - plane->dist;
 		t2 = DotProduct (plane->normal, p2) - plane->dist;
-		if (trace_ispoint)
+		if (tr->ispoint)
 			offset = 0;
 		else
-			offset = fabs(trace_extents[0]*plane->normal[0]) +
-				fabs(trace_extents[1]*plane->normal[1]) +
-				fabs(trace_extents[2]*plane->normal[2]);
+			offset = fabs(tr->extents[0]*plane->normal[0]) +
+				fabs(tr->extents[1]*plane->normal[1]) +
+				fabs(tr->extents[2]*plane->normal[2]);
 	}
 
 
 #if 0
-CM_RecursiveHullCheck (node->children[0], p1f, p2f, p1, p2);
-CM_RecursiveHullCheck (node->children[1], p1f, p2f, p1, p2);
+CM_RecursiveHullCheck (tr, node->children[0], p1f, p2f, p1, p2);
+CM_RecursiveHullCheck (tr, node->children[1], p1f, p2f, p1, p2);
 return;
 #endif
 
 	// see which sides we need to consider
 	if (t1 >= offset && t2 >= offset)
 	{
-		CM_RecursiveHullCheck (node->children[0], p1f, p2f, p1, p2);
+		CM_RecursiveHullCheck (tr, node->children[0], p1f, p2f, p1, p2);
 		return;
 	}
 	if (t1 < -offset && t2 < -offset)
 	{
-		CM_RecursiveHullCheck (node->children[1], p1f, p2f, p1, p2);
+		CM_RecursiveHullCheck (tr, node->children[1], p1f, p2f, p1, p2);
 		return;
 	}
 
@@ -1391,7 +1435,7 @@ return;
 	for (i=0 ; i<3 ; i++)
 		mid[i] = p1[i] + frac*(p2[i] - p1[i]);
 
-	CM_RecursiveHullCheck (node->children[side], p1f, midf, p1, mid);
+	CM_RecursiveHullCheck (tr, node->children[side], p1f, midf, p1, mid);
 
 
 	// go past the node
@@ -1404,7 +1448,7 @@ return;
 	for (i=0 ; i<3 ; i++)
 		mid[i] = p1[i] + frac2*(p2[i] - p1[i]);
 
-	CM_RecursiveHullCheck (node->children[side^1], midf, p2f, mid, p2);
+	CM_RecursiveHullCheck (tr, node->children[side^1], midf, p2f, mid, p2);
 }
 
 
@@ -1413,32 +1457,33 @@ return;
 
 /*
 ==================
-CM_BoxTrace
+CM_ContextBoxTrace
 ==================
 */
-trace_t		CM_BoxTrace (vec3_t start, vec3_t end,
+trace_t		CM_ContextBoxTrace (cmtrace_t *tr, vec3_t start, vec3_t end,
 						  vec3_t mins, vec3_t maxs,
 						  int headnode, int brushmask)
 {
 	int		i;
 
-	checkcount++;		// for multi-check avoidance
+	tr->checkcount++;	// for multi-check avoidance
 
-	c_traces++;			// for statistics, may be zeroed
+	if (tr == &cm_trace)
+		c_traces++;		// for statistics, may be zeroed; main thread only
 
 	// fill in a default trace
-	memset (&trace_trace, 0, sizeof(trace_trace));
-	trace_trace.fraction = 1;
-	trace_trace.surface = &(nullsurface.c);
+	memset (&tr->trace, 0, sizeof(tr->trace));
+	tr->trace.fraction = 1;
+	tr->trace.surface = &(nullsurface.c);
 
 	if (!numnodes)	// map not loaded
-		return trace_trace;
+		return tr->trace;
 
-	trace_contents = brushmask;
-	VectorCopy (start, trace_start);
-	VectorCopy (end, trace_end);
-	VectorCopy (mins, trace_mins);
-	VectorCopy (maxs, trace_maxs);
+	tr->contents = brushmask;
+	VectorCopy (start, tr->start);
+	VectorCopy (end, tr->end);
+	VectorCopy (mins, tr->mins);
+	VectorCopy (maxs, tr->maxs);
 
 	//
 	// check for position test special case
@@ -1461,12 +1506,12 @@ trace_t		CM_BoxTrace (vec3_t start, vec3_t end,
 		numleafs = CM_BoxLeafnums_headnode (c1, c2, leafs, 1024, headnode, &topnode);
 		for (i=0 ; i<numleafs ; i++)
 		{
-			CM_TestInLeaf (leafs[i]);
-			if (trace_trace.allsolid)
+			CM_TestInLeaf (tr, leafs[i]);
+			if (tr->trace.allsolid)
 				break;
 		}
-		VectorCopy (start, trace_trace.endpos);
-		return trace_trace;
+		VectorCopy (start, tr->trace.endpos);
+		return tr->trace;
 	}
 
 	//
@@ -1475,38 +1520,50 @@ trace_t		CM_BoxTrace (vec3_t start, vec3_t end,
 	if (mins[0] == 0 && mins[1] == 0 && mins[2] == 0
 		&& maxs[0] == 0 && maxs[1] == 0 && maxs[2] == 0)
 	{
-		trace_ispoint = true;
-		VectorClear (trace_extents);
+		tr->ispoint = true;
+		VectorClear (tr->extents);
 	}
 	else
 	{
-		trace_ispoint = false;
-		trace_extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
-		trace_extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
-		trace_extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
+		tr->ispoint = false;
+		tr->extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
+		tr->extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
+		tr->extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
 	}
 
 	//
 	// general sweeping through world
 	//
-	CM_RecursiveHullCheck (headnode, 0, 1, start, end);
+	CM_RecursiveHullCheck (tr, headnode, 0, 1, start, end);
 
-	if (trace_trace.fraction == 1)
+	if (tr->trace.fraction == 1)
 	{
-		VectorCopy (end, trace_trace.endpos);
+		VectorCopy (end, tr->trace.endpos);
 	}
 	else
 	{
 		for (i=0 ; i<3 ; i++)
-			trace_trace.endpos[i] = start[i] + trace_trace.fraction * (end[i] - start[i]);
+			tr->trace.endpos[i] = start[i] + tr->trace.fraction * (end[i] - start[i]);
 	}
-	return trace_trace;
+	return tr->trace;
+}
+
+/*
+==================
+CM_BoxTrace
+==================
+*/
+trace_t		CM_BoxTrace (vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask)
+{
+	return CM_ContextBoxTrace (&cm_trace, start, end, mins, maxs, headnode, brushmask);
 }
 
 
 /*
 ==================
-CM_TransformedBoxTrace
+CM_ContextTransformedBoxTrace
 
 Handles offseting and rotation of the end points for moving and
 rotating entities
@@ -1516,7 +1573,7 @@ rotating entities
 #pragma optimize( "", off )
 #endif
 
-trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
+trace_t		CM_ContextTransformedBoxTrace (cmtrace_t *tr, vec3_t start, vec3_t end,
 						  vec3_t mins, vec3_t maxs,
 						  int headnode, int brushmask,
 						  vec3_t origin, vec3_t angles)
@@ -1555,7 +1612,7 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 	}
 
 	// sweep the box through the model
-	trace = CM_BoxTrace (start_l, end_l, mins, maxs, headnode, brushmask);
+	trace = CM_ContextBoxTrace (tr, start_l, end_l, mins, maxs, headnode, brushmask);
 
 	if (rotated && trace.fraction != 1.0)
 	{
@@ -1576,11 +1633,169 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 	return trace;
 }
 
+trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask,
+						  vec3_t origin, vec3_t angles)
+{
+	return CM_ContextTransformedBoxTrace (&cm_trace, start, end, mins, maxs,
+		headnode, brushmask, origin, angles);
+}
+
 #ifdef _MSC_VER
 #pragma optimize( "", on )
 #endif
 
 
+/*
+==================
+CM_TraceTest_f
+
+Fires random traces through the world and the inline models, first on
+the main thread and then split across threads with a context each, and
+reports any trace that came out different.
+"cm_tracetest [traces] [threads]"
+==================
+*/
+#define	TT_FRAND()	((rand() & 0x7fff) / ((float)0x7fff))
+#define	TT_CRAND()	(2.0f * (TT_FRAND() - 0.5f))
+
+typedef struct
+{
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	vec3_t		origin, angles;
+	int			headnode;
+	int			brushmask;
+} tracetest_t;
+
+typedef struct
+{
+	tracetest_t	*tests;
+	trace_t		*results;
+	cmtrace_t	**contexts;		// one per job, the zone isn't thread safe
+	int			count;
+	int			numjobs;
+} tracetestjobs_t;
+
+static void CM_TraceTestRun (cmtrace_t *tr, tracetest_t *t, trace_t *result)
+{
+	*result = CM_ContextTransformedBoxTrace (tr, t->start, t->end, t->mins, t->maxs,
+		t->headnode, t->brushmask, t->origin, t->angles);
+}
+
+static void CM_TraceTestJob (int job, void *arg)
+{
+	tracetestjobs_t	*jobs = arg;
+	int				i;
+
+	for (i=job ; i<jobs->count ; i+=jobs->numjobs)
+		CM_TraceTestRun (jobs->contexts[job], &jobs->tests[i], &jobs->results[i]);
+}
+
+static qboolean CM_TracesMatch (trace_t *a, trace_t *b)
+{
+	return a->allsolid == b->allsolid && a->startsolid == b->startsolid
+		&& a->fraction == b->fraction && VectorCompare (a->endpos, b->endpos)
+		&& VectorCompare (a->plane.normal, b->plane.normal) && a->plane.dist == b->plane.dist
+		&& a->surface == b->surface && a->contents == b->contents;
+}
+
+void CM_TraceTest_f (void)
+{
+	tracetestjobs_t	jobs;
+	tracetest_t		*t;
+	trace_t			*serial;
+	cmodel_t		*world, *model;
+	unsigned		start, serialtime, paralleltime;
+	int				i, j, numthreads, mismatches;
+
+	if (!numnodes)
+	{
+		Com_Printf ("No map loaded.\n");
+		return;
+	}
+
+	jobs.count = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100000;
+	numthreads = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 4;
+	if (jobs.count < 1)
+		jobs.count = 1;
+	if (numthreads < 1)
+		numthreads = 1;
+	jobs.numjobs = numthreads * 4;
+
+	jobs.tests = Z_Malloc (jobs.count * sizeof(tracetest_t));
+	jobs.results = Z_Malloc (jobs.count * sizeof(trace_t));
+	serial = Z_Malloc (jobs.count * sizeof(trace_t));
+
+	// a mix of point, box and position traces against the world and bmodels
+	world = &map_cmodels[0];
+	for (i=0, t=jobs.tests ; i<jobs.count ; i++, t++)
+	{
+		model = &map_cmodels[rand() % numcmodels];
+		for (j=0 ; j<3 ; j++)
+		{
+			t->start[j] = world->mins[j] + TT_FRAND() * (world->maxs[j] - world->mins[j]);
+			t->end[j] = t->start[j] + TT_CRAND() * 512;
+			if (model != world)
+			{
+				t->origin[j] = TT_CRAND() * 64;
+				t->angles[j] = (rand() & 3) ? 0 : TT_FRAND() * 360;
+			}
+		}
+		switch (rand() % 4)
+		{
+		case 0:
+			break;
+		case 1:
+			VectorCopy (t->start, t->end);	// intentional fallthrough, a box position test
+		default:
+			VectorSet (t->mins, -16, -16, -24);
+			VectorSet (t->maxs, 16, 16, 32);
+			break;
+		}
+		t->headnode = model->headnode;
+		t->brushmask = (rand() & 1) ? MASK_PLAYERSOLID : MASK_SHOT;
+	}
+
+	start = Sys_Microseconds ();
+	for (i=0 ; i<jobs.count ; i++)
+		CM_TraceTestRun (&cm_trace, &jobs.tests[i], &serial[i]);
+	serialtime = Sys_Microseconds () - start;
+
+	jobs.contexts = Z_Malloc (jobs.numjobs * sizeof(cmtrace_t *));
+	for (i=0 ; i<jobs.numjobs ; i++)
+		jobs.contexts[i] = CM_AllocTraceContext ();
+
+	start = Sys_Microseconds ();
+	Com_RunJobs (jobs.numjobs, CM_TraceTestJob, &jobs, numthreads);
+	paralleltime = Sys_Microseconds () - start;
+
+	for (i=0 ; i<jobs.numjobs ; i++)
+		CM_FreeTraceContext (jobs.contexts[i]);
+	Z_Free (jobs.contexts);
+
+	mismatches = 0;
+	for (i=0 ; i<jobs.count ; i++)
+	{
+		if (CM_TracesMatch (&serial[i], &jobs.results[i]))
+			continue;
+		if (++mismatches <= 10)
+			Com_Printf ("trace %i: fraction %g / %g, contents %i / %i\n", i,
+				serial[i].fraction, jobs.results[i].fraction,
+				serial[i].contents, jobs.results[i].contents);
+	}
+
+	Com_Printf ("%i traces, %i mismatches\n", jobs.count, mismatches);
+	Com_Printf ("serial %.1f ms, %i threads %.1f ms\n", serialtime * 0.001f,
+		numthreads, paralleltime * 0.001f);
+
+	Z_Free (serial);
+	Z_Free (jobs.results);
+	Z_Free (jobs.tests);
+}
+
+
 /*
 ===============================================================================
 
@@ -1636,25 +1851,107 @@ void CM_DecompressVis (byte *in, byte *out)
 	} while (out_p - out < row);
 }
 
-byte	pvsrow[MAX_MAP_LEAFS/8];
-byte	phsrow[MAX_MAP_LEAFS/8];
+/*
+The rows of every cluster are decompressed once at map load when they fit
+in cm_viscache, so lookups return stable pointers that can be held across
+calls.  Otherwise each lookup decompresses into the next of a few rotating
+rows.  Rows are padded to a multiple of four bytes and must not be written.
+*/
+
+#define	CM_VISROWS	4
+
+static byte	*cm_pvscache;			// [numclusters][cm_visrowbytes]
+static byte	*cm_phscache;
+static int	cm_visrowbytes;
+
+static byte	cm_nullrow[MAX_MAP_LEAFS/8];
+static byte	pvsrows[CM_VISROWS][MAX_MAP_LEAFS/8];
+static byte	phsrows[CM_VISROWS][MAX_MAP_LEAFS/8];
+static int	pvsrownum, phsrownum;
+
+void CM_FreeVisCache (void)
+{
+	if (cm_pvscache)
+		Z_Free (cm_pvscache);
+	if (cm_phscache)
+		Z_Free (cm_phscache);
+	cm_pvscache = cm_phscache = NULL;
+}
+
+static byte *CM_DecompressCache (int ofs)
+{
+	byte	*cache, *row;
+	int		i;
+
+	cache = Z_Malloc (numclusters * cm_visrowbytes);
+	for (i=0, row=cache ; i<numclusters ; i++, row+=cm_visrowbytes)
+		CM_DecompressVis (map_visibility + map_vis->bitofs[i][ofs], row);
+	return cache;
+}
+
+/*
+===================
+CM_BuildVisCache
+
+The PVS is cached first, as it is looked up for every client each frame
+===================
+*/
+void CM_BuildVisCache (void)
+{
+	int		size, budget;
+
+	CM_FreeVisCache ();
+
+	cm_visrowbytes = ((numclusters+31)>>5)<<2;
+	if (!numvisibility)
+		return;		// every row is all visible
+
+	size = numclusters * cm_visrowbytes;
+	budget = cm_viscache->intValue * 1024;
+	if (size <= budget)
+	{
+		cm_pvscache = CM_DecompressCache (DVIS_PVS);
+		budget -= size;
+	}
+	if (size <= budget)
+		cm_phscache = CM_DecompressCache (DVIS_PHS);
+
+	if (cm_pvscache && cm_phscache)
+		Com_DPrintf (DEVELOPER_MSG_STANDARD, "PVS/PHS cache: %i clusters, %i KB\n", numclusters, (size*2 + 1023) / 1024);
+	else
+		Com_Printf ("PVS/PHS cache: %i clusters need %i KB, cm_viscache is %i KB; %s\n",
+			numclusters, (size*2 + 1023) / 1024, cm_viscache->intValue,
+			cm_pvscache ? "only the PVS is cached" : "decompressing on demand");
+}
 
 byte	*CM_ClusterPVS (int cluster)
 {
+	byte	*row;
+
 	if (cluster == -1)
-		memset (pvsrow, 0, (numclusters+7)>>3);
-	else
-		CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][DVIS_PVS], pvsrow);
-	return pvsrow;
+		return cm_nullrow;
+	if (cm_pvscache)
+		return cm_pvscache + cluster*cm_visrowbytes;
+
+	row = pvsrows[pvsrownum];
+	pvsrownum = (pvsrownum + 1) & (CM_VISROWS-1);
+	CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][DVIS_PVS], row);
+	return row;
 }
 
 byte	*CM_ClusterPHS (int cluster)
 {
+	byte	*row;
+
 	if (cluster == -1)
-		memset (phsrow, 0, (numclusters+7)>>3);
-	else
-		CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][DVIS_PHS], phsrow);
-	return phsrow;
+		return cm_nullrow;
+	if (cm_phscache)
+		return cm_phscache + cluster*cm_visrowbytes;
+
+	row = phsrows[phsrownum];
+	phsrownum = (phsrownum + 1) & (CM_VISROWS-1);
+	CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][DVIS_PHS], row);
+	return row;
 }
 
 
@@ -1782,25 +2079,27 @@ int CM_WriteAreaBits (byte *buffer, int area)
 ===================
 CM_WritePortalState
 
-Writes the portal state to a savegame file
+Writes the portal state to a savegame buffer
 ===================
 */
-void	CM_WritePortalState (FILE *f)
+void	CM_WritePortalState (sizebuf_t *buf)
 {
-	fwrite (portalopen, sizeof(portalopen), 1, f);
+	SZ_Write (buf, portalopen, sizeof(portalopen));
 }
 
 /*
 ===================
 CM_ReadPortalState
 
-Reads the portal state from a savegame file
+Reads the portal state from a savegame buffer
 and recalculates the area connections
 ===================
 */
-void	CM_ReadPortalState (FILE *f)
+void	CM_ReadPortalState (sizebuf_t *msg)
 {
-	FS_Read (portalopen, sizeof(portalopen), f);
+	if (msg->readcount + (int)sizeof(portalopen) > msg->cursize)
+		Com_Error (ERR_DROP, "CM_ReadPortalState: savegame is too short");
+	MSG_ReadData (msg, portalopen, sizeof(portalopen));
 	FloodAreaConnections ();
 }
 
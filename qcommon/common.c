@@ -21,6 +21,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <setjmp.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdarg.h>
 #include <limits.h>
 #include <errno.h>
@@ -519,9 +520,10 @@ MSG_WriteDeltaEntity
 
 Writes part of a packetentities message.
 Can delta from either a baseline or a previous packet_entity
+Returns the U_* bits of the update
 ==================
 */
-void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, qboolean newentity)
+int MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, qboolean newentity)
 {
 	int		bits;
 
@@ -614,7 +616,7 @@ void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *
 	// write the message
 	//
 	if (!bits && !force)
-		return;		// nothing to send!
+		return 0;		// nothing to send!
 
 	//----------
 
@@ -713,6 +715,8 @@ void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *
 		MSG_WriteByte (msg, to->event);
 	if (bits & U_SOLID)
 		MSG_WriteShort (msg, to->solid);
+
+	return bits;
 }
 
 
@@ -1095,6 +1099,31 @@ char *CopyString (char *in)
 	return out;
 }
 
+/*
+================
+Com_HashKey
+
+Case insensitive string hash, so names that only differ in
+case land in the same bucket.  size must be a power of two.
+================
+*/
+unsigned Com_HashKey (const char *name, int size)
+{
+	unsigned	hash;
+	int			c;
+
+	hash = 0;
+	while (*name)
+	{
+		c = *name++;
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		hash = hash * 31 + c;
+	}
+
+	return (hash ^ (hash >> 10) ^ (hash >> 20)) & (size - 1);
+}
+
 
 void Info_Print (char *s)
 {
@@ -1145,25 +1174,122 @@ void Info_Print (char *s)
 
 						ZONE MEMORY ALLOCATION
 
-just cleared malloc with counters now...
+Every tag gets its own pool.  Small blocks with a non-zero tag are carved
+out of zero-filled arena pages with a bump pointer, so Z_FreeTags on a
+level or game tag only has to release the pool's pages and its few large
+blocks instead of walking every allocation in the zone.  Tag 0 and large
+blocks are plain cleared malloc with counters.
+
+z_debug guards the bytes after each new block, which are checked and the
+block poisoned when it is freed.
 
 ==============================================================================
 */
 
 #define	Z_MAGIC		0x1d1d
+#define	Z_MAGIC_GUARD	0x1d1e		// block has guard bytes after its data
+#define	Z_GUARD		0xfd
+#define	Z_POISON	0xdd
 
+#define	Z_PAGE_SIZE	0x10000
+#define	Z_SMALL_MAX	1024		// largest block taken from arena pages, header included
+#define	Z_ALIGN		16
 
+// the game dlls' func_clock reads the fields from prev on as its own copy
+// of the original header, right before the data, so they have to stay
+// last and size has to keep its old meaning
 typedef struct zhead_s
 {
-	struct zhead_s	*prev, *next;
+	struct zpage_s	*page;			// NULL if the block was malloced
+	int		blocksize;		// header, padding and guard included
+	struct zhead_s	*prev, *next;	// pool chain, large blocks only
 	short	magic;
 	short	tag;			// for group free
-	int		size;
+	int		size;			// bytes asked for + Z_OLDHEAD
 } zhead_t;
 
-zhead_t		z_chain;
+#define	Z_OLDHEAD	(sizeof(zhead_t) - offsetof(zhead_t, prev))
+
+typedef struct zpage_s
+{
+	struct zpage_s	*prev, *next;
+	struct zpool_s	*pool;
+	int		used;			// bump offset from the start of the page
+	int		live;			// blocks in this page not freed yet
+} zpage_t;
+
+#define	Z_PAGE_DATA	((sizeof(zpage_t) + Z_ALIGN - 1) & ~(Z_ALIGN - 1))
+
+typedef struct zpool_s
+{
+	struct zpool_s	*next;
+	int		tag;
+	zhead_t	chain;			// large blocks
+	zpage_t	*pages;			// current bump page is first
+	int		count, bytes;	// live blocks and bytes, headers included
+	int		numpages;
+	int		pagecount, pagebytes;	// the part of count and bytes living in pages
+} zpool_t;
+
+static zpool_t	*z_pools;
+static zpool_t	*z_lastpool;
+static cvar_t	*z_debug;
 int		z_count, z_bytes;
 
+/*
+========================
+Z_GetPool
+
+Returns the pool for tag, creating it if create is set.
+========================
+*/
+static zpool_t *Z_GetPool (int tag, qboolean create)
+{
+	zpool_t	*pool;
+
+	if (z_lastpool && z_lastpool->tag == tag)
+		return z_lastpool;
+
+	for (pool = z_pools ; pool ; pool = pool->next)
+	{
+		if (pool->tag == tag)
+		{
+			z_lastpool = pool;
+			return pool;
+		}
+	}
+
+	if (!create)
+		return NULL;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		Com_Error (ERR_FATAL, "Z_GetPool: failed on allocation of tag %i", tag);
+	pool->tag = tag;
+	pool->chain.next = pool->chain.prev = &pool->chain;
+	pool->next = z_pools;
+	z_pools = pool;
+	z_lastpool = pool;
+	return pool;
+}
+
+/*
+========================
+Z_FreePage
+========================
+*/
+static void Z_FreePage (zpool_t *pool, zpage_t *page)
+{
+	if (page->prev)
+		page->prev->next = page->next;
+	else
+		pool->pages = page->next;
+	if (page->next)
+		page->next->prev = page->prev;
+	pool->numpages--;
+	free (page);
+}
+
 /*
 ========================
 Z_Free
@@ -1172,17 +1298,66 @@ Z_Free
 void Z_Free (void *ptr)
 {
 	zhead_t	*z;
+	zpool_t	*pool;
+	zpage_t	*page;
+	byte	*guard;
+	int		size, i, n;
 
 	z = ((zhead_t *)ptr) - 1;
 
-	if (z->magic != Z_MAGIC)
+	if (z->magic == Z_MAGIC_GUARD)
+	{	// the last byte counts the guard bytes between the data and the end
+		guard = (byte *)z + z->blocksize;
+		n = guard[-1];
+		if (n < 4 || n > z->blocksize - (int)sizeof(zhead_t))
+			Com_Error (ERR_FATAL, "Z_Free: block of %i bytes with tag %i overwritten", z->blocksize, z->tag);
+		for (i = 2 ; i <= n ; i++)
+		{
+			if (guard[-i] != Z_GUARD)
+				Com_Error (ERR_FATAL, "Z_Free: block of %i bytes with tag %i overwritten", z->blocksize, z->tag);
+		}
+	}
+	else if (z->magic != Z_MAGIC)
 		Com_Error (ERR_FATAL, "Z_Free: bad magic");
 
+	size = z->blocksize;
+	page = z->page;
+	pool = page ? page->pool : Z_GetPool (z->tag, false);
+	if (!pool)
+		Com_Error (ERR_FATAL, "Z_Free: no pool for tag %i", z->tag);
+
+	z_count--;
+	z_bytes -= size;
+	pool->count--;
+	pool->bytes -= size;
+
+	if (page)
+	{
+		pool->pagecount--;
+		pool->pagebytes -= size;
+		if (z->magic == Z_MAGIC_GUARD)
+			memset (z, Z_POISON, size);
+		else
+			z->magic = 0;
+
+		if (--page->live)
+			return;
+
+		if (page == pool->pages)
+		{	// rewind the bump page, it has to read back as zeros
+			memset ((byte *)page + Z_PAGE_DATA, 0, page->used - Z_PAGE_DATA);
+			page->used = Z_PAGE_DATA;
+		}
+		else
+			Z_FreePage (pool, page);
+		return;
+	}
+
 	z->prev->next = z->next;
 	z->next->prev = z->prev;
 
-	z_count--;
-	z_bytes -= z->size;
+	if (z->magic == Z_MAGIC_GUARD)
+		memset (z, Z_POISON, size);
 	free (z);
 }
 
@@ -1194,7 +1369,31 @@ Z_Stats_f
 */
 void Z_Stats_f (void)
 {
+	zpool_t	*pool;
+	zpage_t	*page;
+	int		reserved, bumped;
+
 	Com_Printf ("%i bytes in %i blocks\n", z_bytes, z_count);
+
+	for (pool = z_pools ; pool ; pool = pool->next)
+	{
+		if (!pool->count && !pool->numpages)
+			continue;
+
+		Com_Printf ("tag %5i: %9i bytes in %6i blocks\n", pool->tag, pool->bytes, pool->count);
+		if (!pool->numpages)
+			continue;
+
+		reserved = pool->numpages * Z_PAGE_SIZE;
+		bumped = 0;
+		for (page = pool->pages ; page ; page = page->next)
+			bumped += page->used - Z_PAGE_DATA;
+
+		// freed holes inside pages can't be reused until the page empties
+		Com_Printf ("           %i pages, %i blocks, %i live of %i used of %i reserved, %i%% fragmented\n",
+			pool->numpages, pool->pagecount, pool->pagebytes, bumped, reserved,
+			bumped ? (int)(100.0f * (bumped - pool->pagebytes) / bumped) : 0);
+	}
 }
 
 /*
@@ -1204,14 +1403,27 @@ Z_FreeTags
 */
 void Z_FreeTags (int tag)
 {
+	zpool_t	*pool;
 	zhead_t	*z, *next;
 
-	for (z=z_chain.next ; z != &z_chain ; z=next)
+	pool = Z_GetPool (tag, false);
+	if (!pool)
+		return;
+
+	while (pool->pages)
+		Z_FreePage (pool, pool->pages);
+
+	for (z=pool->chain.next ; z != &pool->chain ; z=next)
 	{
 		next = z->next;
-		if (z->tag == tag)
-			Z_Free ((void *)(z+1));
+		free (z);
 	}
+	pool->chain.next = pool->chain.prev = &pool->chain;
+
+	z_count -= pool->count;
+	z_bytes -= pool->bytes;
+	pool->count = pool->bytes = 0;
+	pool->pagecount = pool->pagebytes = 0;
 }
 
 /*
@@ -1222,25 +1434,81 @@ Z_TagMalloc
 void *Z_TagMalloc (int size, int tag)
 {
 	zhead_t	*z;
-	
+	zpool_t	*pool;
+	zpage_t	*page;
+	qboolean	guard;
+	int		datasize;
+
+	guard = z_debug && z_debug->intValue;
+
+	datasize = size;
 	size = size + sizeof(zhead_t);
-	z = malloc(size);
-	if (!z)
+	if (guard)
+		size += 4;
+	pool = Z_GetPool (tag, true);
+
+	if (tag && size <= Z_SMALL_MAX)
 	{
-		Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", size);
-		return NULL;
+		size = (size + Z_ALIGN - 1) & ~(Z_ALIGN - 1);
+		page = pool->pages;
+		if (!page || page->used + size > Z_PAGE_SIZE)
+		{
+			page = calloc(1, Z_PAGE_SIZE);
+			if (!page)
+			{
+				Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", Z_PAGE_SIZE);
+				return NULL;
+			}
+			page->pool = pool;
+			page->used = Z_PAGE_DATA;
+			page->next = pool->pages;
+			if (pool->pages)
+				pool->pages->prev = page;
+			pool->pages = page;
+			pool->numpages++;
+		}
+
+		z = (zhead_t *)((byte *)page + page->used);
+		page->used += size;
+		page->live++;
+		z->page = page;
+		pool->pagecount++;
+		pool->pagebytes += size;
+	}
+	else
+	{
+		z = malloc(size);
+		if (!z)
+		{
+			Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", size);
+			return NULL;
+		}
+		memset (z, 0, size);
+
+		z->next = pool->chain.next;
+		z->prev = &pool->chain;
+		pool->chain.next->prev = z;
+		pool->chain.next = z;
 	}
-	memset (z, 0, size);
+
 	z_count++;
 	z_bytes += size;
+	pool->count++;
+	pool->bytes += size;
 	z->magic = Z_MAGIC;
 	z->tag = tag;
-	z->size = size;
+	z->blocksize = size;
+	z->size = datasize + Z_OLDHEAD;
 
-	z->next = z_chain.next;
-	z->prev = &z_chain;
-	z_chain.next->prev = z;
-	z_chain.next = z;
+	if (guard)
+	{	// guard everything up to the end, the last byte holds the count
+		byte	*g = (byte *)(z+1) + datasize;
+		int		n = size - sizeof(zhead_t) - datasize;
+
+		z->magic = Z_MAGIC_GUARD;
+		memset (g, Z_GUARD, n - 1);
+		g[n - 1] = n;
+	}
 
 	return (void *)(z+1);
 }
@@ -1255,6 +1523,173 @@ void *Z_Malloc (int size)
 	return Z_TagMalloc (size, 0);
 }
 
+/*
+==============================================================================
+
+						WORKER THREADS
+
+A small pool of worker threads for splitting independent work items
+across cpus.  The pool is created on first use and grows to the largest
+thread count asked for.  Jobs must not call Com_Printf, Com_Error or
+anything else that touches shared engine state.
+
+==============================================================================
+*/
+
+#define	MAX_JOB_THREADS	32
+
+static void		*job_threads[MAX_JOB_THREADS];
+static int		job_numthreads;
+static void		*job_lock;			// protects everything below
+static void		*job_wake;			// posted once per worker for each batch
+static void		*job_done;			// posted when the caller is waiting on the last job
+static void		(*job_func)(int job, void *arg);
+static void		*job_arg;
+static int		job_next, job_count, job_finished;
+static qboolean	job_waiting;
+
+/*
+========================
+Com_JobThread
+========================
+*/
+static void Com_JobThread (void *unused)
+{
+	int		job;
+	void	(*func)(int job, void *arg);
+	void	*arg;
+
+	while (1)
+	{
+		Sys_WaitSemaphore (job_wake);
+
+		Sys_LockMutex (job_lock);
+		while (job_next < job_count)
+		{
+			job = job_next++;
+			func = job_func;
+			arg = job_arg;
+			Sys_UnlockMutex (job_lock);
+
+			func (job, arg);
+
+			Sys_LockMutex (job_lock);
+			job_finished++;
+			if (job_finished == job_count && job_waiting)
+			{
+				job_waiting = false;
+				Sys_PostSemaphore (job_done, 1);
+			}
+		}
+		Sys_UnlockMutex (job_lock);
+	}
+}
+
+/*
+========================
+Com_StartJobThreads
+
+Returns the number of worker threads available, which may be fewer
+than asked for (none at all on platforms without threads)
+========================
+*/
+static int Com_StartJobThreads (int numthreads)
+{
+	if (numthreads > MAX_JOB_THREADS)
+		numthreads = MAX_JOB_THREADS;
+
+	if (!job_lock)
+	{
+		job_lock = Sys_CreateMutex ();
+		job_wake = Sys_CreateSemaphore (0);
+		job_done = Sys_CreateSemaphore (0);
+		if (!job_lock || !job_wake || !job_done)
+		{
+			Sys_DestroyMutex (job_lock);
+			Sys_DestroySemaphore (job_wake);
+			Sys_DestroySemaphore (job_done);
+			job_lock = job_wake = job_done = NULL;
+			return 0;
+		}
+	}
+
+	while (job_numthreads < numthreads)
+	{
+		job_threads[job_numthreads] = Sys_CreateThread (Com_JobThread, NULL);
+		if (!job_threads[job_numthreads])
+			break;
+		job_numthreads++;
+	}
+
+	return job_numthreads;
+}
+
+/*
+========================
+Com_RunJobs
+
+Calls func for every job number from 0 to numjobs-1, using up to
+numthreads threads counting the caller, and returns when all of them
+have completed.  Runs everything on the calling thread if numthreads
+is 1 or less, or no worker threads can be started.
+========================
+*/
+void Com_RunJobs (int numjobs, void (*func)(int job, void *arg), void *arg, int numthreads)
+{
+	int		i, job, workers;
+
+	if (numjobs < 1)
+		return;
+
+	workers = 0;
+	if (numthreads > 1 && numjobs > 1)
+		workers = Com_StartJobThreads (numthreads - 1);
+
+	if (!workers)
+	{
+		for (i=0 ; i<numjobs ; i++)
+			func (i, arg);
+		return;
+	}
+
+	Sys_LockMutex (job_lock);
+	job_func = func;
+	job_arg = arg;
+	job_next = 0;
+	job_count = numjobs;
+	job_finished = 0;
+	job_waiting = false;
+	Sys_UnlockMutex (job_lock);
+
+	if (workers > numthreads - 1)
+		workers = numthreads - 1;
+	if (workers > numjobs - 1)
+		workers = numjobs - 1;
+	Sys_PostSemaphore (job_wake, workers);
+
+	// help out until the queue is empty
+	Sys_LockMutex (job_lock);
+	while (job_next < job_count)
+	{
+		job = job_next++;
+		Sys_UnlockMutex (job_lock);
+
+		func (job, arg);
+
+		Sys_LockMutex (job_lock);
+		job_finished++;
+	}
+
+	if (job_finished < job_count)
+	{	// wait for the workers still busy with the last jobs
+		job_waiting = true;
+		Sys_UnlockMutex (job_lock);
+		Sys_WaitSemaphore (job_done);
+	}
+	else
+		Sys_UnlockMutex (job_lock);
+}
+
 //============================================================================
 static byte chktbl[1024] = {
 0x84, 0x47, 0x51, 0xc1, 0x93, 0x22, 0x21, 0x24, 0x2f, 0x66, 0x60, 0x4d, 0xb0, 0x7c, 0xda,
@@ -1416,7 +1851,6 @@ void Qcommon_Init (int argc, char **argv)
 		Sys_Error ("Qcommon_Init: Error during initialization");
 	}
 
-	z_chain.next = z_chain.prev = &z_chain;
 	// prepare enough of the subsystems to handle
 	// cvar and command buffer management
 	COM_InitArgv (argc, argv);
@@ -1462,7 +1896,10 @@ void Qcommon_Init (int argc, char **argv)
 	// init commands and vars
 	//
     Cmd_AddCommand ("z_stats", Z_Stats_f);
+	z_debug = Cvar_Get ("z_debug", "0", 0);
+	Cvar_SetDescription("z_debug", "Guard new zone memory blocks against overruns and poison freed blocks.");
     Cmd_AddCommand ("error", Com_Error_f);
+	Cmd_AddCommand ("cm_tracetest", CM_TraceTest_f);
 
 	host_speeds = Cvar_Get ("host_speeds", "0", 0);
 	log_stats = Cvar_Get ("log_stats", "0", 0);
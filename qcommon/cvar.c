@@ -22,12 +22,18 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "qcommon.h"
 
 cvar_t	*cvar_vars;
+
+// every cvar is also chained off a hash bucket for fast lookups.
+// cvar_vars keeps the creation order used by completion and archiving
+#define	CVAR_HASH_SIZE	512
+static cvar_t	*cvar_hash[CVAR_HASH_SIZE];
 cvar_t	*con_show_description; /* FS */
 cvar_t	*con_show_dev_flags; /* FS */
 void Cvar_ParseDeveloperFlags (void); /* FS: Special stuff for showing all the dev flags */
 void Cvar_Force_f (void); /* FS: Force a NOSET CVAR (within reason) */
 void Cvar_Toggle_f (void); /* FS: Toggle a CVAR */
 void Cvar_Reset_f (void); /* FS: Reset a CVAR to it's default value */
+void Cvar_Bench_f (void);
 qboolean Cvar_Never_Reset_Cmds(char *var_name); /* FS: Tired of copying CVARs everywhere */
 
 /*
@@ -55,7 +61,7 @@ static cvar_t *Cvar_FindVar (char *var_name)
 {
 	cvar_t	*var;
 
-	for (var=cvar_vars ; var ; var=var->next)
+	for (var=cvar_hash[Com_HashKey (var_name, CVAR_HASH_SIZE)] ; var ; var=var->hash_next)
 		if (!strcmp (var_name, var->name))
 			return var;
 
@@ -148,6 +154,7 @@ The flags will be or'ed in if the variable exists.
 cvar_t *Cvar_Get (char *var_name, char *var_value, int flags)
 {
 	cvar_t	*var;
+	unsigned	hash;
 
 	if (flags & (CVAR_USERINFO | CVAR_SERVERINFO))
 	{
@@ -195,6 +202,9 @@ cvar_t *Cvar_Get (char *var_name, char *var_value, int flags)
 	// link the variable in
 	var->next = cvar_vars;
 	cvar_vars = var;
+	hash = Com_HashKey (var_name, CVAR_HASH_SIZE);
+	var->hash_next = cvar_hash[hash];
+	cvar_hash[hash] = var;
 
 	var->flags = flags;
 
@@ -641,6 +651,79 @@ void Cvar_List_f (void)
 	cvar_vars = (cvar_t *)head;
 }
 
+/*
+============
+Cvar_Bench_f
+
+"cvarbench [rounds]"
+Times Cvar_FindVar against the linear walk of cvar_vars it replaced,
+looking up every cvar and a missing name for each
+============
+*/
+#define	BENCH_NAMELEN	64
+
+void Cvar_Bench_f (void)
+{
+	cvar_t		*var, *found;
+	char		*names;
+	int			i, r, count, rounds, lookups;
+	int			hashhits, linearhits;
+	unsigned	start, hashtime, lineartime;
+
+	rounds = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 1000;
+	if (rounds < 1)
+		rounds = 1;
+
+	for (count = 0, var = cvar_vars ; var ; var = var->next)
+		count++;
+	if (!count)
+		return;
+
+	// every name, then every name with a character appended
+	names = Z_Malloc (count * 2 * BENCH_NAMELEN);
+	for (i = 0, var = cvar_vars ; var ; var = var->next, i++)
+	{
+		Q_strncpyz (names + i * BENCH_NAMELEN, var->name, BENCH_NAMELEN);
+		Com_sprintf (names + (count + i) * BENCH_NAMELEN, BENCH_NAMELEN, "%s#", var->name);
+	}
+	lookups = count * 2 * rounds;
+
+	hashhits = 0;
+	start = Sys_Microseconds ();
+	for (r = 0 ; r < rounds ; r++)
+	{
+		for (i = 0 ; i < count * 2 ; i++)
+		{
+			if (Cvar_FindVar (names + i * BENCH_NAMELEN))
+				hashhits++;
+		}
+	}
+	hashtime = Sys_Microseconds () - start;
+
+	linearhits = 0;
+	start = Sys_Microseconds ();
+	for (r = 0 ; r < rounds ; r++)
+	{
+		for (i = 0 ; i < count * 2 ; i++)
+		{
+			for (found = cvar_vars ; found ; found = found->next)
+			{
+				if (!strcmp (names + i * BENCH_NAMELEN, found->name))
+					break;
+			}
+			if (found)
+				linearhits++;
+		}
+	}
+	lineartime = Sys_Microseconds () - start;
+
+	Z_Free (names);
+
+	Com_Printf ("%i cvars, %i lookups, %i / %i found\n", count, lookups, hashhits, linearhits);
+	Com_Printf ("hashed %.1f ms, %.2f M/s\n", hashtime * 0.001f, lookups / (hashtime + 1.0f));
+	Com_Printf ("linear %.1f ms, %.2f M/s\n", lineartime * 0.001f, lookups / (lineartime + 1.0f));
+}
+
 
 qboolean userinfo_modified;
 
@@ -691,6 +774,7 @@ void Cvar_Init (void)
 	Cmd_AddCommand ("togglecvar", Cvar_Toggle_f); /* FS */
 	Cmd_AddCommand ("forcecvar", Cvar_Force_f); /* FS */
 	Cmd_AddCommand ("resetcvar", Cvar_Reset_f); /* FS */
+	Cmd_AddCommand ("cvarbench", Cvar_Bench_f);
 }
 
 void Cvar_Shutdown (void)
@@ -728,6 +812,9 @@ void Cvar_Shutdown (void)
 		Z_Free(var);
 		var = NULL;
 	}
+
+	cvar_vars = NULL;
+	memset (cvar_hash, 0, sizeof(cvar_hash));
 }
 
 static cvar_t *Cvar_IsNoset (const char *var_name) /* FS: Make sure this isn't a NOSET CVAR! */
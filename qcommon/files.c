@@ -19,6 +19,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "qcommon.h"
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
 
 // enables faster binary pak searck, still experimental
 #define BINARY_PACK_SEARCH
@@ -54,12 +60,24 @@ typedef struct pack_s
 	int		numfiles;
 	packfile_t	*files;
 	unsigned int	contentFlags;	// Knightmare added- to skip cetain paks
+	unsigned	checksum;		// of the directory, for the asset cache
+
+	// fs_mmap
+	byte	*mapped;		// whole pak, copy-on-write
+	int		mappedlen;
+	int		mappedrefs;		// FS_LoadFile buffers not freed yet
+	qboolean	removed;		// no longer on the search path
+	struct pack_s	*nextmapped;
 } pack_t;
 
 char	fs_gamedir[MAX_OSPATH];
 cvar_t	*fs_basedir;
 cvar_t	*fs_cddir;
 cvar_t	*fs_gamedirvar;
+cvar_t	*fs_mmap;
+cvar_t	*fs_cachesize;
+
+static pack_t	*fs_mappedpacks;	// includes removed packs with buffers still out
 
 typedef struct filelink_s
 {
@@ -175,6 +193,8 @@ void	FS_CreatePath (char *path)
 		return;
 	}
 	
+	FS_InvalidateIndexPath (path);
+
 	for (ofs = path+1 ; *ofs ; ofs++)
 	{
 		c = *ofs;
@@ -285,6 +305,490 @@ static int FS_FindPackItem (pack_t *pack, char *itemName, long itemHash)
 }
 #endif /* BINARY_PACK_SEARCH */
 
+/*
+=============================================================================
+
+FILESYSTEM INDEX
+
+Every file on the search path, loose or in a pak, hashed by name so a
+lookup doesn't have to try each search path in turn.  Entries with the
+same name are chained in search path order.  The index is thrown away
+whenever the search path changes, and is rebuilt on the next lookup.
+
+The index is the last word on what exists.  Directories the engine
+writes into are marked stale and listed again before a miss in them is
+final, and a miss also lists a directory again if its modification time
+has moved, checked at most once a second, to catch files put there by
+something else.
+
+=============================================================================
+*/
+
+#define	FS_INDEX_TAG	767		// zone tag for everything in the index
+#define	FS_INDEX_DEPTH	8		// deepest loose subdirectory indexed
+#define	FS_CHECK_MSEC	1000	// between modification time checks of a directory
+
+// loose files are matched the way fopen would
+#if defined(_WIN32) || defined(__MSDOS__)
+#define	FS_LooseCompare	Q_stricmp
+#else
+#define	FS_LooseCompare	strcmp
+#endif
+
+typedef struct fsdir_s
+{
+	struct fsdir_s		*next;
+	char				*name;		// relative to the search path, "" for its root
+	searchpath_t		*search;
+	int					priority;	// of the search path, 0 is searched first
+	int					depth;
+	struct fsentry_s	*files;
+	time_t				mtime;		// of the directory when it was listed
+	time_t				listtime;
+	int					checked;	// Sys_Milliseconds of the last mtime check
+	qboolean			stale;		// written to, list again before a miss is final
+} fsdir_t;
+
+typedef struct fsentry_s
+{
+	struct fsentry_s	*hash_next;
+	struct fsentry_s	*dir_next;	// the other loose files in dir
+	char			*name;		// relative to the search path
+	searchpath_t	*search;
+	fsdir_t			*dir;		// NULL for a pak entry
+	int				priority;
+	int				file;		// pak entry, -1 for a loose file
+} fsentry_t;
+
+int		file_from_pak = 0;
+
+static fsentry_t	**fs_index;
+static int			fs_indexsize;
+static qboolean		fs_indexdirty = true;
+static int			fs_indexpak, fs_indexloose;
+static qboolean		fs_indexnolist;	// Sys_FindFirst doesn't work here
+static fsdir_t		*fs_dirs;		// every loose directory listed
+
+// fs_stats
+static int	fs_hits, fs_misses, fs_slowpath;
+static int	fs_opens, fs_failedopens;
+static int	fs_rebuilds, fs_dirscans, fs_dirchecks;
+static int	fs_cachehits, fs_cachemisses, fs_cachestale;
+static int	fs_cachewrites, fs_cachetrims;
+
+static qboolean FS_WritesPending (void);
+
+/*
+=================
+FS_InvalidateIndex
+
+Called when the search path changes.
+=================
+*/
+void FS_InvalidateIndex (void)
+{
+	fs_indexdirty = true;
+}
+
+/*
+=================
+FS_FindDirectory
+=================
+*/
+static fsdir_t *FS_FindDirectory (searchpath_t *search, const char *name)
+{
+	fsdir_t	*dir;
+
+	for (dir = fs_dirs; dir; dir = dir->next)
+	{
+		if (dir->search == search && !FS_LooseCompare (dir->name, name))
+			return dir;
+	}
+	return NULL;
+}
+
+/*
+=================
+FS_NearestDirectory
+
+The directory filename is in, or the closest parent of it that has
+been listed, so listing that again will find any new subdirectories
+=================
+*/
+static fsdir_t *FS_NearestDirectory (searchpath_t *search, const char *filename)
+{
+	char	path[MAX_OSPATH];
+	char	*slash;
+	fsdir_t	*dir;
+
+	Q_strncpyz (path, filename, sizeof(path));
+	do
+	{
+		slash = strrchr (path, '/');
+		if (slash)
+			*slash = 0;
+		else
+			path[0] = 0;
+		dir = FS_FindDirectory (search, path);
+	} while (!dir && path[0]);
+
+	return dir;
+}
+
+/*
+=================
+FS_InvalidateIndexPath
+
+Called before a file is written to the given OS path.  The directory
+it goes in is listed again before the index says it isn't there.
+=================
+*/
+void FS_InvalidateIndexPath (const char *path)
+{
+	searchpath_t	*search;
+	fsdir_t			*dir;
+	int				len;
+
+	if (fs_indexdirty)
+		return;
+
+	for (search = fs_searchpaths; search; search = search->next)
+	{
+		if (search->pack)
+			continue;
+		len = strlen (search->filename);
+		if (!strncmp (path, search->filename, len) && (path[len] == '/' || path[len] == '\\'))
+			break;
+	}
+	if (!search)
+		return;		// not on the search path
+
+	dir = FS_NearestDirectory (search, path + len + 1);
+	if (dir)
+		dir->stale = true;
+}
+
+/*
+=================
+FS_IndexAdd
+
+Chains are kept in search path order, and within a search path the
+newest entry comes first
+=================
+*/
+static fsentry_t *FS_IndexAdd (char *name, searchpath_t *search, int priority, int file)
+{
+	fsentry_t	*e, **link;
+
+	e = Z_TagMalloc (sizeof(*e), FS_INDEX_TAG);
+	e->name = name;
+	e->search = search;
+	e->dir = NULL;
+	e->priority = priority;
+	e->file = file;
+
+	for (link = &fs_index[Com_HashKey (name, fs_indexsize)]; *link && (*link)->priority < priority; link = &(*link)->hash_next)
+		;
+	e->hash_next = *link;
+	*link = e;
+	return e;
+}
+
+/*
+=================
+FS_IndexRemove
+=================
+*/
+static void FS_IndexRemove (fsentry_t *e)
+{
+	fsentry_t	**link;
+
+	for (link = &fs_index[Com_HashKey (e->name, fs_indexsize)]; *link; link = &(*link)->hash_next)
+	{
+		if (*link == e)
+		{
+			*link = e->hash_next;
+			break;
+		}
+	}
+	Z_Free (e->name);
+	Z_Free (e);
+}
+
+/*
+=================
+FS_ListDirectory
+
+Indexes the files in dir and any subdirectories it doesn't have yet
+=================
+*/
+static void FS_IndexDirectory (searchpath_t *search, int priority, const char *subdir, int depth);
+
+static void FS_ListDirectory (fsdir_t *dir)
+{
+	char		findname[MAX_OSPATH];
+	char		**list, *name;
+	int			i, num, skip;
+	fsentry_t	*e;
+	struct stat	st;
+
+	fs_dirscans++;
+	skip = strlen (dir->search->filename) + 1;
+	if (*dir->name)
+		Com_sprintf (findname, sizeof(findname), "%s/%s", dir->search->filename, dir->name);
+	else
+		Q_strncpyz (findname, dir->search->filename, sizeof(findname));
+
+	// stat first, so a change made while listing shows up next time
+	dir->mtime = stat (findname, &st) ? 0 : st.st_mtime;
+	dir->listtime = time (NULL);
+	dir->checked = Sys_Milliseconds ();
+	dir->stale = FS_WritesPending ();	// they may land after the listing
+	Q_strncatz (findname, "/*", sizeof(findname));
+
+	list = FS_ListFiles (findname, &num, 0, SFF_SUBDIR | SFF_HIDDEN | SFF_SYSTEM);
+	for (i = 0; i < num - 1; i++)
+	{
+		name = Z_TagMalloc (strlen (list[i] + skip) + 1, FS_INDEX_TAG);
+		strcpy (name, list[i] + skip);
+		e = FS_IndexAdd (name, dir->search, dir->priority, -1);
+		e->dir = dir;
+		e->dir_next = dir->files;
+		dir->files = e;
+		fs_indexloose++;
+	}
+	if (list)
+		FS_FreeFileList (list, num);
+
+	if (dir->depth >= FS_INDEX_DEPTH)
+		return;
+
+	// the find functions aren't reentrant, so list the subdirectories first
+	list = FS_ListFiles (findname, &num, SFF_SUBDIR, SFF_HIDDEN | SFF_SYSTEM);
+	for (i = 0; i < num - 1; i++)
+	{
+		if (strrchr (list[i], '/')[1] == '.')
+			continue;
+		if (!FS_FindDirectory (dir->search, list[i] + skip))
+			FS_IndexDirectory (dir->search, dir->priority, list[i] + skip, dir->depth + 1);
+	}
+	if (list)
+		FS_FreeFileList (list, num);
+}
+
+/*
+=================
+FS_IndexDirectory
+=================
+*/
+static void FS_IndexDirectory (searchpath_t *search, int priority, const char *subdir, int depth)
+{
+	fsdir_t	*dir;
+
+	dir = Z_TagMalloc (sizeof(*dir), FS_INDEX_TAG);
+	dir->name = Z_TagMalloc (strlen (subdir) + 1, FS_INDEX_TAG);
+	strcpy (dir->name, subdir);
+	dir->search = search;
+	dir->priority = priority;
+	dir->depth = depth;
+	dir->next = fs_dirs;
+	fs_dirs = dir;
+
+	FS_ListDirectory (dir);
+}
+
+/*
+=================
+FS_RelistDirectory
+=================
+*/
+static void FS_RelistDirectory (fsdir_t *dir)
+{
+	fsentry_t	*e, *next;
+
+	for (e = dir->files; e; e = next)
+	{
+		next = e->dir_next;
+		FS_IndexRemove (e);
+		fs_indexloose--;
+	}
+	dir->files = NULL;
+
+	FS_ListDirectory (dir);
+}
+
+/*
+=================
+FS_CheckDirectories
+
+Called on a miss.  Lists the directories filename could be in again
+if the engine wrote to them or they changed on disk, and returns true
+if any were.
+=================
+*/
+static qboolean FS_CheckDirectories (const char *filename)
+{
+	searchpath_t	*search;
+	fsdir_t			*dir;
+	struct stat		st;
+	char			path[MAX_OSPATH];
+	qboolean		relisted;
+	int				now;
+
+	relisted = false;
+	now = Sys_Milliseconds ();
+	for (search = fs_searchpaths; search; search = search->next)
+	{
+		if (search->pack)
+			continue;
+		dir = FS_NearestDirectory (search, filename);
+		if (!dir)
+			continue;
+
+		if (!dir->stale)
+		{
+			if (now - dir->checked < FS_CHECK_MSEC)
+				continue;
+			dir->checked = now;
+			fs_dirchecks++;
+
+			if (*dir->name)
+				Com_sprintf (path, sizeof(path), "%s/%s", search->filename, dir->name);
+			else
+				Q_strncpyz (path, search->filename, sizeof(path));
+			// a change in the second it was listed may not have been seen
+			if ((stat (path, &st) ? 0 : st.st_mtime) == dir->mtime && dir->mtime < dir->listtime)
+				continue;
+		}
+
+		FS_RelistDirectory (dir);
+		relisted = true;
+	}
+
+	return relisted;
+}
+
+/*
+=================
+FS_BuildIndex
+=================
+*/
+static void FS_BuildIndex (void)
+{
+	searchpath_t	*search, **order;
+	pack_t			*pak;
+	int				i, j, numpaths, numfiles;
+
+	Z_FreeTags (FS_INDEX_TAG);
+	fs_dirs = NULL;
+	fs_indexdirty = false;
+	fs_rebuilds++;
+
+	numpaths = numfiles = 0;
+	for (search = fs_searchpaths; search; search = search->next)
+	{
+		numpaths++;
+		if (search->pack)
+			numfiles += search->pack->numfiles;
+	}
+	numfiles += fs_indexloose;
+
+	for (fs_indexsize = 1024; fs_indexsize < numfiles * 2; fs_indexsize <<= 1)
+		;
+	fs_index = Z_TagMalloc (fs_indexsize * sizeof(*fs_index), FS_INDEX_TAG);
+	fs_indexpak = fs_indexloose = 0;
+
+	if (!numpaths)
+		return;
+
+	// entries go on the front of their chain when nothing outranks
+	// them, so adding the lowest priority search paths first is cheap
+	order = Z_TagMalloc (numpaths * sizeof(*order), FS_INDEX_TAG);
+	for (i = 0, search = fs_searchpaths; search; search = search->next)
+		order[i++] = search;
+
+	for (i = numpaths - 1; i >= 0; i--)
+	{
+		search = order[i];
+		pak = search->pack;
+		if (!pak)
+		{
+			FS_IndexDirectory (search, i, "", 0);
+			continue;
+		}
+
+		for (j = pak->numfiles - 1; j >= 0; j--)
+		{
+			if (pak->files[j].ignore)	// Knightmare- skip blacklisted files
+				continue;
+			FS_IndexAdd (pak->files[j].name, search, i, j);
+			fs_indexpak++;
+		}
+	}
+
+	// any real install lists at least its pak files, so if nothing was
+	// listed the platform can't enumerate directories (null driver) and
+	// lookups have to walk the search path instead
+	fs_indexnolist = !fs_indexloose;
+}
+
+/*
+=================
+FS_Stats_f
+=================
+*/
+void FS_Stats_f (void)
+{
+	if (!strcmp (Cmd_Argv(1), "reset"))
+	{
+		fs_hits = fs_misses = fs_slowpath = 0;
+		fs_opens = fs_failedopens = 0;
+		fs_rebuilds = fs_dirscans = fs_dirchecks = 0;
+		fs_cachehits = fs_cachemisses = fs_cachestale = 0;
+		fs_cachewrites = fs_cachetrims = 0;
+		return;
+	}
+
+	if (fs_indexdirty)
+		Com_Printf ("index: out of date, rebuilt on next lookup\n");
+	else if (fs_indexnolist)
+		Com_Printf ("index: directories can't be listed on this platform, not used\n");
+	else
+		Com_Printf ("index: %i pak files, %i loose files, %i buckets\n", fs_indexpak, fs_indexloose, fs_indexsize);
+	Com_Printf ("lookups: %i hits, %i misses, %i bypassed the index\n", fs_hits, fs_misses, fs_slowpath);
+	Com_Printf ("fopen: %i, %i failed\n", fs_opens, fs_failedopens);
+	Com_Printf ("rebuilds: %i, %i directory scans, %i directory checks\n", fs_rebuilds, fs_dirscans, fs_dirchecks);
+	Com_Printf ("cache: %i hits, %i misses, %i stale, %i written, %i trims\n",
+		fs_cachehits, fs_cachemisses, fs_cachestale, fs_cachewrites, fs_cachetrims);
+}
+
+/*
+=================
+FS_OpenPackFile
+=================
+*/
+static int FS_OpenPackFile (pack_t *pak, int i, FILE **file, byte **mapped)
+{
+	file_from_pak = 1;
+	if (mapped && pak->mapped && pak->files[i].filelen > 0)
+	{
+		*file = NULL;
+		*mapped = pak->mapped + pak->files[i].filepos;
+		return pak->files[i].filelen;
+	}
+
+// open a new file on the pakfile
+	fs_opens++;
+	*file = fopen (pak->filename, "rb");
+	if (!*file)
+	{
+		Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->filename);
+		return -1;
+	}
+	fseek (*file, pak->files[i].filepos, SEEK_SET);
+	return pak->files[i].filelen;
+}
+
 /*
 ===========
 FS_FOpenFile
@@ -295,18 +799,22 @@ Used for streaming data out of either a pak file or
 a seperate file.
 ===========
 */
-int file_from_pak = 0;
-int FS_FOpenFile (char *filename, FILE **file)
+static int FS_FOpenFileOrMap (char *filename, FILE **file, byte **mapped)
 {
 	searchpath_t	*search;
 	char			netpath[MAX_OSPATH];
 	pack_t			*pak;
 	int				i;
 	filelink_t		*link;
+	fsentry_t		*e;
+	qboolean		checked;
 	// Knightmare added
 	long			hash;
 	unsigned int	typeFlag;
 
+	if (mapped)
+		*mapped = NULL;
+
 	if (!filename || !*filename) /* nul name */
 	{
 		*file = NULL;
@@ -314,279 +822,1916 @@ int FS_FOpenFile (char *filename, FILE **file)
 	}
 
 	file_from_pak = 0;
-	// Knightmare added
-	hash = Com_HashFileName(filename, 0, false);
-	typeFlag = FS_TypeFlagForPakItem(filename);
 
-	// check for links first
+	// check for links first
+	for (link = fs_links; link; link = link->next)
+	{
+		if (!strncmp(filename, link->from, link->fromlength))
+		{
+			Com_sprintf (netpath, sizeof(netpath), "%s%s",link->to, filename+link->fromlength);
+			*file = fopen (netpath, "rb");
+			if (*file)
+			{
+				Com_DPrintf(DEVELOPER_MSG_IO, "link file: %s\n",netpath);
+				return FS_filelength (*file);
+			}
+			return -1;
+		}
+	}
+
+//
+// look it up in the index, unless the name is something fopen
+// could resolve differently
+//
+	if (fs_indexdirty)
+		FS_BuildIndex ();
+
+	if (!fs_indexnolist && filename[0] != '/' && !strstr(filename, "..") && !strchr(filename, '\\')
+		&& !strstr(filename, "//") && !strchr(filename, ':'))
+	{
+		for (checked = false ; ; checked = true)
+		{
+			for (e = fs_index[Com_HashKey(filename, fs_indexsize)]; e; e = e->hash_next)
+			{
+				if (e->file >= 0)
+				{
+					if (Q_strcasecmp (e->name, filename))
+						continue;
+					fs_hits++;
+					return FS_OpenPackFile (e->search->pack, e->file, file, mapped);
+				}
+
+				if (FS_LooseCompare (e->name, filename))
+					continue;
+
+				Com_sprintf (netpath, sizeof(netpath), "%s/%s", e->search->filename, e->name);
+				fs_opens++;
+				*file = fopen (netpath, "rb");
+				if (!*file)
+				{	// removed since the directory was listed
+					fs_failedopens++;
+					e->dir->stale = true;
+					continue;
+				}
+
+				Com_DPrintf(DEVELOPER_MSG_IO, "FindFile: %s\n",netpath);
+				fs_hits++;
+				return FS_filelength (*file);
+			}
+
+			if (checked || !FS_CheckDirectories (filename))
+				break;
+		}
+
+		Com_DPrintf(DEVELOPER_MSG_IO, "FindFile: can't find %s\n", filename);
+		fs_misses++;
+		*file = NULL;
+		return -1;
+	}
+
+	fs_slowpath++;
+	// Knightmare added
+	hash = Com_HashFileName(filename, 0, false);
+	typeFlag = FS_TypeFlagForPakItem(filename);
+
+//
+// search through the path, one element at a time
+//
+	for (search = fs_searchpaths ; search ; search = search->next)
+	{
+	// is the element a pak file?
+		if (search->pack)
+		{
+		// look through all the pak file elements
+			pak = search->pack;
+
+			// Knightmare- skip if pack doesn't contain this type of file
+			if (typeFlag != 0 && !(pak->contentFlags & typeFlag))
+				continue;
+
+#ifdef BINARY_PACK_SEARCH /* Knightmare- use new binary algorithm */
+			/* find index of pack item */
+			i = FS_FindPackItem (pak, filename, hash);
+			if (i >= 0) /* found it! */
+				return FS_OpenPackFile (pak, i, file, mapped);
+#else
+			for (i = 0; i < pak->numfiles; i++)
+			{
+				if (pak->files[i].ignore)	// Knightmare- skip blacklisted files
+					continue;
+				if (hash != pak->files[i].hash)	// Knightmare- compare hash first
+					continue;
+				if (!Q_strcasecmp (pak->files[i].name, filename))
+				{	// found it!
+					return FS_OpenPackFile (pak, i, file, mapped);
+				}
+			}
+#endif /* BINARY_PACK_SEARCH */
+		}
+		else
+		{
+		// check a file in the directory tree
+			Com_sprintf (netpath, sizeof(netpath), "%s/%s",search->filename, filename);
+
+			fs_opens++;
+			*file = fopen (netpath, "rb");
+			if (!*file)
+			{
+				fs_failedopens++;
+				continue;
+			}
+			
+			Com_DPrintf(DEVELOPER_MSG_IO, "FindFile: %s\n",netpath);
+
+			return FS_filelength (*file);
+		}
+	}
+
+	Com_DPrintf(DEVELOPER_MSG_IO, "FindFile: can't find %s\n", filename);
+	
+	*file = NULL;
+	return -1;
+}
+
+int FS_FOpenFile (char *filename, FILE **file)
+{
+	return FS_FOpenFileOrMap (filename, file, NULL);
+}
+
+/*
+=================
+FS_Read
+
+Properly handles partial reads
+=================
+*/
+void FS_Read (void *buffer, int len, FILE *f)
+{
+	int		block, remaining;
+	int		read;
+	byte	*buf;
+	int		tries;
+
+	buf = (byte *)buffer;
+
+	// read in chunks for progress bar
+	remaining = len;
+	tries = 0;
+	while (remaining)
+	{
+		block = remaining;
+		if (block > MAX_READ)
+			block = MAX_READ;
+		read = fread (buf, 1, block, f);
+		if (read == 0)
+		{
+			// we might have been trying to read from a CD
+			if (!tries)
+			{
+				tries = 1;
+				CDAudio_Stop();
+			}
+			else
+				Com_Error (ERR_FATAL, "FS_Read: 0 bytes read");
+		}
+
+		// do some progress bar thing here...
+
+		remaining -= read;
+		buf += read;
+	}
+}
+
+
+// Knightmare added
+/*
+=================
+FS_FRead
+
+Properly handles partial reads of size up to count times
+No error if it can't read
+=================
+*/
+int FS_FRead (void *buffer, int size, int count, FILE *f)
+{
+	int			loops, remaining, r;
+	byte		*buf;
+	qboolean	tried = false;
+
+	// Read
+	loops = count;
+	//remaining = size;
+	buf = (byte *)buffer;
+
+	while (loops)
+	{	// Read in chunks
+		remaining = size;
+		while (remaining)
+		{
+			r = fread(buf, 1, remaining, f);
+
+			if (r == 0)
+			{
+				if (!tried)
+				{	// We might have been trying to read from a CD
+					CDAudio_Stop();
+					tried = true;
+				}
+				else {
+				//	Com_Printf("FS_FRead: 0 bytes read\n");
+					return size - remaining;
+				}
+			}
+
+			remaining -= r;
+			buf += r;
+		}
+		loops--;
+	}
+	return size;
+}
+
+
+/*
+=================
+FS_Seek
+=================
+*/
+int FS_Seek (FILE *f, int offset, fsOrigin_t origin)
+{
+	switch (origin)
+	{
+	case FS_SEEK_SET:
+		return fseek(f, offset, SEEK_SET);
+
+	case FS_SEEK_CUR:
+		return fseek(f, offset, SEEK_CUR);
+
+	case FS_SEEK_END:
+		return fseek(f, offset, SEEK_END);
+	}
+	Com_Error(ERR_FATAL, "FS_Seek: bad origin (%i)", origin);
+	return -1;
+}
+
+
+/*
+=================
+FS_Tell
+
+Returns -1 if an error occurs
+=================
+*/
+long FS_Tell (FILE *f)
+{
+	return ftell(f);
+}
+// end Knightmare
+
+
+/*
+=============================================================================
+
+STREAMS
+
+Sequential files that are written from a background thread, so a slow
+disk doesn't stall the caller, and can optionally be compressed.  Only
+the writer thread touches the FILE once it is running; the caller just
+copies into a bounded ring, and waits only when the ring is full.
+
+A compressed stream starts with FSZ_MAGIC and is followed by blocks of
+up to FSZ_BLOCK bytes, each with its raw and packed length.  The packed
+data is LZ77 with byte aligned tokens: a token byte holds the literal
+count in the high nibble and the match length - FSZ_MINMATCH in the
+low one, 15 meaning more length bytes follow, then the literals, then
+a two byte match offset.  The last sequence of a block has no match.
+A block that doesn't get smaller is stored, with both lengths equal.
+
+Readers take either kind of file and give back the original bytes.
+
+=============================================================================
+*/
+
+#define	FSZ_MAGIC		(('1'<<24)+('Z'<<16)+('2'<<8)+'Q')	// "Q2Z1", never a valid demo message length
+#define	FSZ_BLOCK		0x10000
+#define	FSZ_PACKED		(FSZ_BLOCK + FSZ_BLOCK/255 + 16)	// worst case size of a packed block
+#define	FSZ_MINMATCH	4
+#define	FSZ_MAXOFFSET	0xffff
+#define	FSZ_HASHBITS	14
+#define	FSZ_MAXSTREAM	0x10000000	// unpacked, far more than any Quake 2 file
+
+#define	FSZ_READ32(p)	((p)[0] | ((p)[1]<<8) | ((p)[2]<<16) | ((unsigned)(p)[3]<<24))
+#define	FSZ_HASH(v)		(((v) * 2654435761u) >> (32 - FSZ_HASHBITS))
+
+#define	FSW_RING		0x100000	// bytes a writer can fall behind before FS_WriteStream blocks
+
+struct fswriter_s
+{
+	FILE		*f;
+	qboolean	compress;
+	qboolean	error;					// a write failed, reported on close
+
+	// filled by the caller, drained by the thread
+	byte		*ring;					// [FSW_RING]
+	unsigned	head, tail;				// bytes ever queued and written, wrap freely
+	void		*thread;
+	void		*lock;					// protects the ring counters and flags
+	void		*wake;					// posted when the thread is asleep and data arrives
+	void		*space;					// posted when the caller is waiting for room
+	qboolean	sleeping, waiting, closing;
+
+	// only touched by whoever does the writing
+	int			blocklen;
+	byte		*block;					// [FSZ_BLOCK] raw data for the next packed block
+	byte		*packed;				// [FSZ_PACKED]
+	int			*hash;					// [1<<FSZ_HASHBITS] last position + 1 of each hash
+};
+
+struct fsreader_s
+{
+	FILE		*f;
+	int			remaining;				// bytes of the file not read yet
+	qboolean	compressed;
+	byte		*raw;					// [FSZ_BLOCK] the current block
+	int			rawlen, rawpos;
+	byte		*packed;				// [FSZ_PACKED]
+};
+
+/*
+=================
+FS_PackLength
+
+Writes a length continuation for a nibble of 15
+=================
+*/
+static byte *FS_PackLength (byte *op, int len)
+{
+	for ( ; len >= 255 ; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+/*
+=================
+FS_PackSequence
+=================
+*/
+static byte *FS_PackSequence (byte *op, const byte *lit, int litlen, int offset, int matchlen)
+{
+	byte	*token;
+
+	token = op++;
+	*token = (litlen < 15 ? litlen : 15) << 4;
+	if (litlen >= 15)
+		op = FS_PackLength (op, litlen - 15);
+	memcpy (op, lit, litlen);
+	op += litlen;
+
+	if (!matchlen)
+		return op;		// the end of the block
+
+	*op++ = offset & 255;
+	*op++ = offset >> 8;
+	matchlen -= FSZ_MINMATCH;
+	*token |= matchlen < 15 ? matchlen : 15;
+	if (matchlen >= 15)
+		op = FS_PackLength (op, matchlen - 15);
+	return op;
+}
+
+/*
+=================
+FS_Pack
+
+Returns the packed size of in, which may be larger than len.
+out must have room for FSZ_PACKED bytes.
+=================
+*/
+static int FS_Pack (const byte *in, int len, byte *out, int *hash)
+{
+	const byte	*ip, *anchor, *ref, *end;
+	byte		*op;
+	unsigned	v, h;
+	int			pos, matchlen;
+
+	memset (hash, 0, sizeof(int) << FSZ_HASHBITS);
+
+	ip = anchor = in;
+	end = in + len;
+	op = out;
+
+	while (ip + FSZ_MINMATCH <= end)
+	{
+		v = FSZ_READ32(ip);
+		h = FSZ_HASH(v);
+		pos = hash[h] - 1;
+		hash[h] = ip - in + 1;
+
+		ref = in + pos;
+		if (pos < 0 || ip - ref > FSZ_MAXOFFSET || FSZ_READ32(ref) != v)
+		{
+			ip++;
+			continue;
+		}
+
+		for (matchlen = FSZ_MINMATCH ; ip + matchlen < end && ip[matchlen] == ref[matchlen] ; matchlen++)
+			;
+		op = FS_PackSequence (op, anchor, ip - anchor, ip - ref, matchlen);
+		ip += matchlen;
+		anchor = ip;
+	}
+
+	if (anchor < end)
+		op = FS_PackSequence (op, anchor, end - anchor, 0, 0);
+
+	return op - out;
+}
+
+/*
+=================
+FS_UnpackLength
+=================
+*/
+static const byte *FS_UnpackLength (const byte *ip, const byte *end, int *len)
+{
+	int		b;
+
+	do
+	{
+		if (ip >= end)
+			return NULL;
+		b = *ip++;
+		*len += b;
+	} while (b == 255);
+
+	return ip;
+}
+
+/*
+=================
+FS_Unpack
+
+Returns false if in isn't a valid packing of exactly len bytes
+=================
+*/
+static qboolean FS_Unpack (const byte *in, int inlen, byte *out, int len)
+{
+	const byte	*ip, *end;
+	byte		*op, *oend;
+	int			token, litlen, matchlen, offset;
+
+	ip = in;
+	end = in + inlen;
+	op = out;
+	oend = out + len;
+
+	while (ip < end)
+	{
+		token = *ip++;
+
+		litlen = token >> 4;
+		if (litlen == 15 && !(ip = FS_UnpackLength (ip, end, &litlen)))
+			return false;
+		if (litlen > end - ip || litlen > oend - op)
+			return false;
+		memcpy (op, ip, litlen);
+		ip += litlen;
+		op += litlen;
+
+		if (ip == end)
+			break;		// the last sequence
+
+		if (end - ip < 2)
+			return false;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		matchlen = token & 15;
+		if (matchlen == 15 && !(ip = FS_UnpackLength (ip, end, &matchlen)))
+			return false;
+		matchlen += FSZ_MINMATCH;
+		if (!offset || offset > op - out || matchlen > oend - op)
+			return false;
+
+		// may overlap itself, so byte by byte
+		for ( ; matchlen ; matchlen--, op++)
+			*op = op[-offset];
+	}
+
+	return op == oend;
+}
+
+/*
+=================
+FS_WriteRaw
+
+Runs on the writer thread, if there is one
+=================
+*/
+static void FS_WriteRaw (fswriter_t *w, const void *data, int len)
+{
+	if (len && fwrite (data, len, 1, w->f) != 1)
+		w->error = true;
+}
+
+/*
+=================
+FS_FlushBlock
+=================
+*/
+static void FS_FlushBlock (fswriter_t *w)
+{
+	int		lens[2], packedlen;
+
+	if (!w->blocklen)
+		return;
+
+	packedlen = FS_Pack (w->block, w->blocklen, w->packed, w->hash);
+	if (packedlen >= w->blocklen)
+		packedlen = w->blocklen;		// store it
+
+	lens[0] = LittleLong (w->blocklen);
+	lens[1] = LittleLong (packedlen);
+	FS_WriteRaw (w, lens, sizeof(lens));
+	FS_WriteRaw (w, packedlen == w->blocklen ? w->block : w->packed, packedlen);
+	w->blocklen = 0;
+}
+
+/*
+=================
+FS_WriteOut
+
+Runs on the writer thread, if there is one
+=================
+*/
+static void FS_WriteOut (fswriter_t *w, const byte *data, int len)
+{
+	int		n;
+
+	if (!w->compress)
+	{
+		FS_WriteRaw (w, data, len);
+		return;
+	}
+
+	while (len)
+	{
+		n = min(len, FSZ_BLOCK - w->blocklen);
+		memcpy (w->block + w->blocklen, data, n);
+		w->blocklen += n;
+		data += n;
+		len -= n;
+		if (w->blocklen == FSZ_BLOCK)
+			FS_FlushBlock (w);
+	}
+}
+
+/*
+=================
+FS_WriterThread
+=================
+*/
+static void FS_WriterThread (void *arg)
+{
+	fswriter_t	*w = arg;
+	unsigned	tail;
+	int			len;
+
+	Sys_LockMutex (w->lock);
+	while (1)
+	{
+		if (w->head == w->tail)
+		{
+			if (w->closing)
+				break;
+			w->sleeping = true;
+			Sys_UnlockMutex (w->lock);
+			Sys_WaitSemaphore (w->wake);
+			Sys_LockMutex (w->lock);
+			continue;
+		}
+
+		// write as much as doesn't wrap around the ring
+		tail = w->tail;
+		len = min(w->head - tail, FSW_RING - tail % FSW_RING);
+		Sys_UnlockMutex (w->lock);
+
+		FS_WriteOut (w, w->ring + tail % FSW_RING, len);
+
+		Sys_LockMutex (w->lock);
+		w->tail += len;
+		if (w->waiting)
+		{
+			w->waiting = false;
+			Sys_PostSemaphore (w->space, 1);
+		}
+	}
+	Sys_UnlockMutex (w->lock);
+
+	FS_FlushBlock (w);
+}
+
+/*
+=================
+FS_OpenWriter
+
+Creates filename, which must be a full path.  Returns NULL if it
+can't be opened.  Without threads the writes are done in the caller.
+=================
+*/
+fswriter_t *FS_OpenWriter (char *filename, qboolean compress)
+{
+	fswriter_t	*w;
+	int			magic;
+
+	w = Z_Malloc (sizeof(*w));
+	w->f = fopen (filename, "wb");
+	if (!w->f)
+	{
+		Z_Free (w);
+		return NULL;
+	}
+
+	w->compress = compress;
+	if (compress)
+	{
+		w->block = Z_Malloc (FSZ_BLOCK);
+		w->packed = Z_Malloc (FSZ_PACKED);
+		w->hash = Z_Malloc (sizeof(int) << FSZ_HASHBITS);
+		magic = LittleLong (FSZ_MAGIC);
+		FS_WriteRaw (w, &magic, 4);
+	}
+
+	w->lock = Sys_CreateMutex ();
+	w->wake = Sys_CreateSemaphore (0);
+	w->space = Sys_CreateSemaphore (0);
+	if (w->lock && w->wake && w->space)
+	{
+		w->ring = Z_Malloc (FSW_RING);
+		w->thread = Sys_CreateThread (FS_WriterThread, w);
+	}
+	if (!w->thread)
+	{
+		if (w->ring)
+			Z_Free (w->ring);
+		w->ring = NULL;
+	}
+
+	return w;
+}
+
+/*
+=================
+FS_WriteStream
+=================
+*/
+void FS_WriteStream (fswriter_t *w, const void *buffer, int len)
+{
+	const byte	*data = buffer;
+	unsigned	head;
+	int			n;
+
+	if (!w->thread)
+	{
+		FS_WriteOut (w, data, len);
+		return;
+	}
+
+	Sys_LockMutex (w->lock);
+	while (len)
+	{
+		n = FSW_RING - (w->head - w->tail);
+		if (!n)
+		{	// the disk can't keep up, wait for the thread to catch up
+			w->waiting = true;
+			Sys_UnlockMutex (w->lock);
+			Sys_WaitSemaphore (w->space);
+			Sys_LockMutex (w->lock);
+			continue;
+		}
+
+		// the thread only reads below tail + queued, so copying
+		// above head doesn't need the lock
+		head = w->head;
+		n = min(n, len);
+		n = min(n, FSW_RING - head % FSW_RING);
+		Sys_UnlockMutex (w->lock);
+
+		memcpy (w->ring + head % FSW_RING, data, n);
+		data += n;
+		len -= n;
+
+		Sys_LockMutex (w->lock);
+		w->head += n;
+		if (w->sleeping)
+		{
+			w->sleeping = false;
+			Sys_PostSemaphore (w->wake, 1);
+		}
+	}
+	Sys_UnlockMutex (w->lock);
+}
+
+/*
+=================
+FS_CloseWriter
+
+Waits for everything to be written.  Returns false if any of it failed.
+=================
+*/
+qboolean FS_CloseWriter (fswriter_t *w)
+{
+	qboolean	ok;
+
+	if (w->thread)
+	{
+		Sys_LockMutex (w->lock);
+		w->closing = true;
+		if (w->sleeping)
+		{
+			w->sleeping = false;
+			Sys_PostSemaphore (w->wake, 1);
+		}
+		Sys_UnlockMutex (w->lock);
+		Sys_JoinThread (w->thread);
+		Z_Free (w->ring);
+	}
+	else
+		FS_FlushBlock (w);
+
+	Sys_DestroyMutex (w->lock);
+	Sys_DestroySemaphore (w->wake);
+	Sys_DestroySemaphore (w->space);
+
+	if (fclose (w->f))
+		w->error = true;
+	ok = !w->error;
+
+	if (w->compress)
+	{
+		Z_Free (w->block);
+		Z_Free (w->packed);
+		Z_Free (w->hash);
+	}
+	Z_Free (w);
+
+	return ok;
+}
+
+/*
+=================
+FS_OpenReader
+
+Takes over f, as returned by FS_FOpenFile with a length of len,
+and tells if the stream in it is compressed
+=================
+*/
+fsreader_t *FS_OpenReader (FILE *f, int len)
+{
+	fsreader_t	*r;
+	int			magic;
+
+	r = Z_Malloc (sizeof(*r));
+	r->f = f;
+	r->remaining = len;
+	r->raw = Z_Malloc (FSZ_BLOCK);
+
+	if (len >= 4 && fread (&magic, 4, 1, f) == 1)
+	{
+		r->remaining -= 4;
+		if (LittleLong (magic) == FSZ_MAGIC)
+		{
+			r->compressed = true;
+			r->packed = Z_Malloc (FSZ_PACKED);
+		}
+		else
+		{	// hand the first bytes out again
+			memcpy (r->raw, &magic, 4);
+			r->rawlen = 4;
+		}
+	}
+
+	return r;
+}
+
+/*
+=================
+FS_FillReader
+
+Gets the next block, returns false at the end of the
+stream or if it is damaged
+=================
+*/
+static qboolean FS_FillReader (fsreader_t *r)
+{
+	int		lens[2];
+
+	r->rawpos = r->rawlen = 0;
+
+	if (!r->compressed)
+	{
+		r->rawlen = min(r->remaining, FSZ_BLOCK);
+		if (!r->rawlen || fread (r->raw, r->rawlen, 1, r->f) != 1)
+			return false;
+		r->remaining -= r->rawlen;
+		return true;
+	}
+
+	if (r->remaining < (int)sizeof(lens) || fread (lens, sizeof(lens), 1, r->f) != 1)
+		return false;
+	r->remaining -= sizeof(lens);
+	lens[0] = LittleLong (lens[0]);
+	lens[1] = LittleLong (lens[1]);
+	if (lens[0] < 1 || lens[0] > FSZ_BLOCK || lens[1] < 1 || lens[1] > lens[0] || lens[1] > r->remaining)
+		return false;
+
+	if (lens[1] == lens[0])
+	{	// stored
+		if (fread (r->raw, lens[0], 1, r->f) != 1)
+			return false;
+	}
+	else if (fread (r->packed, lens[1], 1, r->f) != 1 || !FS_Unpack (r->packed, lens[1], r->raw, lens[0]))
+		return false;
+
+	r->remaining -= lens[1];
+	r->rawlen = lens[0];
+	return true;
+}
+
+/*
+=================
+FS_ReadStream
+
+Returns the number of bytes read, which is less than len
+only at the end of the stream
+=================
+*/
+int FS_ReadStream (fsreader_t *r, void *buffer, int len)
+{
+	byte	*data = buffer;
+	int		n, read;
+
+	read = 0;
+	while (read < len)
+	{
+		if (r->rawpos == r->rawlen && !FS_FillReader (r))
+			break;
+
+		n = min(len - read, r->rawlen - r->rawpos);
+		memcpy (data + read, r->raw + r->rawpos, n);
+		r->rawpos += n;
+		read += n;
+	}
+
+	return read;
+}
+
+/*
+=================
+FS_CloseReader
+=================
+*/
+void FS_CloseReader (fsreader_t *r)
+{
+	FS_FCloseFile (r->f);
+	Z_Free (r->raw);
+	if (r->packed)
+		Z_Free (r->packed);
+	Z_Free (r);
+}
+
+/*
+=================
+FS_PackBuffer
+
+Packs len bytes into a complete compressed stream, the same as an
+FS_OpenWriter file would hold.  *packed is allocated with Z_Malloc.
+=================
+*/
+int FS_PackBuffer (const void *data, int len, byte **packed)
+{
+	const byte	*in = data;
+	byte		*out;
+	int			*hash;
+	int			pos, outlen, n, packedlen, lens[2];
+
+	out = Z_Malloc (4 + (len / FSZ_BLOCK + 1) * (sizeof(lens) + FSZ_PACKED));
+	hash = Z_Malloc (sizeof(int) << FSZ_HASHBITS);
+
+	lens[0] = LittleLong (FSZ_MAGIC);
+	memcpy (out, lens, 4);
+	outlen = 4;
+
+	for (pos = 0 ; pos < len ; pos += n)
+	{
+		n = min(len - pos, FSZ_BLOCK);
+		packedlen = FS_Pack (in + pos, n, out + outlen + sizeof(lens), hash);
+		if (packedlen >= n)
+		{	// store it
+			packedlen = n;
+			memcpy (out + outlen + sizeof(lens), in + pos, n);
+		}
+
+		lens[0] = LittleLong (n);
+		lens[1] = LittleLong (packedlen);
+		memcpy (out + outlen, lens, sizeof(lens));
+		outlen += sizeof(lens) + packedlen;
+	}
+
+	Z_Free (hash);
+	*packed = out;
+	return outlen;
+}
+
+
+/*
+=============================================================================
+
+BACKGROUND FILES
+
+Whole files that the caller already has in memory, like savegames, are
+handed to a single thread that writes them in the order they came in,
+optionally compressed with the stream format above.  Copies go through
+the same queue, so they see every write queued before them.  Anything
+that reads, lists or removes those files must call FS_FlushWrites first.
+
+=============================================================================
+*/
+
+typedef struct fsjob_s
+{
+	struct fsjob_s	*next;
+	char			path[MAX_OSPATH];
+	char			src[MAX_OSPATH];		// if set, copy this file instead
+	qboolean		touch;					// just set path's time, nothing is written
+	qboolean		compress;
+	int				len;
+	byte			data[4];				// [len], allocated past the end
+} fsjob_t;
+
+static struct
+{
+	qboolean	started;
+	void		*thread;
+	void		*lock;					// protects the queue, the flags and the failures
+	void		*wake;					// posted when the thread is asleep and a job arrives
+	void		*done;					// posted when a flush is waiting and the queue drains
+	qboolean	sleeping, flushing;
+	fsjob_t		*head, *tail;			// head is being written until it is unlinked
+	int			failed;					// jobs that went wrong since the last flush
+	char		failedpath[MAX_OSPATH];
+
+	// only touched by whoever runs the jobs
+	fswriter_t	writer;
+	byte		copybuf[0x10000];
+} fs_queue;
+
+/*
+=================
+FS_RunJob
+
+Runs on the queue thread, if there is one, so it can't use the zone
+=================
+*/
+static qboolean FS_RunJob (fsjob_t *job)
+{
+	fswriter_t	*w = &fs_queue.writer;
+	FILE		*src = NULL;
+	int			magic, len;
+
+	if (job->touch)
+	{
+		utime (job->path, NULL);
+		return true;		// it may have been trimmed since
+	}
+
+	if (job->src[0])
+	{
+		src = fopen (job->src, "rb");
+		if (!src)
+			return true;	// nothing to copy
+	}
+
+	w->f = fopen (job->path, "wb");
+	if (!w->f)
+	{
+		if (src)
+			fclose (src);
+		return false;
+	}
+	w->error = false;
+	w->compress = job->compress;
+	w->blocklen = 0;
+
+	if (src)
+	{
+		while ((len = fread (fs_queue.copybuf, 1, sizeof(fs_queue.copybuf), src)) > 0)
+			FS_WriteRaw (w, fs_queue.copybuf, len);
+		fclose (src);
+	}
+	else
+	{
+		if (w->compress)
+		{
+			magic = LittleLong (FSZ_MAGIC);
+			FS_WriteRaw (w, &magic, 4);
+		}
+		FS_WriteOut (w, job->data, job->len);
+		FS_FlushBlock (w);
+	}
+
+	if (fclose (w->f))
+		w->error = true;
+	return !w->error;
+}
+
+/*
+=================
+FS_QueueThread
+=================
+*/
+static void FS_QueueThread (void *arg)
+{
+	fsjob_t		*job;
+	qboolean	ok;
+
+	Sys_LockMutex (fs_queue.lock);
+	while (1)
+	{
+		job = fs_queue.head;
+		if (!job)
+		{
+			if (fs_queue.flushing)
+			{
+				fs_queue.flushing = false;
+				Sys_PostSemaphore (fs_queue.done, 1);
+			}
+			fs_queue.sleeping = true;
+			Sys_UnlockMutex (fs_queue.lock);
+			Sys_WaitSemaphore (fs_queue.wake);
+			Sys_LockMutex (fs_queue.lock);
+			continue;
+		}
+		Sys_UnlockMutex (fs_queue.lock);
+
+		ok = FS_RunJob (job);
+
+		Sys_LockMutex (fs_queue.lock);
+		if (!ok)
+		{
+			fs_queue.failed++;
+			Q_strncpyz (fs_queue.failedpath, job->path, sizeof(fs_queue.failedpath));
+		}
+		fs_queue.head = job->next;
+		if (!fs_queue.head)
+			fs_queue.tail = NULL;
+		free (job);
+	}
+}
+
+/*
+=================
+FS_QueueJob
+
+Takes over job.  Without threads it is run right away.
+=================
+*/
+static void FS_QueueJob (fsjob_t *job)
+{
+	if (!job->touch)
+		FS_InvalidateIndexPath (job->path);
+
+	if (job->compress && !fs_queue.writer.block)
+	{
+		fs_queue.writer.block = Z_Malloc (FSZ_BLOCK);
+		fs_queue.writer.packed = Z_Malloc (FSZ_PACKED);
+		fs_queue.writer.hash = Z_Malloc (sizeof(int) << FSZ_HASHBITS);
+	}
+
+	if (!fs_queue.started)
+	{
+		fs_queue.started = true;
+		fs_queue.lock = Sys_CreateMutex ();
+		fs_queue.wake = Sys_CreateSemaphore (0);
+		fs_queue.done = Sys_CreateSemaphore (0);
+		if (fs_queue.lock && fs_queue.wake && fs_queue.done)
+			fs_queue.thread = Sys_CreateThread (FS_QueueThread, NULL);
+	}
+
+	if (!fs_queue.thread)
+	{
+		if (!FS_RunJob (job))
+			Com_Printf ("Couldn't write %s\n", job->path);
+		free (job);
+		return;
+	}
+
+	Sys_LockMutex (fs_queue.lock);
+	if (fs_queue.tail)
+		fs_queue.tail->next = job;
+	else
+		fs_queue.head = job;
+	fs_queue.tail = job;
+	if (fs_queue.sleeping)
+	{
+		fs_queue.sleeping = false;
+		Sys_PostSemaphore (fs_queue.wake, 1);
+	}
+	Sys_UnlockMutex (fs_queue.lock);
+}
+
+/*
+=================
+FS_WritesPending
+
+True if anything queued may not be on disk yet
+=================
+*/
+static qboolean FS_WritesPending (void)
+{
+	qboolean	pending;
+
+	if (!fs_queue.thread)
+		return false;
+
+	Sys_LockMutex (fs_queue.lock);
+	pending = fs_queue.head != NULL;
+	Sys_UnlockMutex (fs_queue.lock);
+	return pending;
+}
+
+/*
+=================
+FS_CopyQueued
+
+If a write of path is still queued, returns a Z_Malloc copy of the
+last data queued for it, as that is what will end up on disk
+=================
+*/
+static byte *FS_CopyQueued (const char *path, int *len)
+{
+	fsjob_t	*job, *last;
+	byte	*copy;
+
+	if (!fs_queue.thread)
+		return NULL;
+
+	copy = NULL;
+	Sys_LockMutex (fs_queue.lock);
+	last = NULL;
+	for (job = fs_queue.head; job; job = job->next)
+	{
+		if (!job->touch && !job->src[0] && !job->compress && !strcmp (job->path, path))
+			last = job;
+	}
+	if (last)
+	{	// the queue thread only reads the data, and can't free the job
+		// until it has the lock
+		copy = Z_Malloc (last->len + 1);
+		memcpy (copy, last->data, last->len);
+		*len = last->len;
+	}
+	Sys_UnlockMutex (fs_queue.lock);
+
+	return copy;
+}
+
+/*
+=================
+FS_NewJob
+=================
+*/
+static fsjob_t *FS_NewJob (char *filename, int len)
+{
+	fsjob_t	*job;
+
+	// the queue thread frees it, and the zone isn't thread safe
+	job = malloc (sizeof(*job) + len);
+	if (!job)
+		Com_Error (ERR_FATAL, "FS_NewJob: couldn't allocate %i bytes for %s", len, filename);
+	memset (job, 0, sizeof(*job));
+	Q_strncpyz (job->path, filename, sizeof(job->path));
+	job->len = len;
+	return job;
+}
+
+/*
+=================
+FS_WriteFileAsync
+
+Queues len bytes of data to be written to filename, which must be a
+full path.  The data is copied, so the caller can reuse it at once.
+=================
+*/
+void FS_WriteFileAsync (char *filename, const void *data, int len, qboolean compress)
+{
+	fsjob_t	*job;
+
+	job = FS_NewJob (filename, len);
+	job->compress = compress;
+	memcpy (job->data, data, len);
+	FS_QueueJob (job);
+}
+
+/*
+=================
+FS_CopyFileAsync
+
+Like FS_WriteFileAsync, a missing src is silently skipped
+=================
+*/
+void FS_CopyFileAsync (char *src, char *dst)
+{
+	fsjob_t	*job;
+
+	job = FS_NewJob (dst, 0);
+	Q_strncpyz (job->src, src, sizeof(job->src));
+	FS_QueueJob (job);
+}
+
+/*
+=================
+FS_FlushWrites
+
+Waits for everything queued to be on disk
+=================
+*/
+void FS_FlushWrites (void)
+{
+	int		failed;
+	char	path[MAX_OSPATH];
+
+	if (!fs_queue.thread)
+		return;
+
+	Sys_LockMutex (fs_queue.lock);
+	if (fs_queue.head)
+	{
+		fs_queue.flushing = true;
+		Sys_UnlockMutex (fs_queue.lock);
+		Sys_WaitSemaphore (fs_queue.done);
+		Sys_LockMutex (fs_queue.lock);
+	}
+	failed = fs_queue.failed;
+	Q_strncpyz (path, fs_queue.failedpath, sizeof(path));
+	fs_queue.failed = 0;
+	Sys_UnlockMutex (fs_queue.lock);
+
+	if (failed == 1)
+		Com_Printf ("Couldn't write %s\n", path);
+	else if (failed)
+		Com_Printf ("Couldn't write %s and %i other files\n", path, failed - 1);
+}
+
+/*
+=================
+FS_StreamLength
+
+Returns the unpacked length of a whole compressed file, or -1 if the
+block headers don't add up
+=================
+*/
+static int FS_StreamLength (const byte *data, int len)
+{
+	int		pos, rawlen, lens[2];
+
+	rawlen = 0;
+	for (pos = 4 ; pos < len ; pos += 8 + lens[1])
+	{
+		if (len - pos < 8)
+			return -1;
+		lens[0] = FSZ_READ32(data + pos);
+		lens[1] = FSZ_READ32(data + pos + 4);
+		if (lens[0] < 1 || lens[0] > FSZ_BLOCK || lens[1] < 1 || lens[1] > lens[0] || lens[1] > len - pos - 8)
+			return -1;
+		if (rawlen > FSZ_MAXSTREAM - lens[0])
+			return -1;		// or a hostile server could wrap the total
+		rawlen += lens[0];
+	}
+
+	return rawlen;
+}
+
+/*
+=================
+FS_LoadStreamFile
+
+Reads all of filename, which must be a full path, with a single read,
+and unpacks it if it was written compressed.  Waits for queued writes
+first.  Returns -1 if the file can't be opened or is damaged, else the
+buffer must be released with FS_FreeFile.
+=================
+*/
+int FS_LoadStreamFile (char *filename, void **buffer)
+{
+	FILE	*f;
+	byte	*file, *out, *in;
+	int		len, rawlen, size, pos, lens[2];
+
+	*buffer = NULL;
+	FS_FlushWrites ();
+
+	f = fopen (filename, "rb");
+	if (!f)
+		return -1;
+	len = FS_filelength (f);
+	file = Z_Malloc (len + 1);
+	if (len && fread (file, len, 1, f) != 1)
+	{
+		fclose (f);
+		Z_Free (file);
+		return -1;
+	}
+	fclose (f);
+
+	if (len < 4 || FSZ_READ32(file) != FSZ_MAGIC)
+	{
+		*buffer = file;
+		return len;
+	}
+
+	rawlen = FS_StreamLength (file, len);
+	if (rawlen < 0)
+	{
+		Com_Printf ("%s is damaged\n", filename);
+		Z_Free (file);
+		return -1;
+	}
+
+	size = rawlen;
+	out = Z_Malloc (size + 1);
+	for (pos = 4, rawlen = 0 ; pos < len ; pos += 8 + lens[1], rawlen += lens[0])
+	{
+		lens[0] = FSZ_READ32(file + pos);
+		lens[1] = FSZ_READ32(file + pos + 4);
+		in = file + pos + 8;
+		if (lens[0] > size - rawlen)
+		{
+			Com_Printf ("%s is damaged\n", filename);
+			Z_Free (out);
+			Z_Free (file);
+			return -1;
+		}
+		if (lens[1] == lens[0])
+			memcpy (out + rawlen, in, lens[0]);
+		else if (!FS_Unpack (in, lens[1], out + rawlen, lens[0]))
+		{
+			Com_Printf ("%s is damaged\n", filename);
+			Z_Free (out);
+			Z_Free (file);
+			return -1;
+		}
+	}
+
+	Z_Free (file);
+	*buffer = out;
+	return rawlen;
+}
+
+
+/*
+============
+FS_LoadFile
+
+Filename are reletive to the quake search path
+a null buffer will just return the file length without loading
+
+With fs_mmap set, files in a pak come back as pointers straight into
+the mapped pak.  The mapping is copy-on-write, so callers may still
+scribble on the data, but the changes stay until the pak is unmapped.
+============
+*/
+int FS_LoadFile (char *path, void **buffer)
+{
+	FILE *h;
+	byte *buf;
+	int len;
+	pack_t *pak;
+
+	buf = NULL;	// quiet compiler warning
+
+	// look for it in the filesystem or pack files
+	len = FS_FOpenFileOrMap(path, &h, &buf);
+	if (buf) {
+		if (buffer) {
+			for (pak = fs_mappedpacks; pak; pak = pak->nextmapped) {
+				if (buf >= pak->mapped && buf < pak->mapped + pak->mappedlen) {
+					pak->mappedrefs++;
+					break;
+				}
+			}
+			*buffer = buf;
+		}
+		return len;
+	}
+	if (!h) {
+		if (buffer) {
+			*buffer = NULL;
+		}
+		return -1;
+	}
+
+	if (!buffer) {
+		fclose (h);
+		return len;
+	}
+
+	buf = Z_Malloc(len);
+	*buffer = buf;
+
+	FS_Read(buf, len, h);
+
+	fclose (h);
+
+	return len;
+}
+
+
+/*
+=============
+FS_UnmapPack
+=============
+*/
+static void FS_UnmapPack (pack_t *pack)
+{
+	pack_t	**prev;
+
+	for (prev = &fs_mappedpacks; *prev; prev = &(*prev)->nextmapped)
+	{
+		if (*prev == pack)
+		{
+			*prev = pack->nextmapped;
+			break;
+		}
+	}
+
+	Sys_UnmapFile (pack->mapped, pack->mappedlen);
+	pack->mapped = NULL;
+}
+
+/*
+=============
+FS_FreePack
+
+Mapped paks with buffers still out are kept around until
+the last one is freed.
+=============
+*/
+static void FS_FreePack (pack_t *pack)
+{
+	fclose (pack->handle);
+	Z_Free (pack->files);
+	pack->files = NULL;
+	pack->numfiles = 0;
+
+	if (pack->mapped)
+	{
+		if (pack->mappedrefs)
+		{
+			pack->removed = true;
+			return;
+		}
+		FS_UnmapPack (pack);
+	}
+	Z_Free (pack);
+}
+
+/*
+=============
+FS_FreeFile
+=============
+*/
+void FS_FreeFile (void *buffer)
+{
+	pack_t	*pak;
+
+	if (!buffer)
+		return;
+
+	for (pak = fs_mappedpacks; pak; pak = pak->nextmapped)
+	{
+		if ((byte *)buffer >= pak->mapped && (byte *)buffer < pak->mapped + pak->mappedlen)
+		{
+			if (!--pak->mappedrefs && pak->removed)
+			{
+				FS_UnmapPack (pak);
+				Z_Free (pak);
+			}
+			return;
+		}
+	}
+
+	Z_Free (buffer);
+}
+
+
+/*
+=============================================================================
+
+ASSET CACHE
+
+Things that take a while to work out from a file, like resampled sounds
+or mipmapped textures, can be kept in the cache directory of the game
+dir and mapped back in on later runs.  An entry is named after the file
+it came from and a key the caller builds from whatever else went into
+it, such as the output rate or picmip.  It is only used while the search
+path still finds the same file: for a pak entry that is the checksum of
+the pak's directory and where the entry sits in it, for a loose file its
+size and time.  Entries are written by the background queue and are in
+native byte order.  Each hit touches its entry's time, also from the
+queue, so when the directory has grown past fs_cachesize megabytes by
+the end of a level load the least recently used entries are removed.
+0 turns the cache off.
+
+=============================================================================
+*/
+
+#define	FS_CACHEDIR			"cache"
+#define	FS_CACHE_IDENT		(('C'<<24)+('A'<<16)+('2'<<8)+'Q')	// "Q2AC"
+#define	FS_CACHE_VERSION	1	// bump when the header or any caller's data changes
+
+typedef struct
+{
+	int			ident;
+	int			version;
+	unsigned	stamp;			// FS_FileStamp of the source
+	unsigned	keysum;			// Com_BlockChecksum of the caller's key
+	int			datalen;
+	char		name[MAX_QPATH];	// source, to catch name collisions
+	int			pad[3];			// keeps the data 16 byte aligned
+} fscacheheader_t;
+
+typedef struct fscachebuf_s
+{
+	struct fscachebuf_s	*next;
+	byte		*base;			// the header
+	int			mappedlen;		// 0 if base is in the zone
+} fscachebuf_t;
+
+static fscachebuf_t	*fs_cachebufs;		// handed out by FS_LoadCache
+static int			fs_cachebytes = -1;	// in the directory, -1 until counted
+static qboolean		fs_cachedir;		// created this session
+
+/*
+=================
+FS_FileStamp
+
+Returns something that changes whenever the file the search path finds
+for filename does, 0 if it isn't found or comes through a link
+=================
+*/
+unsigned FS_FileStamp (char *filename)
+{
+	searchpath_t	*search;
+	filelink_t		*link;
+	pack_t			*pak;
+	struct stat		st;
+	char			netpath[MAX_OSPATH];
+	unsigned		stamp[4];
+	long			hash;
+	int				i;
+
 	for (link = fs_links; link; link = link->next)
 	{
 		if (!strncmp(filename, link->from, link->fromlength))
-		{
-			Com_sprintf (netpath, sizeof(netpath), "%s%s",link->to, filename+link->fromlength);
-			*file = fopen (netpath, "rb");
-			if (*file)
-			{
-				Com_DPrintf(DEVELOPER_MSG_IO, "link file: %s\n",netpath);
-				return FS_filelength (*file);
-			}
-			return -1;
-		}
+			return 0;
 	}
 
-//
-// search through the path, one element at a time
-//
+	hash = Com_HashFileName (filename, 0, false);
 	for (search = fs_searchpaths ; search ; search = search->next)
 	{
-	// is the element a pak file?
-		if (search->pack)
+		pak = search->pack;
+		if (pak)
 		{
-		// look through all the pak file elements
-			pak = search->pack;
-
-			// Knightmare- skip if pack doesn't contain this type of file
-			if (typeFlag != 0 && !(pak->contentFlags & typeFlag))
-				continue;
-
-#ifdef BINARY_PACK_SEARCH /* Knightmare- use new binary algorithm */
-			/* find index of pack item */
+#ifdef BINARY_PACK_SEARCH
 			i = FS_FindPackItem (pak, filename, hash);
-			if (i >= 0) /* found it! */
-			{
-				file_from_pak = 1;
-			// open a new file on the pakfile
-				*file = fopen (pak->filename, "rb");
-				if (!*file)
-				{
-					Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->filename);
-					return -1;
-				}
-				fseek (*file, pak->files[i].filepos, SEEK_SET);
-				return pak->files[i].filelen;
-			}
 #else
 			for (i = 0; i < pak->numfiles; i++)
 			{
-				if (pak->files[i].ignore)	// Knightmare- skip blacklisted files
-					continue;
-				if (hash != pak->files[i].hash)	// Knightmare- compare hash first
-					continue;
-				if (!Q_strcasecmp (pak->files[i].name, filename))
-				{	// found it!
-					file_from_pak = 1;
-				// open a new file on the pakfile
-					*file = fopen (pak->filename, "rb");
-					if (!*file)
-						Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->filename);
-					fseek (*file, pak->files[i].filepos, SEEK_SET);
-					return pak->files[i].filelen;
-				}
+				if (!pak->files[i].ignore && hash == pak->files[i].hash
+					&& !Q_strcasecmp (pak->files[i].name, filename))
+					break;
 			}
+			if (i == pak->numfiles)
+				i = -1;
 #endif /* BINARY_PACK_SEARCH */
-		}
-		else
-		{
-		// check a file in the directory tree
-			Com_sprintf (netpath, sizeof(netpath), "%s/%s",search->filename, filename);
-
-			*file = fopen (netpath, "rb");
-			if (!*file)
+			if (i < 0)
 				continue;
-			
-			Com_DPrintf(DEVELOPER_MSG_IO, "FindFile: %s\n",netpath);
-
-			return FS_filelength (*file);
+			stamp[0] = pak->checksum;
+			stamp[1] = pak->files[i].filepos;
+			stamp[2] = pak->files[i].filelen;
+			stamp[3] = 0;
+			break;
 		}
+
+		Com_sprintf (netpath, sizeof(netpath), "%s/%s", search->filename, filename);
+		if (stat (netpath, &st) || (st.st_mode & S_IFDIR))
+			continue;
+		stamp[0] = (unsigned)st.st_size;
+		stamp[1] = (unsigned)st.st_mtime;
+		stamp[2] = 0;
+		stamp[3] = 1;
+		break;
 	}
 
-	Com_DPrintf(DEVELOPER_MSG_IO, "FindFile: can't find %s\n", filename);
-	
-	*file = NULL;
-	return -1;
+	if (!search)
+		return 0;
+	stamp[0] = Com_BlockChecksum (stamp, sizeof(stamp));
+	return stamp[0] ? stamp[0] : 1;
 }
 
 /*
 =================
-FS_Read
-
-Properly handles partial reads
+FS_CachePath
 =================
 */
-void FS_Read (void *buffer, int len, FILE *f)
+static void FS_CachePath (char *path, int size, char *name, unsigned keysum)
 {
-	int		block, remaining;
-	int		read;
-	byte	*buf;
-	int		tries;
+	char	lower[MAX_QPATH];
+
+	// pak lookups ignore case, so the entries do too.  8.3 names for
+	// dos, the header sorts out the odd collision
+	Q_strncpyz (lower, name, sizeof(lower));
+	Q_strlwr (lower);
+	Com_sprintf (path, size, "%s/" FS_CACHEDIR "/%08x.bin", FS_Gamedir(),
+		Com_BlockChecksum (lower, strlen(lower)) ^ keysum);
+}
 
-	buf = (byte *)buffer;
+/*
+=================
+FS_CacheCompare
 
-	// read in chunks for progress bar
-	remaining = len;
-	tries = 0;
-	while (remaining)
-	{
-		block = remaining;
-		if (block > MAX_READ)
-			block = MAX_READ;
-		read = fread (buf, 1, block, f);
-		if (read == 0)
-		{
-			// we might have been trying to read from a CD
-			if (!tries)
-			{
-				tries = 1;
-				CDAudio_Stop();
-			}
-			else
-				Com_Error (ERR_FATAL, "FS_Read: 0 bytes read");
-		}
+Least recently used first, the queue touches an entry on every hit
+=================
+*/
+typedef struct
+{
+	char	*name;
+	int		size;
+	time_t	time;
+} fscachefile_t;
 
-		// do some progress bar thing here...
+static int FS_CacheCompare (const void *a, const void *b)
+{
+	const fscachefile_t	*fa = (const fscachefile_t *)a;
+	const fscachefile_t	*fb = (const fscachefile_t *)b;
 
-		remaining -= read;
-		buf += read;
-	}
+	return (fa->time > fb->time) - (fa->time < fb->time);
 }
 
-
-// Knightmare added
 /*
 =================
-FS_FRead
+FS_TrimCache
 
-Properly handles partial reads of size up to count times
-No error if it can't read
+Removes the least recently used entries until no more than keep bytes
+are left, and returns how many are.  Entries still queued aren't
+counted until they are on disk.
 =================
 */
-int FS_FRead (void *buffer, int size, int count, FILE *f)
+static int FS_TrimCache (int keep, int *removed)
 {
-	int			loops, remaining, r;
-	byte		*buf;
-	qboolean	tried = false;
+	fscachefile_t	*files;
+	struct stat		st;
+	char			findname[MAX_OSPATH];
+	char			**list;
+	int				i, num, total;
 
-	// Read
-	loops = count;
-	//remaining = size;
-	buf = (byte *)buffer;
+	*removed = 0;
 
-	while (loops)
-	{	// Read in chunks
-		remaining = size;
-		while (remaining)
-		{
-			r = fread(buf, 1, remaining, f);
+	Com_sprintf (findname, sizeof(findname), "%s/" FS_CACHEDIR "/*.bin", FS_Gamedir());
+	list = FS_ListFiles (findname, &num, 0, SFF_SUBDIR | SFF_HIDDEN | SFF_SYSTEM);
+	if (!list)
+		return 0;
+	num--;	// the guard
 
-			if (r == 0)
-			{
-				if (!tried)
-				{	// We might have been trying to read from a CD
-					CDAudio_Stop();
-					tried = true;
-				}
-				else {
-				//	Com_Printf("FS_FRead: 0 bytes read\n");
-					return size - remaining;
-				}
-			}
+	files = Z_Malloc (num * sizeof(*files));
+	for (i = total = 0; i < num; i++)
+	{
+		files[i].name = list[i];
+		if (stat (list[i], &st))
+			continue;	// left at size 0
+		files[i].size = st.st_size;
+		files[i].time = st.st_mtime;
+		total += st.st_size;
+	}
+	qsort (files, num, sizeof(*files), FS_CacheCompare);
 
-			remaining -= r;
-			buf += r;
-		}
-		loops--;
+	for (i = 0; i < num && total > keep; i++)
+	{
+		if (remove (files[i].name))
+			continue;
+		total -= files[i].size;
+		(*removed)++;
 	}
-	return size;
-}
 
+	Z_Free (files);
+	FS_FreeFileList (list, num + 1);
+	return total;
+}
 
 /*
 =================
-FS_Seek
+FS_LoadCache
+
+Returns the data stored for name and key, mapped if the platform can,
+or NULL.  Release it with FS_FreeCache.
 =================
 */
-int FS_Seek (FILE *f, int offset, fsOrigin_t origin)
+void *FS_LoadCache (char *name, const void *key, int keylen, int *len)
 {
-	switch (origin)
-	{
-	case FS_SEEK_SET:
-		return fseek(f, offset, SEEK_SET);
+	fscacheheader_t	*header;
+	fscachebuf_t	*buf;
+	fsjob_t			*job;
+	char			path[MAX_OSPATH];
+	unsigned		stamp, keysum;
+	byte			*base;
+	int				baselen, mappedlen;
+	FILE			*f;
+
+	if (!fs_cachesize || fs_cachesize->intValue <= 0)
+		return NULL;
+	stamp = FS_FileStamp (name);
+	if (!stamp)
+		return NULL;
 
-	case FS_SEEK_CUR:
-		return fseek(f, offset, SEEK_CUR);
+	keysum = Com_BlockChecksum ((void *)key, keylen);
+	FS_CachePath (path, sizeof(path), name, keysum);
+
+	// a mapping of a file the queue is still writing could be cut short,
+	// so an entry that is queued comes from the queue
+	mappedlen = baselen = 0;
+	base = FS_CopyQueued (path, &baselen);
+	if (!base)
+		base = Sys_MapFile (path, &mappedlen);
+	if (mappedlen)
+		baselen = mappedlen;
+	else if (!base)
+	{
+		f = fopen (path, "rb");
+		if (!f)
+		{
+			fs_cachemisses++;
+			return NULL;
+		}
+		baselen = FS_filelength (f);
+		base = Z_Malloc (baselen + 1);
+		if (fread (base, 1, baselen, f) != baselen)
+			baselen = 0;
+		fclose (f);
+	}
 
-	case FS_SEEK_END:
-		return fseek(f, offset, SEEK_END);
+	header = (fscacheheader_t *)base;
+	if (baselen < sizeof(*header) || header->ident != FS_CACHE_IDENT
+		|| header->version != FS_CACHE_VERSION || header->stamp != stamp
+		|| header->keysum != keysum || header->datalen != baselen - sizeof(*header)
+		|| Q_stricmp (header->name, name))
+	{
+		if (mappedlen)
+			Sys_UnmapFile (base, mappedlen);
+		else
+			Z_Free (base);
+		fs_cachestale++;
+		return NULL;
 	}
-	Com_Error(ERR_FATAL, "FS_Seek: bad origin (%i)", origin);
-	return -1;
-}
 
+	buf = Z_Malloc (sizeof(*buf));
+	buf->base = base;
+	buf->mappedlen = mappedlen;
+	buf->next = fs_cachebufs;
+	fs_cachebufs = buf;
+
+	job = FS_NewJob (path, 0);
+	job->touch = true;
+	FS_QueueJob (job);
+
+	fs_cachehits++;
+	*len = header->datalen;
+	return base + sizeof(*header);
+}
 
 /*
 =================
-FS_Tell
-
-Returns -1 if an error occurs
+FS_FreeCache
 =================
 */
-long FS_Tell (FILE *f)
+void FS_FreeCache (void *data)
 {
-	return ftell(f);
-}
-// end Knightmare
+	fscachebuf_t	**prev, *buf;
 
+	for (prev = &fs_cachebufs; *prev; prev = &(*prev)->next)
+	{
+		buf = *prev;
+		if (buf->base + sizeof(fscacheheader_t) != data)
+			continue;
+
+		*prev = buf->next;
+		if (buf->mappedlen)
+			Sys_UnmapFile (buf->base, buf->mappedlen);
+		else
+			Z_Free (buf->base);
+		Z_Free (buf);
+		return;
+	}
+}
 
 /*
-============
-FS_LoadFile
+=================
+FS_WriteCache
 
-Filename are reletive to the quake search path
-a null buffer will just return the file length without loading
-============
+Queues len bytes of data to be stored for name and key
+=================
 */
-int FS_LoadFile (char *path, void **buffer)
+void FS_WriteCache (char *name, const void *key, int keylen, const void *data, int len)
 {
-	FILE *h;
-	byte *buf;
-	int len;
+	fscacheheader_t	*header;
+	fsjob_t			*job;
+	char			path[MAX_OSPATH];
+	unsigned		stamp, keysum;
 
-	buf = NULL;	// quiet compiler warning
+	if (!fs_cachesize || fs_cachesize->intValue <= 0 || strlen(name) >= MAX_QPATH)
+		return;
+	stamp = FS_FileStamp (name);
+	if (!stamp)
+		return;
 
-	// look for it in the filesystem or pack files
-	len = FS_FOpenFile(path, &h);
-	if (!h) {
-		if (buffer) {
-			*buffer = NULL;
-		}
-		return -1;
+	keysum = Com_BlockChecksum ((void *)key, keylen);
+	FS_CachePath (path, sizeof(path), name, keysum);
+	if (!fs_cachedir)
+	{
+		FS_CreatePath (path);
+		fs_cachedir = true;
 	}
 
-	if (!buffer) {
-		fclose (h);
-		return len;
-	}
+	job = FS_NewJob (path, sizeof(*header) + len);
+	header = (fscacheheader_t *)job->data;
+	memset (header, 0, sizeof(*header));
+	header->ident = FS_CACHE_IDENT;
+	header->version = FS_CACHE_VERSION;
+	header->stamp = stamp;
+	header->keysum = keysum;
+	header->datalen = len;
+	Q_strncpyz (header->name, name, sizeof(header->name));
+	memcpy (job->data + sizeof(*header), data, len);
+	FS_QueueJob (job);
+	fs_cachewrites++;
+
+	// replaced entries are counted twice until the next trim, which
+	// waits for FS_CheckCache so the directory isn't walked mid game
+	if (fs_cachebytes >= 0)
+		fs_cachebytes += sizeof(*header) + len;
+}
 
-	buf = Z_Malloc(len);
-	*buffer = buf;
+/*
+=================
+FS_CheckCache
 
-	FS_Read(buf, len, h);
+Called when a level has finished loading.  Counts the cache directory
+the first time, and trims it if it has grown past fs_cachesize.
+=================
+*/
+void FS_CheckCache (void)
+{
+	int		limit, removed;
 
-	fclose (h);
+	if (!fs_cachesize || fs_cachesize->intValue <= 0)
+		return;
 
-	return len;
+	limit = min(fs_cachesize->intValue, 2047) * 1024 * 1024;
+	if (fs_cachebytes < 0)
+		fs_cachebytes = FS_TrimCache (0x7fffffff, &removed);
+
+	if (fs_cachebytes > limit)
+	{
+		fs_cachebytes = FS_TrimCache (limit - limit/4, &removed);
+		fs_cachetrims++;
+	}
 }
 
+/*
+=================
+FS_ClearCache_f
+=================
+*/
+void FS_ClearCache_f (void)
+{
+	int		removed;
+
+	FS_FlushWrites ();
+	fs_cachebytes = FS_TrimCache (0, &removed);
+	Com_Printf ("Removed %i cache entries.\n", removed);
+}
 
 /*
-=============
-FS_FreeFile
-=============
+=================
+FS_ResetCache
+
+The cache directory moves with the game dir
+=================
 */
-void FS_FreeFile (void *buffer)
+static void FS_ResetCache (void)
 {
-	if(buffer)
-		Z_Free (buffer);
+	fs_cachebytes = -1;
+	fs_cachedir = false;
 }
 
 
@@ -778,8 +2923,34 @@ static pack_t *FS_LoadPackFile (const char *packfile)
 	pack->numfiles = numpackfiles;
 	pack->files = newfiles;
 	pack->contentFlags = contentFlags;	// Knightmare added
+	pack->checksum = Com_BlockChecksum (info, header.dirlen) ^ header.dirofs;
+
+	if (fs_mmap && fs_mmap->intValue)
+	{
+		pack->mapped = Sys_MapFile (packfile, &pack->mappedlen);
+		if (pack->mapped)
+		{	// a truncated pak falls back to reading
+			for (i = 0; i < numpackfiles; i++)
+			{
+				if (newfiles[i].filepos < 0 || newfiles[i].filelen < 0
+					|| newfiles[i].filepos > pack->mappedlen - newfiles[i].filelen)
+					break;
+			}
+			if (i < numpackfiles)
+			{
+				Com_Printf ("%s is truncated, not mapping it\n", packfile);
+				Sys_UnmapFile (pack->mapped, pack->mappedlen);
+				pack->mapped = NULL;
+			}
+			else
+			{
+				pack->nextmapped = fs_mappedpacks;
+				fs_mappedpacks = pack;
+			}
+		}
+	}
 
-	Com_Printf ("Added packfile %s (%i files)\n", packfile, numpackfiles);
+	Com_Printf ("Added packfile %s (%i files%s)\n", packfile, numpackfiles, pack->mapped ? ", mapped" : "");
 	return pack;
 }
 
@@ -823,6 +2994,7 @@ void FS_AddPAKFile (const char *packPath)
 	search->pack = pack;
 	search->next = fs_searchpaths;
 	fs_searchpaths = search;
+	FS_InvalidateIndex ();
 }
 
 /*
@@ -842,6 +3014,7 @@ static void FS_AddGameDirectory (const char *dir)
 
 	strncpy (fs_gamedir, dir, sizeof(fs_gamedir)-1);
 	fs_gamedir[sizeof(fs_gamedir)-1] = 0;
+	FS_InvalidateIndex ();
 
 	//
 	// add the directory to the search path
@@ -928,15 +3101,13 @@ void FS_SetGamedir (char *dir)
 	while (fs_searchpaths != fs_base_searchpaths)
 	{
 		if (fs_searchpaths->pack)
-		{
-			fclose (fs_searchpaths->pack->handle);
-			Z_Free (fs_searchpaths->pack->files);
-			Z_Free (fs_searchpaths->pack);
-		}
+			FS_FreePack (fs_searchpaths->pack);
 		next = fs_searchpaths->next;
 		Z_Free (fs_searchpaths);
 		fs_searchpaths = next;
 	}
+	FS_InvalidateIndex ();
+	FS_ResetCache ();
 
 	//
 	// flush all data, so it will be forced to reload
@@ -980,6 +3151,8 @@ void FS_Link_f (void)
 		return;
 	}
 
+	FS_InvalidateIndex ();
+
 	// r1ch's fix to prevent filesystem browsing
 	to = Cmd_Argv(2);
 	if (to[0])
@@ -1143,7 +3316,7 @@ void FS_Path_f (void)
 			Com_Printf ("----------\n");
 		if (s->pack)
 		//	Com_Printf("%s (%i files, content flags: %d)\n", s->pack->filename, s->pack->numfiles, s->pack->contentFlags);
-			Com_Printf ("%s (%i files)\n", s->pack->filename, s->pack->numfiles);
+			Com_Printf ("%s (%i files%s)\n", s->pack->filename, s->pack->numfiles, s->pack->mapped ? ", mapped" : "");
 		else
 			Com_Printf ("%s\n", s->filename);
 	}
@@ -1195,6 +3368,13 @@ void FS_InitFilesystem (void)
 	Cmd_AddCommand ("path", FS_Path_f);
 	Cmd_AddCommand ("link", FS_Link_f);
 	Cmd_AddCommand ("dir", FS_Dir_f);
+	Cmd_AddCommand ("fs_stats", FS_Stats_f);
+	Cmd_AddCommand ("cache_clear", FS_ClearCache_f);
+
+	fs_mmap = Cvar_Get ("fs_mmap", "0", CVAR_NOSET);
+	Cvar_SetDescription("fs_mmap", "Map pak files into memory and load files from them without copying.  Must be set at run time.");
+	fs_cachesize = Cvar_Get ("fs_cachesize", "0", CVAR_ARCHIVE);
+	Cvar_SetDescription("fs_cachesize", "Megabytes of decoded sounds and textures to keep in the cache directory of the game dir for later runs.  0 disables the cache.");
 
 	//
 	// basedir <path>
@@ -121,7 +121,7 @@ void MSG_WritePos (sizebuf_t *sb, vec3_t pos);
 void MSG_WriteAngle (sizebuf_t *sb, float f);
 void MSG_WriteAngle16 (sizebuf_t *sb, float f);
 void MSG_WriteDeltaUsercmd (sizebuf_t *sb, struct usercmd_s *from, struct usercmd_s *cmd);
-void MSG_WriteDeltaEntity (struct entity_state_s *from, struct entity_state_s *to, sizebuf_t *msg, qboolean force, qboolean newentity);
+int MSG_WriteDeltaEntity (struct entity_state_s *from, struct entity_state_s *to, sizebuf_t *msg, qboolean force, qboolean newentity);
 void MSG_WriteDir (sizebuf_t *sb, vec3_t vector);
 
 
@@ -169,6 +169,7 @@ void COM_Init (void);
 void COM_InitArgv (int argc, char **argv);
 
 char *CopyString (char *in);
+unsigned Com_HashKey (const char *name, int size);	// size must be a power of two
 
 void StripHighBits (char *string, int highbits);
 void ExpandNewLines (char *string);
@@ -249,6 +250,16 @@ enum svc_ops_e
 	svc_frame
 };
 
+// svc_download sizes below -1 belong to the windowed download protocol.
+// a client asks for it with a flags argument after the "download" offset,
+// servers that don't know it ignore the argument and answer as usual
+#define	DOWNLOAD_WINDOWED	-2		// [byte] flags [long] size [long] offset, reliable
+#define	DOWNLOAD_CHUNK		-3		// [long] offset [short] length [length bytes], unreliable
+#define	DOWNLOAD_CHUNKSIZE	(MAX_MSGLEN_MP - 64)	// keeps a chunk and the headers in one datagram
+
+#define	DLF_WINDOWED		1		// the client acknowledges with "nextdl <offset>"
+#define	DLF_COMPRESSED		2		// asked for by the client, set by the server if it did
+
 //==============================================
 
 //
@@ -581,6 +592,14 @@ void		NET_Config (qboolean multiplayer);
 qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message);
 void		NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to);
 
+void		NET_BeginBatch (netsrc_t sock);
+void		NET_FlushBatch (netsrc_t sock);
+// packets sent on sock in between may be held back and sent together
+// with fewer system calls
+
+int			NET_SystemCalls (void);
+// socket calls made so far, for stats
+
 qboolean	NET_CompareAdr (netadr_t a, netadr_t b);
 qboolean	NET_CompareBaseAdr (netadr_t a, netadr_t b);
 qboolean	NET_IsLocalAddress (netadr_t adr);
@@ -679,6 +698,25 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 						  int headnode, int brushmask,
 						  vec3_t origin, vec3_t angles);
 
+// traces through different contexts may run at the same time, the two
+// above share one context and must stay on the main thread.  the box
+// hull from CM_HeadnodeForBox is still shared by everyone
+typedef struct cmtrace_s cmtrace_t;
+
+// these use the zone, so only on the main thread, around any jobs
+cmtrace_t	*CM_AllocTraceContext (void);
+void		CM_FreeTraceContext (cmtrace_t *tr);
+trace_t		CM_ContextBoxTrace (cmtrace_t *tr, vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask);
+trace_t		CM_ContextTransformedBoxTrace (cmtrace_t *tr, vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask,
+						  vec3_t origin, vec3_t angles);
+void		CM_TraceTest_f (void);
+
+// the returned rows are read only, and only stay valid across later
+// calls when cm_viscache holds the whole map
 byte		*CM_ClusterPVS (int cluster);
 byte		*CM_ClusterPHS (int cluster);
 
@@ -699,8 +737,8 @@ qboolean	CM_AreasConnected (int area1, int area2);
 int			CM_WriteAreaBits (byte *buffer, int area);
 qboolean	CM_HeadnodeVisible (int headnode, byte *visbits);
 
-void		CM_WritePortalState (FILE *f);
-void		CM_ReadPortalState (FILE *f);
+void		CM_WritePortalState (sizebuf_t *buf);
+void		CM_ReadPortalState (sizebuf_t *msg);
 
 /*
 ==============================================================
@@ -751,6 +789,48 @@ void	FS_FreeFile (void *buffer);
 
 void	FS_CreatePath (char *path);
 
+void	FS_InvalidateIndex (void);
+// call when the search path changes
+void	FS_InvalidateIndexPath (const char *path);
+// call before writing the file at this OS path, FS_CreatePath does it
+
+// sequential files written on a background thread, optionally compressed,
+// and read back either way.  the writer takes a full path
+typedef struct fswriter_s fswriter_t;
+typedef struct fsreader_s fsreader_t;
+
+fswriter_t	*FS_OpenWriter (char *filename, qboolean compress);
+void		FS_WriteStream (fswriter_t *w, const void *buffer, int len);
+qboolean	FS_CloseWriter (fswriter_t *w);
+// waits for the writes to finish, false if any failed
+
+fsreader_t	*FS_OpenReader (FILE *f, int len);
+// takes over a file from FS_FOpenFile
+int			FS_ReadStream (fsreader_t *r, void *buffer, int len);
+void		FS_CloseReader (fsreader_t *r);
+
+// whole files written in order by a background thread, full paths only.
+// anything that reads those files back must flush first
+void		FS_WriteFileAsync (char *filename, const void *data, int len, qboolean compress);
+void		FS_CopyFileAsync (char *src, char *dst);
+void		FS_FlushWrites (void);
+int			FS_LoadStreamFile (char *filename, void **buffer);
+// flushes, unpacks if needed, free with FS_FreeFile.  -1 if it can't be read
+int			FS_PackBuffer (const void *data, int len, byte **packed);
+// a whole compressed stream in one Z_Malloc buffer, returns its length
+
+// decoded assets kept across runs, see fs_cachesize.  name is the source
+// file, key whatever else went into the data.  main thread only
+unsigned	FS_FileStamp (char *filename);
+// changes whenever the file the search path finds does, 0 if it isn't found
+void		*FS_LoadCache (char *name, const void *key, int keylen, int *len);
+// NULL if there is no entry for exactly this file and key
+void		FS_FreeCache (void *data);
+void		FS_WriteCache (char *name, const void *key, int keylen, const void *data, int len);
+// data is copied
+void		FS_CheckCache (void);
+// after a level has loaded, trims the cache to fs_cachesize
+
 // Knightmare added
 int			FS_FRead (void *buffer, int size, int count, FILE *f);
 int			FS_Seek (FILE *f, int offset, fsOrigin_t origin);
@@ -823,6 +903,10 @@ void *Z_Malloc (int size);			// returns 0 filled memory
 void *Z_TagMalloc (int size, int tag);
 void Z_FreeTags (int tag);
 
+void Com_RunJobs (int numjobs, void (*func)(int job, void *arg), void *arg, int numthreads);
+// calls func for each job number on up to numthreads threads, and waits
+// for them all.  runs serially on platforms without threads
+
 void Qcommon_Init (int argc, char **argv);
 
 void Qcommon_Frame (int msec);
@@ -861,6 +945,10 @@ void	Sys_CopyProtect (void);
 
 void	Sys_Sleep (unsigned msec);	// Knightmare added
 
+void	*Sys_MapFile (const char *path, int *length);
+// maps a whole file copy-on-write, NULL if it can't be mapped
+void	Sys_UnmapFile (void *base, int length);
+
 #ifdef __DJGPP__
 void Sys_InitDXE3 (void);
 void *Sys_dlopen (const char *filename, qboolean globalmode);
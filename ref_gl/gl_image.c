@@ -26,6 +26,7 @@ int			base_textureid;		// gltextures[i] = base_textureid+i
 
 static byte			 intensitytable[256];
 static unsigned char gammatable[256];
+static byte			 lighttable[256];	// gammatable[intensitytable[i]]
 
 cvar_t		*intensity;
 
@@ -34,6 +35,17 @@ unsigned	d_8to24table[256];
 qboolean GL_Upload8 (byte *data, int width, int height,  qboolean mipmap, qboolean is_sky );
 qboolean GL_Upload32 (unsigned *data, int width, int height,  qboolean mipmap);
 
+// a texture ready to be handed to GL, see GL_PrepareUpload32
+typedef struct
+{
+	byte		*levels;		// every mip level, largest first
+	int			numlevels;
+	int			width, height;	// of the first level, after power of two and picmip
+	qboolean	hasAlpha;
+	qboolean	paletted;		// levels are 8 bit, otherwise rgba
+	qboolean	cached;			// levels belong to the asset cache
+} glupload_t;
+
 int		gl_solid_format = 3;
 int		gl_alpha_format = 4;
 
@@ -486,36 +498,13 @@ PCX LOADING
 
 /*
 ==============
-LoadPCX
+PCX_Header
+
+Byte swaps and checks the header of a PCX file in memory
 ==============
 */
-void LoadPCX (char *filename, byte **pic, byte **palette, int *width, int *height)
+static qboolean PCX_Header (pcx_t *pcx)
 {
-	byte	*raw;
-	pcx_t	*pcx;
-	int		x, y;
-	int		len;
-	int		dataByte, runLength;
-	byte	*out, *pix;
-
-	*pic = NULL;
-	*palette = NULL;
-
-	//
-	// load the file
-	//
-	len = ri.FS_LoadFile (filename, (void **)&raw);
-	if (!raw)
-	{
-		ri.Con_Printf (PRINT_DEVELOPER, "Bad pcx file %s\n", filename);
-		return;
-	}
-
-	//
-	// parse the PCX file
-	//
-	pcx = (pcx_t *)raw;
-
     pcx->xmin = LittleShort(pcx->xmin);
     pcx->ymin = LittleShort(pcx->ymin);
     pcx->xmax = LittleShort(pcx->xmax);
@@ -525,35 +514,36 @@ void LoadPCX (char *filename, byte **pic, byte **palette, int *width, int *heigh
     pcx->bytes_per_line = LittleShort(pcx->bytes_per_line);
     pcx->palette_type = LittleShort(pcx->palette_type);
 
-	raw = &pcx->data;
-
 	if (pcx->manufacturer != 0x0a
 		|| pcx->version != 5
 		|| pcx->encoding != 1
 		|| pcx->bits_per_pixel != 8
 		|| pcx->xmax >= 640
 		|| pcx->ymax >= 480)
-	{
-		ri.Con_Printf (PRINT_ALL, "Bad pcx file %s\n", filename);
-		return;
-	}
+		return false;
 
-	out = malloc ( (pcx->ymax+1) * (pcx->xmax+1) );
+	return true;
+}
 
-	*pic = out;
+/*
+==============
+PCX_Decode
 
-	pix = out;
+Unpacks the pixels of a PCX file that passed PCX_Header.  Returns NULL
+if the file is malformed.  Safe to call from worker threads.
+==============
+*/
+static byte *PCX_Decode (pcx_t *pcx, int len)
+{
+	int		x, y;
+	int		dataByte, runLength;
+	byte	*raw, *out, *pix;
 
-	if (palette)
-	{
-		*palette = malloc(768);
-		memcpy (*palette, (byte *)pcx + len - 768, 768);
-	}
+	raw = &pcx->data;
 
-	if (width)
-		*width = pcx->xmax+1;
-	if (height)
-		*height = pcx->ymax+1;
+	out = malloc ( (pcx->ymax+1) * (pcx->xmax+1) );
+
+	pix = out;
 
 	for (y=0 ; y<=pcx->ymax ; y++, pix += pcx->xmax+1)
 	{
@@ -577,11 +567,63 @@ void LoadPCX (char *filename, byte **pic, byte **palette, int *width, int *heigh
 
 	if ( raw - (byte *)pcx > len)
 	{
-		ri.Con_Printf (PRINT_DEVELOPER, "PCX file %s was malformed", filename);
-		free (*pic);
-		*pic = NULL;
+		free (out);
+		return NULL;
+	}
+
+	return out;
+}
+
+/*
+==============
+LoadPCX
+==============
+*/
+void LoadPCX (char *filename, byte **pic, byte **palette, int *width, int *height)
+{
+	byte	*raw;
+	pcx_t	*pcx;
+	int		len;
+
+	*pic = NULL;
+	*palette = NULL;
+
+	//
+	// load the file
+	//
+	len = ri.FS_LoadFile (filename, (void **)&raw);
+	if (!raw)
+	{
+		ri.Con_Printf (PRINT_DEVELOPER, "Bad pcx file %s\n", filename);
+		return;
+	}
+
+	//
+	// parse the PCX file
+	//
+	pcx = (pcx_t *)raw;
+
+	if (!PCX_Header (pcx))
+	{
+		ri.Con_Printf (PRINT_ALL, "Bad pcx file %s\n", filename);
+		return;
+	}
+
+	if (palette)
+	{
+		*palette = malloc(768);
+		memcpy (*palette, (byte *)pcx + len - 768, 768);
 	}
 
+	if (width)
+		*width = pcx->xmax+1;
+	if (height)
+		*height = pcx->ymax+1;
+
+	*pic = PCX_Decode (pcx, len);
+	if (!*pic)
+		ri.Con_Printf (PRINT_DEVELOPER, "PCX file %s was malformed", filename);
+
 	ri.FS_FreeFile (pcx);
 }
 
@@ -603,87 +645,84 @@ typedef struct _TargaHeader {
 
 /*
 =============
-LoadTGA
+TGA_Header
+
+Reads and checks the header of a targa file in memory, returning where
+the pixels start
 =============
 */
-void LoadTGA (char *name, byte **pic, int *width, int *height)
+static byte *TGA_Header (byte *buffer, TargaHeader *targa_header)
 {
-	int		columns, rows, numPixels;
-	byte	*pixbuf;
-	int		row, column;
 	byte	*buf_p;
-	byte	*buffer;
-	TargaHeader		targa_header;
-	byte			*targa_rgba;
-	byte tmp[2];
-
-	*pic = NULL;
-
-	//
-	// load the file
-	//
-	ri.FS_LoadFile (name, (void **)&buffer);
-	if (!buffer)
-	{
-		ri.Con_Printf (PRINT_DEVELOPER, "Bad tga file %s\n", name);
-		return;
-	}
+	byte	tmp[2];
 
 	buf_p = buffer;
 
-	targa_header.id_length = *buf_p++;
-	targa_header.colormap_type = *buf_p++;
-	targa_header.image_type = *buf_p++;
+	targa_header->id_length = *buf_p++;
+	targa_header->colormap_type = *buf_p++;
+	targa_header->image_type = *buf_p++;
 	
 	tmp[0] = buf_p[0];
 	tmp[1] = buf_p[1];
-	targa_header.colormap_index = LittleShort ( *((short *)tmp) );
+	targa_header->colormap_index = LittleShort ( *((short *)tmp) );
 	buf_p+=2;
 	tmp[0] = buf_p[0];
 	tmp[1] = buf_p[1];
-	targa_header.colormap_length = LittleShort ( *((short *)tmp) );
+	targa_header->colormap_length = LittleShort ( *((short *)tmp) );
 	buf_p+=2;
-	targa_header.colormap_size = *buf_p++;
-	targa_header.x_origin = LittleShort ( *((short *)buf_p) );
+	targa_header->colormap_size = *buf_p++;
+	targa_header->x_origin = LittleShort ( *((short *)buf_p) );
 	buf_p+=2;
-	targa_header.y_origin = LittleShort ( *((short *)buf_p) );
+	targa_header->y_origin = LittleShort ( *((short *)buf_p) );
 	buf_p+=2;
-	targa_header.width = LittleShort ( *((short *)buf_p) );
+	targa_header->width = LittleShort ( *((short *)buf_p) );
 	buf_p+=2;
-	targa_header.height = LittleShort ( *((short *)buf_p) );
+	targa_header->height = LittleShort ( *((short *)buf_p) );
 	buf_p+=2;
-	targa_header.pixel_size = *buf_p++;
-	targa_header.attributes = *buf_p++;
+	targa_header->pixel_size = *buf_p++;
+	targa_header->attributes = *buf_p++;
 
-	if (targa_header.image_type!=2 
-		&& targa_header.image_type!=10) 
+	if (targa_header->image_type!=2 
+		&& targa_header->image_type!=10) 
 		ri.Sys_Error (ERR_DROP, "LoadTGA: Only type 2 and 10 targa RGB images supported\n");
 
-	if (targa_header.colormap_type !=0 
-		|| (targa_header.pixel_size!=32 && targa_header.pixel_size!=24))
+	if (targa_header->colormap_type !=0 
+		|| (targa_header->pixel_size!=32 && targa_header->pixel_size!=24))
 		ri.Sys_Error (ERR_DROP, "LoadTGA: Only 32 or 24 bit images supported (no colormaps)\n");
 
-	columns = targa_header.width;
-	rows = targa_header.height;
-	numPixels = columns * rows;
+	return buf_p;
+}
 
-	if (width)
-		*width = columns;
-	if (height)
-		*height = rows;
+/*
+=============
+TGA_Decode
+
+Unpacks the pixels of a targa file that passed TGA_Header.  Safe to
+call from worker threads.
+=============
+*/
+static byte *TGA_Decode (byte *buf_p, TargaHeader *targa_header)
+{
+	int		columns, rows, numPixels;
+	byte	*pixbuf;
+	int		row, column;
+	byte	*targa_rgba;
+
+	columns = targa_header->width;
+	rows = targa_header->height;
+	numPixels = columns * rows;
 
 	targa_rgba = malloc (numPixels*4);
-	*pic = targa_rgba;
 
-	if (targa_header.id_length != 0)
-		buf_p += targa_header.id_length;  // skip TARGA image comment
+	if (targa_header->id_length != 0)
+		buf_p += targa_header->id_length;  // skip TARGA image comment
 	
-	if (targa_header.image_type==2) {  // Uncompressed, RGB images
+	if (targa_header->image_type==2) {  // Uncompressed, RGB images
 		for(row=rows-1; row>=0; row--) {
 			pixbuf = targa_rgba + row*columns*4;
 			for(column=0; column<columns; column++) {
 				unsigned char red,green,blue,alphabyte;
-				switch (targa_header.pixel_size) {
+				switch (targa_header->pixel_size) {
 					case 24:
 							
 							blue = *buf_p++;
@@ -708,7 +747,7 @@ void LoadTGA (char *name, byte **pic, int *width, int *height)
 			}
 		}
 	}
-	else if (targa_header.image_type==10) {   // Runlength encoded RGB images
+	else if (targa_header->image_type==10) {   // Runlength encoded RGB images
 		unsigned char red,green,blue,alphabyte,packetHeader,packetSize,j;
 		for(row=rows-1; row>=0; row--) {
 			pixbuf = targa_rgba + row*columns*4;
@@ -716,7 +755,7 @@ void LoadTGA (char *name, byte **pic, int *width, int *height)
 				packetHeader= *buf_p++;
 				packetSize = 1 + (packetHeader & 0x7f);
 				if (packetHeader & 0x80) {        // run-length packet
-					switch (targa_header.pixel_size) {
+					switch (targa_header->pixel_size) {
 						case 24:
 								blue = *buf_p++;
 								green = *buf_p++;
@@ -752,7 +791,7 @@ void LoadTGA (char *name, byte **pic, int *width, int *height)
 				}
 				else {                            // non run-length packet
 					for(j=0;j<packetSize;j++) {
-						switch (targa_header.pixel_size) {
+						switch (targa_header->pixel_size) {
 							case 24:
 									blue = *buf_p++;
 									green = *buf_p++;
@@ -789,6 +828,41 @@ void LoadTGA (char *name, byte **pic, int *width, int *height)
 		}
 	}
 
+	return targa_rgba;
+}
+
+/*
+=============
+LoadTGA
+=============
+*/
+void LoadTGA (char *name, byte **pic, int *width, int *height)
+{
+	byte			*buf_p;
+	byte			*buffer;
+	TargaHeader		targa_header;
+
+	*pic = NULL;
+
+	//
+	// load the file
+	//
+	ri.FS_LoadFile (name, (void **)&buffer);
+	if (!buffer)
+	{
+		ri.Con_Printf (PRINT_DEVELOPER, "Bad tga file %s\n", name);
+		return;
+	}
+
+	buf_p = TGA_Header (buffer, &targa_header);
+
+	if (width)
+		*width = targa_header.width;
+	if (height)
+		*height = targa_header.height;
+
+	*pic = TGA_Decode (buf_p, &targa_header);
+
 	ri.FS_FreeFile (buffer);
 }
 
@@ -876,6 +950,55 @@ void R_FloodFillSkin( byte *skin, int skinwidth, int skinheight )
 
 //=======================================================
 
+#ifdef GL_SSE2
+/*
+================
+GL_Lerp2
+
+Two rgba pixels at 16 bits a channel, (a * (0x10000 - w) + b * w) >> 16
+exactly as the C loops round it.  w is 0 to 0xffff for each channel,
+and is handled as a*0x10000 + b*w - a*w, as 0x10000 doesn't fit.
+================
+*/
+static __m128i GL_Lerp2 (__m128i a, __m128i b, __m128i w)
+{
+	__m128i	zero, alo, ahi, blo, bhi, lo, hi;
+
+	zero = _mm_setzero_si128 ();
+	alo = _mm_mullo_epi16 (a, w);
+	ahi = _mm_mulhi_epu16 (a, w);
+	blo = _mm_mullo_epi16 (b, w);
+	bhi = _mm_mulhi_epu16 (b, w);
+
+	lo = _mm_sub_epi32 (_mm_unpacklo_epi16 (blo, bhi), _mm_unpacklo_epi16 (alo, ahi));
+	lo = _mm_srli_epi32 (_mm_add_epi32 (lo, _mm_unpacklo_epi16 (zero, a)), 16);
+	hi = _mm_sub_epi32 (_mm_unpackhi_epi16 (blo, bhi), _mm_unpackhi_epi16 (alo, ahi));
+	hi = _mm_srli_epi32 (_mm_add_epi32 (hi, _mm_unpackhi_epi16 (zero, a)), 16);
+
+	return _mm_packs_epi32 (lo, hi);
+}
+
+/*
+================
+GL_LerpPair
+
+The horizontal lerp for the output pixels at f and f+fstep, both of
+which must have a pixel to their right
+================
+*/
+static __m128i GL_LerpPair (byte *in, int f, int fstep)
+{
+	__m128i	zero, p0, p1, w;
+
+	zero = _mm_setzero_si128 ();
+	p0 = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i *)(in + (f >> 16) * 4)), zero);
+	p1 = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i *)(in + ((f + fstep) >> 16) * 4)), zero);
+	w = _mm_unpacklo_epi64 (_mm_set1_epi16 ((short)(f & 0xFFFF)), _mm_set1_epi16 ((short)((f + fstep) & 0xFFFF)));
+
+	return GL_Lerp2 (_mm_unpacklo_epi64 (p0, p1), _mm_unpackhi_epi64 (p0, p1), w);
+}
+#endif
+
 #if 1
 /*
 ================
@@ -884,13 +1007,25 @@ from DarkPlaces
 ================
 */
 
-void GL_ResampleTextureLerpLine (byte *in, byte *out, int inwidth, int outwidth) 
+static void GL_ResampleTextureLerpLine (byte *in, byte *out, int inwidth, int outwidth, int simd)
 { 
 	int j, xi, oldx = 0, f, fstep, l1, l2, endx;
 
 	fstep = (int) (inwidth*65536.0f/outwidth); 
 	endx = (inwidth-1); 
-	for (j = 0,f = 0;j < outwidth;j++, f += fstep) 
+	j = f = 0;
+#ifdef GL_SSE2
+	// four pixels at a time while they all have a pixel to lerp to
+	if (simd)
+	{
+		for ( ; j+4 <= outwidth && ((f + 3*fstep) >> 16) < endx ; j += 4, f += 4*fstep, out += 16)
+		{
+			_mm_storeu_si128 ((__m128i *)out, _mm_packus_epi16 (GL_LerpPair (in, f, fstep),
+				GL_LerpPair (in, f + 2*fstep, fstep)));
+		}
+	}
+#endif
+	for ( ;j < outwidth;j++, f += fstep) 
 	{ 
 		xi = (int) f >> 16; 
 		if (xi != oldx) 
@@ -920,13 +1055,19 @@ void GL_ResampleTextureLerpLine (byte *in, byte *out, int inwidth, int outwidth)
 /*
 ================
 GL_ResampleTexture
+
+With simd set the lerps use SSE2, if the build has it, and give the
+same result
 ================
 */
-void GL_ResampleTexture (void *indata, int inwidth, int inheight, void *outdata, int outwidth, int outheight) 
+void GL_ResampleTexture (void *indata, int inwidth, int inheight, void *outdata, int outwidth, int outheight, int simd) 
 { 
 	int i, j, yi, oldy, f, fstep, l1, l2, endy = (inheight-1);
 	
 	byte *inrow, *out, *row1, *row2; 
+#ifdef GL_SSE2
+	__m128i	zero, w, r1, r2;
+#endif
 	out = outdata; 
 	fstep = (int) (inheight*65536.0f/outheight); 
 
@@ -934,8 +1075,8 @@ void GL_ResampleTexture (void *indata, int inwidth, int inheight, void *outdata,
 	row2 = malloc(outwidth*4); 
 	inrow = indata; 
 	oldy = 0; 
-	GL_ResampleTextureLerpLine (inrow, row1, inwidth, outwidth); 
-	GL_ResampleTextureLerpLine (inrow + inwidth*4, row2, inwidth, outwidth); 
+	GL_ResampleTextureLerpLine (inrow, row1, inwidth, outwidth, simd); 
+	GL_ResampleTextureLerpLine (inrow + inwidth*4, row2, inwidth, outwidth, simd); 
 	for (i = 0, f = 0;i < outheight;i++,f += fstep) 
 	{ 
 		yi = f >> 16; 
@@ -945,10 +1086,10 @@ void GL_ResampleTexture (void *indata, int inwidth, int inheight, void *outdata,
 			if (yi == oldy+1) 
 				memcpy(row1, row2, outwidth*4); 
 			else 
-				GL_ResampleTextureLerpLine (inrow, row1, inwidth, outwidth);
+				GL_ResampleTextureLerpLine (inrow, row1, inwidth, outwidth, simd);
 
 			if (yi < endy) 
-				GL_ResampleTextureLerpLine (inrow + inwidth*4, row2, inwidth, outwidth); 
+				GL_ResampleTextureLerpLine (inrow + inwidth*4, row2, inwidth, outwidth, simd); 
 			else 
 				memcpy(row2, row1, outwidth*4); 
 			oldy = yi; 
@@ -957,7 +1098,23 @@ void GL_ResampleTexture (void *indata, int inwidth, int inheight, void *outdata,
 		{ 
 			l2 = f & 0xFFFF; 
 			l1 = 0x10000 - l2; 
-			for (j = 0;j < outwidth;j++) 
+			j = 0;
+#ifdef GL_SSE2
+			if (simd)
+			{
+				zero = _mm_setzero_si128 ();
+				w = _mm_set1_epi16 ((short)l2);
+				for ( ; j+4 <= outwidth ; j+=4, row1+=16, row2+=16, out+=16)
+				{
+					r1 = _mm_loadu_si128 ((__m128i *)row1);
+					r2 = _mm_loadu_si128 ((__m128i *)row2);
+					_mm_storeu_si128 ((__m128i *)out, _mm_packus_epi16 (
+						GL_Lerp2 (_mm_unpacklo_epi8 (r1, zero), _mm_unpacklo_epi8 (r2, zero), w),
+						GL_Lerp2 (_mm_unpackhi_epi8 (r1, zero), _mm_unpackhi_epi8 (r2, zero), w)));
+				}
+			}
+#endif
+			for ( ;j < outwidth;j++) 
 			{ 
 				*out++ = (byte) ((*row1++ * l1 + *row2++ * l2) >> 16); 
 				*out++ = (byte) ((*row1++ * l1 + *row2++ * l2) >> 16); 
@@ -1041,35 +1198,19 @@ lighting range
 */
 void GL_LightScaleTexture (unsigned *in, int inwidth, int inheight, qboolean only_gamma )
 {
-	if ( only_gamma )
-	{
-		int		i, c;
-		byte	*p;
+	int		i, c;
+	byte	*p, *table;
 
-		p = (byte *)in;
+	// lighttable already has the intensity in it
+	table = only_gamma ? gammatable : lighttable;
+	p = (byte *)in;
 
-		c = inwidth*inheight;
-		for (i=0 ; i<c ; i++, p+=4)
-		{
-			p[0] = gammatable[p[0]];
-			p[1] = gammatable[p[1]];
-			p[2] = gammatable[p[2]];
-		}
-	}
-	else
+	c = inwidth*inheight;
+	for (i=0 ; i<c ; i++, p+=4)
 	{
-		int		i, c;
-		byte	*p;
-
-		p = (byte *)in;
-
-		c = inwidth*inheight;
-		for (i=0 ; i<c ; i++, p+=4)
-		{
-			p[0] = gammatable[intensitytable[p[0]]];
-			p[1] = gammatable[intensitytable[p[1]]];
-			p[2] = gammatable[intensitytable[p[2]]];
-		}
+		p[0] = table[p[0]];
+		p[1] = table[p[1]];
+		p[2] = table[p[2]];
 	}
 }
 
@@ -1077,20 +1218,47 @@ void GL_LightScaleTexture (unsigned *in, int inwidth, int inheight, qboolean onl
 ================
 GL_MipMap
 
-Operates in place, quartering the size of the texture
+Operates in place, quartering the size of the texture.  With simd set
+rows are averaged with SSE2 to the same result.
 ================
 */
-void GL_MipMap (byte *in, int width, int height)
+void GL_MipMap (byte *in, int width, int height, int simd)
 {
 	int		i, j;
 	byte	*out;
+#ifdef GL_SSE2
+	__m128i	zero, a, b, c, d, s01, s23, s45, s67, lo, hi;
+#endif
 
 	width <<=2;
 	height >>= 1;
 	out = in;
 	for (i=0 ; i<height ; i++, in+=width)
 	{
-		for (j=0 ; j<width ; j+=8, out+=4, in+=8)
+		j = 0;
+#ifdef GL_SSE2
+		// each half of a row sum holds two pixels, so the unpacks
+		// line up left and right neighbours
+		if (simd)
+		{
+			zero = _mm_setzero_si128 ();
+			for ( ; j+32 <= width ; j+=32, out+=16, in+=32)
+			{
+				a = _mm_loadu_si128 ((__m128i *)in);
+				b = _mm_loadu_si128 ((__m128i *)(in+16));
+				c = _mm_loadu_si128 ((__m128i *)(in+width));
+				d = _mm_loadu_si128 ((__m128i *)(in+width+16));
+				s01 = _mm_add_epi16 (_mm_unpacklo_epi8 (a, zero), _mm_unpacklo_epi8 (c, zero));
+				s23 = _mm_add_epi16 (_mm_unpackhi_epi8 (a, zero), _mm_unpackhi_epi8 (c, zero));
+				s45 = _mm_add_epi16 (_mm_unpacklo_epi8 (b, zero), _mm_unpacklo_epi8 (d, zero));
+				s67 = _mm_add_epi16 (_mm_unpackhi_epi8 (b, zero), _mm_unpackhi_epi8 (d, zero));
+				lo = _mm_add_epi16 (_mm_unpacklo_epi64 (s01, s23), _mm_unpackhi_epi64 (s01, s23));
+				hi = _mm_add_epi16 (_mm_unpacklo_epi64 (s45, s67), _mm_unpackhi_epi64 (s45, s67));
+				_mm_storeu_si128 ((__m128i *)out, _mm_packus_epi16 (_mm_srli_epi16 (lo, 2), _mm_srli_epi16 (hi, 2)));
+			}
+		}
+#endif
+		for ( ; j<width ; j+=8, out+=4, in+=8)
 		{
 			out[0] = (in[0] + in[4] + in[width+0] + in[width+4])>>2;
 			out[1] = (in[1] + in[5] + in[width+1] + in[width+5])>>2;
@@ -1156,60 +1324,39 @@ int nearest_power_of_2 (int size)
 
 /*
 ===============
-GL_Upload32
+GL_PrepareUpload32
 
-Returns has_alpha
+Does everything GL_Upload32 does short of talking to GL: scales the
+texture, builds its mip levels and converts them to the upload format,
+leaving them in up->levels for GL_FinishUpload.  data is used as
+scratch space.  Safe to call from worker threads.
 Knightmare: rewrite for higher-res
 and non-power-of-two texture support
 ===============
 */
-#if 1
-qboolean GL_Upload32 (unsigned *data, int width, int height,  qboolean mipmap)
+static void GL_PrepareUpload32 (unsigned *data, int width, int height, qboolean mipmap, glupload_t *up)
 {
 	unsigned	*scaled;
-	unsigned char *paletted_texture;
 	int			scaled_width, scaled_height;
-	int			i, c, comp;
-	int			samples;
-	byte		*scan;
+	int			mip_width, mip_height;
+	int			i, c, size, texel;
+	byte		*scan, *level;
 	qboolean	hasAlpha;
 	qboolean	isPaletted;
 
-	if (width < 1 || height < 1)
-		ri.Sys_Error (ERR_DROP, "GL_Upload32: bad dimensions %d x %d", width, height);
-
-	uploaded_paletted = false;
-
 	// scan the texture for any non-255 alpha
 	c = width*height;
 	scan = ((byte *)data) + 3;
-	samples = gl_solid_format;
 	hasAlpha = false;
 	for (i=0 ; i<c ; i++, scan += 4)
 	{
 		if ( *scan != 255 )
 		{
-			samples = gl_alpha_format;
 			hasAlpha = true;
 			break;
 		}
 	}
 
-	// use either old or new texture formats
-	if ( gl_config.newTexFormat ) {
-		comp = GL_RGBA;
-	}
-	else
-	{
-		if (samples == gl_solid_format)
-			comp = gl_tex_solid_format;
-		else if (samples == gl_alpha_format)
-			comp = gl_tex_alpha_format;
-		else {
-			ri.Con_Printf (PRINT_ALL, "Unknown number of texture components %i\n", samples);
-			comp = samples;
-		}
-	}
 //	isPaletted = (qglColorTableEXT && gl_ext_palettedtexture->value && samples == gl_solid_format);
 	isPaletted = (qglColorTableEXT && gl_ext_palettedtexture->value && !hasAlpha);
 
@@ -1237,7 +1384,7 @@ qboolean GL_Upload32 (unsigned *data, int width, int height,  qboolean mipmap)
 	if (scaled_width != width || scaled_height != height) 
 	{
 		scaled = malloc((scaled_width * scaled_height) * 4);
-		GL_ResampleTexture (data, width, height, scaled, scaled_width, scaled_height);
+		GL_ResampleTexture (data, width, height, scaled, scaled_width, scaled_height, gl_simd->intValue);
 	}
 	else {
 		scaled_width = width;
@@ -1249,48 +1396,100 @@ qboolean GL_Upload32 (unsigned *data, int width, int height,  qboolean mipmap)
 		GL_LightScaleTexture (scaled, scaled_width, scaled_height, !mipmap);
 
 	//
-	// generate mipmaps and upload
+	// generate mipmaps
 	//
-	if ( isPaletted )
-	{
-		uploaded_paletted = true;
-		paletted_texture = malloc((scaled_width * scaled_height) * 4);
-		GL_BuildPalettedTexture (paletted_texture, (unsigned char *)scaled, scaled_width, scaled_height);
-		qglTexImage2D (GL_TEXTURE_2D, 0, GL_COLOR_INDEX8_EXT, scaled_width, scaled_height, 0,
-						GL_COLOR_INDEX, GL_UNSIGNED_BYTE, paletted_texture);
-	}
-	else {
-		qglTexImage2D (GL_TEXTURE_2D, 0, comp, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scaled);
-		paletted_texture = NULL;/* silence compiler */
-	}
-
+	texel = isPaletted ? 1 : 4;
+	up->numlevels = 1;
+	size = scaled_width * scaled_height * texel;
 	if (mipmap)
 	{
-		int		mip_width, mip_height, miplevel = 0;
-
 		mip_width = scaled_width;	mip_height = scaled_height;
 		while (mip_width > 1 || mip_height > 1)
 		{
-			GL_MipMap ((byte *)scaled, mip_width, mip_height);
 			mip_width = max(mip_width>>1, 1);
 			mip_height = max(mip_height>>1, 1);
-			miplevel++;
-			if ( isPaletted )
-			{
-				uploaded_paletted = true;
-				GL_BuildPalettedTexture (paletted_texture, (unsigned char *)scaled, mip_width, mip_height);
-				qglTexImage2D (GL_TEXTURE_2D, miplevel, GL_COLOR_INDEX8_EXT, mip_width, mip_height, 0,
-								GL_COLOR_INDEX, GL_UNSIGNED_BYTE, paletted_texture);
-			}
-			else
-				qglTexImage2D (GL_TEXTURE_2D, miplevel, comp, mip_width, mip_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scaled);
+			size += mip_width * mip_height * texel;
+			up->numlevels++;
 		}
 	}
 
-	if (scaled_width != width || scaled_height != height)
+	up->levels = level = malloc (size);
+	mip_width = scaled_width;	mip_height = scaled_height;
+	for (i=0 ; i<up->numlevels ; i++)
+	{
+		if (i)
+		{
+			GL_MipMap ((byte *)scaled, mip_width, mip_height, gl_simd->intValue);
+			mip_width = max(mip_width>>1, 1);
+			mip_height = max(mip_height>>1, 1);
+		}
+		if ( isPaletted )
+			GL_BuildPalettedTexture (level, (unsigned char *)scaled, mip_width, mip_height);
+		else
+			memcpy (level, scaled, mip_width * mip_height * 4);
+		level += mip_width * mip_height * texel;
+	}
+
+	if (scaled_width != width || scaled_height != height)
 		free(scaled);
 
-	upload_width = scaled_width;	upload_height = scaled_height;
+	up->width = scaled_width;
+	up->height = scaled_height;
+	up->hasAlpha = hasAlpha;
+	up->paletted = isPaletted;
+	up->cached = false;
+}
+
+/*
+===============
+GL_FinishUpload
+
+Hands the levels built by GL_PrepareUpload32 to the bound texture and
+frees them.  Returns has_alpha.
+===============
+*/
+static qboolean GL_FinishUpload (glupload_t *up, qboolean mipmap)
+{
+	int		i, comp;
+	int		mip_width, mip_height;
+	byte	*level;
+
+	// use either old or new texture formats
+	if ( gl_config.newTexFormat )
+		comp = GL_RGBA;
+	else if ( up->hasAlpha )
+		comp = gl_tex_alpha_format;
+	else
+		comp = gl_tex_solid_format;
+
+	//
+	// upload
+	//
+	level = up->levels;
+	mip_width = up->width;	mip_height = up->height;
+	for (i=0 ; i<up->numlevels ; i++)
+	{
+		if ( up->paletted )
+		{
+			qglTexImage2D (GL_TEXTURE_2D, i, GL_COLOR_INDEX8_EXT, mip_width, mip_height, 0,
+							GL_COLOR_INDEX, GL_UNSIGNED_BYTE, level);
+			level += mip_width * mip_height;
+		}
+		else
+		{
+			qglTexImage2D (GL_TEXTURE_2D, i, comp, mip_width, mip_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, level);
+			level += mip_width * mip_height * 4;
+		}
+		mip_width = max(mip_width>>1, 1);
+		mip_height = max(mip_height>>1, 1);
+	}
+
+	if (!up->cached)
+		free (up->levels);
+	up->levels = NULL;
+
+	uploaded_paletted = up->paletted;
+	upload_width = up->width;	upload_height = up->height;
 
 	qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (mipmap) ? gl_filter_min : gl_filter_max);
 	qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, gl_filter_max);
@@ -1299,8 +1498,26 @@ qboolean GL_Upload32 (unsigned *data, int width, int height,  qboolean mipmap)
 	if (mipmap && gl_config.anisotropic && gl_anisotropic->value)
 		qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, gl_anisotropic->value);
 
-//	return (samples == gl_alpha_format);
-	return hasAlpha;
+	return up->hasAlpha;
+}
+
+/*
+===============
+GL_Upload32
+
+Returns has_alpha
+===============
+*/
+#if 1
+qboolean GL_Upload32 (unsigned *data, int width, int height,  qboolean mipmap)
+{
+	glupload_t	up;
+
+	if (width < 1 || height < 1)
+		ri.Sys_Error (ERR_DROP, "GL_Upload32: bad dimensions %d x %d", width, height);
+
+	GL_PrepareUpload32 (data, width, height, mipmap, &up);
+	return GL_FinishUpload (&up, mipmap);
 }
 #else
 qboolean GL_Upload32 (unsigned *data, int width, int height,  qboolean mipmap)
@@ -1412,7 +1629,7 @@ qboolean GL_Upload32 (unsigned *data, int width, int height,  qboolean mipmap)
 		memcpy (scaled, data, width*height*4);
 	}
 	else
-		GL_ResampleTexture (data, width, height, scaled, scaled_width, scaled_height);
+		GL_ResampleTexture (data, width, height, scaled, scaled_width, scaled_height, gl_simd->intValue);
 
 	GL_LightScaleTexture (scaled, scaled_width, scaled_height, !mipmap );
 
@@ -1442,7 +1659,7 @@ qboolean GL_Upload32 (unsigned *data, int width, int height,  qboolean mipmap)
 		miplevel = 0;
 		while (scaled_width > 1 || scaled_height > 1)
 		{
-			GL_MipMap ((byte *)scaled, scaled_width, scaled_height);
+			GL_MipMap ((byte *)scaled, scaled_width, scaled_height, gl_simd->intValue);
 			scaled_width >>= 1;
 			scaled_height >>= 1;
 			if (scaled_width < 1)
@@ -1489,6 +1706,48 @@ done: ;
 }
 #endif
 
+/*
+===============
+GL_Expand8
+
+Converts a paletted image to rgba, giving transparent texels the color
+of a neighbour so they don't fringe when filtered
+===============
+*/
+static void GL_Expand8 (byte *data, int width, int height, unsigned *trans)
+{
+	int			i, s;
+	int			p;
+
+	s = width*height;
+
+	for (i=0 ; i<s ; i++)
+	{
+		p = data[i];
+		trans[i] = d_8to24table[p];
+
+		if (p == 255)
+		{	// transparent, so scan around for another color
+			// to avoid alpha fringes
+			// FIXME: do a full flood fill so mips work...
+			if (i > width && data[i-width] != 255)
+				p = data[i-width];
+			else if (i < s-width && data[i+width] != 255)
+				p = data[i+width];
+			else if (i > 0 && data[i-1] != 255)
+				p = data[i-1];
+			else if (i < s-1 && data[i+1] != 255)
+				p = data[i+1];
+			else
+				p = 0;
+			// copy rgb components
+			((byte *)&trans[i])[0] = ((byte *)&d_8to24table[p])[0];
+			((byte *)&trans[i])[1] = ((byte *)&d_8to24table[p])[1];
+			((byte *)&trans[i])[2] = ((byte *)&d_8to24table[p])[2];
+		}
+	}
+}
+
 /*
 ===============
 GL_Upload8
@@ -1499,8 +1758,7 @@ Returns has_alpha
 qboolean GL_Upload8 (byte *data, int width, int height,  qboolean mipmap, qboolean is_sky )
 {
 	unsigned	trans[512*256];
-	int			i, s;
-	int			p;
+	int			s;
 
 	s = width*height;
 
@@ -1527,32 +1785,7 @@ qboolean GL_Upload8 (byte *data, int width, int height,  qboolean mipmap, qboole
 	}
 	else
 	{
-		for (i=0 ; i<s ; i++)
-		{
-			p = data[i];
-			trans[i] = d_8to24table[p];
-
-			if (p == 255)
-			{	// transparent, so scan around for another color
-				// to avoid alpha fringes
-				// FIXME: do a full flood fill so mips work...
-				if (i > width && data[i-width] != 255)
-					p = data[i-width];
-				else if (i < s-width && data[i+width] != 255)
-					p = data[i+width];
-				else if (i > 0 && data[i-1] != 255)
-					p = data[i-1];
-				else if (i < s-1 && data[i+1] != 255)
-					p = data[i+1];
-				else
-					p = 0;
-				// copy rgb components
-				((byte *)&trans[i])[0] = ((byte *)&d_8to24table[p])[0];
-				((byte *)&trans[i])[1] = ((byte *)&d_8to24table[p])[1];
-				((byte *)&trans[i])[2] = ((byte *)&d_8to24table[p])[2];
-			}
-		}
-
+		GL_Expand8 (data, width, height, trans);
 		return GL_Upload32 (trans, width, height, mipmap);
 	}
 }
@@ -1560,12 +1793,12 @@ qboolean GL_Upload8 (byte *data, int width, int height,  qboolean mipmap, qboole
 
 /*
 ================
-GL_LoadPic
+GL_AllocImage
 
-This is also used as an entry point for the generated r_notexture
+Finds a free image_t and names it
 ================
 */
-image_t *GL_LoadPic (char *name, byte *pic, int width, int height, imagetype_t type, int bits)
+static image_t *GL_AllocImage (char *name, int width, int height, imagetype_t type)
 {
 	image_t		*image;
 	int			i;
@@ -1594,6 +1827,22 @@ image_t *GL_LoadPic (char *name, byte *pic, int width, int height, imagetype_t t
 	image->height = height;
 	image->type = type;
 
+	return image;
+}
+
+/*
+================
+GL_LoadPic
+
+This is also used as an entry point for the generated r_notexture
+================
+*/
+image_t *GL_LoadPic (char *name, byte *pic, int width, int height, imagetype_t type, int bits)
+{
+	image_t		*image;
+
+	image = GL_AllocImage (name, width, height, type);
+
 	if (type == it_skin && bits == 8)
 		R_FloodFillSkin(pic, width, height);
 
@@ -1675,6 +1924,597 @@ image_t *GL_LoadWal (char *name)
 	return image;
 }
 
+/*
+=================================================================
+
+REGISTRATION LOADING
+
+Between R_BeginRegistration and R_EndRegistration, GL_FindImage only
+reads the textures that get mipmapped and hands out their image_t.
+GL_FlushImages then decodes, scales and mipmaps all of them on
+cl_loadthreads threads and uploads them in order on the main thread.
+Pics and skies are still loaded on the spot, as the loading screen
+may draw them.  The times of the last registration are kept for the
+gl_loadstats command.
+
+With fs_cachesize set, the finished mip levels are also kept in the
+asset cache, and a texture found there is neither read nor decoded,
+just uploaded.  The key holds everything GL_PrepareUpload32 depends on
+besides the file.  Paletted textures also depend on 16to8.dat, so they
+aren't cached.
+
+=================================================================
+*/
+
+#define	GL_LOAD_BYTES	(32*1024*1024)	// file data held before flushing early
+
+typedef enum
+{
+	IMG_PCX,
+	IMG_WAL,
+	IMG_TGA
+} imgformat_t;
+
+typedef struct
+{
+	char		name[MAX_QPATH];
+	image_t		*image;
+	imgformat_t	format;
+	byte		*raw;			// file contents, freed once uploaded
+	int			rawlen;
+	byte		*cache;			// or the asset cache entry, see glcached_t
+	qboolean	cached;			// load came from the cache
+	byte		*pixels;		// where the pixels start in raw
+	TargaHeader	targa;
+	qboolean	malformed;
+	glupload_t	upload;
+	unsigned	readtime;		// microseconds on the main thread
+	unsigned	decodetime;		// microseconds on whichever thread decoded it
+	unsigned	uploadtime;		// microseconds on the main thread
+} glload_t;
+
+static glload_t	gl_loads[MAX_GLTEXTURES];
+static int		gl_numloads;		// this registration
+static int		gl_numflushed;		// the first gl_numflushed loads are uploaded
+static int		gl_loadbytes;		// file data held by the rest
+static unsigned	gl_loadtime;		// spent in GL_FlushImages
+static int		gl_numloadthreads;
+
+static cvar_t	*cl_loadthreads;
+
+typedef struct
+{
+	int			type;			// skins are flood filled
+	int			picmip, maxsize;
+	qboolean	npot, lightscale;
+	byte		gamma[256], intensity[256];
+	unsigned	palette[256];
+} glcachekey_t;
+
+// an asset cache entry, followed by the levels
+typedef struct
+{
+	int			width, height;	// of the file
+	int			upwidth, upheight;
+	int			numlevels;
+	qboolean	hasAlpha;
+	int			pad[2];			// keeps the levels 16 byte aligned
+} glcached_t;
+
+static glcachekey_t	gl_cachekey;
+static qboolean		gl_cacheable;
+
+/*
+================
+GL_UploadSize
+================
+*/
+static int GL_UploadSize (glupload_t *up)
+{
+	int		i, size, w, h;
+
+	size = 0;
+	w = up->width;	h = up->height;
+	for (i=0 ; i<up->numlevels ; i++)
+	{
+		size += w * h;
+		w = max(w>>1, 1);
+		h = max(h>>1, 1);
+	}
+	return up->paletted ? size : size * 4;
+}
+
+/*
+================
+GL_LoadCachedImage
+
+Returns the asset cache entry for name, with up pointing into it
+================
+*/
+static glcached_t *GL_LoadCachedImage (char *name, imagetype_t type, glupload_t *up, int *len)
+{
+	glcached_t	*cached;
+
+	if (!gl_cacheable || !ri.FS_LoadCache)
+		return NULL;
+
+	gl_cachekey.type = type;
+	cached = ri.FS_LoadCache (name, &gl_cachekey, sizeof(gl_cachekey), len);
+	if (!cached)
+		return NULL;
+
+	memset (up, 0, sizeof(*up));
+	up->levels = (byte *)(cached + 1);
+	up->numlevels = cached->numlevels;
+	up->width = cached->upwidth;
+	up->height = cached->upheight;
+	up->hasAlpha = cached->hasAlpha;
+	up->cached = true;
+	if (*len < sizeof(*cached) || cached->width < 1 || cached->height < 1
+		|| up->numlevels < 1 || up->width < 1 || up->height < 1
+		|| *len != sizeof(*cached) + GL_UploadSize (up))
+	{
+		ri.FS_FreeCache (cached);
+		return NULL;
+	}
+	return cached;
+}
+
+/*
+================
+GL_WriteCachedImage
+================
+*/
+static void GL_WriteCachedImage (glload_t *load)
+{
+	glcached_t	*cached;
+	image_t		*image;
+	int			size;
+
+	if (!gl_cacheable || !ri.FS_WriteCache || load->malformed)
+		return;
+
+	image = load->image;
+	size = GL_UploadSize (&load->upload);
+	cached = malloc (sizeof(*cached) + size);
+	memset (cached, 0, sizeof(*cached));
+	cached->width = image->width;
+	cached->height = image->height;
+	cached->upwidth = load->upload.width;
+	cached->upheight = load->upload.height;
+	cached->numlevels = load->upload.numlevels;
+	cached->hasAlpha = load->upload.hasAlpha;
+	memcpy (cached + 1, load->upload.levels, size);
+
+	gl_cachekey.type = image->type;
+	ri.FS_WriteCache (load->name, &gl_cachekey, sizeof(gl_cachekey), cached, sizeof(*cached) + size);
+	free (cached);
+}
+
+/*
+================
+GL_NewLoad
+
+Hands out the image_t for a queued load
+================
+*/
+static glload_t *GL_NewLoad (char *name, int width, int height, imagetype_t type, int bytes)
+{
+	glload_t	*load;
+	image_t		*image;
+
+	if (gl_loadbytes + bytes > GL_LOAD_BYTES)
+		GL_FlushImages ();
+
+	image = GL_AllocImage (name, width, height, type);
+	image->scrap = false;
+	image->texnum = TEXNUM_IMAGES + (image - gltextures);
+	image->sl = 0;
+	image->sh = 1;
+	image->tl = 0;
+	image->th = 1;
+
+	load = &gl_loads[gl_numloads++];
+	memset (load, 0, sizeof(*load));
+	Q_strncpyz (load->name, name, sizeof(load->name));
+	load->image = image;
+	gl_loadbytes += bytes;
+
+	return load;
+}
+
+/*
+================
+GL_QueueImage
+
+Reads an image for GL_FlushImages to load, returning what GL_FindImage
+would have
+================
+*/
+static image_t *GL_QueueImage (char *name, int len, imagetype_t type)
+{
+	glload_t	*load;
+	glcached_t	*cached;
+	glupload_t	upload;
+	imgformat_t	format;
+	byte		*raw, *pixels;
+	int			rawlen, width, height;
+	unsigned	time;
+	miptex_t	*mt;
+	pcx_t		*pcx;
+	TargaHeader	targa;
+
+	time = Sys_Microseconds ();
+
+	if (!strcmp(name+len-4, ".pcx"))
+		format = IMG_PCX;
+	else if (!strcmp(name+len-4, ".wal"))
+	{
+		format = IMG_WAL;
+		type = it_wall;
+	}
+	else if (!strcmp(name+len-4, ".tga"))
+		format = IMG_TGA;
+	else
+		return NULL;	//	ri.Sys_Error (ERR_DROP, "GL_FindImage: bad extension on: %s", name);
+
+	cached = GL_LoadCachedImage (name, type, &upload, &rawlen);
+	if (cached)
+	{
+		load = GL_NewLoad (name, cached->width, cached->height, type, rawlen);
+		load->format = format;
+		load->cache = (byte *)cached;
+		load->cached = true;
+		load->rawlen = rawlen;
+		load->upload = upload;
+		load->readtime = Sys_Microseconds () - time;
+		return load->image;
+	}
+
+	rawlen = ri.FS_LoadFile (name, (void **)&raw);
+	if (!raw)
+	{
+		if (format == IMG_WAL)
+		{
+			ri.Con_Printf (PRINT_ALL, "GL_FindImage: can't load %s\n", name);
+			return r_notexture;
+		}
+		ri.Con_Printf (PRINT_DEVELOPER, "Bad %s file %s\n", (format == IMG_PCX) ? "pcx" : "tga", name);
+		return NULL;
+	}
+
+	memset (&targa, 0, sizeof(targa));
+	switch (format)
+	{
+	case IMG_PCX:
+		pcx = (pcx_t *)raw;
+		if (!PCX_Header (pcx))
+		{
+			ri.Con_Printf (PRINT_ALL, "Bad pcx file %s\n", name);
+			ri.FS_FreeFile (raw);
+			return NULL;
+		}
+		width = pcx->xmax+1;
+		height = pcx->ymax+1;
+		pixels = raw;
+		break;
+	case IMG_WAL:
+		mt = (miptex_t *)raw;
+		width = LittleLong (mt->width);
+		height = LittleLong (mt->height);
+		pixels = raw + LittleLong (mt->offsets[0]);
+		break;
+	default:
+		pixels = TGA_Header (raw, &targa);
+		width = targa.width;
+		height = targa.height;
+		break;
+	}
+
+	// the same limits the upload would have hit
+	if (width < 1 || height < 1)
+		ri.Sys_Error (ERR_DROP, "GL_Upload32: bad dimensions %d x %d", width, height);
+	if (format != IMG_TGA && width*height > 512*256)
+		ri.Sys_Error (ERR_DROP, "GL_Upload8: too large");
+
+	load = GL_NewLoad (name, width, height, type, rawlen);
+	load->format = format;
+	load->raw = raw;
+	load->rawlen = rawlen;
+	load->pixels = pixels;
+	load->targa = targa;
+	load->readtime = Sys_Microseconds () - time;
+
+	return load->image;
+}
+
+/*
+================
+GL_LoadImageJob
+
+Decodes one queued image and builds its mip levels
+================
+*/
+static void GL_LoadImageJob (int job, void *arg)
+{
+	glload_t	*load;
+	image_t		*image;
+	byte		*pic;
+	unsigned	*trans;
+	unsigned	time;
+
+	load = (glload_t *)arg + job;
+	if (load->cache)
+		return;
+	image = load->image;
+	time = Sys_Microseconds ();
+
+	if (load->format == IMG_TGA)
+	{
+		pic = TGA_Decode (load->pixels, &load->targa);
+		GL_PrepareUpload32 ((unsigned *)pic, image->width, image->height, true, &load->upload);
+		free (pic);
+	}
+	else
+	{
+		if (load->format == IMG_PCX)
+		{
+			pic = PCX_Decode ((pcx_t *)load->raw, load->rawlen);
+			if (!pic)
+			{	// the image_t is already handed out, so leave it black
+				load->malformed = true;
+				pic = calloc (image->width * image->height, 1);
+			}
+		}
+		else
+			pic = load->pixels;
+
+		if (image->type == it_skin)
+			R_FloodFillSkin (pic, image->width, image->height);
+
+		trans = malloc (image->width * image->height * 4);
+		GL_Expand8 (pic, image->width, image->height, trans);
+		GL_PrepareUpload32 (trans, image->width, image->height, true, &load->upload);
+		free (trans);
+
+		if (pic != load->pixels)
+			free (pic);
+	}
+
+	load->decodetime = Sys_Microseconds () - time;
+}
+
+/*
+================
+GL_FlushImages
+
+Loads everything GL_QueueImage has read so far
+================
+*/
+void GL_FlushImages (void)
+{
+	glload_t	*load, *batch;
+	image_t		*image;
+	int			i, count;
+	unsigned	start, time;
+
+	count = gl_numloads - gl_numflushed;
+	if (count < 1)
+		return;
+
+	start = Sys_Microseconds ();
+	batch = gl_loads + gl_numflushed;
+	gl_numloadthreads = max(cl_loadthreads->intValue, 1);
+	if (ri.RunJobs)
+		ri.RunJobs (count, GL_LoadImageJob, batch, gl_numloadthreads);
+	else
+	{
+		gl_numloadthreads = 1;
+		for (i=0 ; i<count ; i++)
+			GL_LoadImageJob (i, batch);
+	}
+
+	for (load=batch ; load<batch+count ; load++)
+	{
+		time = Sys_Microseconds ();
+		if (load->malformed)
+			ri.Con_Printf (PRINT_DEVELOPER, "PCX file %s was malformed", load->name);
+
+		if (!load->cache)
+			GL_WriteCachedImage (load);
+
+		image = load->image;
+		GL_Bind (image->texnum);
+		image->has_alpha = GL_FinishUpload (&load->upload, true);
+		image->upload_width = upload_width;		// after power of 2 and scales
+		image->upload_height = upload_height;
+		image->paletted = uploaded_paletted;
+
+		if (load->cache)
+			ri.FS_FreeCache (load->cache);
+		else
+			ri.FS_FreeFile (load->raw);
+		load->raw = load->pixels = load->cache = NULL;
+		load->uploadtime = Sys_Microseconds () - time;
+	}
+
+	gl_numflushed = gl_numloads;
+	gl_loadbytes = 0;
+	gl_loadtime += Sys_Microseconds () - start;
+}
+
+/*
+================
+GL_BeginImageLoads
+
+Starts the queue for a new registration
+================
+*/
+void GL_BeginImageLoads (void)
+{
+	GL_FlushImages ();	// left by a registration that was cut short
+	gl_numloads = gl_numflushed = 0;
+	gl_loadtime = 0;
+
+	gl_cacheable = !(qglColorTableEXT && gl_ext_palettedtexture->value);
+	memset (&gl_cachekey, 0, sizeof(gl_cachekey));
+	gl_cachekey.picmip = max((int)gl_picmip->value, 0);
+	gl_cachekey.maxsize = gl_config.max_texsize;
+	gl_cachekey.npot = gl_config.arbTextureNonPowerOfTwo && gl_nonpoweroftwo_mipmaps->value;
+	gl_cachekey.lightscale = !gl_state.gammaRamp;
+	memcpy (gl_cachekey.gamma, gammatable, sizeof(gammatable));
+	memcpy (gl_cachekey.intensity, intensitytable, sizeof(intensitytable));
+	memcpy (gl_cachekey.palette, d_8to24table, sizeof(d_8to24table));
+}
+
+/*
+================
+GL_LoadStats_f
+
+Prints the images of the last registration by the time they took
+================
+*/
+static int GL_LoadCompare (const void *a, const void *b)
+{
+	const glload_t	*la = *(const glload_t **)a;
+	const glload_t	*lb = *(const glload_t **)b;
+	unsigned		ta = la->readtime + la->decodetime + la->uploadtime;
+	unsigned		tb = lb->readtime + lb->decodetime + lb->uploadtime;
+
+	return (ta < tb) - (ta > tb);
+}
+
+void GL_LoadStats_f (void)
+{
+	static glload_t	*sorted[MAX_GLTEXTURES];
+	glload_t	*load;
+	unsigned	readtime, decodetime, uploadtime;
+	int			i, bytes, cached;
+
+	if (!gl_numflushed)
+	{
+		ri.Con_Printf (PRINT_ALL, "No textures loaded at the last registration.\n");
+		return;
+	}
+
+	readtime = decodetime = uploadtime = 0;
+	bytes = cached = 0;
+	for (i=0 ; i<gl_numflushed ; i++)
+	{
+		load = &gl_loads[i];
+		sorted[i] = load;
+		cached += load->cached;
+		readtime += load->readtime;
+		decodetime += load->decodetime;
+		uploadtime += load->uploadtime;
+		bytes += load->rawlen;
+	}
+	qsort (sorted, gl_numflushed, sizeof(sorted[0]), GL_LoadCompare);
+
+	ri.Con_Printf (PRINT_ALL, "    read  decode  upload    bytes texture\n");
+	ri.Con_Printf (PRINT_ALL, "-------- ------- ------- -------- ----------------\n");
+	for (i=0 ; i<gl_numflushed ; i++)
+	{
+		load = sorted[i];
+		ri.Con_Printf (PRINT_ALL, "%8.2f %7.2f %7.2f %8i %s%s\n", load->readtime * 0.001f,
+			load->decodetime * 0.001f, load->uploadtime * 0.001f, load->rawlen, load->name,
+			load->cached ? " (cached)" : "");
+	}
+	ri.Con_Printf (PRINT_ALL, "%i textures, %i from the cache, %i bytes read in %.1f ms, then loaded in %.1f ms with cl_loadthreads %i (%.1f ms decoding, %.1f ms uploading)\n",
+		gl_numflushed, cached, bytes, readtime * 0.001f, gl_loadtime * 0.001f, gl_numloadthreads,
+		decodetime * 0.001f, uploadtime * 0.001f);
+}
+
+/*
+================
+GL_ImageBench_f
+
+Times the texture resample and mipmap kernels on made up images with
+gl_simd off and on, and checks the two give the same pixels.  Only the
+CPU kernels run, nothing is uploaded, but the command is registered
+by R_Init like the other gl_ commands.  The odd sizes leave pixels
+over after the SIMD loops, so the scalar tails are compared too.
+================
+*/
+static void GL_BenchKernel (char *name, int simd, byte *in, int inwidth, int inheight, byte *out, int outwidth, int outheight, int count)
+{
+	int			i, w, h;
+	unsigned	time;
+
+	time = Sys_Microseconds ();
+	for (i=0 ; i<count ; i++)
+	{
+		if (outwidth)
+		{
+			GL_ResampleTexture (in, inwidth, inheight, out, outwidth, outheight, simd);
+			continue;
+		}
+		// the whole chain, in place on a copy, until the width is odd
+		// (GL_MipMap takes pairs of pixels, an odd height drops a row)
+		memcpy (out, in, inwidth*inheight*4);
+		for (w=inwidth, h=inheight ; w > 1 && h > 1 && !(w & 1) ; w>>=1, h>>=1)
+			GL_MipMap (out, w, h, simd);
+	}
+	time = Sys_Microseconds () - time;
+
+	ri.Con_Printf (PRINT_ALL, "%-28s %s %8.2f ms\n", name, simd ? "simd  " : "scalar", time * 0.001f / count);
+}
+
+void GL_ImageBench_f (void)
+{
+	static const int	sizes[][4] = {
+		{1000, 600, 1024, 512},		// odd sized skin to power of two
+		{64, 64, 256, 256},			// scaled up
+		{256, 256, 64, 64},			// picmip
+		{301, 97, 129, 65},			// odd widths, a pixel left after the SIMD loop
+		{1024, 1024, 0, 0},			// mipmap chain
+		{200, 150, 0, 0},			// widths 200, 100, 50, none a multiple of 16
+		{36, 75, 0, 0},				// four pixels left after the SIMD loop, odd height
+		{6, 6, 0, 0}				// too narrow for any SIMD step
+	};
+	byte		*in, *out[2];
+	char		name[32];
+	unsigned	seed;
+	int			i, j, n, count;
+
+	count = ri.Cmd_Argc () > 1 ? atoi (ri.Cmd_Argv (1)) : 10;
+	if (count < 1)
+		count = 1;
+
+	for (i=0 ; i<sizeof(sizes)/sizeof(sizes[0]) ; i++)
+	{
+		n = sizes[i][0]*sizes[i][1]*4;
+		in = malloc (n);
+		out[0] = malloc (n > sizes[i][2]*sizes[i][3]*4 ? n : sizes[i][2]*sizes[i][3]*4);
+		out[1] = malloc (n > sizes[i][2]*sizes[i][3]*4 ? n : sizes[i][2]*sizes[i][3]*4);
+		for (j=0, seed=i+1 ; j<n ; j++)
+		{
+			seed = seed * 1103515245 + 12345;
+			in[j] = seed >> 24;
+		}
+
+		if (sizes[i][2])
+		{
+			Com_sprintf (name, sizeof(name), "resample %ix%i to %ix%i", sizes[i][0], sizes[i][1], sizes[i][2], sizes[i][3]);
+			n = sizes[i][2]*sizes[i][3]*4;
+		}
+		else
+			Com_sprintf (name, sizeof(name), "mipmap %ix%i", sizes[i][0], sizes[i][1]);
+		GL_BenchKernel (name, 0, in, sizes[i][0], sizes[i][1], out[0], sizes[i][2], sizes[i][3], count);
+		GL_BenchKernel (name, 1, in, sizes[i][0], sizes[i][1], out[1], sizes[i][2], sizes[i][3], count);
+		if (memcmp (out[0], out[1], n))
+			ri.Con_Printf (PRINT_ALL, "%s: simd result differs!\n", name);
+
+		free (in);
+		free (out[0]);
+		free (out[1]);
+	}
+
+#ifndef GL_SSE2
+	ri.Con_Printf (PRINT_ALL, "This build has no SSE2 kernels.\n");
+#endif
+}
+
 /*
 ===============
 GL_FindImage
@@ -1723,6 +2563,9 @@ image_t	*GL_FindImage (char *name, imagetype_t type)
 	//
 	// load the pic from disk
 	//
+	if (registration_active && type != it_pic && type != it_sky)
+		return GL_QueueImage (name, len, type);
+
 	pic = NULL;
 	palette = NULL;
 	if (!strcmp(name+len-4, ".pcx"))
@@ -1853,6 +2696,8 @@ void	GL_InitImages (void)
 	// init intensity conversions
 	intensity = ri.Cvar_Get ("intensity", "2", 0);
 
+	cl_loadthreads = ri.Cvar_Get ("cl_loadthreads", "0", CVAR_ARCHIVE);
+
 	if ( intensity->value <= 1 )
 		ri.Cvar_Set( "intensity", "1" );
 
@@ -1893,6 +2738,9 @@ void	GL_InitImages (void)
 			j = 255;
 		intensitytable[i] = j;
 	}
+
+	for (i=0 ; i<256 ; i++)
+		lighttable[i] = gammatable[intensitytable[i]];
 }
 
 /*
@@ -1905,6 +2753,17 @@ void	GL_ShutdownImages (void)
 	int		i;
 	image_t	*image;
 
+	// drop whatever a cut short registration left queued
+	for (i=gl_numflushed ; i<gl_numloads ; i++)
+	{
+		if (gl_loads[i].cache)
+			ri.FS_FreeCache (gl_loads[i].cache);
+		else
+			ri.FS_FreeFile (gl_loads[i].raw);
+	}
+	gl_numloads = gl_numflushed = 0;
+	gl_loadbytes = 0;
+
 	for (i=0, image=gltextures ; i<numgltextures ; i++, image++)
 	{
 		if (!image->registration_sequence)
@@ -349,30 +349,50 @@ void R_LightPoint (vec3_t p, vec3_t color)
 //===================================================================
 
 static float s_blocklights[128*128*4]; /* Knightmare-  was [34*34*3], supports max chop size of 2048? */
+
+// the dynamic lights reaching the surface being built, set up once so
+// their extent is known before anything is rebuilt
+typedef struct
+{
+	float		local[2];		// light position in luxels * 16
+	float		frad;			// intensity on the plane
+	float		fminlight;		// lit where the distance is below this
+	float		*color;
+	int			rect[4];		// s0, t0, s1, t1 of the luxels it can reach
+} surflight_t;
+
+static surflight_t	s_surflights[MAX_DLIGHTS];
+static int			s_numsurflights;
+
 /*
 ===============
-R_AddDynamicLights
+R_SetupDynamicLights
+
+Finds the dynamic lights that reach the surface this frame and the
+luxels each can touch, returning all of those in rect
 ===============
 */
-void R_AddDynamicLights (msurface_t *surf)
+static void R_SetupDynamicLights (msurface_t *surf, int smax, int tmax, int *rect)
 {
 	int			lnum;
-	int			sd, td;
 	float		fdist, frad, fminlight;
-	vec3_t		impact, local;
-	int			s, t;
+	vec3_t		impact;
 	int			i;
-	int			smax, tmax;
 	mtexinfo_t	*tex;
 	dlight_t	*dl;
-	float		*pfBL;
-	float		fsacc, ftacc;
+	surflight_t	*sl;
 	/* Knightmare added */
 	qboolean	rotated = false;
 	vec3_t		dlorigin, temp, entOrigin, entAngles, forward, right, up;
 
-	smax = (surf->extents[0]>>4)+1;
-	tmax = (surf->extents[1]>>4)+1;
+	s_numsurflights = 0;
+	rect[0] = smax;
+	rect[1] = tmax;
+	rect[2] = rect[3] = 0;
+
+	if (surf->dlightframe != r_framecount)
+		return;
+
 	tex = surf->texinfo;
 
 	/* Knightmare- factor in entity movement */
@@ -436,19 +456,110 @@ void R_AddDynamicLights (msurface_t *surf)
 			impact[i] = dlorigin[i] - surf->plane->normal[i]*fdist;
 		}
 
-		local[0] = DotProduct (impact, tex->vecs[0]) + tex->vecs[0][3] - surf->texturemins[0];
-		local[1] = DotProduct (impact, tex->vecs[1]) + tex->vecs[1][3] - surf->texturemins[1];
+		sl = &s_surflights[s_numsurflights];
+		sl->local[0] = DotProduct (impact, tex->vecs[0]) + tex->vecs[0][3] - surf->texturemins[0];
+		sl->local[1] = DotProduct (impact, tex->vecs[1]) + tex->vecs[1][3] - surf->texturemins[1];
+		sl->frad = frad;
+		sl->fminlight = fminlight;
+		sl->color = dl->color;
 
-		pfBL = s_blocklights;
-		for (t = 0, ftacc = 0 ; t<tmax ; t++, ftacc += 16)
+		// the distance is at least the truncated offset along either
+		// axis, so one more unit either way covers every lit luxel
+		for (i=0 ; i<2 ; i++)
 		{
-			td = local[1] - ftacc;
+			sl->rect[i] = (int)floor((sl->local[i] - fminlight - 1) / 16);
+			if (sl->rect[i] < 0)
+				sl->rect[i] = 0;
+			sl->rect[i+2] = (int)floor((sl->local[i] + fminlight + 1) / 16) + 1;
+			if (sl->rect[i+2] > (i ? tmax : smax))
+				sl->rect[i+2] = i ? tmax : smax;
+		}
+		if (sl->rect[0] >= sl->rect[2] || sl->rect[1] >= sl->rect[3])
+			continue;		// misses the surface
+
+		for (i=0 ; i<2 ; i++)
+		{
+			if (sl->rect[i] < rect[i])
+				rect[i] = sl->rect[i];
+			if (sl->rect[i+2] > rect[i+2])
+				rect[i+2] = sl->rect[i+2];
+		}
+		s_numsurflights++;
+	}
+}
+
+/*
+===============
+R_AddDynamicLights
+
+Adds the lights R_SetupDynamicLights found to the luxels in rect
+===============
+*/
+static void R_AddDynamicLights (int smax, const int *rect, int simd)
+{
+	int			sd, td;
+	float		fdist;
+	int			s, t, s0, s1, t0, t1;
+	float		*pfBL;
+	surflight_t	*sl;
+#ifdef GL_SSE2
+	__m128i		sdv, tdv, gt, sign;
+	__m128		fd, w, lit, c0, c1, c2;
+#endif
+
+	for (sl=s_surflights ; sl<s_surflights+s_numsurflights ; sl++)
+	{
+		s0 = max(sl->rect[0], rect[0]);
+		t0 = max(sl->rect[1], rect[1]);
+		s1 = min(sl->rect[2], rect[2]);
+		t1 = min(sl->rect[3], rect[3]);
+#ifdef GL_SSE2
+		c0 = _mm_setr_ps (sl->color[0], sl->color[1], sl->color[2], sl->color[0]);
+		c1 = _mm_setr_ps (sl->color[1], sl->color[2], sl->color[0], sl->color[1]);
+		c2 = _mm_setr_ps (sl->color[2], sl->color[0], sl->color[1], sl->color[2]);
+#endif
+
+		for (t = t0 ; t<t1 ; t++)
+		{
+			td = sl->local[1] - (float)(t*16);
 			if ( td < 0 )
 				td = -td;
 
-			for ( s=0, fsacc = 0 ; s<smax ; s++, fsacc += 16, pfBL += 3)
+			s = s0;
+			pfBL = s_blocklights + (t*smax + s)*3;
+#ifdef GL_SSE2
+			// four luxels at a time, as the loop below rounds them
+			if (simd)
 			{
-				sd = Q_ftol( local[0] - fsacc );
+				tdv = _mm_set1_epi32 (td);
+				for ( ; s+4 <= s1 ; s += 4, pfBL += 12)
+				{
+					sdv = _mm_slli_epi32 (_mm_add_epi32 (_mm_set1_epi32 (s), _mm_setr_epi32 (0, 1, 2, 3)), 4);
+					sdv = _mm_cvttps_epi32 (_mm_sub_ps (_mm_set1_ps (sl->local[0]), _mm_cvtepi32_ps (sdv)));
+					sign = _mm_srai_epi32 (sdv, 31);
+					sdv = _mm_sub_epi32 (_mm_xor_si128 (sdv, sign), sign);
+
+					gt = _mm_cmpgt_epi32 (sdv, tdv);
+					fd = _mm_cvtepi32_ps (_mm_or_si128 (
+						_mm_and_si128 (gt, _mm_add_epi32 (sdv, _mm_srai_epi32 (tdv, 1))),
+						_mm_andnot_si128 (gt, _mm_add_epi32 (tdv, _mm_srai_epi32 (sdv, 1)))));
+					lit = _mm_cmplt_ps (fd, _mm_set1_ps (sl->fminlight));
+					if (!_mm_movemask_ps (lit))
+						continue;
+					w = _mm_and_ps (_mm_sub_ps (_mm_set1_ps (sl->frad), fd), lit);
+
+					_mm_storeu_ps (pfBL, _mm_add_ps (_mm_loadu_ps (pfBL),
+						_mm_mul_ps (_mm_shuffle_ps (w, w, _MM_SHUFFLE(1,0,0,0)), c0)));
+					_mm_storeu_ps (pfBL+4, _mm_add_ps (_mm_loadu_ps (pfBL+4),
+						_mm_mul_ps (_mm_shuffle_ps (w, w, _MM_SHUFFLE(2,2,1,1)), c1)));
+					_mm_storeu_ps (pfBL+8, _mm_add_ps (_mm_loadu_ps (pfBL+8),
+						_mm_mul_ps (_mm_shuffle_ps (w, w, _MM_SHUFFLE(3,3,3,2)), c2)));
+				}
+			}
+#endif
+			for ( ; s<s1 ; s++, pfBL += 3)
+			{
+				sd = Q_ftol( sl->local[0] - (float)(s*16) );
 
 				if ( sd < 0 )
 					sd = -sd;
@@ -458,11 +569,11 @@ void R_AddDynamicLights (msurface_t *surf)
 				else
 					fdist = td + (sd>>1);
 
-				if ( fdist < fminlight )
+				if ( fdist < sl->fminlight )
 				{
-					pfBL[0] += ( frad - fdist ) * dl->color[0];
-					pfBL[1] += ( frad - fdist ) * dl->color[1];
-					pfBL[2] += ( frad - fdist ) * dl->color[2];
+					pfBL[0] += ( sl->frad - fdist ) * sl->color[0];
+					pfBL[1] += ( sl->frad - fdist ) * sl->color[1];
+					pfBL[2] += ( sl->frad - fdist ) * sl->color[2];
 				}
 			}
 		}
@@ -489,14 +600,508 @@ void R_SetCacheState( msurface_t *surf )
 #endif
 }
 
+/*
+===============
+R_AddLightmap
+
+Scales count floats of one lightmap style into blocklights, or onto what
+is there with add set
+===============
+*/
+static void R_AddLightmap (float *bl, byte *lightmap, int count, float *scale, qboolean add, int simd)
+{
+	int			i;
+#ifdef GL_SSE2
+	__m128i		zero, b, w;
+	__m128		f0, f1, f2, s0, s1, s2;
+	int			last;
+#endif
+
+	i = 0;
+#ifdef GL_SSE2
+	// four luxels, twelve bytes, at a time
+	if (simd)
+	{
+		zero = _mm_setzero_si128 ();
+		s0 = _mm_setr_ps (scale[0], scale[1], scale[2], scale[0]);
+		s1 = _mm_setr_ps (scale[1], scale[2], scale[0], scale[1]);
+		s2 = _mm_setr_ps (scale[2], scale[0], scale[1], scale[2]);
+		for ( ; i+12 <= count ; i += 12)
+		{
+			memcpy (&last, lightmap + i + 8, 4);
+			b = _mm_unpacklo_epi64 (_mm_loadl_epi64 ((__m128i *)(lightmap + i)), _mm_cvtsi32_si128 (last));
+			w = _mm_unpacklo_epi8 (b, zero);
+			f0 = _mm_mul_ps (_mm_cvtepi32_ps (_mm_unpacklo_epi16 (w, zero)), s0);
+			f1 = _mm_mul_ps (_mm_cvtepi32_ps (_mm_unpackhi_epi16 (w, zero)), s1);
+			f2 = _mm_mul_ps (_mm_cvtepi32_ps (_mm_unpacklo_epi16 (_mm_unpackhi_epi8 (b, zero), zero)), s2);
+			if (add)
+			{
+				f0 = _mm_add_ps (f0, _mm_loadu_ps (bl + i));
+				f1 = _mm_add_ps (f1, _mm_loadu_ps (bl + i + 4));
+				f2 = _mm_add_ps (f2, _mm_loadu_ps (bl + i + 8));
+			}
+			_mm_storeu_ps (bl + i, f0);
+			_mm_storeu_ps (bl + i + 4, f1);
+			_mm_storeu_ps (bl + i + 8, f2);
+		}
+	}
+#endif
+	if (add)
+	{
+		for ( ; i<count ; i+=3)
+		{
+			bl[i+0] += lightmap[i+0] * scale[0];
+			bl[i+1] += lightmap[i+1] * scale[1];
+			bl[i+2] += lightmap[i+2] * scale[2];
+		}
+	}
+	else
+	{
+		for ( ; i<count ; i+=3)
+		{
+			bl[i+0] = lightmap[i+0] * scale[0];
+			bl[i+1] = lightmap[i+1] * scale[1];
+			bl[i+2] = lightmap[i+2] * scale[2];
+		}
+	}
+}
+
+/*
+===============
+R_StoreLightmap
+
+Puts count luxels of blocklights into texture format
+===============
+*/
+static void R_StoreLightmap (float *bl, byte *dest, int count, int monolightmap, int simd)
+{
+	int			j;
+	int			r, g, b, a, max;
+#ifdef GL_SSE2
+	__m128		v0, v1, v2, t;
+	__m128i		rv, gv, bv, maxv, mask, over;
+#endif
+
+	j = 0;
+#ifdef GL_SSE2
+	// four luxels at a time, split into red, green and blue
+	if (simd && monolightmap == '0')
+	{
+		for ( ; j+4 <= count ; j += 4, bl += 12, dest += 16)
+		{
+			v0 = _mm_loadu_ps (bl);
+			v1 = _mm_loadu_ps (bl + 4);
+			v2 = _mm_loadu_ps (bl + 8);
+			rv = _mm_cvttps_epi32 (_mm_shuffle_ps (v0, _mm_shuffle_ps (v1, v2, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,3,0)));
+			gv = _mm_cvttps_epi32 (_mm_shuffle_ps (_mm_shuffle_ps (v0, v1, _MM_SHUFFLE(0,0,1,1)), _mm_shuffle_ps (v1, v2, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0)));
+			bv = _mm_cvttps_epi32 (_mm_shuffle_ps (_mm_shuffle_ps (v0, v1, _MM_SHUFFLE(1,1,2,2)), v2, _MM_SHUFFLE(3,0,2,0)));
+
+			// catch negative lights
+			rv = _mm_andnot_si128 (_mm_srai_epi32 (rv, 31), rv);
+			gv = _mm_andnot_si128 (_mm_srai_epi32 (gv, 31), gv);
+			bv = _mm_andnot_si128 (_mm_srai_epi32 (bv, 31), bv);
+
+			mask = _mm_cmpgt_epi32 (gv, rv);
+			maxv = _mm_or_si128 (_mm_and_si128 (mask, gv), _mm_andnot_si128 (mask, rv));
+			mask = _mm_cmpgt_epi32 (bv, maxv);
+			maxv = _mm_or_si128 (_mm_and_si128 (mask, bv), _mm_andnot_si128 (mask, maxv));
+
+			over = _mm_cmpgt_epi32 (maxv, _mm_set1_epi32 (255));
+			if (_mm_movemask_epi8 (over))
+			{
+				t = _mm_div_ps (_mm_set1_ps (255.0F), _mm_cvtepi32_ps (maxv));
+				rv = _mm_or_si128 (_mm_andnot_si128 (over, rv), _mm_and_si128 (over, _mm_cvttps_epi32 (_mm_mul_ps (_mm_cvtepi32_ps (rv), t))));
+				gv = _mm_or_si128 (_mm_andnot_si128 (over, gv), _mm_and_si128 (over, _mm_cvttps_epi32 (_mm_mul_ps (_mm_cvtepi32_ps (gv), t))));
+				bv = _mm_or_si128 (_mm_andnot_si128 (over, bv), _mm_and_si128 (over, _mm_cvttps_epi32 (_mm_mul_ps (_mm_cvtepi32_ps (bv), t))));
+			}
+
+			if (gl_lms.external_format == GL_BGRA)
+				rv = _mm_or_si128 (bv, _mm_or_si128 (_mm_slli_epi32 (gv, 8), _mm_slli_epi32 (rv, 16)));
+			else
+				rv = _mm_or_si128 (rv, _mm_or_si128 (_mm_slli_epi32 (gv, 8), _mm_slli_epi32 (bv, 16)));
+			_mm_storeu_si128 ((__m128i *)dest, _mm_or_si128 (rv, _mm_set1_epi32 (0xff000000)));
+		}
+	}
+#endif
+	for ( ; j<count ; j++)
+	{
+		r = Q_ftol( bl[0] );
+		g = Q_ftol( bl[1] );
+		b = Q_ftol( bl[2] );
+
+		// catch negative lights
+		if (r < 0)
+			r = 0;
+		if (g < 0)
+			g = 0;
+		if (b < 0)
+			b = 0;
+
+		/*
+		** determine the brightest of the three color components
+		*/
+		if (r > g)
+			max = r;
+		else
+			max = g;
+		if (b > max)
+			max = b;
+
+		/*
+		** alpha is ONLY used for the mono lightmap case.  For this reason
+		** we set it to the brightest of the color components so that 
+		** things don't get too dim.
+		*/
+		a = max;
+
+		/*
+		** rescale all the color components if the intensity of the greatest
+		** channel exceeds 1.0
+		*/
+		if (max > 255)
+		{
+			float t = 255.0F / max;
+
+			r = r*t;
+			g = g*t;
+			b = b*t;
+			a = a*t;
+		}
+
+		/*
+		** So if we are doing alpha lightmaps we need to set the R, G, and B
+		** components to 0 and we need to set alpha to 1-alpha.
+		*/
+		switch ( monolightmap )
+		{
+		case '0':
+			a = 255; /* Knightmare- fix for alpha test */
+			break;
+		case 'L':
+		case 'I':
+			r = a;
+			g = b = 0;
+			a = 255; /* Knightmare- fix for alpha test */
+			break;
+		case 'C':
+			// try faking colored lighting
+			a = 255 - ((r+g+b)/3);
+			r *= a/255.0;
+			g *= a/255.0;
+			b *= a/255.0;
+			a = 255; /* Knightmare- fix for alpha test */
+			break;
+		case 'A':
+		//	r = g = b = 0;
+			a = 255 - a;
+			r = g = b = a;
+			break;
+		default:
+			r = g = b = a;
+			a = 255; /* Knightmare- fix for alpha test */
+			break;
+		}
+		/* Knightmare- changed to BGRA */
+		if (gl_lms.external_format == GL_BGRA)
+		{
+			dest[0] = b;
+			dest[1] = g;
+			dest[2] = r;
+			dest[3] = a;
+		}
+		else
+		{
+			dest[0] = r;
+			dest[1] = g;
+			dest[2] = b;
+			dest[3] = a;
+		}
+
+		bl += 3;
+		dest += 4;
+	}
+}
+
+/*
+===============
+R_RebuildLightMap
+
+Combine and scale multiple lightmaps into the floating format in
+blocklights, then into the texture at dest.  Unless full is set only the
+luxels dynamic lights reach now or reached at the last build are redone,
+as nothing else can have changed; rect is set to what was, and false is
+returned if that was nothing.
+===============
+*/
+static qboolean R_RebuildLightMap (msurface_t *surf, byte *dest, int stride, qboolean full, int *rect, int simd)
+{
+	int			smax, tmax;
+	int			i, t, size;
+	byte		*lightmap;
+	float		scale[4];
+	int			maps;
+	int			lit[4];
+	int monolightmap;
+
+	if ( surf->texinfo->flags & (SURF_SKY|SURF_TRANS33|SURF_TRANS66|SURF_WARP) )
+		ri.Sys_Error (ERR_DROP, "R_BuildLightMap called for non-lit surface");
+
+	smax = (surf->extents[0]>>4)+1;
+	tmax = (surf->extents[1]>>4)+1;
+	size = smax*tmax;
+	if (size > (sizeof(s_blocklights)>>4) )
+		ri.Sys_Error (ERR_DROP, "Bad s_blocklights size");
+
+	// surfaces without light data are full bright, dynamic lights or not
+	if (surf->samples)
+		R_SetupDynamicLights (surf, smax, tmax, lit);
+	else
+	{
+		s_numsurflights = 0;
+		lit[0] = lit[1] = lit[2] = lit[3] = 0;
+	}
+
+	if (full)
+	{
+		rect[0] = rect[1] = 0;
+		rect[2] = smax;
+		rect[3] = tmax;
+	}
+	else
+	{
+		// what the last build lit plus what this one will
+		for (i=0 ; i<4 ; i++)
+			rect[i] = surf->dlightrect[i];
+		if (lit[0] < lit[2] && lit[1] < lit[3])
+		{
+			if (rect[0] >= rect[2] || rect[1] >= rect[3])
+			{
+				for (i=0 ; i<4 ; i++)
+					rect[i] = lit[i];
+			}
+			else
+			{
+				for (i=0 ; i<2 ; i++)
+				{
+					rect[i] = min(rect[i], lit[i]);
+					rect[i+2] = max(rect[i+2], lit[i+2]);
+				}
+			}
+		}
+	}
+
+	for (i=0 ; i<4 ; i++)
+		surf->dlightrect[i] = lit[i];
+
+	if (rect[0] >= rect[2] || rect[1] >= rect[3])
+		return false;
+
+// set to full bright if no light data
+	if (!surf->samples)
+	{
+		for (t=rect[1] ; t<rect[3] ; t++)
+			for (i=(t*smax + rect[0])*3 ; i<(t*smax + rect[2])*3 ; i++)
+				s_blocklights[i] = 255;
+
+		goto store;
+	}
+
+	lightmap = surf->samples;
+
+	// add all the lightmaps
+	if (surf->styles[0] == 255)
+	{
+		for (t=rect[1] ; t<rect[3] ; t++)
+			memset (s_blocklights + (t*smax + rect[0])*3, 0, sizeof(s_blocklights[0]) * (rect[2] - rect[0])*3);
+	}
+	for (maps = 0 ; maps < MAXLIGHTMAPS && surf->styles[maps] != 255 ;
+		 maps++)
+	{
+		for (i=0 ; i<3 ; i++)
+			scale[i] = gl_modulate->value*r_newrefdef.lightstyles[surf->styles[maps]].rgb[i];
+
+		for (t=rect[1] ; t<rect[3] ; t++)
+		{
+			i = (t*smax + rect[0])*3;
+			R_AddLightmap (s_blocklights + i, lightmap + i, (rect[2] - rect[0])*3, scale, maps > 0, simd);
+		}
+		lightmap += size*3;		// skip to next lightmap
+	}
+
+	// add all the dynamic lights
+	R_AddDynamicLights (smax, rect, simd);
+
+	// put into texture format
+store:
+	monolightmap = gl_monolightmap->string[0];
+
+	for (t=rect[1] ; t<rect[3] ; t++)
+	{
+		R_StoreLightmap (s_blocklights + (t*smax + rect[0])*3, dest + t*stride + rect[0]*4,
+			rect[2] - rect[0], monolightmap, simd);
+	}
+
+	return true;
+}
+
 /*
 ===============
 R_BuildLightMap
 
-Combine and scale multiple lightmaps into the floating format in blocklights
+Builds the whole of a surface's lightmap
 ===============
 */
 void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
+{
+	int		rect[4];
+
+	R_RebuildLightMap (surf, dest, stride, true, rect, gl_simd->intValue);
+}
+
+/*
+===============
+R_UpdateLightMap
+
+Rebuilds what dynamic lights changed in a surface's lightmap since it
+was last built, or all of it if its light styles changed.  rect gets the
+luxels redone, s0, t0, s1, t1.
+===============
+*/
+qboolean R_UpdateLightMap (msurface_t *surf, byte *dest, int stride, qboolean restyled, int *rect)
+{
+	return R_RebuildLightMap (surf, dest, stride, restyled, rect, gl_simd->intValue);
+}
+
+/*
+===============
+R_AddDynamicLightsReference
+
+R_AddDynamicLights and R_BuildLightMap as they were before partial
+rebuilds and the SSE2 kernels, kept unchanged for gl_lightmapbench to
+check the current builders against
+===============
+*/
+static void R_AddDynamicLightsReference (msurface_t *surf)
+{
+	int			lnum;
+	int			sd, td;
+	float		fdist, frad, fminlight;
+	vec3_t		impact, local;
+	int			s, t;
+	int			i;
+	int			smax, tmax;
+	mtexinfo_t	*tex;
+	dlight_t	*dl;
+	float		*pfBL;
+	float		fsacc, ftacc;
+	/* Knightmare added */
+	qboolean	rotated = false;
+	vec3_t		dlorigin, temp, entOrigin, entAngles, forward, right, up;
+
+	smax = (surf->extents[0]>>4)+1;
+	tmax = (surf->extents[1]>>4)+1;
+	tex = surf->texinfo;
+
+	/* Knightmare- factor in entity movement */
+	// currententity is not valid for trans surfaces
+	if (tex->flags & (SURF_TRANS33|SURF_TRANS66)) {
+		if (surf->entity) {
+			VectorCopy (surf->entity->origin, entOrigin);
+			VectorCopy (surf->entity->angles, entAngles);
+		}
+		else {
+			VectorCopy (vec3_origin, entOrigin);
+			VectorCopy (vec3_origin, entAngles);
+		}
+	}
+	else {
+		VectorCopy (currententity->origin, entOrigin);
+		VectorCopy (currententity->angles, entAngles);
+	}
+
+	if (entAngles[0] || entAngles[1] || entAngles[2])
+	{
+		rotated = true;
+		AngleVectors (entAngles, forward, right, up);
+	}
+	/* end Knigthmare */
+
+	for (lnum=0 ; lnum<r_newrefdef.num_dlights ; lnum++)
+	{
+		if ( !(surf->dlightbits & (1<<lnum) ) )
+			continue;		// not lit by this light
+
+		dl = &r_newrefdef.dlights[lnum];
+
+		frad = dl->intensity;
+
+		/* Knightmare- factor in entity movement */
+		VectorCopy (dl->origin, dlorigin);
+		VectorSubtract (dlorigin, entOrigin, dlorigin);
+		if (rotated)
+		{
+			VectorCopy (dlorigin, temp);
+			dlorigin[0] = DotProduct (temp, forward);
+			dlorigin[1] = -DotProduct (temp, right);
+			dlorigin[2] = DotProduct (temp, up);
+		}
+	//	fdist = DotProduct (dl->origin, surf->plane->normal) -	surf->plane->dist;
+		fdist = DotProduct (dlorigin, surf->plane->normal) - surf->plane->dist;
+		/* end Knigthmare */
+
+		frad -= fabs(fdist);
+		// rad is now the highest intensity on the plane
+
+		fminlight = r_lightcutoff->value; 	//** DMP var dynalight cutoff
+		if (frad < fminlight)
+			continue;
+		fminlight = frad - fminlight;
+
+		for (i=0 ; i<3 ; i++)
+		{	/* Knightmare- use adjusted light origin */
+		//	impact[i] = dl->origin[i] - surf->plane->normal[i]*fdist;
+			impact[i] = dlorigin[i] - surf->plane->normal[i]*fdist;
+		}
+
+		local[0] = DotProduct (impact, tex->vecs[0]) + tex->vecs[0][3] - surf->texturemins[0];
+		local[1] = DotProduct (impact, tex->vecs[1]) + tex->vecs[1][3] - surf->texturemins[1];
+
+		pfBL = s_blocklights;
+		for (t = 0, ftacc = 0 ; t<tmax ; t++, ftacc += 16)
+		{
+			td = local[1] - ftacc;
+			if ( td < 0 )
+				td = -td;
+
+			for ( s=0, fsacc = 0 ; s<smax ; s++, fsacc += 16, pfBL += 3)
+			{
+				sd = Q_ftol( local[0] - fsacc );
+
+				if ( sd < 0 )
+					sd = -sd;
+
+				if (sd > td)
+					fdist = sd + (td>>1);
+				else
+					fdist = td + (sd>>1);
+
+				if ( fdist < fminlight )
+				{
+					pfBL[0] += ( frad - fdist ) * dl->color[0];
+					pfBL[1] += ( frad - fdist ) * dl->color[1];
+					pfBL[2] += ( frad - fdist ) * dl->color[2];
+				}
+			}
+		}
+	}
+}
+
+/*
+===============
+R_BuildLightMapReference
+===============
+*/
+static void R_BuildLightMapReference (msurface_t *surf, byte *dest, int stride)
 {
 	int			smax, tmax;
 	int			r, g, b, a, max;
@@ -608,7 +1213,7 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
 
 	// add all the dynamic lights
 	if (surf->dlightframe == r_framecount)
-		R_AddDynamicLights (surf);
+		R_AddDynamicLightsReference (surf);
 
 	// put into texture format
 store:
@@ -792,3 +1397,142 @@ store:
 	}
 }
 
+/*
+===============
+R_LightmapBench_f
+
+Builds every lightmap of the current map with a dynamic light in front
+of it, with the original builder and with gl_simd off and on, then moves
+the light and updates just the luxels it changed, and checks all of them
+come out byte for byte as the original builder's.  Registered with the
+renderer, so it needs R_Init and a loaded world; nothing is uploaded.
+===============
+*/
+void R_LightmapBench_f (void)
+{
+	static byte	ref[128*128*4], out[128*128*4], upd[128*128*4];
+	dlight_t	light, *saveddlights;
+	entity_t	ent, *savedentity;
+	msurface_t	*surf, saved;
+	glpoly_t	*p;
+	vec3_t		center, a, b;
+	int			i, j, n, count, numsurfs, texels, redone, rect[4], bad[4];
+	int			stride, smax, tmax, saveddlightcount;
+	unsigned	time, reftime, scalartime, simdtime, fulltime, updatetime;
+
+	if (!r_worldmodel)
+	{
+		ri.Con_Printf (PRINT_ALL, "No map loaded.\n");
+		return;
+	}
+
+	count = ri.Cmd_Argc () > 1 ? atoi (ri.Cmd_Argv (1)) : 1;
+	if (count < 1)
+		count = 1;
+
+	saveddlights = r_newrefdef.dlights;
+	saveddlightcount = r_newrefdef.num_dlights;
+	savedentity = currententity;
+	memset (&ent, 0, sizeof(ent));
+	memset (&light, 0, sizeof(light));
+	VectorSet (light.color, 1, 0.5, 0.25);
+	light.intensity = 300;
+	r_newrefdef.dlights = &light;
+	r_newrefdef.num_dlights = 1;
+	currententity = &ent;
+
+	numsurfs = texels = redone = 0;
+	bad[0] = bad[1] = bad[2] = bad[3] = 0;
+	reftime = scalartime = simdtime = fulltime = updatetime = 0;
+	for (i=0, surf=r_worldmodel->surfaces ; i<r_worldmodel->numsurfaces ; i++, surf++)
+	{
+		if (surf->texinfo->flags & (SURF_SKY|SURF_TRANS33|SURF_TRANS66|SURF_WARP))
+			continue;
+		if (!(p = surf->polys) || !p->numverts)
+			continue;
+
+		smax = (surf->extents[0]>>4)+1;
+		tmax = (surf->extents[1]>>4)+1;
+		stride = smax*4;
+		numsurfs++;
+		texels += smax*tmax;
+
+		// a light just off the middle of the surface, then one along it
+		VectorClear (center);
+		for (j=0 ; j<p->numverts ; j++)
+			VectorAdd (center, p->verts[j], center);
+		VectorScale (center, 1.0f/p->numverts, center);
+		VectorMA (center, (surf->flags & SURF_PLANEBACK) ? -32 : 32, surf->plane->normal, a);
+		VectorNormalize2 (surf->texinfo->vecs[0], b);
+		VectorMA (a, 64, b, b);
+
+		saved = *surf;
+		surf->dlightframe = r_framecount;
+		surf->dlightbits = 1;
+
+		VectorCopy (b, light.origin);
+		time = Sys_Microseconds ();
+		for (n=0 ; n<count ; n++)
+			R_BuildLightMapReference (surf, ref, stride);
+		reftime += Sys_Microseconds () - time;
+		time = Sys_Microseconds ();
+		for (n=0 ; n<count ; n++)
+			R_RebuildLightMap (surf, out, stride, true, rect, 0);
+		scalartime += Sys_Microseconds () - time;
+		if (memcmp (ref, out, smax*tmax*4))
+			bad[0]++;
+		time = Sys_Microseconds ();
+		for (n=0 ; n<count ; n++)
+			R_RebuildLightMap (surf, out, stride, true, rect, 1);
+		simdtime += Sys_Microseconds () - time;
+		if (memcmp (ref, out, smax*tmax*4))
+			bad[1]++;
+
+		// from a to b, as a frame would see it
+		for (n=0 ; n<count ; n++)
+		{
+			VectorCopy (a, light.origin);
+			time = Sys_Microseconds ();
+			R_RebuildLightMap (surf, upd, stride, true, rect, gl_simd->intValue);
+			fulltime += Sys_Microseconds () - time;
+			VectorCopy (b, light.origin);
+			time = Sys_Microseconds ();
+			if (R_RebuildLightMap (surf, upd, stride, false, rect, gl_simd->intValue) && !n)
+				redone += (rect[2] - rect[0]) * (rect[3] - rect[1]);
+			updatetime += Sys_Microseconds () - time;
+		}
+		if (memcmp (ref, upd, smax*tmax*4))
+			bad[2]++;
+
+		// and the light going out
+		surf->dlightframe = r_framecount - 1;
+		R_RebuildLightMap (surf, upd, stride, false, rect, gl_simd->intValue);
+		R_BuildLightMapReference (surf, ref, stride);
+		if (memcmp (ref, upd, smax*tmax*4))
+			bad[3]++;
+
+		*surf = saved;
+	}
+
+	r_newrefdef.dlights = saveddlights;
+	r_newrefdef.num_dlights = saveddlightcount;
+	currententity = savedentity;
+
+	if (!numsurfs)
+	{
+		ri.Con_Printf (PRINT_ALL, "No lightmapped surfaces.\n");
+		return;
+	}
+	count *= numsurfs;
+	ri.Con_Printf (PRINT_ALL, "%i surfaces, %i luxels\n", numsurfs, texels);
+	ri.Con_Printf (PRINT_ALL, "full build     original %7.2f us scalar %7.2f us simd %7.2f us\n",
+		(float)reftime / count, (float)scalartime / count, (float)simdtime / count);
+	ri.Con_Printf (PRINT_ALL, "moved light    full   %7.2f us dirty %6.2f us, %i%% of luxels\n",
+		(float)fulltime / count, (float)updatetime / count, (int)(redone * 100.0f / texels));
+	if (bad[0] || bad[1] || bad[2] || bad[3])
+		ri.Con_Printf (PRINT_ALL, "%i scalar builds, %i simd builds, %i moved and %i removed lights differ from the original!\n",
+			bad[0], bad[1], bad[2], bad[3]);
+#ifndef GL_SSE2
+	ri.Con_Printf (PRINT_ALL, "This build has no SSE2 kernels.\n");
+#endif
+}
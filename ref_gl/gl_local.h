@@ -43,6 +43,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "qgl.h"
 
+// the texture and lightmap kernels, switched by gl_simd
+#if !id386 && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define GL_SSE2
+#include <emmintrin.h>
+#endif
+
 #define	REF_VERSION	"GL 0.02" /* Knightmare changed, was 0.01 */
 
 // up / down
@@ -306,6 +312,7 @@ extern	cvar_t	*gl_texturealphamode;
 extern	cvar_t	*gl_texturesolidmode;
 extern  cvar_t  *gl_saturatelighting;
 extern  cvar_t  *gl_lockpvs;
+extern  cvar_t  *gl_simd;
 
 extern	cvar_t	*vid_fullscreen;
 extern	cvar_t	*vid_gamma;
@@ -375,6 +382,7 @@ void R_AddSkySurface (msurface_t *fa);
 void R_ClearSkyBox (void);
 void R_DrawSkyBox (void);
 void R_MarkLights (dlight_t *light, int bit, mnode_t *node);
+void R_LightmapBench_f (void);
 
 #if 0
 short LittleShort (short l);
@@ -404,7 +412,7 @@ void	R_SetPalette ( const unsigned char *palette);
 int		Draw_GetPalette (void);
 
 //void GL_ResampleTexture (unsigned *in, int inwidth, int inheight, unsigned *out,  int outwidth, int outheight);
-void GL_ResampleTexture (void *indata, int inwidth, int inheight, void *outdata,  int outwidth, int outheight);
+void GL_ResampleTexture (void *indata, int inwidth, int inheight, void *outdata,  int outwidth, int outheight, int simd);
 
 struct image_s *R_RegisterSkin (char *name);
 
@@ -423,6 +431,11 @@ void	GL_ShutdownImages (void);
 
 void	GL_FreeUnusedImages (void);
 
+void	GL_BeginImageLoads (void);
+void	GL_FlushImages (void);
+void	GL_LoadStats_f (void);
+void	GL_ImageBench_f (void);
+
 void GL_TextureAlphaMode( char *string );
 void GL_TextureSolidMode( char *string );
 
@@ -118,6 +118,7 @@ typedef struct msurface_s
 	int			dlightframe;
 	int			dlightbits;
 	qboolean	cached_dlight;	/* Knightmare added */
+	short		dlightrect[4];	// s0, t0, s1, t1 dynamic lights reached at the last build
 
 	int			lightmaptexturenum;
 	byte		styles[MAXLIGHTMAPS];
@@ -140,6 +140,7 @@ cvar_t	*gl_texturemode;
 cvar_t	*gl_texturealphamode;
 cvar_t	*gl_texturesolidmode;
 cvar_t	*gl_lockpvs;
+cvar_t	*gl_simd;
 
 cvar_t	*gl_3dlabs_broken;
 
@@ -1125,6 +1126,8 @@ void R_Register ( void )
 	gl_texturealphamode = ri.Cvar_Get( "gl_texturealphamode", "default", CVAR_ARCHIVE );
 	gl_texturesolidmode = ri.Cvar_Get( "gl_texturesolidmode", "default", CVAR_ARCHIVE );
 	gl_lockpvs = ri.Cvar_Get( "gl_lockpvs", "0", 0 );
+	gl_simd = ri.Cvar_Get( "gl_simd", "1", 0 );
+	ri.Cvar_SetDescription("gl_simd", "Use SSE2 to resample and mipmap textures and to build lightmaps.  Has no effect on builds without it.");
 
 	gl_vertex_arrays = ri.Cvar_Get( "gl_vertex_arrays", "0", CVAR_ARCHIVE );
 
@@ -1174,6 +1177,9 @@ void R_Register ( void )
 	ri.Cmd_AddCommand( "screenshot_silent", GL_ScreenShot_Silent_f );
 	ri.Cmd_AddCommand( "modellist", Mod_Modellist_f );
 	ri.Cmd_AddCommand( "gl_strings", GL_Strings_f );
+	ri.Cmd_AddCommand( "gl_loadstats", GL_LoadStats_f );
+	ri.Cmd_AddCommand( "gl_imagebench", GL_ImageBench_f );
+	ri.Cmd_AddCommand( "gl_lightmapbench", R_LightmapBench_f );
 }
 
 /*
@@ -1686,6 +1692,9 @@ void R_Shutdown (void)
 	ri.Cmd_RemoveCommand ("screenshot_silent");	/* Knightmare added */
 	ri.Cmd_RemoveCommand ("imagelist");
 	ri.Cmd_RemoveCommand ("gl_strings");
+	ri.Cmd_RemoveCommand ("gl_loadstats");
+	ri.Cmd_RemoveCommand ("gl_imagebench");
+	ri.Cmd_RemoveCommand ("gl_lightmapbench");
 
 	Mod_FreeAll ();
 
@@ -42,6 +42,7 @@ static void R_RenderLightmappedPoly (msurface_t *surf);
 
 extern void R_SetCacheState( msurface_t *surf );
 extern void R_BuildLightMap (msurface_t *surf, byte *dest, int stride);
+extern qboolean R_UpdateLightMap (msurface_t *surf, byte *dest, int stride, qboolean restyled, int *rect);
 
 /* Knightmare- added for lightmap update batching */
 #ifdef BATCH_LM_UPDATES
@@ -874,8 +875,10 @@ Based on code from MH's experimental Q2 engine
 */
 void R_UpdateSurfaceLightmap (msurface_t *surf)
 {
-	int			map, smax, tmax;
+	int			map, lrect[4];
 	qboolean	is_dynamic = false;
+	qboolean	restyled = false;
+	qboolean	updated;
 
 	if ( !qglMultiTexCoord2fARB || (r_fullbright->intValue != 0) )
 		return;
@@ -885,13 +888,15 @@ void R_UpdateSurfaceLightmap (msurface_t *surf)
 	for ( map = 0; map < MAXLIGHTMAPS && surf->styles[map] != 255; map++ )
 	{
 		if ( r_newrefdef.lightstyles[surf->styles[map]].white != surf->cached_light[map] )
-			goto dynamic;
+		{
+			restyled = true;
+			break;
+		}
 	}
 
-	// dynamic this frame or dynamic previously
-	if ( (surf->dlightframe == r_framecount) || surf->cached_dlight )
+	// restyled, dynamic this frame or dynamic previously
+	if ( restyled || (surf->dlightframe == r_framecount) || surf->cached_dlight )
 	{
-dynamic:
 		if ( gl_dynamic->intValue || surf->cached_dlight )
 		{
 			if ( !(surf->texinfo->flags & (SURF_SKY|SURF_TRANS33|SURF_TRANS66|SURF_WARP)) )
@@ -906,22 +911,22 @@ dynamic:
 		unsigned	*base = gl_lms.lightmap_update[surf->lightmaptexturenum];
 		rect_t		*rect = &gl_lms.lightrect[surf->lightmaptexturenum];
 
-		smax = ( surf->extents[0] >> 4 ) + 1;
-		tmax = ( surf->extents[1] >> 4 ) + 1;
-
+		// a light that moved only needs the luxels it left and reached
 		base += (surf->light_t * LM_BLOCK_WIDTH + surf->light_s);
-		R_BuildLightMap (surf, (byte *)base, LM_BLOCK_WIDTH*LIGHTMAP_BYTES);
+		updated = R_UpdateLightMap (surf, (byte *)base, LM_BLOCK_WIDTH*LIGHTMAP_BYTES, restyled, lrect);
 		R_SetCacheState (surf);
+		if (!updated)
+			return;
 		gl_lms.modified[surf->lightmaptexturenum] = true;
 
-		if (surf->light_s < rect->left)
-			rect->left = surf->light_s;
-		if ((surf->light_s + smax) > rect->right)
-			rect->right = surf->light_s + smax;
-		if (surf->light_t < rect->top)
-			rect->top = surf->light_t;
-		if ((surf->light_t + tmax) > rect->bottom)
-			rect->bottom = surf->light_t + tmax;
+		if (surf->light_s + lrect[0] < rect->left)
+			rect->left = surf->light_s + lrect[0];
+		if (surf->light_s + lrect[2] > rect->right)
+			rect->right = surf->light_s + lrect[2];
+		if (surf->light_t + lrect[1] < rect->top)
+			rect->top = surf->light_t + lrect[1];
+		if (surf->light_t + lrect[3] > rect->bottom)
+			rect->bottom = surf->light_t + lrect[3];
 	}
 }
 
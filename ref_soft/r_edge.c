@@ -771,18 +771,17 @@ int D_MipLevelForScale (float scale)
 
 /*
 ==============
-D_FlatFillSurface
+D_FlatFillSpans
 
 Simple single color fill with no texture mapping
 ==============
 */
-void D_FlatFillSurface (surf_t *surf, int color)
+void D_FlatFillSpans (espan_t *span, int color)
 {
-	espan_t	*span;
 	byte	*pdest;
 	int		u, u2;
 	
-	for (span=surf->spans ; span ; span=span->pnext)
+	for ( ; span ; span=span->pnext)
 	{
 		pdest = (byte *)d_viewbuffer + r_screenwidth*span->v;
 		u = span->u;
@@ -854,6 +853,281 @@ void D_CalcGradients (msurface_t *pface)
 }
 
 
+/*
+=========================================================================
+
+SPAN DRAWING
+
+With sw_threads > 1 the surfaces are still set up and cached in order on
+the main thread, but instead of drawing their spans right away the span
+drawing state is saved in a record and the spans are sorted into
+horizontal bands.  The bands are then drawn in parallel, each thread
+going through every record for its own rows.  Spans never overlap, so
+the result is the same as drawing them in order.
+
+=========================================================================
+*/
+
+#define	MAX_SPAN_BANDS	64
+
+typedef struct
+{
+	int			type;
+	int			color;			// SPANS_BACKGROUND
+	pixel_t		*cacheblock;
+	int			cachewidth;
+	float		d_sdivzstepu, d_tdivzstepu, d_zistepu;
+	float		d_sdivzstepv, d_tdivzstepv, d_zistepv;
+	float		d_sdivzorigin, d_tdivzorigin, d_ziorigin;
+	fixed16_t	sadjust, tadjust, bbextents, bbextentt;
+} spanrecord_t;
+
+unsigned			d_spanbatch = 1;	// surface caches used by pending records are stamped with this
+
+static spanrecord_t	*d_spanrecords;
+static espan_t		**d_bandspans;		// [band][record]
+static int			d_numspanrecords, d_maxspanrecords;
+static int			d_spanthreads;		// 0 draws spans as they are emitted
+static int			d_numbands, d_bandheight;
+
+/*
+==============
+D_SaveSpanState
+==============
+*/
+static void D_SaveSpanState (spanrecord_t *rec)
+{
+	rec->cacheblock = cacheblock;
+	rec->cachewidth = cachewidth;
+	rec->d_sdivzstepu = d_sdivzstepu;
+	rec->d_tdivzstepu = d_tdivzstepu;
+	rec->d_zistepu = d_zistepu;
+	rec->d_sdivzstepv = d_sdivzstepv;
+	rec->d_tdivzstepv = d_tdivzstepv;
+	rec->d_zistepv = d_zistepv;
+	rec->d_sdivzorigin = d_sdivzorigin;
+	rec->d_tdivzorigin = d_tdivzorigin;
+	rec->d_ziorigin = d_ziorigin;
+	rec->sadjust = sadjust;
+	rec->tadjust = tadjust;
+	rec->bbextents = bbextents;
+	rec->bbextentt = bbextentt;
+}
+
+/*
+==============
+D_LoadSpanState
+==============
+*/
+static void D_LoadSpanState (spanrecord_t *rec)
+{
+	cacheblock = rec->cacheblock;
+	cachewidth = rec->cachewidth;
+	d_sdivzstepu = rec->d_sdivzstepu;
+	d_tdivzstepu = rec->d_tdivzstepu;
+	d_zistepu = rec->d_zistepu;
+	d_sdivzstepv = rec->d_sdivzstepv;
+	d_tdivzstepv = rec->d_tdivzstepv;
+	d_zistepv = rec->d_zistepv;
+	d_sdivzorigin = rec->d_sdivzorigin;
+	d_tdivzorigin = rec->d_tdivzorigin;
+	d_ziorigin = rec->d_ziorigin;
+	sadjust = rec->sadjust;
+	tadjust = rec->tadjust;
+	bbextents = rec->bbextents;
+	bbextentt = rec->bbextentt;
+}
+
+/*
+==============
+D_DrawSpanList
+
+Draws spans with the current span drawing state
+==============
+*/
+static void D_DrawSpanList (int type, int color, espan_t *spans)
+{
+	switch (type)
+	{
+	case SPANS_SOLID:
+		D_DrawSpans16 (spans);
+		break;
+
+	case SPANS_TURBULENT:
+		Turbulent8 (spans);
+		break;
+
+	case SPANS_FLOWING:
+		NonTurbulent8 (spans);
+		break;
+
+	case SPANS_SKY:
+		D_DrawSpans16 (spans);
+
+	// set up a gradient for the background surface that places it
+	// effectively at infinity distance from the viewpoint
+		d_zistepu = 0;
+		d_zistepv = 0;
+		d_ziorigin = -0.9;
+		break;
+
+	case SPANS_BACKGROUND:
+		D_FlatFillSpans (spans, color);
+		break;
+	}
+
+	D_DrawZSpans (spans);
+}
+
+/*
+==============
+D_EmitSpans
+
+Draws the spans of a surface that has been set up for drawing, or
+records them for the band threads
+==============
+*/
+void D_EmitSpans (surf_t *s, int type, int color)
+{
+	spanrecord_t	*rec;
+	espan_t			*span, *next;
+	int				i, band;
+
+	if (!d_spanthreads)
+	{
+		D_DrawSpanList (type, color, s->spans);
+		return;
+	}
+
+	i = d_numspanrecords++;
+	rec = &d_spanrecords[i];
+	rec->type = type;
+	rec->color = color;
+	D_SaveSpanState (rec);
+
+	for (band = 0; band < d_numbands; band++)
+		d_bandspans[band * d_maxspanrecords + i] = NULL;
+
+	for (span = s->spans; span; span = next)
+	{
+		next = span->pnext;
+		band = (span->v - r_refdef.vrect.y) / d_bandheight;
+		if (band < 0)
+			band = 0;
+		else if (band >= d_numbands)
+			band = d_numbands - 1;
+		span->pnext = d_bandspans[band * d_maxspanrecords + i];
+		d_bandspans[band * d_maxspanrecords + i] = span;
+	}
+
+	// keep D_SCAlloc from handing out the cache before it is drawn
+	if (type == SPANS_SOLID)
+		pcurrentcache->spanbatch = d_spanbatch;
+}
+
+/*
+==============
+D_DrawBandJob
+==============
+*/
+static void D_DrawBandJob (int band, void *unused)
+{
+	espan_t	**spans;
+	int		i;
+
+	spans = d_bandspans + band * d_maxspanrecords;
+	for (i = 0; i < d_numspanrecords; i++)
+	{
+		if (!spans[i])
+			continue;
+		D_LoadSpanState (&d_spanrecords[i]);
+		D_DrawSpanList (d_spanrecords[i].type, d_spanrecords[i].color, spans[i]);
+	}
+}
+
+/*
+==============
+D_BeginSpanRecords
+
+Decides whether the surfaces up to surface_p are drawn by band threads
+==============
+*/
+static void D_BeginSpanRecords (void)
+{
+	int		need;
+
+	d_spanthreads = 0;
+	d_numspanrecords = 0;
+
+	if (!R_THREADED_SPANS || sw_threads->intValue < 2 || !ri.RunJobs)
+		return;
+
+	need = surface_p - surfaces;
+	if (need > d_maxspanrecords)
+	{
+		D_FreeSpanRecords ();
+		d_spanrecords = malloc (need * sizeof(*d_spanrecords));
+		d_bandspans = malloc (need * MAX_SPAN_BANDS * sizeof(*d_bandspans));
+		if (!d_spanrecords || !d_bandspans)
+		{
+			D_FreeSpanRecords ();
+			return;
+		}
+		d_maxspanrecords = need;
+	}
+
+	d_spanthreads = sw_threads->intValue;
+	d_numbands = d_spanthreads * 4;	// small enough to even out busy and empty parts of the screen
+	if (d_numbands > MAX_SPAN_BANDS)
+		d_numbands = MAX_SPAN_BANDS;
+	if (d_numbands > r_refdef.vrect.height)
+		d_numbands = r_refdef.vrect.height;
+	d_bandheight = (r_refdef.vrect.height + d_numbands - 1) / d_numbands;
+	if (d_bandheight < 1)
+		d_bandheight = 1;
+}
+
+/*
+==============
+D_FlushSpanRecords
+
+Draws all recorded spans.  Also called by D_SCAlloc before it reuses a
+surface cache that is still waiting to be drawn.
+==============
+*/
+void D_FlushSpanRecords (void)
+{
+	spanrecord_t	saved;
+
+	if (!d_numspanrecords)
+		return;
+
+	// the calling thread draws bands too, so keep the state of the
+	// surface it is in the middle of setting up
+	D_SaveSpanState (&saved);
+	ri.RunJobs (d_numbands, D_DrawBandJob, NULL, d_spanthreads);
+	D_LoadSpanState (&saved);
+
+	d_numspanrecords = 0;
+	if (!++d_spanbatch)
+		d_spanbatch = 1;
+}
+
+/*
+==============
+D_FreeSpanRecords
+==============
+*/
+void D_FreeSpanRecords (void)
+{
+	free (d_spanrecords);
+	free (d_bandspans);
+	d_spanrecords = NULL;
+	d_bandspans = NULL;
+	d_maxspanrecords = d_numspanrecords = 0;
+	d_spanthreads = 0;
+}
+
 /*
 ==============
 D_BackgroundSurf
@@ -869,8 +1143,7 @@ void D_BackgroundSurf (surf_t *s)
 	d_zistepv = 0;
 	d_ziorigin = -0.9;
 
-	D_FlatFillSurface (s, (int)sw_clearcolor->value & 0xFF);
-	D_DrawZSpans (s->spans);
+	D_EmitSpans (s, SPANS_BACKGROUND, (int)sw_clearcolor->value & 0xFF);
 }
 
 /*
@@ -909,14 +1182,12 @@ void D_TurbulentSurf (surf_t *s)
 //PGM
 	// textures that aren't warping are just flowing. Use NonTurbulent8 instead
 	if(!(pface->texinfo->flags & SURF_WARP))
-		NonTurbulent8 (s->spans);
+		D_EmitSpans (s, SPANS_FLOWING, 0);
 	else
-		Turbulent8 (s->spans);
+		D_EmitSpans (s, SPANS_TURBULENT, 0);
 //PGM
 //============
 
-	D_DrawZSpans (s->spans);
-
 	if (s->insubmodel)
 	{
 	//
@@ -954,15 +1225,7 @@ void D_SkySurf (surf_t *s)
 
 	D_CalcGradients (pface);
 
-	D_DrawSpans16 (s->spans);
-
-// set up a gradient for the background surface that places it
-// effectively at infinity distance from the viewpoint
-	d_zistepu = 0;
-	d_zistepv = 0;
-	d_ziorigin = -0.9;
-
-	D_DrawZSpans (s->spans);
+	D_EmitSpans (s, SPANS_SKY, 0);
 }
 
 /*
@@ -1031,9 +1294,7 @@ void D_SolidSurf (surf_t *s)
 
 	D_CalcGradients (pface);
 
-	D_DrawSpans16 (s->spans);
-
-	D_DrawZSpans (s->spans);
+	D_EmitSpans (s, SPANS_SOLID, 0);
 
 	if (s->insubmodel)
 	{
@@ -1074,7 +1335,7 @@ void D_DrawflatSurfaces (void)
 
 		// make a stable color for each surface by taking the low
 		// bits of the msurface pointer
-		D_FlatFillSurface (s, (int)((intptr_t) s->msurf) & 0xFF);
+		D_FlatFillSpans (s->spans, (int)((intptr_t) s->msurf) & 0xFF);
 		D_DrawZSpans (s->spans);
 	}
 }
@@ -1090,6 +1351,10 @@ May be called more than once a frame if the surf list overflows (higher res)
 void D_DrawSurfaces (void)
 {
 	surf_t			*s;
+	unsigned		time = 0;
+
+	if (sw_bench->intValue)
+		time = Sys_Microseconds ();
 
 //	currententity = NULL;	//&r_worldentity;
 	VectorSubtract (r_origin, vec3_origin, modelorg);
@@ -1098,6 +1363,8 @@ void D_DrawSurfaces (void)
 
 	if (!sw_drawflat->intValue)
 	{
+		D_BeginSpanRecords ();
+
 		for (s = &surfaces[1] ; s<surface_p ; s++)
 		{
 			if (!s->spans)
@@ -1114,6 +1381,8 @@ void D_DrawSurfaces (void)
 			else if (s->flags & SURF_DRAWTURB)
 				D_TurbulentSurf (s);
 		}
+
+		D_FlushSpanRecords ();
 	}
 	else
 		D_DrawflatSurfaces ();
@@ -1121,5 +1390,8 @@ void D_DrawSurfaces (void)
 	currententity = NULL;	//&r_worldentity;
 	VectorSubtract (r_origin, vec3_origin, modelorg);
 	R_TransformFrustum ();
+
+	if (sw_bench->intValue)
+		rb_surftime += Sys_Microseconds () - time;
 }
 
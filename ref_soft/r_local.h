@@ -37,6 +37,21 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #define REF_VERSION     "SOFT 0.01"
 
+// span drawing state that every sw_threads worker keeps its own copy of.
+// The assembly span drawers use it as plain globals, so threaded span
+// drawing is only built for C builds on platforms that have threads.
+#if !id386 && !defined(__MSDOS__)
+#define R_THREADED_SPANS	1
+#ifdef _MSC_VER
+#define R_THREADLOCAL		__declspec(thread)
+#else	// the default model, the renderer is dlopen'd
+#define R_THREADLOCAL		__thread
+#endif
+#else
+#define R_THREADED_SPANS	0
+#define R_THREADLOCAL
+#endif
+
 // up / down
 #define PITCH   0
 
@@ -377,6 +392,7 @@ typedef struct surfcache_s
 	unsigned                        height;         // DEBUG only needed for debug
 	float                           mipscale;
 	image_t							*image;
+	unsigned						spanbatch;		// == d_spanbatch while threaded spans still use it
 	byte                            data[4];        // width*height elements
 } surfcache_t;
 
@@ -486,12 +502,12 @@ extern qboolean         d_roverwrapped;
 extern surfcache_t      *sc_rover;
 extern surfcache_t      *d_initial_rover;
 
-extern float    d_sdivzstepu, d_tdivzstepu, d_zistepu;
-extern float    d_sdivzstepv, d_tdivzstepv, d_zistepv;
-extern float    d_sdivzorigin, d_tdivzorigin, d_ziorigin;
+extern R_THREADLOCAL float    d_sdivzstepu, d_tdivzstepu, d_zistepu;
+extern R_THREADLOCAL float    d_sdivzstepv, d_tdivzstepv, d_zistepv;
+extern R_THREADLOCAL float    d_sdivzorigin, d_tdivzorigin, d_ziorigin;
 
-extern  fixed16_t       sadjust, tadjust;
-extern  fixed16_t       bbextents, bbextentt;
+extern R_THREADLOCAL fixed16_t       sadjust, tadjust;
+extern R_THREADLOCAL fixed16_t       bbextents, bbextentt;
 
 
 void D_DrawSpans16 (espan_t *pspans);
@@ -501,6 +517,22 @@ void NonTurbulent8 (espan_t *pspan);	//PGM
 
 surfcache_t     *D_CacheSurface (msurface_t *surface, int miplevel);
 
+// how D_EmitSpans draws a surface's spans
+enum
+{
+	SPANS_SOLID,
+	SPANS_TURBULENT,
+	SPANS_FLOWING,
+	SPANS_SKY,
+	SPANS_BACKGROUND
+};
+
+extern unsigned	d_spanbatch;
+
+void D_EmitSpans (surf_t *s, int type, int color);
+void D_FlushSpanRecords (void);
+void D_FreeSpanRecords (void);
+
 extern int      d_vrectx, d_vrecty, d_vrectright_particle, d_vrectbottom_particle;
 
 extern int      d_pix_min, d_pix_max, d_pix_shift;
@@ -516,8 +548,8 @@ extern float    d_scalemip[3];
 
 //===================================================================
 
-extern int              cachewidth;
-extern pixel_t  *cacheblock;
+extern R_THREADLOCAL int              cachewidth;
+extern R_THREADLOCAL pixel_t  *cacheblock;
 extern int              r_screenwidth;
 
 extern int              r_drawnpolycount;
@@ -560,6 +592,7 @@ extern int      ubasestep, errorterm, erroradjustup, erroradjustdown;
 //===========================================================================
 
 extern cvar_t   *sw_aliasstats;
+extern cvar_t   *sw_bench;
 extern cvar_t   *sw_clearcolor;
 extern cvar_t   *sw_drawflat;
 extern cvar_t   *sw_draworder;
@@ -571,6 +604,7 @@ extern cvar_t   *sw_mode;
 extern cvar_t   *sw_reportsurfout;
 extern cvar_t   *sw_reportedgeout;
 extern cvar_t   *sw_stipplealpha;
+extern cvar_t   *sw_threads;
 extern cvar_t   *sw_surfcacheoverride;
 extern cvar_t   *sw_waterwarp;
 
@@ -685,8 +719,8 @@ extern int      r_wholepolycount;
 
 extern int                      ubasestep, errorterm, erroradjustup, erroradjustdown;
 
-extern fixed16_t        sadjust, tadjust;
-extern fixed16_t        bbextents, bbextentt;
+extern R_THREADLOCAL fixed16_t        sadjust, tadjust;
+extern R_THREADLOCAL fixed16_t        bbextents, bbextentt;
 
 extern mvertex_t        *r_ptverts, *r_ptvertsmax;
 
@@ -739,6 +773,9 @@ extern double    r_time1;
 extern double	da_time1, da_time2;
 extern double	dp_time1, dp_time2, db_time1, db_time2, rw_time1, rw_time2;
 extern double	se_time1, se_time2, de_time1, de_time2, dv_time1, dv_time2;
+extern double	rb_marktime, rb_edgetime, rb_surftime, rb_aliastime, rb_parttime, rb_frametime;
+extern int		rb_frames;
+extern unsigned	rb_checksum;
 extern int              r_frustum_indexes[4*6];
 extern int              r_maxsurfsseen, r_maxedgesseen, r_cnumsurfs;
 extern qboolean r_surfsonstack;
@@ -756,6 +793,7 @@ extern  model_t         *r_worldmodel;
 void R_PrintAliasStats (void);
 void R_PrintTimes (void);
 void R_PrintDSpeeds (void);
+void R_BenchStats_f (void);
 void R_AnimateLight (void);
 void R_LightPoint (vec3_t p, vec3_t color);
 void R_SetupFrame (void);
@@ -106,10 +106,16 @@ image_t  	*r_notexture_mip;
 double	da_time1, da_time2, dp_time1, dp_time2, db_time1, db_time2, rw_time1, rw_time2;
 double	se_time1, se_time2, de_time1, de_time2;
 
+// sw_bench accumulators, in microseconds; reported and reset by sw_benchstats
+double	rb_marktime, rb_edgetime, rb_surftime, rb_aliastime, rb_parttime, rb_frametime;
+int		rb_frames;
+unsigned	rb_checksum = 2166136261u;
+
 void R_MarkLeaves (void);
 
 cvar_t	*r_lefthand;
 cvar_t	*sw_aliasstats;
+cvar_t	*sw_bench;
 #ifdef WIN32
 cvar_t	*sw_allow_modex;
 #endif
@@ -122,6 +128,7 @@ cvar_t  *sw_mode;
 cvar_t	*sw_reportedgeout;
 cvar_t	*sw_reportsurfout;
 cvar_t  *sw_stipplealpha;
+cvar_t	*sw_threads;
 cvar_t	*sw_surfcacheoverride;
 cvar_t	*sw_waterwarp;
 
@@ -179,14 +186,14 @@ cvar_t	*r_gunfov;		/* FS */
 // FIXME: make into one big structure, like cl or sv
 // FIXME: do separately for refresh engine and driver
 
-float	d_sdivzstepu, d_tdivzstepu, d_zistepu;
-float	d_sdivzstepv, d_tdivzstepv, d_zistepv;
-float	d_sdivzorigin, d_tdivzorigin, d_ziorigin;
+R_THREADLOCAL float	d_sdivzstepu, d_tdivzstepu, d_zistepu;
+R_THREADLOCAL float	d_sdivzstepv, d_tdivzstepv, d_zistepv;
+R_THREADLOCAL float	d_sdivzorigin, d_tdivzorigin, d_ziorigin;
 
-fixed16_t	sadjust, tadjust, bbextents, bbextentt;
+R_THREADLOCAL fixed16_t	sadjust, tadjust, bbextents, bbextentt;
 
-pixel_t			*cacheblock;
-int				cachewidth;
+R_THREADLOCAL pixel_t	*cacheblock;
+R_THREADLOCAL int		cachewidth;
 pixel_t			*d_viewbuffer;
 short			*d_pzbuffer;
 unsigned int	d_zrowbytes;
@@ -254,6 +261,8 @@ void R_ImageList_f( void );
 void R_Register (void)
 {
 	sw_aliasstats = ri.Cvar_Get ("sw_polymodelstats", "0", 0);
+	sw_bench = ri.Cvar_Get ("sw_bench", "0", 0);
+	ri.Cvar_SetDescription("sw_bench", "Accumulate per-stage render timings and a frame checksum.  Print them with sw_benchstats.");
 #ifdef WIN32
 	sw_allow_modex = ri.Cvar_Get( "sw_allow_modex", "1", CVAR_ARCHIVE );
 #endif
@@ -274,6 +283,8 @@ void R_Register (void)
 	sw_reportsurfout = ri.Cvar_Get ("sw_reportsurfout", "0", 0);
 	ri.Cvar_SetDescription("sw_reportsurfout", "Report running out of surfaces.");
 	sw_stipplealpha = ri.Cvar_Get( "sw_stipplealpha", "0", CVAR_ARCHIVE );
+	sw_threads = ri.Cvar_Get ("sw_threads", "0", CVAR_ARCHIVE);
+	ri.Cvar_SetDescription("sw_threads", "Number of threads used to draw world surfaces, each taking bands of the screen.  0 or 1 draws everything on the main thread.");
 	sw_surfcacheoverride = ri.Cvar_Get ("sw_surfcacheoverride", "0", 0);
 	ri.Cvar_SetDescription("sw_surfcacheoverride", "Surface cache size (in bytes).  Standard formula is 1024x768 + ((width*height)-64000)*3");
 	sw_waterwarp = ri.Cvar_Get ("sw_waterwarp", "1", CVAR_ARCHIVE);
@@ -312,6 +323,7 @@ void R_Register (void)
 	ri.Cmd_AddCommand ("modellist", Mod_Modellist_f);
 	ri.Cmd_AddCommand( "screenshot", R_ScreenShot_f );
 	ri.Cmd_AddCommand( "imagelist", R_ImageList_f );
+	ri.Cmd_AddCommand( "sw_benchstats", R_BenchStats_f );
 
 	sw_mode->modified = true; // force us to do mode specific stuff later
 	vid_gamma->modified = true; // force us to rebuild the gamma table later
@@ -330,6 +342,7 @@ void R_UnRegister (void)
 	ri.Cmd_RemoveCommand( "screenshot" );
 	ri.Cmd_RemoveCommand ("modellist");
 	ri.Cmd_RemoveCommand( "imagelist" );
+	ri.Cmd_RemoveCommand( "sw_benchstats" );
 }
 
 /*
@@ -398,6 +411,7 @@ void R_Shutdown (void)
 		free (sc_base);
 		sc_base = NULL;
 	}
+	D_FreeSpanRecords ();
 
 	// free colormap
 	if (vid.colormap)
@@ -545,6 +559,28 @@ void R_DrawNullModel( void )
 {
 }
 
+/*
+=============
+R_DrawAliasEntity
+
+R_AliasDrawModel, timed for sw_bench
+=============
+*/
+static void R_DrawAliasEntity (void)
+{
+	unsigned	time;
+
+	if (!sw_bench->intValue)
+	{
+		R_AliasDrawModel ();
+		return;
+	}
+
+	time = Sys_Microseconds ();
+	R_AliasDrawModel ();
+	rb_aliastime += Sys_Microseconds () - time;
+}
+
 /*
 =============
 R_DrawEntitiesOnList
@@ -595,7 +631,7 @@ void R_DrawEntitiesOnList (void)
 				break;
 
 			case mod_alias:
-				R_AliasDrawModel ();
+				R_DrawAliasEntity ();
 				break;
 
 			default:
@@ -640,7 +676,7 @@ void R_DrawEntitiesOnList (void)
 				break;
 
 			case mod_alias:
-				R_AliasDrawModel ();
+				R_DrawAliasEntity ();
 				break;
 
 			default:
@@ -1029,8 +1065,34 @@ R_RenderFrame
 
 @@@@@@@@@@@@@@@@
 */
+/*
+================
+R_BenchChecksum
+
+Folds the rendered view into rb_checksum so optimizations can be
+checked for bit-exact output
+================
+*/
+static void R_BenchChecksum (void)
+{
+	int			x, y;
+	pixel_t		*row;
+	unsigned	hash;
+
+	hash = rb_checksum;
+	for (y = 0; y < r_refdef.vrect.height; y++)
+	{
+		row = vid.buffer + (r_refdef.vrect.y + y) * vid.rowbytes + r_refdef.vrect.x;
+		for (x = 0; x < r_refdef.vrect.width; x++)
+			hash = (hash ^ row[x]) * 16777619u;	// FNV-1a
+	}
+	rb_checksum = hash;
+}
+
 void R_RenderFrame (refdef_t *fd)
 {
+	unsigned	rb_start = 0, rb_time = 0, rb_now;
+
 	r_newrefdef = *fd;
 
 	if (!r_worldmodel && !( r_newrefdef.rdflags & RDF_NOWORLDMODEL ) )
@@ -1044,12 +1106,29 @@ void R_RenderFrame (refdef_t *fd)
 
 	R_SetupFrame ();
 
+	if (sw_bench->intValue)
+		rb_start = rb_time = Sys_Microseconds ();
+
 	R_MarkLeaves ();	// done here so we know if we're in water
 
+	if (sw_bench->intValue)
+	{
+		rb_now = Sys_Microseconds ();
+		rb_marktime += rb_now - rb_time;
+		rb_time = rb_now;
+	}
+
 	R_PushDlights (r_worldmodel);
 
 	R_EdgeDrawing ();
 
+	if (sw_bench->intValue)
+	{
+		rb_now = Sys_Microseconds ();
+		rb_edgetime += rb_now - rb_time;	// D_DrawSurfaces is taken out when reporting
+		rb_time = rb_now;
+	}
+
 	if (r_dspeeds->intValue)
 	{
 		se_time2 = Sys_Milliseconds ();
@@ -1064,11 +1143,17 @@ void R_RenderFrame (refdef_t *fd)
 		dp_time1 = Sys_Milliseconds ();
 	}
 
+	if (sw_bench->intValue)
+		rb_time = Sys_Microseconds ();
+
 	R_DrawParticles ();
 
 	if (r_dspeeds->intValue)
 		dp_time2 = Sys_Milliseconds ();
 
+	if (sw_bench->intValue)
+		rb_parttime += Sys_Microseconds () - rb_time;
+
 	currententity = &r_worldentity; // FS: Dr Jack Whitham ref_soft fix
 	currentmodel = currententity->model; // FS: Dr Jack Whitham ref_soft fix
 
@@ -1087,6 +1172,13 @@ void R_RenderFrame (refdef_t *fd)
 
 	R_CalcPalette ();
 
+	if (sw_bench->intValue)
+	{
+		rb_frametime += Sys_Microseconds () - rb_start;
+		rb_frames++;
+		R_BenchChecksum ();
+	}
+
 	if (sw_aliasstats->intValue)
 		R_PrintAliasStats ();
 
@@ -161,6 +161,40 @@ void R_PrintDSpeeds (void)
 }
 
 
+/*
+=============
+R_BenchStats_f
+
+Prints the per frame averages gathered while sw_bench is set and starts over
+=============
+*/
+void R_BenchStats_f (void)
+{
+	double	frames;
+
+	if (!rb_frames)
+	{
+		ri.Con_Printf (PRINT_ALL, "No frames benchmarked.  Set sw_bench 1 first.\n");
+		return;
+	}
+
+	frames = rb_frames * 1000.0;	// microseconds to milliseconds per frame
+
+	ri.Con_Printf (PRINT_ALL, "%i frames at %ix%i, average ms per frame:\n", rb_frames, vid.width, vid.height);
+	ri.Con_Printf (PRINT_ALL, "R_MarkLeaves    %8.3f\n", rb_marktime / frames);
+	ri.Con_Printf (PRINT_ALL, "R_EdgeDrawing   %8.3f\n", (rb_edgetime - rb_surftime) / frames);
+	ri.Con_Printf (PRINT_ALL, "D_DrawSurfaces  %8.3f\n", rb_surftime / frames);
+	ri.Con_Printf (PRINT_ALL, "alias models    %8.3f\n", rb_aliastime / frames);
+	ri.Con_Printf (PRINT_ALL, "particles       %8.3f\n", rb_parttime / frames);
+	ri.Con_Printf (PRINT_ALL, "R_RenderFrame   %8.3f\n", rb_frametime / frames);
+	ri.Con_Printf (PRINT_ALL, "checksum        %08x\n", rb_checksum);
+
+	rb_marktime = rb_edgetime = rb_surftime = rb_aliastime = rb_parttime = rb_frametime = 0;
+	rb_frames = 0;
+	rb_checksum = 2166136261u;
+}
+
+
 /*
 =============
 R_PrintAliasStats
@@ -407,6 +407,7 @@ void R_InitCaches (void)
 	sc_base->next = NULL;
 	sc_base->owner = NULL;
 	sc_base->size = sc_size;
+	sc_base->spanbatch = 0;
 }
 
 
@@ -432,6 +433,7 @@ void D_FlushCaches (void)
 	sc_base->next = NULL;
 	sc_base->owner = NULL;
 	sc_base->size = sc_size;
+	sc_base->spanbatch = 0;
 }
 
 /*
@@ -443,6 +445,7 @@ surfcache_t     *D_SCAlloc (int width, int size)
 {
 	surfcache_t             *new;
 	qboolean                wrapped_this_time;
+	qboolean                pending;
 
 	if ((width < 0) || (width > 256))
 		ri.Sys_Error (ERR_FATAL,"D_SCAlloc: bad cache width %d\n", width);
@@ -471,6 +474,7 @@ surfcache_t     *D_SCAlloc (int width, int size)
 	new = sc_rover;
 	if (sc_rover->owner)
 		*sc_rover->owner = NULL;
+	pending = (sc_rover->spanbatch == d_spanbatch);
 	
 	while (new->size < size)
 	{
@@ -480,11 +484,18 @@ surfcache_t     *D_SCAlloc (int width, int size)
 			ri.Sys_Error (ERR_FATAL,"D_SCAlloc: hit the end of memory");
 		if (sc_rover->owner)
 			*sc_rover->owner = NULL;
+		if (sc_rover->spanbatch == d_spanbatch)
+			pending = true;
 			
 		new->size += sc_rover->size;
 		new->next = sc_rover->next;
 	}
 
+// only headers have been touched so far, so recorded spans can still
+// be drawn from the blocks that are about to be overwritten
+	if (pending)
+		D_FlushSpanRecords ();
+
 // create a fragment out of any leftovers
 	if (new->size - size > 256)
 	{
@@ -493,6 +504,7 @@ surfcache_t     *D_SCAlloc (int width, int size)
 		sc_rover->next = new->next;
 		sc_rover->width = 0;
 		sc_rover->owner = NULL;
+		sc_rover->spanbatch = 0;
 		new->next = sc_rover;
 		new->size = size;
 	}
@@ -505,6 +517,7 @@ surfcache_t     *D_SCAlloc (int width, int size)
 		new->height = (size - sizeof(*new) + sizeof(new->data)) / width;
 
 	new->owner = NULL;              // should be set properly after return
+	new->spanbatch = 0;
 
 	if (d_roverwrapped)
 	{
@@ -598,6 +611,11 @@ surfcache_t *D_CacheSurface (msurface_t *surface, int miplevel)
 			&& cache->lightadj[3] == r_drawsurf.lightadj[3] )
 		return cache;
 
+// an animating or flashing surface drawn twice in one batch is redrawn
+// in place, so draw what was recorded with the old contents first
+	if (cache && cache->spanbatch == d_spanbatch)
+		D_FlushSpanRecords ();
+
 //
 // determine shape of surface
 //
@@ -61,8 +61,14 @@ typedef struct
 	sizebuf_t	multicast;
 	byte		multicast_buf[MAX_MSGLEN];
 
+	// clients grouped by the cluster they are in, see SV_ClientClusters
+	qboolean	clientclustersdirty;
+	int			numclientclusters;
+	int			clientclusters[MAX_CLIENTS];
+	unsigned	clusterclients[MAX_CLIENTS][MAX_CLIENTS/32];	// client number bits
+
 	// demo server information
-	FILE		*demofile;
+	fsreader_t	*demofile;
 	qboolean	timedemo;		// don't time sync
 } server_t;
 
@@ -92,6 +98,38 @@ typedef struct
 #define	LATENCY_COUNTS	16
 #define	RATE_MESSAGES	10
 
+// entity delta bytes by field, see SV_CountDelta
+typedef enum
+{
+	NSF_HEADER,		// update bits and entity number
+	NSF_MODEL,
+	NSF_FRAME,
+	NSF_SKIN,
+	NSF_EFFECTS,	// effects and renderfx
+	NSF_ORIGIN,
+	NSF_ANGLES,
+	NSF_OLDORIGIN,
+	NSF_SOUND,
+	NSF_EVENT,
+	NSF_SOLID,
+	NSF_REMOVE,		// entities leaving the frame
+	NSF_NUMFIELDS
+} nsfield_t;
+
+#define	NETSTATS_SVCOPS	(svc_frame+1)
+
+// byte counters for what is written to a client, reported by sv_netstats
+typedef struct
+{
+	int		svc[NETSTATS_SVCOPS];		// by message type
+	int		fields[NSF_NUMFIELDS];		// the svc_packetentities bytes by field
+	int		entities;					// entity deltas written
+	int		frames;						// frames sent
+	int		ratedrops;					// frames not sent because of rate
+	int		overflows;					// frames or datagrams thrown away for size
+	int		starttime;					// svs.realtime when counting began
+} netstats_t;
+
 typedef struct client_s
 {
 	client_state_t	state;
@@ -111,6 +149,9 @@ typedef struct client_s
 	int				rate;
 	int				surpressCount;		// number of messages rate supressed
 
+	netstats_t		netstats;
+	netstats_t		framestats;			// the frame being encoded, added to netstats once sent
+
 	edict_t			*edict;				// EDICT_NUM(clientnum+1)
 	char			name[32];			// extracted from userinfo, high bits masked
 	int				messagelevel;		// for filtering printed messages
@@ -125,6 +166,12 @@ typedef struct client_s
 	byte			*download;			// file being downloaded
 	int				downloadsize;		// total bytes (can't use EOF because of paks)
 	int				downloadcount;		// bytes sent
+	int				downloadwindow;		// bytes that may be unacknowledged, 0 for the original protocol
+	int				downloadacked;		// bytes the client has confirmed
+	int				downloadacktime;	// svs.realtime when downloadacked last moved
+	int				downloadrate;		// bytes per second
+	float			downloadcredit;		// bytes that can go out without exceeding downloadrate
+	int				downloadcredittime;	// svs.realtime when downloadcredit was last topped up
 
 	int				lastmessage;		// sv.framenum when packet was last received
 	int				lastconnect;
@@ -132,6 +179,12 @@ typedef struct client_s
 	int				idletime;			/* FS: From R1Q2.  Kick excessive idlers. */
 	int				challenge;			// challenge of this user, randomly generated
 
+	// leaf of edict->s.origin for multicasts, found again when the origin moves
+	qboolean		clustervalid;
+	vec3_t			clusterorigin;
+	int				cluster;
+	int				area;
+
 	netchan_t		netchan;
 } client_t;
 
@@ -143,6 +196,50 @@ typedef struct client_s
 
 //=============================================================================
 
+// per-client scratch space for building and encoding
+// client frames on worker threads (sv_threads)
+typedef struct
+{
+	qboolean		send;				// spawned and not rate dropped this frame
+	client_frame_t	*frame;				// NULL if the client isn't in game yet
+	vec3_t			org;				// view origin
+	int				clientarea;
+	byte			fatpvs[65536/8];
+	byte			phs[65536/8];
+	int				num_entities;		// visible edict numbers
+	short			entities[MAX_EDICTS];
+	int				maxsize;			// the real limit for msg
+	int				surpressCount;		// restored if the frame must be rewritten
+	qboolean		rewrite;			// must be encoded again on the main thread
+	sizebuf_t		msg;
+	byte			msg_buf[MAX_MSGLEN];	// holds any frame, see SV_EncodeClientJob
+} clientbuild_t;
+
+// which entities touch each PVS cluster, kept by SV_LinkEdict so a
+// client's frame can be culled a cluster at a time instead of an
+// entity at a time (see SV_CullEntities)
+#define	SV_ENTWORDS		(MAX_EDICTS/32)
+
+typedef struct
+{
+	int			numclusters;
+	unsigned	*clusterents;				// [numclusters][SV_ENTWORDS] entity bits
+	int			*clustercount;				// [numclusters] entities touching each cluster
+	int			*occupied;					// [numoccupied] clusters with any entities
+	int			*occupiedslot;				// [numclusters] position in occupied
+	int			numoccupied;
+
+	// what was indexed for each entity, so it can be taken out again
+	int			linkcount[MAX_EDICTS];
+	int			numentclusters[MAX_EDICTS];	// -1 for headnode entities, as num_clusters
+	int			entclusters[MAX_EDICTS][MAX_ENT_CLUSTERS];
+
+	// set up by SV_PrepareEntityCull for the frame being sent
+	unsigned	indexed[SV_ENTWORDS];		// can be found through the clusters
+	unsigned	scalar[SV_ENTWORDS];		// beams and headnode entities
+	unsigned	sendable[SV_ENTWORDS];		// either of the above
+} entindex_t;
+
 // MAX_CHALLENGES is made large to prevent a denial
 // of service attack that could cycle all of them
 // out before legitimate users connected
@@ -156,6 +253,8 @@ typedef struct
 } challenge_t;
 
 
+#define	SV_CLIENTHASH	(MAX_CLIENTS*2)		// must be a power of two
+
 typedef struct
 {
 	qboolean	initialized;				// sv_init has completed
@@ -167,6 +266,7 @@ typedef struct
 											// used to check late spawns
 
 	client_t	*clients;					// [maxclients->value];
+	clientbuild_t	*clientbuilds;			// [maxclients->value], allocated when sv_threads is first used
 	int			num_client_entities;		// maxclients->value*UPDATE_BACKUP*MAX_PACKET_ENTITIES
 	int			next_client_entities;		// next client_entity to use
 	entity_state_t	*client_entities;		// [num_client_entities]
@@ -175,12 +275,37 @@ typedef struct
 
 	challenge_t	challenges[MAX_CHALLENGES];	// to prevent invalid IPs from connecting
 
+	// finds the client a packet is from, see SV_ClientForPacket
+	short		clienthash[SV_CLIENTHASH];	// client number + 1, 0 is empty
+	qboolean	clienthashdirty;			// rebuild before the next lookup
+
 	// serverrecord values
-	FILE		*demofile;
+	fswriter_t	*demofile;				// serverrecord
 	sizebuf_t	demo_multicast;
 	byte		demo_multicast_buf[MAX_MSGLEN];
 } server_static_t;
 
+// per-frame profile, reported by sv_profile
+typedef enum
+{
+	SVP_READ,		// timeouts and packet reading, including idle frames
+	SVP_GAME,		// pings, msec and the game frame
+	SVP_SEND,		// client messages
+	SVP_DEMO,		// serverrecord
+	SVP_OTHER,		// heartbeat and world frame prep
+	SVP_TOTAL,
+	SVP_NUMPHASES
+} svphase_t;
+
+typedef struct
+{
+	unsigned	phase[SVP_NUMPHASES];		// microseconds
+	int			traces;
+	int			links;
+	int			multicasts;
+	int			syscalls;					// socket calls, see NET_SystemCalls
+} svprofile_t;
+
 //=============================================================================
 
 extern	netadr_t	net_from;
@@ -200,14 +325,29 @@ extern	cvar_t		*sv_enforcetime;
 
 extern	cvar_t		*sv_skipcinematics; /* FS: skip cinematics if we want to. */
 extern	cvar_t		*sv_allow_download_maps_in_paks; /* FS: Allow bsp downloads from a pak file if we want to. */
+extern	cvar_t		*sv_download_window;
+extern	cvar_t		*sv_download_maxrate;
+extern	cvar_t		*sv_download_compress;
 
 /* FS: Added these to filter out wallfly's spammy rcon status request every 30 seconds */
 extern	cvar_t		*sv_filter_wallfly_rcon_request;
 extern	cvar_t		*sv_filter_wallfly_ip;
 
+extern	cvar_t		*sv_area_cellsize;
+extern	cvar_t		*sv_threads;
+extern	cvar_t		*sv_profile_log;
+extern	cvar_t		*sv_netstats_log;
+extern	cvar_t		*sv_netstats_interval;
+extern	cvar_t		*sv_simd;
+extern	cvar_t		*sv_demo_compress;
+extern	cvar_t		*sv_save_compress;
+
 extern	client_t	*sv_client;
 extern	edict_t		*sv_player;
 
+extern	svprofile_t	sv_prof;				// counters for the frame being run
+extern	entindex_t	sv_entindex;
+
 //===========================================================
 
 //
@@ -215,8 +355,13 @@ extern	edict_t		*sv_player;
 //
 extern char uptime_infostring[80]; /* FS: Uptime for /info */
 void SV_FinalMessage (char *message, qboolean reconnect);
+void SV_Profile_f (void);
+void SV_Netstats_f (void);
+void SV_NetstatsFrame (void);
+void SV_FloodTest_f (void);
 void SV_DropClient (client_t *drop);
 client_t *GetClientFromAdr (netadr_t address); // Knightmare added
+client_t *SV_ClientForPacket (netadr_t from, int qport);
 void SV_DropClientFromAdr (netadr_t address); // Knightmare added
 
 int SV_ModelIndex (char *name);
@@ -261,6 +406,7 @@ void SV_FlushRedirect (int sv_redirected, char *outputbuf);
 void SV_DemoCompleted (void);
 void SV_SendClientMessages (void);
 
+void SV_CountMessage (client_t *cl, int op, int len);
 void SV_Multicast (vec3_t origin, multicast_t to);
 void SV_StartSound (vec3_t origin, edict_t *entity, int channel,
 					int soundindex, float volume,
@@ -274,19 +420,30 @@ void SV_BroadcastCommand (const char *fmt, ...) __attribute__((__format__(__prin
 //
 void SV_Nextserver (void);
 void SV_ExecuteClientMessage (client_t *cl);
+void SV_SendDownload (client_t *cl);
+void SV_FreeDownloadCache (void);
 
 //
 // sv_ccmds.c
 //
 void SV_ReadLevelFile (void);
+void SV_WriteSaveFile (char *filename, void *data, int len);
 void SV_Status_f (void);
+qboolean SV_SetPlayer (void);
 
 //
 // sv_ents.c
 //
 void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg);
+void SV_CountDelta (netstats_t *ns, int bits, int size);
 void SV_RecordDemoMessage (void);
 void SV_BuildClientFrame (client_t *client);
+client_frame_t *SV_SetupClientFrame (client_t *client, vec3_t org, int *clientarea, int *clientcluster, byte *pvs);
+qboolean SV_EntityVisibleToClient (edict_t *ent, edict_t *clent, vec3_t org, int clientarea, byte *pvs, byte *phs);
+void SV_PrepareEntityCull (void);
+int SV_CullEntities (edict_t *clent, vec3_t org, int clientarea, byte *pvs, byte *phs, short *list);
+void SV_CullBench_f (void);
+void SV_AddClientEntity (client_t *client, client_frame_t *frame, int e);
 
 //
 // sv_game.c
@@ -327,6 +484,13 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list, int maxcount, int a
 // returns the number of pointers filled in
 // ??? does this always return the world?
 
+void SV_AreaStats_f (void);
+// prints per-node occupancy and SV_AreaEdicts query cost
+
+void SV_SyncEntityIndex (void);
+// reindexes entities whose clusters were changed without SV_LinkEdict,
+// such as by the game clearing a freed edict
+
 //===================================================================
 
 //
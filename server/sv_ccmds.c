@@ -169,6 +169,8 @@ void SV_WipeSavegame (char *savename)
 
 	Com_DPrintf(DEVELOPER_MSG_SAVE, "SV_WipeSaveGame(%s)\n", savename);
 
+	FS_FlushWrites ();
+
 	Com_sprintf (name, sizeof(name), "%s/save/%s/server.ssv", FS_Gamedir (), savename);
 	remove (name);
 	Com_sprintf (name, sizeof(name), "%s/save/%s/game.ssv", FS_Gamedir (), savename);
@@ -193,45 +195,11 @@ void SV_WipeSavegame (char *savename)
 }
 
 
-/*
-================
-CopyFile
-================
-*/
-void CopyFile (char *src, char *dst)
-{
-	FILE	*f1, *f2;
-	int		l;
-	byte	buffer[65536];
-
-	Com_DPrintf(DEVELOPER_MSG_IO, "CopyFile (%s, %s)\n", src, dst);
-
-	f1 = fopen (src, "rb");
-	if (!f1)
-		return;
-	f2 = fopen (dst, "wb");
-	if (!f2)
-	{
-		fclose (f1);
-		return;
-	}
-
-	while (1)
-	{
-		l = fread (buffer, 1, sizeof(buffer), f1);
-		if (!l)
-			break;
-		fwrite (buffer, 1, l, f2);
-	}
-
-	fclose (f1);
-	fclose (f2);
-}
-
-
 /*
 ================
 SV_CopySaveGame
+
+The copies are queued behind any writes that haven't finished yet
 ================
 */
 void SV_CopySaveGame (char *src, char *dst)
@@ -248,11 +216,11 @@ void SV_CopySaveGame (char *src, char *dst)
 	Com_sprintf (name, sizeof(name), "%s/save/%s/server.ssv", FS_Gamedir(), src);
 	Com_sprintf (name2, sizeof(name2), "%s/save/%s/server.ssv", FS_Gamedir(), dst);
 	FS_CreatePath (name2);
-	CopyFile (name, name2);
+	FS_CopyFileAsync (name, name2);
 
 	Com_sprintf (name, sizeof(name), "%s/save/%s/game.ssv", FS_Gamedir(), src);
 	Com_sprintf (name2, sizeof(name2), "%s/save/%s/game.ssv", FS_Gamedir(), dst);
-	CopyFile (name, name2);
+	FS_CopyFileAsync (name, name2);
 
 	Com_sprintf (name, sizeof(name), "%s/save/%s/", FS_Gamedir(), src);
 	len = strlen(name);
@@ -263,7 +231,7 @@ void SV_CopySaveGame (char *src, char *dst)
 	//	strncpy (name+len, found+len);
 		Q_strncpyz (name+len, found+len, sizeof(name)-len);
 		Com_sprintf (name2, sizeof(name2), "%s/save/%s/%s", FS_Gamedir(), dst, found+len);
-		CopyFile (name, name2);
+		FS_CopyFileAsync (name, name2);
 
 		// change sav to sv2
 		l = strlen(name);
@@ -272,7 +240,7 @@ void SV_CopySaveGame (char *src, char *dst)
 		l = strlen(name2);
 	//	strncpy (name2+l-3, "sv2");
 		Q_strncpyz (name2+l-3, "sv2", sizeof(name2)-l+3);
-		CopyFile (name, name2);
+		FS_CopyFileAsync (name, name2);
 
 		found = Sys_FindNext( 0, 0 );
 	}
@@ -280,6 +248,18 @@ void SV_CopySaveGame (char *src, char *dst)
 }
 
 
+/*
+==============
+SV_WriteSaveFile
+
+Queues a savegame file to be written in the background
+==============
+*/
+void SV_WriteSaveFile (char *filename, void *data, int len)
+{
+	FS_WriteFileAsync (filename, data, len, sv_save_compress->intValue);
+}
+
 /*
 ==============
 SV_WriteLevelFile
@@ -288,23 +268,24 @@ SV_WriteLevelFile
 */
 void SV_WriteLevelFile (void)
 {
-	char	name[MAX_OSPATH];
-	FILE	*f;
+	char		name[MAX_OSPATH];
+	sizebuf_t	buf;
+	int			size;
 
 	Com_DPrintf(DEVELOPER_MSG_SAVE, "SV_WriteLevelFile()\n");
 
+	size = sizeof(sv.configstrings) + MAX_MAP_AREAPORTALS * sizeof(qboolean);
+	SZ_Init (&buf, Z_Malloc (size), size);
+	SZ_Write (&buf, sv.configstrings, sizeof(sv.configstrings));
+	CM_WritePortalState (&buf);
+
 	Com_sprintf (name, sizeof(name), "%s/save/doscursv/%s.sv2", FS_Gamedir(), sv.name);
-	f = fopen(name, "wb");
-	if (!f)
-	{
-		Com_Printf ("Failed to open %s\n", name);
-		return;
-	}
-	fwrite (sv.configstrings, sizeof(sv.configstrings), 1, f);
-	CM_WritePortalState (f);
-	fclose (f);
+	SV_WriteSaveFile (name, buf.data, buf.cursize);
+	Z_Free (buf.data);
 
 	Com_sprintf (name, sizeof(name), "%s/save/doscursv/%s.sav", FS_Gamedir(), sv.name);
+	if (ge->apiversion == GAME_API_VERSION_OLD)
+		FS_FlushWrites ();	// writes it with stdio, queued copies may still read it
 	ge->WriteLevel (name);
 }
 
@@ -316,21 +297,30 @@ SV_ReadLevelFile
 */
 void SV_ReadLevelFile (void)
 {
-	char	name[MAX_OSPATH];
-	FILE	*f;
+	char		name[MAX_OSPATH];
+	sizebuf_t	msg;
+	void		*data;
+	int			len;
 
 	Com_DPrintf(DEVELOPER_MSG_SAVE, "SV_ReadLevelFile()\n");
 
 	Com_sprintf (name, sizeof(name), "%s/save/doscursv/%s.sv2", FS_Gamedir(), sv.name);
-	f = fopen(name, "rb");
-	if (!f)
+	len = FS_LoadStreamFile (name, &data);
+	if (len < 0)
 	{
 		Com_Printf ("Failed to open %s\n", name);
 		return;
 	}
-	FS_Read (sv.configstrings, sizeof(sv.configstrings), f);
-	CM_ReadPortalState (f);
-	fclose (f);
+	if (len < (int)sizeof(sv.configstrings))
+	{
+		FS_FreeFile (data);
+		Com_Error (ERR_DROP, "SV_ReadLevelFile: %s is too short", name);
+	}
+	SZ_Init (&msg, data, len);
+	msg.cursize = len;
+	MSG_ReadData (&msg, sv.configstrings, sizeof(sv.configstrings));
+	CM_ReadPortalState (&msg);
+	FS_FreeFile (data);
 
 	Com_sprintf (name, sizeof(name), "%s/save/doscursv/%s.sav", FS_Gamedir(), sv.name);
 	ge->ReadLevel (name);
@@ -344,22 +334,24 @@ SV_WriteServerFile
 */
 void SV_WriteServerFile (qboolean autosave)
 {
-	FILE	*f;
+	sizebuf_t	buf;
 	cvar_t	*var;
 	char	fileName[MAX_OSPATH], varName[128], string[128];
 	char	comment[32];
 	time_t	aclock;
 	struct tm	*newtime;
+	int		size;
 
 	Com_DPrintf(DEVELOPER_MSG_SAVE, "SV_WriteServerFile(%s)\n", autosave ? "true" : "false");
 
-	Com_sprintf (fileName, sizeof(fileName), "%s/save/doscursv/server.ssv", FS_Gamedir());
-	f = fopen (fileName, "wb");
-	if (!f)
+	size = sizeof(comment) + sizeof(svs.mapcmd);
+	for (var = cvar_vars ; var ; var=var->next)
 	{
-		Com_Printf ("Couldn't write %s\n", fileName);
-		return;
+		if (var->flags & CVAR_LATCH)
+			size += sizeof(varName) + sizeof(string);
 	}
+	SZ_Init (&buf, Z_Malloc (size), size);
+
 	// write the comment field
 	memset (comment, 0, sizeof(comment));
 
@@ -377,10 +369,10 @@ void SV_WriteServerFile (qboolean autosave)
 		Com_sprintf (comment, sizeof(comment), "ENTERING %s", sv.configstrings[CS_NAME]);
 	}
 
-	fwrite (comment, 1, sizeof(comment), f);
+	SZ_Write (&buf, comment, sizeof(comment));
 
 	// write the mapcmd
-	fwrite (svs.mapcmd, 1, sizeof(svs.mapcmd), f);
+	SZ_Write (&buf, svs.mapcmd, sizeof(svs.mapcmd));
 
 	// write all CVAR_LATCH cvars
 	// these will be things like coop, skill, deathmatch, etc
@@ -400,14 +392,19 @@ void SV_WriteServerFile (qboolean autosave)
 	//	strncpy (string, var->string);
 		Q_strncpyz (varName, var->name, sizeof(varName));
 		Q_strncpyz (string, var->string, sizeof(string));
-		fwrite (varName, 1, sizeof(varName), f);
-		fwrite (string, 1, sizeof(string), f);
+		SZ_Write (&buf, varName, sizeof(varName));
+		SZ_Write (&buf, string, sizeof(string));
 	}
 
-	fclose (f);
+	// never compressed, the load menu reads the comment straight out of it
+	Com_sprintf (fileName, sizeof(fileName), "%s/save/doscursv/server.ssv", FS_Gamedir());
+	FS_WriteFileAsync (fileName, buf.data, buf.cursize, false);
+	Z_Free (buf.data);
 
 	// write game state
 	Com_sprintf (fileName, sizeof(fileName), "%s/save/doscursv/game.ssv", FS_Gamedir());
+	if (ge->apiversion == GAME_API_VERSION_OLD)
+		FS_FlushWrites ();	// writes it with stdio, queued copies may still read it
 	ge->WriteGame (fileName, autosave);
 }
 
@@ -419,7 +416,9 @@ SV_ReadServerFile
 */
 void SV_ReadServerFile (void)
 {
-	FILE	*f;
+	sizebuf_t	msg;
+	void	*data;
+	int		len;
 	char	fileName[MAX_OSPATH], varName[128], string[128];
 	char	comment[32];
 	char	mapcmd[MAX_TOKEN_CHARS];
@@ -427,30 +426,39 @@ void SV_ReadServerFile (void)
 	Com_DPrintf(DEVELOPER_MSG_SAVE, "SV_ReadServerFile()\n");
 
 	Com_sprintf (fileName, sizeof(fileName), "%s/save/doscursv/server.ssv", FS_Gamedir());
-	f = fopen (fileName, "rb");
-	if (!f)
+	len = FS_LoadStreamFile (fileName, &data);
+	if (len < 0)
 	{
 		Com_Printf ("Couldn't read %s\n", fileName);
 		return;
 	}
+	if (len < (int)(sizeof(comment) + sizeof(mapcmd)))
+	{
+		FS_FreeFile (data);
+		Com_Error (ERR_DROP, "SV_ReadServerFile: %s is too short", fileName);
+	}
+	SZ_Init (&msg, data, len);
+	msg.cursize = len;
+
 	// read the comment field
-	FS_Read (comment, sizeof(comment), f);
+	MSG_ReadData (&msg, comment, sizeof(comment));
 
 	// read the mapcmd
-	FS_Read (mapcmd, sizeof(mapcmd), f);
+	MSG_ReadData (&msg, mapcmd, sizeof(mapcmd));
+	mapcmd[sizeof(mapcmd)-1] = 0;
 
 	// read all CVAR_LATCH cvars
 	// these will be things like coop, skill, deathmatch, etc
-	while (1)
+	while (msg.readcount + (int)(sizeof(varName) + sizeof(string)) <= msg.cursize)
 	{
-		if (!fread (varName, 1, sizeof(varName), f))
-			break;
-		FS_Read (string, sizeof(string), f);
+		MSG_ReadData (&msg, varName, sizeof(varName));
+		MSG_ReadData (&msg, string, sizeof(string));
+		varName[sizeof(varName)-1] = string[sizeof(string)-1] = 0;
 		Com_DPrintf(DEVELOPER_MSG_STANDARD, "Set %s = %s\n", varName, string);
 		Cvar_ForceSet (varName, string);
 	}
 
-	fclose (f);
+	FS_FreeFile (data);
 
 	// start a new game fresh with new cvars
 	SV_InitGame ();
@@ -663,8 +671,9 @@ void SV_Loadgame_f (void)
 		Com_Printf ("Bad savedir.\n");
 	}
 
-	// make sure the server.ssv file exists
+	// make sure the server.ssv file exists, it may still be queued
 	Com_sprintf (name, sizeof(name), "%s/save/%s/server.ssv", FS_Gamedir(), Cmd_Argv(1));
+	FS_FlushWrites ();
 	f = fopen (name, "rb");
 	if (!f)
 	{
@@ -1055,7 +1064,7 @@ void SV_ServerRecord_f (void)
 
 	Com_Printf ("recording to %s.\n", name);
 	FS_CreatePath (name);
-	svs.demofile = fopen (name, "wb");
+	svs.demofile = FS_OpenWriter (name, sv_demo_compress->intValue);
 	if (!svs.demofile)
 	{
 		Com_Printf ("ERROR: couldn't open.\n");
@@ -1096,7 +1105,7 @@ void SV_ServerRecord_f (void)
 			if (buf.cursize + 67 >= buf.maxsize)
 			{
 				Com_Printf("not enough buffer space available.\n");
-				fclose(svs.demofile);
+				FS_CloseWriter (svs.demofile);
 				svs.demofile = NULL;
 				return;
 			}
@@ -1106,8 +1115,8 @@ void SV_ServerRecord_f (void)
 	// write it to the demo file
 	Com_DPrintf(DEVELOPER_MSG_NET, "signon message length: %i\n", buf.cursize);
 	len = LittleLong (buf.cursize);
-	fwrite (&len, 4, 1, svs.demofile);
-	fwrite (buf.data, buf.cursize, 1, svs.demofile);
+	FS_WriteStream (svs.demofile, &len, 4);
+	FS_WriteStream (svs.demofile, buf.data, buf.cursize);
 
 	// the rest of the demo file will be individual frames
 }
@@ -1127,7 +1136,8 @@ void SV_ServerStop_f (void)
 		Com_Printf ("Not doing a serverrecord.\n");
 		return;
 	}
-	fclose (svs.demofile);
+	if (!FS_CloseWriter (svs.demofile))
+		Com_Printf ("ERROR: couldn't write all of the demo.\n");
 	svs.demofile = NULL;
 	Com_Printf ("Recording completed.\n");
 }
@@ -1246,5 +1256,10 @@ void SV_InitOperatorCommands (void)
 
 	Cmd_AddCommand ("sv", SV_ServerCommand_f);
 	Cmd_AddCommand ("sv_dumpentities", SV_DumpEntities_f); /* FS */
+	Cmd_AddCommand ("sv_areastats", SV_AreaStats_f);
+	Cmd_AddCommand ("sv_profile", SV_Profile_f);
+	Cmd_AddCommand ("sv_netstats", SV_Netstats_f);
+	Cmd_AddCommand ("sv_floodtest", SV_FloodTest_f);
+	Cmd_AddCommand ("sv_cullbench", SV_CullBench_f);
 }
 
@@ -20,6 +20,17 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "server.h"
 
+// the bitset kernels for culling, switched by sv_simd; AVX2 replaces
+// SSE2 only in builds that target it (-mavx2), there is no cpuid check
+#if !id386 && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SV_SSE2
+#include <emmintrin.h>
+#ifdef __AVX2__
+#define SV_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
 /*
 =============================================================================
 
@@ -31,6 +42,77 @@ Encode a client frame onto the network channel
 byte		fatpvs[65536/8];	// 32767 is MAX_MAP_LEAFS
 
 
+/*
+=============
+SV_CountDelta
+
+Splits the size of one MSG_WriteDeltaEntity update between the fields
+its bits say were written, the rest is the header
+=============
+*/
+void SV_CountDelta (netstats_t *ns, int bits, int size)
+{
+	int		n;
+
+	if (!size)
+		return;
+
+	ns->entities++;
+
+	n = !!(bits & U_MODEL) + !!(bits & U_MODEL2) + !!(bits & U_MODEL3) + !!(bits & U_MODEL4);
+	ns->fields[NSF_MODEL] += n;
+	size -= n;
+
+	n = (bits & U_FRAME8) ? 1 : 0;
+	n += (bits & U_FRAME16) ? 2 : 0;
+	ns->fields[NSF_FRAME] += n;
+	size -= n;
+
+	if ((bits & (U_SKIN8|U_SKIN16)) == (U_SKIN8|U_SKIN16))
+		n = 4;
+	else
+		n = (bits & U_SKIN8) ? 1 : (bits & U_SKIN16) ? 2 : 0;
+	ns->fields[NSF_SKIN] += n;
+	size -= n;
+
+	if ((bits & (U_EFFECTS8|U_EFFECTS16)) == (U_EFFECTS8|U_EFFECTS16))
+		n = 4;
+	else
+		n = (bits & U_EFFECTS8) ? 1 : (bits & U_EFFECTS16) ? 2 : 0;
+	if ((bits & (U_RENDERFX8|U_RENDERFX16)) == (U_RENDERFX8|U_RENDERFX16))
+		n += 4;
+	else
+		n += (bits & U_RENDERFX8) ? 1 : (bits & U_RENDERFX16) ? 2 : 0;
+	ns->fields[NSF_EFFECTS] += n;
+	size -= n;
+
+	n = 2 * (!!(bits & U_ORIGIN1) + !!(bits & U_ORIGIN2) + !!(bits & U_ORIGIN3));
+	ns->fields[NSF_ORIGIN] += n;
+	size -= n;
+
+	n = !!(bits & U_ANGLE1) + !!(bits & U_ANGLE2) + !!(bits & U_ANGLE3);
+	ns->fields[NSF_ANGLES] += n;
+	size -= n;
+
+	n = (bits & U_OLDORIGIN) ? 6 : 0;
+	ns->fields[NSF_OLDORIGIN] += n;
+	size -= n;
+
+	n = (bits & U_SOUND) ? 1 : 0;
+	ns->fields[NSF_SOUND] += n;
+	size -= n;
+
+	n = (bits & U_EVENT) ? 1 : 0;
+	ns->fields[NSF_EVENT] += n;
+	size -= n;
+
+	n = (bits & U_SOLID) ? 2 : 0;
+	ns->fields[NSF_SOLID] += n;
+	size -= n;
+
+	ns->fields[NSF_HEADER] += size;
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -38,13 +120,14 @@ SV_EmitPacketEntities
 Writes a delta update of an entity_state_t list to the message.
 =============
 */
-void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
+void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t *msg, netstats_t *ns)
 {
 	entity_state_t	*oldent, *newent;
 	int		oldindex, newindex;
 	int		oldnum, newnum;
 	int		from_num_entities;
 	int		bits;
+	int		start;
 
 		MSG_WriteByte (msg, svc_packetentities);
 
@@ -95,8 +178,10 @@ void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t
 			// in any bytes being emited if the entity has not changed at all
 			// note that players are always 'newentities', this updates their oldorigin always
 			// and prevents warping
-			MSG_WriteDeltaEntity(oldent, newent, msg,
+			start = msg->cursize;
+			bits = MSG_WriteDeltaEntity(oldent, newent, msg,
 					false, newent->number <= maxclients->value);
+			SV_CountDelta (ns, bits, msg->cursize - start);
 			oldindex++;
 			newindex++;
 			continue;
@@ -104,13 +189,16 @@ void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t
 
 		if (newnum < oldnum)
 		{	// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity (&sv.baselines[newnum], newent, msg, true, true);
+			start = msg->cursize;
+			bits = MSG_WriteDeltaEntity (&sv.baselines[newnum], newent, msg, true, true);
+			SV_CountDelta (ns, bits, msg->cursize - start);
 			newindex++;
 			continue;
 		}
 
 		if (newnum > oldnum)
 		{	// the old entity isn't present in the new message
+			start = msg->cursize;
 			bits = U_REMOVE;
 			if (oldnum >= 256)
 			{
@@ -131,6 +219,7 @@ void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t
 			{
 				MSG_WriteByte (msg, oldnum);
 			}
+			ns->fields[NSF_REMOVE] += msg->cursize - start;
 
 			oldindex++;
 			continue;
@@ -392,6 +481,8 @@ void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg)
 {
 	client_frame_t		*frame, *oldframe;
 	int					lastframe;
+	netstats_t			*ns;
+	int					start;
 
 //Com_Printf ("%i -> %i\n", client->lastframe, sv.framenum);
 	// this is the frame we are creating
@@ -414,6 +505,11 @@ void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg)
 		lastframe = client->lastframe;
 	}
 
+	// counted apart until it is known the frame goes out
+	ns = &client->framestats;
+	memset (ns, 0, sizeof(*ns));
+	start = msg->cursize;
+
 	MSG_WriteByte (msg, svc_frame);
 	MSG_WriteLong (msg, sv.framenum);
 	MSG_WriteLong (msg, lastframe);	// what we are delta'ing from
@@ -424,11 +520,17 @@ void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg)
 	MSG_WriteByte (msg, frame->areabytes);
 	SZ_Write (msg, frame->areabits, frame->areabytes);
 
+	ns->svc[svc_frame] += msg->cursize - start;
+
 	// delta encode the playerstate
+	start = msg->cursize;
 	SV_WritePlayerstateToClient (oldframe, frame, msg);
+	ns->svc[svc_playerinfo] += msg->cursize - start;
 
 	// delta encode the entities
-	SV_EmitPacketEntities (oldframe, frame, msg);
+	start = msg->cursize;
+	SV_EmitPacketEntities (oldframe, frame, msg, ns);
+	ns->svc[svc_packetentities] += msg->cursize - start;
 }
 
 
@@ -440,6 +542,43 @@ Build a client frame structure
 =============================================================================
 */
 
+/*
+============
+SV_OrBits
+
+out |= in, for PVS rows and entity bitsets
+============
+*/
+static void SV_OrBits (unsigned *out, const unsigned *in, int words, qboolean simd)
+{
+	int		i;
+
+	i = 0;
+#if defined(SV_AVX2)
+	if (simd)
+	{
+		for ( ; i+8 <= words ; i+=8)
+		{
+			_mm256_storeu_si256 ((__m256i *)(out+i), _mm256_or_si256 (
+				_mm256_loadu_si256 ((const __m256i *)(out+i)), _mm256_loadu_si256 ((const __m256i *)(in+i))));
+		}
+	}
+#elif defined(SV_SSE2)
+	if (simd)
+	{
+		for ( ; i+4 <= words ; i+=4)
+		{
+			_mm_storeu_si128 ((__m128i *)(out+i), _mm_or_si128 (
+				_mm_loadu_si128 ((const __m128i *)(out+i)), _mm_loadu_si128 ((const __m128i *)(in+i))));
+		}
+	}
+#endif
+	for ( ; i<words ; i++)
+	{
+		out[i] |= in[i];
+	}
+}
+
 /*
 ============
 SV_FatPVS
@@ -448,7 +587,7 @@ The client will interpolate the view position,
 so we can't use a single PVS point
 ===========
 */
-void SV_FatPVS (vec3_t org)
+static void SV_FatPVSBits (vec3_t org, byte *pvs, qboolean simd)
 {
 	int		leafs[64];
 	int		i, j, count;
@@ -475,7 +614,7 @@ void SV_FatPVS (vec3_t org)
 		leafs[i] = CM_LeafCluster(leafs[i]);
 	}
 
-	memcpy (fatpvs, CM_ClusterPVS(leafs[0]), longs<<2);
+	memcpy (pvs, CM_ClusterPVS(leafs[0]), longs<<2);
 	// or in all the other leaf bits
 	for (i=1 ; i<count ; i++)
 	{
@@ -491,40 +630,36 @@ void SV_FatPVS (vec3_t org)
 			continue;		// already have the cluster we want
 		}
 		src = CM_ClusterPVS(leafs[i]);
-		for (j=0 ; j<longs ; j++)
-		{
-			((long *)fatpvs)[j] |= ((long *)src)[j];
-		}
+		SV_OrBits ((unsigned *)pvs, (unsigned *)src, longs, simd);
 	}
 }
 
+void SV_FatPVS (vec3_t org, byte *pvs)
+{
+	SV_FatPVSBits (org, pvs, sv_simd->intValue);
+}
+
 /*
 =============
-SV_BuildClientFrame
+SV_SetupClientFrame
 
-Decides which entities are going to be visible to the client, and
-copies off the playerstat and areabits.
+Starts the client's frame for this server frame: saves off the
+playerstate and areabits, and finds the view origin, area and cluster
+that SV_EntityVisibleToClient tests against.  The fat PVS is written
+to pvs.  Returns NULL if the client isn't in the game yet.
 =============
 */
-void SV_BuildClientFrame (client_t *client)
+client_frame_t *SV_SetupClientFrame (client_t *client, vec3_t org, int *clientarea, int *clientcluster, byte *pvs)
 {
-	int		e, i;
-	vec3_t	org;
-	edict_t	*ent;
+	int		i;
+	int		leafnum;
 	edict_t	*clent;
 	client_frame_t	*frame;
-	entity_state_t	*state;
-	int		l;
-	int		clientarea, clientcluster;
-	int		leafnum;
-	int		c_fullsend;
-	byte	*clientphs;
-	byte	*bitvector;
 
 	clent = client->edict;
 	if (!clent->client)
 	{
-		return;		// not in game yet
+		return NULL;		// not in game yet
 	}
 
 	// this is the frame we are creating
@@ -540,125 +675,504 @@ void SV_BuildClientFrame (client_t *client)
 	}
 
 	leafnum = CM_PointLeafnum (org);
-	clientarea = CM_LeafArea (leafnum);
-	clientcluster = CM_LeafCluster (leafnum);
+	*clientarea = CM_LeafArea (leafnum);
+	*clientcluster = CM_LeafCluster (leafnum);
 
 	// calculate the visible areas
-	frame->areabytes = CM_WriteAreaBits (frame->areabits, clientarea);
+	frame->areabytes = CM_WriteAreaBits (frame->areabits, *clientarea);
 
 	// grab the current player_state_t
 	frame->ps = clent->client->ps;
 
-	SV_FatPVS (org);
-	clientphs = CM_ClusterPHS (clientcluster);
+	SV_FatPVS (org, pvs);
 
 	// build up the list of visible entities
 	frame->num_entities = 0;
 	frame->first_entity = svs.next_client_entities;
 
-	c_fullsend = 0;
+	return frame;
+}
+
+/*
+=============
+SV_EntityVisibleToClient
+
+Decides if ent should go into the frame of the client viewing from org.
+Only reads world state, so it is safe to call from worker threads.
+=============
+*/
+qboolean SV_EntityVisibleToClient (edict_t *ent, edict_t *clent, vec3_t org, int clientarea, byte *pvs, byte *phs)
+{
+	int		i, l;
+
+	// ignore ents without visible models
+	if (ent->svflags & SVF_NOCLIENT)
+	{
+		return false;
+	}
+
+	// ignore ents without visible models unless they have an effect
+	if (!ent->s.modelindex && !ent->s.effects && 
+		!ent->s.sound && !ent->s.event)
+	{
+		return false;
+	}
+
+	if (ent == clent)
+	{
+		return true;
+	}
+
+	// ignore if not touching a PV leaf
+	// check area
+	if (!CM_AreasConnected (clientarea, ent->areanum))
+	{	// doors can legally straddle two areas, so
+		// we may need to check another one
+		if (!ent->areanum2 ||
+			!CM_AreasConnected(clientarea, ent->areanum2))
+		{
+			return false;		// blocked by a door
+		}
+	}
+
+	// beams just check one point for PHS
+	if (ent->s.renderfx & RF_BEAM)
+	{
+		l = ent->clusternums[0];
+		if ( !(phs[l >> 3] & (1 << (l&7) )) )
+		{
+			return false;
+		}
+		return true;
+	}
+
+	if (ent->num_clusters == -1)
+	{	// too many leafs for individual check, go by headnode
+		if (!CM_HeadnodeVisible (ent->headnode, pvs))
+		{
+			return false;
+		}
+	}
+	else
+	{	// check individual leafs
+		for (i=0 ; i < ent->num_clusters ; i++)
+		{
+			l = ent->clusternums[i];
+			if (pvs[l >> 3] & (1 << (l&7) ))
+			{
+				break;
+			}
+		}
+		if (i == ent->num_clusters)
+		{
+			return false;		// not visible
+		}
+	}
+
+	if (!ent->s.modelindex)
+	{	// don't send sounds if they will be attenuated away
+		vec3_t	delta;
+		float	len;
+
+		VectorSubtract (org, ent->s.origin, delta);
+		len = VectorLength (delta);
+		if (len > 400)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+=============
+SV_PrepareEntityCull
+
+Brings the entity cluster index up to date and sorts the entities that
+have anything to send by how SV_CullEntities finds them.  Run once on
+the main thread before any client frames are built.
+=============
+*/
+void SV_PrepareEntityCull (void)
+{
+	entindex_t	*ix = &sv_entindex;
+	edict_t		*ent;
+	int			e;
+	unsigned	bit;
+
+	memset (ix->indexed, 0, sizeof(ix->indexed));
+	memset (ix->scalar, 0, sizeof(ix->scalar));
+	memset (ix->sendable, 0, sizeof(ix->sendable));
+
+	if (sv.state != ss_game || ge->num_edicts > MAX_EDICTS)
+		return;
+
+	SV_SyncEntityIndex ();
 
 	for (e=1 ; e<ge->num_edicts ; e++)
 	{
 		ent = EDICT_NUM(e);
 
-		// ignore ents without visible models
+		// same as the first tests of SV_EntityVisibleToClient
 		if (ent->svflags & SVF_NOCLIENT)
-		{
 			continue;
+		if (!ent->s.modelindex && !ent->s.effects && !ent->s.sound && !ent->s.event)
+			continue;
+
+		bit = 1u << (e & 31);
+		ix->sendable[e>>5] |= bit;
+		if ((ent->s.renderfx & RF_BEAM) || ent->num_clusters == -1)
+			ix->scalar[e>>5] |= bit;
+		else
+			ix->indexed[e>>5] |= bit;
+	}
+}
+
+/*
+=============
+SV_CullEach
+
+Tests every entity against the client
+=============
+*/
+static int SV_CullEach (edict_t *clent, vec3_t org, int clientarea, byte *pvs, byte *phs, short *list)
+{
+	int		e, count;
+
+	count = 0;
+	for (e=1 ; e<ge->num_edicts ; e++)
+	{
+		if (SV_EntityVisibleToClient (EDICT_NUM(e), clent, org, clientarea, pvs, phs))
+		{
+			list[count++] = e;
 		}
+	}
 
-		// ignore ents without visible models unless they have an effect
-		if (!ent->s.modelindex && !ent->s.effects && 
-			!ent->s.sound && !ent->s.event)
+	return count;
+}
+
+/*
+=============
+SV_CullIndexed
+
+Gathers the entities of every occupied cluster in the PVS, then only
+runs the full test on those, the beams and headnode entities, and the
+client itself.  Finds exactly what SV_CullEach does, in the same order.
+=============
+*/
+static int SV_CullIndexed (edict_t *clent, vec3_t org, int clientarea, byte *pvs, byte *phs, short *list, qboolean simd)
+{
+	entindex_t	*ix = &sv_entindex;
+	unsigned	visible[SV_ENTWORDS];
+	unsigned	bits;
+	int			i, c, e, w, words, count;
+
+	words = (ge->num_edicts+31)>>5;
+	memset (visible, 0, words*sizeof(unsigned));
+
+	for (i=0 ; i<ix->numoccupied ; i++)
+	{
+		c = ix->occupied[i];
+		if (pvs[c>>3] & (1<<(c&7)))
 		{
-			continue;
+			SV_OrBits (visible, ix->clusterents + c*SV_ENTWORDS, words, simd);
 		}
+	}
 
-		// ignore if not touching a PV leaf
-		if (ent != clent)
+	// only entities that would pass the cluster test in
+	// SV_EntityVisibleToClient are left with their bit set
+	i = 0;
+#if defined(SV_AVX2)
+	if (simd)
+	{
+		for ( ; i+8 <= words ; i+=8)
 		{
-			// check area
-			if (!CM_AreasConnected (clientarea, ent->areanum))
-			{	// doors can legally straddle two areas, so
-				// we may need to check another one
-				if (!ent->areanum2 ||
-					!CM_AreasConnected(clientarea, ent->areanum2))
-				{
-					continue;		// blocked by a door
-				}
-			}
+			_mm256_storeu_si256 ((__m256i *)(visible+i), _mm256_or_si256 (
+				_mm256_and_si256 (_mm256_loadu_si256 ((const __m256i *)(visible+i)), _mm256_loadu_si256 ((const __m256i *)(ix->indexed+i))),
+				_mm256_loadu_si256 ((const __m256i *)(ix->scalar+i))));
+		}
+	}
+#elif defined(SV_SSE2)
+	if (simd)
+	{
+		for ( ; i+4 <= words ; i+=4)
+		{
+			_mm_storeu_si128 ((__m128i *)(visible+i), _mm_or_si128 (
+				_mm_and_si128 (_mm_loadu_si128 ((const __m128i *)(visible+i)), _mm_loadu_si128 ((const __m128i *)(ix->indexed+i))),
+				_mm_loadu_si128 ((const __m128i *)(ix->scalar+i))));
+		}
+	}
+#endif
+	for ( ; i<words ; i++)
+	{
+		visible[i] = (visible[i] & ix->indexed[i]) | ix->scalar[i];
+	}
 
-			// beams just check one point for PHS
-			if (ent->s.renderfx & RF_BEAM)
-			{
-				l = ent->clusternums[0];
-				if ( !(clientphs[l >> 3] & (1 << (l&7) )) )
-				{
-					continue;
-				}
-			}
-			else
+	if (clent)
+	{
+		e = NUM_FOR_EDICT(clent);
+		if (e < MAX_EDICTS)
+			visible[e>>5] |= ix->sendable[e>>5] & (1u << (e&31));
+	}
+
+	count = 0;
+	for (w=0 ; w<words ; w++)
+	{
+		for (bits = visible[w], e = w<<5 ; bits ; bits >>= 1, e++)
+		{
+			if (!(bits & 1))
+				continue;
+			if (SV_EntityVisibleToClient (EDICT_NUM(e), clent, org, clientarea, pvs, phs))
+				list[count++] = e;
+		}
+	}
+
+	return count;
+}
+
+/*
+=============
+SV_CullEntities
+
+Fills list with the numbers of the entities that go into the frame of
+the client viewing from org, and returns how many there are.  Needs
+SV_PrepareEntityCull to have been run for the frame, and no more than
+MAX_EDICTS entities.  Only reads world state, so it is safe to call
+from worker threads.
+=============
+*/
+int SV_CullEntities (edict_t *clent, vec3_t org, int clientarea, byte *pvs, byte *phs, short *list)
+{
+	if (!sv_entindex.clusterents || sv.state != ss_game)
+		return SV_CullEach (clent, org, clientarea, pvs, phs, list);
+
+	return SV_CullIndexed (clent, org, clientarea, pvs, phs, list, sv_simd->intValue);
+}
+
+/*
+=============
+SV_CullBench_f
+
+Culls the entities for random viewpoints the way client frames do:
+testing every entity, and through the cluster index in C and with
+SIMD, checking that all three find the same entities.  Free edicts
+are filled with stand-ins up to the requested count while it runs.
+"sv_cullbench [entities] [viewpoints] [passes]"
+=============
+*/
+#define	CULLBENCH_MAXVIEWS	256
+
+void SV_CullBench_f (void)
+{
+	static const char	*names[3] = {"per entity:", "index C:",
+#if defined(SV_AVX2)
+		"index AVX2:"
+#elif defined(SV_SSE2)
+		"index SSE2:"
+#else
+		"index SIMD:"
+#endif
+	};
+	vec3_t		*orgs;
+	int			*areas;
+	byte		*pvs, *phs;
+	short		list[MAX_EDICTS];
+	edict_t		*ent;
+	int			numents, numviews, passes, oldnum;
+	int			i, j, m, count, leafnum, rowbytes;
+	unsigned	seed, sum[3], start, time[3];
+	float		visible;
+
+	if (sv.state != ss_game)
+	{
+		Com_Printf ("No map running.\n");
+		return;
+	}
+
+	numents = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 512;
+	numviews = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 64;
+	passes = Cmd_Argc() > 3 ? atoi(Cmd_Argv(3)) : 20;
+	numents = max(numents, 1);
+	numents = min(numents, min(ge->max_edicts, MAX_EDICTS));
+	numviews = max(numviews, 1);
+	numviews = min(numviews, CULLBENCH_MAXVIEWS);
+	passes = max(passes, 1);
+
+	// scatter stand-ins over the world, with a model so they get sent
+	seed = 0x3117;
+	oldnum = ge->num_edicts;
+	for ( ; ge->num_edicts < numents ; ge->num_edicts++)
+	{
+		ent = EDICT_NUM(ge->num_edicts);
+		memset (ent, 0, sizeof(*ent));
+		ent->inuse = true;
+		ent->s.number = ge->num_edicts;
+		ent->s.modelindex = 1;
+		VectorSet (ent->mins, -16, -16, -16);
+		VectorSet (ent->maxs, 16, 16, 16);
+		for (j=0 ; j<3 ; j++)
+		{
+			seed = seed * 1103515245 + 12345;
+			ent->s.origin[j] = sv.models[1]->mins[j] + (sv.models[1]->maxs[j] - sv.models[1]->mins[j]) * ((seed >> 16) & 0x7fff) / 32768.0f;
+		}
+		SV_LinkEdict (ent);
+	}
+
+	rowbytes = ((CM_NumClusters()+31)>>5)<<2;
+	orgs = Z_Malloc (numviews * sizeof(vec3_t));
+	areas = Z_Malloc (numviews * sizeof(int));
+	pvs = Z_Malloc (numviews * rowbytes);
+	phs = Z_Malloc (numviews * rowbytes);
+	for (i=0 ; i<numviews ; i++)
+	{
+		for (j=0 ; j<3 ; j++)
+		{
+			seed = seed * 1103515245 + 12345;
+			orgs[i][j] = sv.models[1]->mins[j] + (sv.models[1]->maxs[j] - sv.models[1]->mins[j]) * ((seed >> 16) & 0x7fff) / 32768.0f;
+		}
+		leafnum = CM_PointLeafnum (orgs[i]);
+		areas[i] = CM_LeafArea (leafnum);
+		memcpy (phs + i*rowbytes, CM_ClusterPHS (CM_LeafCluster (leafnum)), (CM_NumClusters()+7)>>3);
+	}
+
+	SV_PrepareEntityCull ();
+
+	visible = 0;
+	for (m=0 ; m<3 ; m++)
+	{
+		sum[m] = 0;
+		start = Sys_Microseconds ();
+		for (j=0 ; j<passes ; j++)
+		{
+			for (i=0 ; i<numviews ; i++)
 			{
-				bitvector = fatpvs;
-
-				if (ent->num_clusters == -1)
-				{	// too many leafs for individual check, go by headnode
-					if (!CM_HeadnodeVisible (ent->headnode, bitvector))
-					{
-						continue;
-					}
-					c_fullsend++;
-				}
+				SV_FatPVSBits (orgs[i], pvs + i*rowbytes, m == 2);
+				if (m == 0)
+					count = SV_CullEach (NULL, orgs[i], areas[i], pvs + i*rowbytes, phs + i*rowbytes, list);
 				else
-				{	// check individual leafs
-					for (i=0 ; i < ent->num_clusters ; i++)
-					{
-						l = ent->clusternums[i];
-						if (bitvector[l >> 3] & (1 << (l&7) ))
-						{
-							break;
-						}
-					}
-					if (i == ent->num_clusters)
-					{
-						continue;		// not visible
-					}
-				}
-
-				if (!ent->s.modelindex)
-				{	// don't send sounds if they will be attenuated away
-					vec3_t	delta;
-					float	len;
-
-					VectorSubtract (org, ent->s.origin, delta);
-					len = VectorLength (delta);
-					if (len > 400)
-					{
-						continue;
-					}
-				}
+					count = SV_CullIndexed (NULL, orgs[i], areas[i], pvs + i*rowbytes, phs + i*rowbytes, list, m == 2);
+
+				if (j)
+					continue;
+				if (m == 0)
+					visible += count;
+				sum[m] = sum[m] * 31 + count;
+				while (count--)
+					sum[m] = sum[m] * 31 + list[count];
 			}
 		}
+		time[m] = Sys_Microseconds () - start;
+	}
 
-		// add it to the circular client_entities array
-		state = &svs.client_entities[svs.next_client_entities %
-				svs.num_client_entities];
-		if (ent->s.number != e)
+	Com_Printf ("%i entities, %i of %i clusters occupied, %i viewpoints, %i passes\n",
+		ge->num_edicts - 1, sv_entindex.numoccupied, CM_NumClusters(), numviews, passes);
+	Com_Printf ("%.1f entities visible on average\n", visible / numviews);
+	for (m=0 ; m<3 ; m++)
+	{
+#ifndef SV_SSE2
+		if (m == 2)
 		{
-			Com_DPrintf(DEVELOPER_MSG_ENTITY, "FIXING ENT->S.NUMBER!!!\n");
-			ent->s.number = e;
+			Com_Printf ("%-12s not compiled in\n", names[m]);
+			break;
 		}
-		*state = ent->s;
+#endif
+		Com_Printf ("%-12s %8.2f us per view%s\n", names[m], (float)time[m] / (numviews * passes),
+			!m ? "" : sum[m] == sum[0] ? ", entities match" : ", ENTITIES DIFFER");
+	}
+
+	Z_Free (orgs);
+	Z_Free (areas);
+	Z_Free (pvs);
+	Z_Free (phs);
+
+	// take the stand-ins out again
+	for (i=oldnum ; i<ge->num_edicts ; i++)
+	{
+		ent = EDICT_NUM(i);
+		SV_UnlinkEdict (ent);
+		memset (ent, 0, sizeof(*ent));
+	}
+	SV_SyncEntityIndex ();
+	ge->num_edicts = oldnum;
+}
+
+/*
+=============
+SV_AddClientEntity
+
+Copies edict e into the circular client_entities array
+as the next entity of the client's frame
+=============
+*/
+void SV_AddClientEntity (client_t *client, client_frame_t *frame, int e)
+{
+	edict_t	*ent;
+	entity_state_t	*state;
+
+	ent = EDICT_NUM(e);
+
+	// add it to the circular client_entities array
+	state = &svs.client_entities[svs.next_client_entities %
+			svs.num_client_entities];
+	if (ent->s.number != e)
+	{
+		Com_DPrintf(DEVELOPER_MSG_ENTITY, "FIXING ENT->S.NUMBER!!!\n");
+		ent->s.number = e;
+	}
+	*state = ent->s;
+
+	// don't mark players missiles as solid
+	if (ent->owner == client->edict)
+	{
+		state->solid = 0;
+	}
+
+	svs.next_client_entities++;
+	frame->num_entities++;
+}
+
+/*
+=============
+SV_BuildClientFrame
+
+Decides which entities are going to be visible to the client, and
+copies off the playerstat and areabits.
+=============
+*/
+void SV_BuildClientFrame (client_t *client)
+{
+	int		e, i, count;
+	short	list[MAX_EDICTS];
+	vec3_t	org;
+	client_frame_t	*frame;
+	int		clientarea, clientcluster;
+	byte	*clientphs;
+
+	frame = SV_SetupClientFrame (client, org, &clientarea, &clientcluster, fatpvs);
+	if (!frame)
+	{
+		return;		// not in game yet
+	}
 
-		// don't mark players missiles as solid
-		if (ent->owner == client->edict)
+	clientphs = CM_ClusterPHS (clientcluster);
+
+	if (ge->num_edicts > MAX_EDICTS)
+	{	// more than the entity index covers
+		for (e=1 ; e<ge->num_edicts ; e++)
 		{
-			state->solid = 0;
+			if (SV_EntityVisibleToClient (EDICT_NUM(e), client->edict, org, clientarea, fatpvs, clientphs))
+			{
+				SV_AddClientEntity (client, frame, e);
+			}
 		}
+		return;
+	}
 
-		svs.next_client_entities++;
-		frame->num_entities++;
+	count = SV_CullEntities (client->edict, org, clientarea, fatpvs, clientphs, list);
+	for (i=0 ; i<count ; i++)
+	{
+		SV_AddClientEntity (client, frame, list[i]);
 	}
 }
 
@@ -718,7 +1232,7 @@ void SV_RecordDemoMessage (void)
 
 	// now write the entire message to the file, prefixed by the length
 	len = LittleLong (buf.cursize);
-	fwrite (&len, 4, 1, svs.demofile);
-	fwrite (buf.data, buf.cursize, 1, svs.demofile);
+	FS_WriteStream (svs.demofile, &len, 4);
+	FS_WriteStream (svs.demofile, buf.data, buf.cursize);
 }
 
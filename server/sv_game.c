@@ -58,6 +58,7 @@ void PF_Unicast (edict_t *ent, qboolean reliable)
 	{
 		SZ_Write (&client->datagram, sv.multicast.data, sv.multicast.cursize);
 	}
+	SV_CountMessage (client, sv.multicast.data[0], sv.multicast.cursize);
 
 	SZ_Clear (&sv.multicast);
 }
@@ -465,13 +466,17 @@ void SV_InitGameProgs (void)
 	import.SetAreaPortalState = CM_SetAreaPortalState;
 	import.AreasConnected = CM_AreasConnected;
 
+	import.WriteSaveFile = SV_WriteSaveFile;
+	import.LoadSaveFile = FS_LoadStreamFile;
+	import.FreeSaveFile = FS_FreeFile;
+
 	ge = (game_export_t *)Sys_GetGameAPI (&import);
 
 	if (!ge)
 	{
 		Com_Error (ERR_DROP, "failed to load game DLL");
 	}
-	if (ge->apiversion != GAME_API_VERSION)
+	if (ge->apiversion != GAME_API_VERSION && ge->apiversion != GAME_API_VERSION_OLD)
 	{
 		Com_Error (ERR_DROP, "game is version %i, not %i", ge->apiversion,
 		GAME_API_VERSION);
@@ -143,6 +143,7 @@ void SV_CheckForSavegame (void)
 		return;
 
 	Com_sprintf (name, sizeof(name), "%s/save/doscursv/%s.sav", FS_Gamedir(), sv.name);
+	FS_FlushWrites ();
 	f = fopen (name, "rb");
 	if (!f)
 		return;		// no savegame
@@ -194,7 +195,7 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 
 	Com_DPrintf(DEVELOPER_MSG_SERVER, "SpawnServer: %s\n",server);
 	if (sv.demofile)
-		fclose (sv.demofile);
+		FS_CloseReader (sv.demofile);
 
 	svs.spawncount++;		// any partially connected client will be
 							// restarted
@@ -235,6 +236,7 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 		if (svs.clients[i].state > cs_connected)
 			svs.clients[i].state = cs_connected;
 		svs.clients[i].lastframe = -1;
+		svs.clients[i].clustervalid = false;
 	}
 
 	sv.time = 1000;
@@ -59,6 +59,9 @@ cvar_t	*sv_entfile;	// Knightmare 6/25/12- cvar to control use of .ent files
 cvar_t	*sv_skipcinematics; /* FS: Skip cinematics if we want to. */
 cvar_t	*sv_allow_download_maps_in_paks; /* FS: Allow bsp downloads from a pak file if we want to. */
 cvar_t	*sv_downloadserver; /* FS: From R1Q2: HTTP Downloading */
+cvar_t	*sv_download_window;
+cvar_t	*sv_download_maxrate;
+cvar_t	*sv_download_compress;
 cvar_t	*sv_idlekick; /* FS: Kick excessive idlers.  From R1Q2 */
 
 /* FS: Added these to filter out wallfly's spammy rcon status request every 30 seconds */
@@ -67,8 +70,19 @@ cvar_t		*sv_filter_wallfly_ip;
 
 cvar_t		*sv_getspace_overflow_hack; /* FS: Bullshit hack for coop mod. */
 
+cvar_t		*sv_area_cellsize;
+cvar_t		*sv_threads;
+cvar_t		*sv_profile_log;
+cvar_t		*sv_netstats_log;
+cvar_t		*sv_netstats_interval;
+cvar_t		*sv_simd;
+cvar_t		*sv_demo_compress;
+cvar_t		*sv_save_compress;
+
 extern	int num_sz_getspace_overflows;
 
+static int	sv_packetsread;			// for SV_FloodTest_f
+
 void Master_Shutdown (void);
 
 
@@ -189,7 +203,7 @@ void SV_CleanClient (client_t *drop)
 {
 	if (drop->download)
 	{
-		Z_Free (drop->download);
+		FS_FreeFile (drop->download);
 		drop->download = NULL;
 	}
 }
@@ -566,6 +580,8 @@ gotnewcl:
 	Netchan_Setup (NS_SERVER, &newcl->netchan , adr, qport);
 
 	newcl->state = cs_connected;
+	newcl->netstats.starttime = svs.realtime;
+	svs.clienthashdirty = true;
 
 	SZ_Init (&newcl->datagram, newcl->datagram_buf, sizeof(newcl->datagram_buf) );
 	if ((maxclients->intValue > 1) && !(newcl->netchan.remote_address.type == NA_LOOPBACK)) /* FS: Enforce a 1400 MTU size for datagram packets. */
@@ -822,6 +838,92 @@ void SV_GiveMsec (void)
 }
 
 
+/*
+=================
+SV_ClientHashKey
+
+Hashes the parts of the address that NET_CompareBaseAdr looks at
+=================
+*/
+static int SV_ClientHashKey (netadr_t *adr, int qport)
+{
+	unsigned	h;
+	int			i;
+
+	h = adr->type * 31 + qport;
+	if (adr->type == NA_IP)
+	{
+		for (i=0 ; i<4 ; i++)
+			h = h*33 + adr->ip[i];
+	}
+	else if (adr->type == NA_IPX)
+	{
+		for (i=0 ; i<10 ; i++)
+			h = h*33 + adr->ipx[i];
+	}
+	h ^= h >> 11;
+	h *= 0x9e3779b1;
+
+	return (h >> 16) & (SV_CLIENTHASH-1);
+}
+
+/*
+=================
+SV_RehashClients
+
+Slots go in in order, so a lookup finds the same client as a scan would
+=================
+*/
+static void SV_RehashClients (void)
+{
+	client_t	*cl;
+	int			i, h;
+
+	memset (svs.clienthash, 0, sizeof(svs.clienthash));
+	for (i=0, cl=svs.clients ; i<maxclients->intValue ; i++, cl++)
+	{
+		if (cl->state == cs_free)
+			continue;
+		h = SV_ClientHashKey (&cl->netchan.remote_address, cl->netchan.qport);
+		while (svs.clienthash[h])
+			h = (h + 1) & (SV_CLIENTHASH-1);
+		svs.clienthash[h] = i + 1;
+	}
+	svs.clienthashdirty = false;
+}
+
+/*
+=================
+SV_ClientForPacket
+
+Finds the connected client with the base address and qport of a packet.
+Slots that were freed since the last rehash are skipped by the checks,
+only a new connection needs to mark the table dirty.
+=================
+*/
+client_t *SV_ClientForPacket (netadr_t from, int qport)
+{
+	client_t	*cl;
+	int			h;
+
+	if (svs.clienthashdirty)
+		SV_RehashClients ();
+
+	for (h = SV_ClientHashKey (&from, qport) ; svs.clienthash[h] ; h = (h + 1) & (SV_CLIENTHASH-1))
+	{
+		cl = &svs.clients[svs.clienthash[h] - 1];
+		if (cl->state == cs_free)
+			continue;
+		if (cl->netchan.qport != qport)
+			continue;
+		if (!NET_CompareBaseAdr (from, cl->netchan.remote_address))
+			continue;
+		return cl;
+	}
+
+	return NULL;
+}
+
 /*
 =================
 SV_ReadPackets
@@ -829,12 +931,13 @@ SV_ReadPackets
 */
 void SV_ReadPackets (void)
 {
-	int			i;
 	client_t	*cl;
 	int			qport;
 
 	while (NET_GetPacket (NS_SERVER, &net_from, &net_message))
 	{
+		sv_packetsread++;
+
 		// check for connectionless packet (0xffffffff) first
 		if (*(int *)net_message.data == -1)
 		{
@@ -850,34 +953,126 @@ void SV_ReadPackets (void)
 		qport = MSG_ReadShort (&net_message) & 0xffff;
 
 		// check for packets from connected clients
-		for (i=0, cl=svs.clients ; i<maxclients->value ; i++,cl++)
+		cl = SV_ClientForPacket (net_from, qport);
+		if (!cl)
+			continue;
+
+		if (cl->netchan.remote_address.port != net_from.port)
 		{
-			if (cl->state == cs_free)
-				continue;
-			if (!NET_CompareBaseAdr (net_from, cl->netchan.remote_address))
-				continue;
-			if (cl->netchan.qport != qport)
-				continue;
-			if (cl->netchan.remote_address.port != net_from.port)
-			{
-				Com_Printf ("SV_ReadPackets: fixing up a translated port\n");
-				cl->netchan.remote_address.port = net_from.port;
-			}
+			Com_Printf ("SV_ReadPackets: fixing up a translated port\n");
+			cl->netchan.remote_address.port = net_from.port;
+		}
 
-			if (Netchan_Process(&cl->netchan, &net_message))
-			{	// this is a valid, sequenced packet, so process it
-				if (cl->state != cs_zombie)
-				{
-					cl->lastmessage = svs.realtime;	// don't timeout
-					SV_ExecuteClientMessage (cl);
-				}
+		if (Netchan_Process(&cl->netchan, &net_message))
+		{	// this is a valid, sequenced packet, so process it
+			if (cl->state != cs_zombie)
+			{
+				cl->lastmessage = svs.realtime;	// don't timeout
+				SV_ExecuteClientMessage (cl);
 			}
-			break;
 		}
-		
-		if (i != maxclients->intValue)
+	}
+}
+
+/*
+==================
+SV_FloodTest_f
+
+Fills the free client slots with zombies on 127.0.0.1 and floods the
+server port with sequenced packets for them over the loopback interface,
+timing how long the server takes to read them.
+"sv_floodtest [packets]"
+==================
+*/
+#define	FLOOD_BURST		64		// packets sent before each read
+#define	FLOOD_QPORT		0x7000
+
+void SV_FloodTest_f (void)
+{
+	client_t	*cl, *saved;
+	netadr_t	adr;
+	sizebuf_t	msg;
+	byte		data[64];
+	int			packets, sent, numfake, port;
+	int			i, j, read;
+	unsigned	start, readtime;
+
+	if (!svs.initialized || sv.state == ss_dead)
+	{
+		Com_Printf ("No server running.\n");
+		return;
+	}
+
+	packets = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100000;
+
+	port = Cvar_VariableValueInt ("ip_hostport");
+	if (!port)
+		port = Cvar_VariableValueInt ("hostport");
+	if (!port)
+		port = Cvar_VariableValueInt ("port");
+	if (!port || !NET_StringToAdr (va("127.0.0.1:%i", port), &adr))
+	{
+		Com_Printf ("The server isn't on a network port.\n");
+		return;
+	}
+
+	// the packets come back from the server socket itself
+	saved = Z_Malloc (maxclients->intValue * sizeof(client_t));
+	memcpy (saved, svs.clients, maxclients->intValue * sizeof(client_t));
+	numfake = 0;
+	for (i=0, cl=svs.clients ; i<maxclients->intValue ; i++, cl++)
+	{
+		if (cl->state != cs_free)
 			continue;
+		memset (cl, 0, sizeof(*cl));
+		Netchan_Setup (NS_SERVER, &cl->netchan, adr, FLOOD_QPORT + i);
+		cl->state = cs_zombie;
+		numfake++;
 	}
+	if (!numfake)
+	{
+		Com_Printf ("No free client slots.\n");
+		Z_Free (saved);
+		return;
+	}
+	svs.clienthashdirty = true;
+
+	// every fourth packet is for nobody
+	sent = read = 0;
+	readtime = 0;
+	while (sent < packets)
+	{
+		for (j=0 ; j<FLOOD_BURST && sent < packets ; j++, sent++)
+		{
+			i = (sent % maxclients->intValue) + ((sent & 3) ? 0 : maxclients->intValue);
+			SZ_Init (&msg, data, sizeof(data));
+			MSG_WriteLong (&msg, sent / maxclients->intValue + 1);
+			MSG_WriteLong (&msg, 0);
+			MSG_WriteShort (&msg, FLOOD_QPORT + i);
+			while (msg.cursize < 40)
+				MSG_WriteByte (&msg, svc_nop);
+			NET_SendPacket (NS_SERVER, msg.cursize, msg.data, adr);
+		}
+
+		i = sv_packetsread;
+		start = Sys_Microseconds ();
+		SV_ReadPackets ();
+		readtime += Sys_Microseconds () - start;
+		read += sv_packetsread - i;
+	}
+
+	for (i=0, cl=svs.clients ; i<maxclients->intValue ; i++, cl++)
+	{
+		if (saved[i].state == cs_free)
+			*cl = saved[i];
+	}
+	Z_Free (saved);
+	svs.clienthashdirty = true;
+
+	Com_Printf ("%i packets sent, %i read for %i fake clients\n", sent, read, numfake);
+	if (read)
+		Com_Printf ("%.1f ms reading, %.3f us per packet, net_mmsg %s\n", readtime * 0.001f,
+			(float)readtime / read, Cvar_VariableString ("net_mmsg"));
 }
 
 /*
@@ -1005,6 +1200,481 @@ void SV_RunGameFrame (void)
 		time_after_game = Sys_Milliseconds ();
 }
 
+/*
+==============================================================================
+
+SERVER PROFILER
+
+Every server frame is timed by phase and the samples are kept in a ring
+covering the last SV_PROFILE_FRAMES frames.
+
+==============================================================================
+*/
+
+#define	SV_PROFILE_FRAMES	600		// one minute at 10hz
+
+svprofile_t		sv_prof;
+
+static svprofile_t	sv_profframes[SV_PROFILE_FRAMES];
+static int			sv_profcount;		// total frames recorded
+static int			sv_profsyscalls;	// NET_SystemCalls at the end of the last frame
+static FILE			*sv_proflog;
+
+static const char *sv_phasenames[SVP_NUMPHASES] =
+{
+	"read", "game", "send", "demo", "other", "total"
+};
+
+/*
+==================
+SV_ProfileOpenLog
+
+(Re)opens the csv log named by sv_profile_log, relative to the gamedir
+==================
+*/
+static void SV_ProfileOpenLog (void)
+{
+	char	name[MAX_OSPATH];
+	int		i;
+
+	sv_profile_log->modified = false;
+
+	if (sv_proflog)
+	{
+		fclose (sv_proflog);
+		sv_proflog = NULL;
+	}
+
+	if (!sv_profile_log->string[0])
+		return;
+
+	Com_sprintf (name, sizeof(name), "%s/%s", FS_Gamedir(), sv_profile_log->string);
+	FS_CreatePath (name);
+	sv_proflog = fopen (name, "w");
+	if (!sv_proflog)
+	{
+		Com_Printf ("SV_ProfileOpenLog: couldn't open %s\n", name);
+		return;
+	}
+
+	fprintf (sv_proflog, "frame");
+	for (i=0 ; i<SVP_NUMPHASES ; i++)
+		fprintf (sv_proflog, ",%s_us", sv_phasenames[i]);
+	fprintf (sv_proflog, ",traces,links,multicasts,syscalls\n");
+}
+
+/*
+==================
+SV_ProfileEndFrame
+
+Files the counters of the frame that just ran and starts a new one
+==================
+*/
+static void SV_ProfileEndFrame (void)
+{
+	svprofile_t	*p;
+	int			i;
+
+	p = &sv_prof;
+	p->syscalls = NET_SystemCalls () - sv_profsyscalls;
+	sv_profsyscalls += p->syscalls;
+	p->phase[SVP_TOTAL] = 0;
+	for (i=0 ; i<SVP_TOTAL ; i++)
+		p->phase[SVP_TOTAL] += p->phase[i];
+
+	sv_profframes[sv_profcount % SV_PROFILE_FRAMES] = *p;
+	sv_profcount++;
+
+	if (sv_profile_log->modified)
+		SV_ProfileOpenLog ();
+	if (sv_proflog)
+	{
+		fprintf (sv_proflog, "%i", sv.framenum);
+		for (i=0 ; i<SVP_NUMPHASES ; i++)
+			fprintf (sv_proflog, ",%u", p->phase[i]);
+		fprintf (sv_proflog, ",%i,%i,%i,%i\n", p->traces, p->links, p->multicasts, p->syscalls);
+	}
+
+	memset (p, 0, sizeof(*p));
+}
+
+static int SV_ProfileCompare (const void *a, const void *b)
+{
+	unsigned	ua = *(const unsigned *)a;
+	unsigned	ub = *(const unsigned *)b;
+
+	return (ua > ub) - (ua < ub);
+}
+
+/*
+==================
+SV_ProfileRow
+
+Prints avg, p50, p99 and max of one column of the window
+==================
+*/
+static void SV_ProfileRow (const char *name, unsigned *values, int count, float scale)
+{
+	double	sum;
+	int		i;
+
+	sum = 0;
+	for (i=0 ; i<count ; i++)
+		sum += values[i];
+	qsort (values, count, sizeof(*values), SV_ProfileCompare);
+
+	Com_Printf ("%-10s %9.2f %9.2f %9.2f %9.2f\n", name, sum / count * scale,
+		values[count/2] * scale, values[(count*99)/100] * scale, values[count-1] * scale);
+}
+
+/*
+==================
+SV_Profile_f
+
+Reports the phase breakdown of the last SV_PROFILE_FRAMES server frames.
+"sv_profile reset" clears the window.
+==================
+*/
+void SV_Profile_f (void)
+{
+	unsigned	values[SV_PROFILE_FRAMES];
+	int			hist[10];
+	int			count;
+	int			i, j, b;
+	unsigned	t;
+
+	if (Cmd_Argc() > 1 && !Q_stricmp(Cmd_Argv(1), "reset"))
+	{
+		sv_profcount = 0;
+		Com_Printf ("Server profile reset.\n");
+		return;
+	}
+
+	count = sv_profcount < SV_PROFILE_FRAMES ? sv_profcount : SV_PROFILE_FRAMES;
+	if (!count)
+	{
+		Com_Printf ("No server frames recorded.\n");
+		return;
+	}
+
+	Com_Printf ("last %i frames\n", count);
+	Com_Printf ("phase         avg ms    p50 ms    p99 ms    max ms\n");
+	Com_Printf ("---------- --------- --------- --------- ---------\n");
+	for (i=0 ; i<SVP_NUMPHASES ; i++)
+	{
+		for (j=0 ; j<count ; j++)
+			values[j] = sv_profframes[j].phase[i];
+		SV_ProfileRow (sv_phasenames[i], values, count, 0.001f);
+	}
+
+	Com_Printf ("\ncount            avg       p50       p99       max\n");
+	Com_Printf ("---------- --------- --------- --------- ---------\n");
+	for (j=0 ; j<count ; j++)
+		values[j] = sv_profframes[j].traces;
+	SV_ProfileRow ("traces", values, count, 1);
+	for (j=0 ; j<count ; j++)
+		values[j] = sv_profframes[j].links;
+	SV_ProfileRow ("links", values, count, 1);
+	for (j=0 ; j<count ; j++)
+		values[j] = sv_profframes[j].multicasts;
+	SV_ProfileRow ("multicasts", values, count, 1);
+	for (j=0 ; j<count ; j++)
+		values[j] = sv_profframes[j].syscalls;
+	SV_ProfileRow ("syscalls", values, count, 1);
+
+	// power of two histogram of the frame time, starting below 0.25ms
+	memset (hist, 0, sizeof(hist));
+	for (j=0 ; j<count ; j++)
+	{
+		t = sv_profframes[j].phase[SVP_TOTAL] >> 8;
+		for (b=0 ; t && b<9 ; b++)
+			t >>= 1;
+		hist[b]++;
+	}
+
+	Com_Printf ("\nframe time\n");
+	for (b=0 ; b<10 ; b++)
+	{
+		if (b < 9)
+			Com_Printf ("  < %6.2f ms %5i ", (256 << b) * 0.001f, hist[b]);
+		else
+			Com_Printf (" >= %6.2f ms %5i ", (256 << 8) * 0.001f, hist[b]);
+		for (i=0 ; i<(hist[b]*40 + count-1)/count ; i++)
+			Com_Printf ("#");
+		Com_Printf ("\n");
+	}
+}
+
+/*
+==============================================================================
+
+NETWORK STATISTICS
+
+Everything written to a client is counted by message type, and the
+entity deltas by field as well, see SV_CountMessage and SV_CountDelta.
+Multicasts and reliable messages are counted when they are queued,
+frames only once they go out.
+
+==============================================================================
+*/
+
+static FILE			*sv_netlog;
+static int			sv_netlogtime;				// svs.realtime of the last row
+static netstats_t	sv_netlogged[MAX_CLIENTS];	// the totals at the last row
+
+static const char *sv_svcnames[NETSTATS_SVCOPS] =
+{
+	"bad", "muzzleflash", "muzzleflash2", "temp_entity", "layout",
+	"inventory", "nop", "disconnect", "reconnect", "sound", "print",
+	"stufftext", "serverdata", "configstring", "spawnbaseline",
+	"centerprint", "download", "playerinfo", "packetentities",
+	"deltapacketentities", "frame"
+};
+
+static const char *sv_fieldnames[NSF_NUMFIELDS] =
+{
+	"header", "model", "frame", "skin", "effects", "origin",
+	"angles", "oldorigin", "sound", "event", "solid", "remove"
+};
+
+static int SV_NetstatsTotal (const netstats_t *ns)
+{
+	int		i, total;
+
+	total = 0;
+	for (i=0 ; i<NETSTATS_SVCOPS ; i++)
+		total += ns->svc[i];
+	return total;
+}
+
+/*
+==================
+SV_NetstatsOpenLog
+
+(Re)opens the csv log named by sv_netstats_log, relative to the gamedir
+==================
+*/
+static void SV_NetstatsOpenLog (void)
+{
+	char	name[MAX_OSPATH];
+	int		i;
+
+	sv_netstats_log->modified = false;
+
+	if (sv_netlog)
+	{
+		fclose (sv_netlog);
+		sv_netlog = NULL;
+	}
+
+	if (!sv_netstats_log->string[0])
+		return;
+
+	Com_sprintf (name, sizeof(name), "%s/%s", FS_Gamedir(), sv_netstats_log->string);
+	FS_CreatePath (name);
+	sv_netlog = fopen (name, "w");
+	if (!sv_netlog)
+	{
+		Com_Printf ("SV_NetstatsOpenLog: couldn't open %s\n", name);
+		return;
+	}
+
+	memset (sv_netlogged, 0, sizeof(sv_netlogged));
+	sv_netlogtime = svs.realtime;
+
+	fprintf (sv_netlog, "time,client,name,msec,bytes,frames,ratedrops,overflows,entities");
+	for (i=0 ; i<NETSTATS_SVCOPS ; i++)
+		fprintf (sv_netlog, ",%s", sv_svcnames[i]);
+	for (i=0 ; i<NSF_NUMFIELDS ; i++)
+		fprintf (sv_netlog, ",ent_%s", sv_fieldnames[i]);
+	fprintf (sv_netlog, "\n");
+}
+
+/*
+==================
+SV_NetstatsFrame
+
+Writes a row for every client to the sv_netstats_log file each
+sv_netstats_interval seconds, with what was sent since the last one
+==================
+*/
+void SV_NetstatsFrame (void)
+{
+	client_t	*cl;
+	netstats_t	*ns, *old;
+	char		name[32];
+	int			i, j, last;
+
+	if (sv_netstats_log->modified)
+		SV_NetstatsOpenLog ();
+	if (!sv_netlog)
+		return;
+
+	if (svs.realtime - sv_netlogtime < (int)(sv_netstats_interval->value * 1000) || svs.realtime == sv_netlogtime)
+		return;
+	last = sv_netlogtime;
+	sv_netlogtime = svs.realtime;
+
+	for (i=0, cl = svs.clients ; i<maxclients->intValue ; i++, cl++)
+	{
+		if (!cl->state)
+			continue;
+
+		ns = &cl->netstats;
+		old = &sv_netlogged[i];
+		if (old->starttime != ns->starttime)
+		{	// a new client in the slot, or the counters were reset
+			memset (old, 0, sizeof(*old));
+			old->starttime = ns->starttime;
+		}
+
+		// keep the columns intact
+		Q_strncpyz (name, cl->name, sizeof(name));
+		for (j=0 ; name[j] ; j++)
+		{
+			if (name[j] == ',' || name[j] == '"' || name[j] < ' ')
+				name[j] = '_';
+		}
+
+		fprintf (sv_netlog, "%i,%i,%s,%i,%i,%i,%i,%i,%i", svs.realtime, i, name,
+			svs.realtime - max(last, ns->starttime),
+			SV_NetstatsTotal (ns) - SV_NetstatsTotal (old), ns->frames - old->frames,
+			ns->ratedrops - old->ratedrops, ns->overflows - old->overflows,
+			ns->entities - old->entities);
+		for (j=0 ; j<NETSTATS_SVCOPS ; j++)
+			fprintf (sv_netlog, ",%i", ns->svc[j] - old->svc[j]);
+		for (j=0 ; j<NSF_NUMFIELDS ; j++)
+			fprintf (sv_netlog, ",%i", ns->fields[j] - old->fields[j]);
+		fprintf (sv_netlog, "\n");
+
+		*old = *ns;
+	}
+	fflush (sv_netlog);
+}
+
+/*
+==================
+SV_NetstatsClient
+
+Prints the breakdown for one client
+==================
+*/
+static void SV_NetstatsClient (client_t *cl)
+{
+	netstats_t	*ns;
+	float		secs;
+	int			i, total, ents;
+
+	ns = &cl->netstats;
+	secs = (svs.realtime - ns->starttime) * 0.001f;
+	if (secs < 0.001f)
+		secs = 0.001f;
+	total = SV_NetstatsTotal (ns);
+
+	Com_Printf ("%i %s: %i bytes in %.1f s, %i frames, %i rate drops, %i overflows\n",
+		(int)(cl - svs.clients), cl->name, total, secs, ns->frames, ns->ratedrops, ns->overflows);
+
+	Com_Printf ("\nmessage                   bytes       B/s     %%\n");
+	Com_Printf ("------------------- ---------- --------- -----\n");
+	for (i=0 ; i<NETSTATS_SVCOPS ; i++)
+	{
+		if (!ns->svc[i])
+			continue;
+		Com_Printf ("%-19s %10i %9.0f %5.1f\n", sv_svcnames[i], ns->svc[i],
+			ns->svc[i] / secs, ns->svc[i] * 100.0f / total);
+	}
+
+	ents = ns->svc[svc_packetentities];
+	if (!ents)
+		return;
+
+	Com_Printf ("\n%i entity updates, %.1f bytes each\n", ns->entities,
+		ns->entities ? (float)(ents - ns->fields[NSF_REMOVE]) / ns->entities : 0);
+	Com_Printf ("entity field              bytes       B/s     %%\n");
+	Com_Printf ("------------------- ---------- --------- -----\n");
+	for (i=0 ; i<NSF_NUMFIELDS ; i++)
+	{
+		if (!ns->fields[i])
+			continue;
+		Com_Printf ("%-19s %10i %9.0f %5.1f\n", sv_fieldnames[i], ns->fields[i],
+			ns->fields[i] / secs, ns->fields[i] * 100.0f / ents);
+	}
+}
+
+/*
+==================
+SV_Netstats_f
+
+"sv_netstats" lists what every client is being sent,
+"sv_netstats <client>" breaks one down by message type and
+entity field, "sv_netstats reset" starts counting again.
+==================
+*/
+void SV_Netstats_f (void)
+{
+	client_t	*cl;
+	netstats_t	*ns;
+	float		secs;
+	int			i, j, top, topfield;
+
+	if (!svs.initialized)
+	{
+		Com_Printf ("No server running.\n");
+		return;
+	}
+
+	if (Cmd_Argc() > 1 && !Q_stricmp(Cmd_Argv(1), "reset"))
+	{
+		for (i=0, cl = svs.clients ; i<maxclients->intValue ; i++, cl++)
+		{
+			memset (&cl->netstats, 0, sizeof(cl->netstats));
+			cl->netstats.starttime = svs.realtime;
+		}
+		Com_Printf ("Network statistics reset.\n");
+		return;
+	}
+
+	if (Cmd_Argc() > 1)
+	{
+		if (SV_SetPlayer ())
+			SV_NetstatsClient (sv_client);
+		return;
+	}
+
+	Com_Printf ("num name               B/s  frames drops  ovfl top message         top entity field\n");
+	Com_Printf ("--- --------------- ------- ------- ----- ----- ------------------- ----------------\n");
+	for (i=0, cl = svs.clients ; i<maxclients->intValue ; i++, cl++)
+	{
+		if (!cl->state)
+			continue;
+
+		ns = &cl->netstats;
+		secs = (svs.realtime - ns->starttime) * 0.001f;
+		if (secs < 0.001f)
+			secs = 0.001f;
+
+		top = 0;
+		for (j=1 ; j<NETSTATS_SVCOPS ; j++)
+		{
+			if (ns->svc[j] > ns->svc[top])
+				top = j;
+		}
+		topfield = 0;
+		for (j=1 ; j<NSF_NUMFIELDS ; j++)
+		{
+			if (ns->fields[j] > ns->fields[topfield])
+				topfield = j;
+		}
+
+		Com_Printf ("%3i %-15.15s %7.0f %7i %5i %5i %-19s %s\n", i, cl->name,
+			SV_NetstatsTotal (ns) / secs, ns->frames, ns->ratedrops, ns->overflows,
+			ns->svc[top] ? sv_svcnames[top] : "-",
+			ns->fields[topfield] ? sv_fieldnames[topfield] : "-");
+	}
+}
+
+//============================================================================
+
 /*
 ==================
 SV_Frame
@@ -1013,6 +1683,8 @@ SV_Frame
 */
 void SV_Frame (int msec)
 {
+	unsigned	start, now;
+
 	time_before_game = time_after_game = 0;
 
 	// if server is not active, do nothing
@@ -1024,12 +1696,20 @@ void SV_Frame (int msec)
 	// keep the random time dependent
 	rand ();
 
+	start = Sys_Microseconds ();
+
+	// hold back everything sent this frame and send it together
+	NET_BeginBatch (NS_SERVER);
+
 	// check timeouts
 	SV_CheckTimeouts ();
 
 	// get packets from clients
 	SV_ReadPackets ();
 
+	now = Sys_Microseconds ();
+	sv_prof.phase[SVP_READ] += now - start;
+
 	// move autonomous things around if enough time has passed
 	if (!sv_timedemo->intValue && svs.realtime < sv.time)
 	{
@@ -1040,6 +1720,7 @@ void SV_Frame (int msec)
 				Com_Printf ("sv lowclamp\n");
 			svs.realtime = sv.time - 100;
 		}
+		NET_FlushBatch (NS_SERVER);
 		NET_Sleep(sv.time - svs.realtime);
 		return;
 	}
@@ -1053,18 +1734,36 @@ void SV_Frame (int msec)
 	// let everything in the world think and move
 	SV_RunGameFrame ();
 
+	start = now;
+	now = Sys_Microseconds ();
+	sv_prof.phase[SVP_GAME] += now - start;
+
 	// send messages back to the clients that had packets read this frame
 	SV_SendClientMessages ();
 
+	start = now;
+	now = Sys_Microseconds ();
+	sv_prof.phase[SVP_SEND] += now - start;
+
 	// save the entire world state if recording a serverdemo
 	SV_RecordDemoMessage ();
 
+	start = now;
+	now = Sys_Microseconds ();
+	sv_prof.phase[SVP_DEMO] += now - start;
+
 	// send a heartbeat to the master if needed
 	Master_Heartbeat ();
 
 	// clear teleport flags, etc for next frame
 	SV_PrepWorldFrame ();
 
+	NET_FlushBatch (NS_SERVER);
+
+	sv_prof.phase[SVP_OTHER] += Sys_Microseconds () - now;
+	SV_ProfileEndFrame ();
+	SV_NetstatsFrame ();
+
 	if (sv_getspace_overflow_hack->intValue && num_sz_getspace_overflows >= 1000)
 	{
 		num_sz_getspace_overflows = 0;
@@ -1248,6 +1947,12 @@ void SV_Init (void)
 	/* FS: Allow bsp downloads from a pak file if we want to. */
 	sv_allow_download_maps_in_paks = Cvar_Get ("sv_allow_download_maps_in_paks", "1", 0);
 	Cvar_SetDescription("sv_allow_download_maps_in_paks", "Allow BSP downloads accessed from a PAK file.");
+	sv_download_window = Cvar_Get ("sv_download_window", "65536", 0);
+	Cvar_SetDescription("sv_download_window", "Bytes a client that supports windowed downloads may have in flight.  0 makes every client use the original one block per request protocol.");
+	sv_download_maxrate = Cvar_Get ("sv_download_maxrate", "250000", 0);
+	Cvar_SetDescription("sv_download_maxrate", "Most bytes per second sent to one client in a windowed download, whatever its rate.");
+	sv_download_compress = Cvar_Get ("sv_download_compress", "1", 0);
+	Cvar_SetDescription("sv_download_compress", "Compress windowed downloads for clients that ask for it.");
 
 	/* FS: From R1Q2: HTTP Downloading */
 	sv_downloadserver = Cvar_Get ("sv_downloadserver", "", 0);
@@ -1277,6 +1982,27 @@ void SV_Init (void)
 
 	sv_reconnect_limit = Cvar_Get ("sv_reconnect_limit", "3", CVAR_ARCHIVE);
 
+	sv_area_cellsize = Cvar_Get ("sv_area_cellsize", "256", 0);
+	Cvar_SetDescription("sv_area_cellsize", "Target size of the entity area tree leafs, in units.  Larger maps get a deeper tree.  Takes effect on the next map load.");
+
+	sv_threads = Cvar_Get ("sv_threads", "0", 0);
+	Cvar_SetDescription("sv_threads", "Number of threads used to build and encode client frames.  0 or 1 does it all on the main thread.");
+
+	sv_profile_log = Cvar_Get ("sv_profile_log", "", 0);
+	Cvar_SetDescription("sv_profile_log", "Name of a CSV file in the game directory that receives the phase times and counters of every server frame.  Empty disables the log.");
+	sv_netstats_log = Cvar_Get ("sv_netstats_log", "", 0);
+	Cvar_SetDescription("sv_netstats_log", "Name of a CSV file in the game directory that receives the bytes sent to each client by message type and entity field.  Empty disables the log.");
+	sv_netstats_interval = Cvar_Get ("sv_netstats_interval", "10", 0);
+	Cvar_SetDescription("sv_netstats_interval", "Seconds between the rows of sv_netstats_log.");
+
+	sv_simd = Cvar_Get ("sv_simd", "1", 0);
+	Cvar_SetDescription("sv_simd", "Use SSE2 (or AVX2, if built for it) for the PVS and entity bitsets when culling client frames.  Has no effect on builds without them.");
+
+	sv_demo_compress = Cvar_Get ("sv_demo_compress", "0", 0);
+	Cvar_SetDescription("sv_demo_compress", "Compress demos made with serverrecord.  Only engines that understand the compressed format can play them back.");
+	sv_save_compress = Cvar_Get ("sv_save_compress", "0", 0);
+	Cvar_SetDescription("sv_save_compress", "Compress the level and game state in savegames.  Saves written this way don't load in older engines.");
+
 	SZ_Init (&net_message, net_message_buffer, sizeof(net_message_buffer));
 }
 
@@ -1329,6 +2055,9 @@ before Sys_Quit or Sys_Error
 */
 void SV_Shutdown (char *finalmsg, qboolean reconnect)
 {
+	// a frame that was cut short by an error may have left packets behind
+	NET_FlushBatch (NS_SERVER);
+
 	if (svs.clients)
 		SV_FinalMessage (finalmsg, reconnect);
 
@@ -1337,18 +2066,38 @@ void SV_Shutdown (char *finalmsg, qboolean reconnect)
 
 	// free current level
 	if (sv.demofile)
-		fclose (sv.demofile);
+		FS_CloseReader (sv.demofile);
 	memset (&sv, 0, sizeof(sv));
 	Com_SetServerState (sv.state);
 
 	// free server static data
 	if (svs.clients)
 		Z_Free (svs.clients);
+	if (svs.clientbuilds)
+		Z_Free (svs.clientbuilds);
 	if (svs.client_entities)
 		Z_Free (svs.client_entities);
 	if (svs.demofile)
-		fclose (svs.demofile);
+		FS_CloseWriter (svs.demofile);
 	memset (&svs, 0, sizeof(svs));
+	SV_FreeDownloadCache ();
+
+	// don't quit with a savegame half written
+	FS_FlushWrites ();
+
+	// the log is reopened when the next server runs a frame
+	if (sv_proflog)
+	{
+		fclose (sv_proflog);
+		sv_proflog = NULL;
+		sv_profile_log->modified = true;
+	}
+	if (sv_netlog)
+	{
+		fclose (sv_netlog);
+		sv_netlog = NULL;
+		sv_netstats_log->modified = true;
+	}
 }
 
 void SV_GetUptime (void) /* FS: Uptime for /info */
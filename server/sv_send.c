@@ -42,6 +42,7 @@ void SV_FlushRedirect (int sv_redirected, char *outputbuf)
 		MSG_WriteByte (&sv_client->netchan.message, svc_print);
 		MSG_WriteByte (&sv_client->netchan.message, PRINT_HIGH);
 		MSG_WriteString (&sv_client->netchan.message, outputbuf);
+		SV_CountMessage (sv_client, svc_print, (int)strlen(outputbuf) + 3);
 	}
 }
 
@@ -54,6 +55,23 @@ EVENT MESSAGES
 =============================================================================
 */
 
+/*
+=================
+SV_CountMessage
+
+Adds len bytes written to the client to the counter for
+message type op.  A multicast is counted as a whole by its first op.
+=================
+*/
+void SV_CountMessage (client_t *cl, int op, int len)
+{
+	if (len <= 0)
+		return;
+	if (op < 0 || op >= NETSTATS_SVCOPS)
+		op = svc_bad;
+	cl->netstats.svc[op] += len;
+}
+
 
 /*
 =================
@@ -78,6 +96,7 @@ void SV_ClientPrintf (client_t *cl, int level, const char *fmt, ...)
 	MSG_WriteByte (&cl->netchan.message, svc_print);
 	MSG_WriteByte (&cl->netchan.message, level);
 	MSG_WriteString (&cl->netchan.message, string);
+	SV_CountMessage (cl, svc_print, (int)strlen(string) + 3);
 }
 
 /*
@@ -121,6 +140,7 @@ void SV_BroadcastPrintf (int level, const char *fmt, ...)
 		MSG_WriteByte (&cl->netchan.message, svc_print);
 		MSG_WriteByte (&cl->netchan.message, level);
 		MSG_WriteString (&cl->netchan.message, string);
+		SV_CountMessage (cl, svc_print, (int)strlen(string) + 3);
 	}
 }
 
@@ -149,6 +169,63 @@ void SV_BroadcastCommand (const char *fmt, ...)
 }
 
 
+/*
+=================
+SV_ClientClusters
+
+Finds the cluster and area of every client that moved since the last
+multicast, and regroups the clients by cluster if any of them changed
+cluster.  Clients in solid (cluster -1) are in no group.
+=================
+*/
+static void SV_ClientClusters (void)
+{
+	client_t	*client;
+	int			j, k, leafnum, cluster;
+
+	for (j = 0, client = svs.clients; j < maxclients->intValue; j++, client++)
+	{
+		if (client->state == cs_free || client->state == cs_zombie)
+			continue;
+		if (client->clustervalid && VectorCompare (client->edict->s.origin, client->clusterorigin))
+			continue;
+
+		leafnum = CM_PointLeafnum (client->edict->s.origin);
+		cluster = CM_LeafCluster (leafnum);
+		client->area = CM_LeafArea (leafnum);
+		VectorCopy (client->edict->s.origin, client->clusterorigin);
+		if (!client->clustervalid || client->cluster != cluster)
+			sv.clientclustersdirty = true;
+		client->cluster = cluster;
+		client->clustervalid = true;
+	}
+
+	if (!sv.clientclustersdirty)
+		return;
+	sv.clientclustersdirty = false;
+
+	// the groups may hold clients that left since, SV_Multicast checks them
+	sv.numclientclusters = 0;
+	for (j = 0, client = svs.clients; j < maxclients->intValue; j++, client++)
+	{
+		if (!client->clustervalid || client->cluster == -1)
+			continue;
+		if (client->state == cs_free || client->state == cs_zombie)
+			continue;
+
+		for (k=0 ; k<sv.numclientclusters ; k++)
+			if (sv.clientclusters[k] == client->cluster)
+				break;
+		if (k == sv.numclientclusters)
+		{
+			sv.numclientclusters++;
+			sv.clientclusters[k] = client->cluster;
+			memset (sv.clusterclients[k], 0, sizeof(sv.clusterclients[k]));
+		}
+		sv.clusterclients[k][j>>5] |= 1u << (j&31);
+	}
+}
+
 /*
 =================
 SV_Multicast
@@ -166,10 +243,12 @@ void SV_Multicast (vec3_t origin, multicast_t to)
 	client_t	*client;
 	byte		*mask;
 	int			leafnum, cluster;
-	int			j;
+	int			j, k;
 	qboolean	reliable;
-	int			area1, area2;
+	int			area1;
+	unsigned	recipients[MAX_CLIENTS/32];
 
+	sv_prof.multicasts++;
 	reliable = false;
 
 	if (to != MULTICAST_ALL_R && to != MULTICAST_ALL)
@@ -199,7 +278,6 @@ void SV_Multicast (vec3_t origin, multicast_t to)
 	case MULTICAST_PHS_R:
 		reliable = true;	// intentional fallthrough
 	case MULTICAST_PHS:
-		leafnum = CM_PointLeafnum (origin);
 		cluster = CM_LeafCluster (leafnum);
 		mask = CM_ClusterPHS (cluster);
 		break;
@@ -207,7 +285,6 @@ void SV_Multicast (vec3_t origin, multicast_t to)
 	case MULTICAST_PVS_R:
 		reliable = true;	// intentional fallthrough
 	case MULTICAST_PVS:
-		leafnum = CM_PointLeafnum (origin);
 		cluster = CM_LeafCluster (leafnum);
 		mask = CM_ClusterPVS (cluster);
 		break;
@@ -217,6 +294,22 @@ void SV_Multicast (vec3_t origin, multicast_t to)
 		Com_Error (ERR_FATAL, "SV_Multicast: bad to:%i", to);
 	}
 
+	// gather the clients in clusters the mask has
+	if (mask)
+	{
+		SV_ClientClusters ();
+
+		memset (recipients, 0, sizeof(recipients));
+		for (k=0 ; k<sv.numclientclusters ; k++)
+		{
+			cluster = sv.clientclusters[k];
+			if (!(mask[cluster>>3] & (1<<(cluster&7))))
+				continue;
+			for (j=0 ; j<MAX_CLIENTS/32 ; j++)
+				recipients[j] |= sv.clusterclients[k][j];
+		}
+	}
+
 	// send the data to all relevent clients
 	for (j = 0, client = svs.clients; j < maxclients->value; j++, client++)
 	{
@@ -227,12 +320,9 @@ void SV_Multicast (vec3_t origin, multicast_t to)
 
 		if (mask)
 		{
-			leafnum = CM_PointLeafnum (client->edict->s.origin);
-			cluster = CM_LeafCluster (leafnum);
-			area2 = CM_LeafArea (leafnum);
-			if (!CM_AreasConnected (area1, area2))
+			if (!(recipients[j>>5] & (1u<<(j&31))))
 				continue;
-			if (!(mask[cluster>>3] & (1<<(cluster&7))))
+			if (!CM_AreasConnected (area1, client->area))
 				continue;
 		}
 
@@ -240,6 +330,7 @@ void SV_Multicast (vec3_t origin, multicast_t to)
 			SZ_Write (&client->netchan.message, sv.multicast.data, sv.multicast.cursize);
 		else
 			SZ_Write (&client->datagram, sv.multicast.data, sv.multicast.cursize);
+		SV_CountMessage (client, sv.multicast.data[0], sv.multicast.cursize);
 	}
 
 	SZ_Clear (&sv.multicast);
@@ -394,50 +485,114 @@ FRAME UPDATES
 
 /*
 =======================
-SV_SendClientDatagram
+SV_ClientMessageSize
+
+The largest unreliable message the client can be sent
 =======================
 */
-qboolean SV_SendClientDatagram (client_t *client)
+int SV_ClientMessageSize (client_t *client)
 {
-	byte		msg_buf[MAX_MSGLEN];
-	sizebuf_t	msg;
-
-	SV_BuildClientFrame (client);
-
-	SZ_Init (&msg, msg_buf, sizeof(msg_buf));
-
 	if ((maxclients->intValue > 1) && !(client->netchan.remote_address.type == NA_LOOPBACK))
 	{
-		msg.maxsize = MAX_MSGLEN_MP; /* FS: MAX_MSGLEN is now for single player */
+		return MAX_MSGLEN_MP; /* FS: MAX_MSGLEN is now for single player */
 	}
 
-	msg.allowoverflow = true;
+	return MAX_MSGLEN;
+}
 
-	// send over all the relevant entity_state_t
-	// and the player_state_t
-	SV_WriteFrameToClient (client, &msg);
+/*
+=======================
+SV_AddFrameStats
+
+Adds the counts of the frame that is going out to the client's totals
+=======================
+*/
+static void SV_AddFrameStats (client_t *client)
+{
+	netstats_t	*ns, *fs;
+	int			i;
 
+	ns = &client->netstats;
+	fs = &client->framestats;
+	for (i=0 ; i<NETSTATS_SVCOPS ; i++)
+		ns->svc[i] += fs->svc[i];
+	for (i=0 ; i<NSF_NUMFIELDS ; i++)
+		ns->fields[i] += fs->fields[i];
+	ns->entities += fs->entities;
+	ns->frames++;
+}
+
+/*
+=======================
+SV_TransmitClientDatagram
+
+Appends the client's datagram to msg, unless that was already
+done, and sends it
+=======================
+*/
+void SV_TransmitClientDatagram (client_t *client, sizebuf_t *msg, qboolean datagram_written)
+{
 	// copy the accumulated multicast datagram
 	// for this client out to the message
 	// it is necessary for this to be after the WriteEntities
 	// so that entity references will be current
 	if (client->datagram.overflowed)
+	{
 		Com_DPrintf (DEVELOPER_MSG_SERVER, "WARNING: datagram overflowed for %s [Cur: %d] [Max: %d]\n", client->name, client->datagram.cursize, client->datagram.maxsize);
-	else
-		SZ_Write (&msg, client->datagram.data, client->datagram.cursize);
+		client->netstats.overflows++;
+	}
+	else if (!datagram_written)
+		SZ_Write (msg, client->datagram.data, client->datagram.cursize);
 	SZ_Clear (&client->datagram);
 
-	if (msg.overflowed)
+	if (msg->overflowed)
 	{	// must have room left for the packet header
-		Com_DPrintf (DEVELOPER_MSG_SERVER, "WARNING: msg overflowed for %s [Cur: %d] [Max: %d]\n", client->name, msg.cursize, msg.maxsize);
-		SZ_Clear (&msg);
+		Com_DPrintf (DEVELOPER_MSG_SERVER, "WARNING: msg overflowed for %s [Cur: %d] [Max: %d]\n", client->name, msg->cursize, msg->maxsize);
+		SZ_Clear (msg);
+		client->netstats.overflows++;
 	}
+	else
+		SV_AddFrameStats (client);
 
 	// send the datagram
-	Netchan_Transmit (&client->netchan, msg.cursize, msg.data);
+	Netchan_Transmit (&client->netchan, msg->cursize, msg->data);
 
 	// record the size for rate estimation
-	client->message_size[sv.framenum % RATE_MESSAGES] = msg.cursize;
+	client->message_size[sv.framenum % RATE_MESSAGES] = msg->cursize;
+}
+
+/*
+=======================
+SV_WriteClientDatagram
+
+Encodes the client's already built frame and sends it
+=======================
+*/
+void SV_WriteClientDatagram (client_t *client)
+{
+	byte		msg_buf[MAX_MSGLEN];
+	sizebuf_t	msg;
+
+	SZ_Init (&msg, msg_buf, sizeof(msg_buf));
+	msg.maxsize = SV_ClientMessageSize (client);
+	msg.allowoverflow = true;
+
+	// send over all the relevant entity_state_t
+	// and the player_state_t
+	SV_WriteFrameToClient (client, &msg);
+
+	SV_TransmitClientDatagram (client, &msg, false);
+}
+
+/*
+=======================
+SV_SendClientDatagram
+=======================
+*/
+qboolean SV_SendClientDatagram (client_t *client)
+{
+	SV_BuildClientFrame (client);
+	SV_WriteClientDatagram (client);
 
 	return true;
 }
@@ -452,7 +607,7 @@ void SV_DemoCompleted (void)
 {
 	if (sv.demofile)
 	{
-		fclose (sv.demofile);
+		FS_CloseReader (sv.demofile);
 		sv.demofile = NULL;
 	}
 	SV_Nextserver ();
@@ -486,6 +641,7 @@ qboolean SV_RateDrop (client_t *c)
 	if (total > c->rate)
 	{
 		c->surpressCount++;
+		c->netstats.ratedrops++;
 		c->message_size[sv.framenum % RATE_MESSAGES] = 0;
 		return true;
 	}
@@ -493,6 +649,228 @@ qboolean SV_RateDrop (client_t *c)
 	return false;
 }
 
+/*
+===============================================================================
+
+THREADED FRAME BUILDING
+
+With sv_threads > 1, every client's entity list is culled and its
+frame encoded on worker threads.  Everything that touches shared state
+(the collision model's static vis rows, the client_entities ring,
+printing and the network) stays on the main thread, in client order,
+so the packets are byte for byte the same as the serial path's.
+
+===============================================================================
+*/
+
+static int	sv_buildlist[MAX_CLIENTS];	// clientbuilds[] with a frame to build
+
+/*
+=======================
+SV_CullClientJob
+=======================
+*/
+static void SV_CullClientJob (int job, void *arg)
+{
+	client_t		*client;
+	clientbuild_t	*cb;
+
+	client = svs.clients + sv_buildlist[job];
+	cb = svs.clientbuilds + sv_buildlist[job];
+
+	cb->num_entities = SV_CullEntities (client->edict, cb->org, cb->clientarea, cb->fatpvs, cb->phs, cb->entities);
+}
+
+/*
+=======================
+SV_EncodeClientJob
+=======================
+*/
+static void SV_EncodeClientJob (int job, void *arg)
+{
+	client_t		*client;
+	clientbuild_t	*cb;
+
+	client = svs.clients + sv_buildlist[job];
+	cb = svs.clientbuilds + sv_buildlist[job];
+
+	// SV_EmitPacketEntities adds no entities past MAX_MSGLEN-150, and
+	// one entity delta is at most 43 bytes, so with the end marker the
+	// frame fits in MAX_MSGLEN.  The datagram is only added if it stays
+	// inside the real limit.  Anything bigger is left for the main
+	// thread to redo with the normal overflow handling, as SZ_GetSpace
+	// can't be allowed to overflow (and print) on a worker.
+	SZ_Init (&cb->msg, cb->msg_buf, sizeof(cb->msg_buf));
+	cb->maxsize = SV_ClientMessageSize (client);
+	cb->surpressCount = client->surpressCount;
+
+	SV_WriteFrameToClient (client, &cb->msg);
+	if (cb->msg.cursize + client->datagram.cursize > cb->maxsize)
+	{
+		cb->rewrite = true;
+		return;
+	}
+	if (!client->datagram.overflowed)
+		SZ_Write (&cb->msg, client->datagram.data, client->datagram.cursize);
+
+	cb->rewrite = false;
+}
+
+/*
+=======================
+SV_CommitClientFrame
+
+Adds the culled entities to the client_entities ring
+=======================
+*/
+static void SV_CommitClientFrame (client_t *client, clientbuild_t *cb)
+{
+	int		i;
+
+	cb->frame->num_entities = 0;
+	cb->frame->first_entity = svs.next_client_entities;
+	for (i=0 ; i<cb->num_entities ; i++)
+		SV_AddClientEntity (client, cb->frame, cb->entities[i]);
+}
+
+/*
+=======================
+SV_FramesOverlap
+
+Returns true if committing all of this frame's entities at once
+would overwrite ring entries that a client still needs to delta
+from.  The serial path writes and sends one client at a time, so it
+could still use them.
+=======================
+*/
+static qboolean SV_FramesOverlap (int numbuilds)
+{
+	int				i, total;
+	client_t		*client;
+	client_frame_t	*oldframe;
+
+	total = svs.next_client_entities;
+	for (i=0 ; i<numbuilds ; i++)
+		total += svs.clientbuilds[sv_buildlist[i]].num_entities;
+
+	for (i=0 ; i<numbuilds ; i++)
+	{
+		client = svs.clients + sv_buildlist[i];
+
+		if (client->lastframe <= 0 || sv.framenum - client->lastframe >= (UPDATE_BACKUP - 3))
+			continue;	// will be sent uncompressed
+
+		oldframe = &client->frames[client->lastframe & UPDATE_MASK];
+		if (oldframe->num_entities && oldframe->first_entity < total - svs.num_client_entities)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+=======================
+SV_SendClientMessagesThreaded
+
+Returns false if this frame has to go through the serial path
+=======================
+*/
+static qboolean SV_SendClientMessagesThreaded (void)
+{
+	int				i, numbuilds, clientcluster;
+	qboolean		overlap;
+	client_t		*c;
+	clientbuild_t	*cb;
+
+	if (sv.state != ss_game || ge->num_edicts > MAX_EDICTS)
+		return false;
+
+	// dropping a client for an overflowed reliable message
+	// prints to everyone, so keep that in order
+	for (i=0, c = svs.clients ; i<maxclients->intValue; i++, c++)
+	{
+		if (c->state && c->netchan.message.overflowed)
+			return false;
+	}
+
+	if (!svs.clientbuilds)
+		svs.clientbuilds = Z_Malloc (sizeof(clientbuild_t)*maxclients->intValue);
+
+	// find the PVS and PHS for everyone that gets a frame, as the
+	// collision model may decompress them into shared rows
+	numbuilds = 0;
+	for (i=0, c = svs.clients ; i<maxclients->intValue; i++, c++)
+	{
+		cb = svs.clientbuilds + i;
+		cb->send = false;
+		cb->frame = NULL;
+
+		if (c->state != cs_spawned)
+			continue;
+
+		// don't overrun bandwidth
+		if (SV_RateDrop (c))
+			continue;
+
+		cb->send = true;
+		cb->frame = SV_SetupClientFrame (c, cb->org, &cb->clientarea, &clientcluster, cb->fatpvs);
+		if (!cb->frame)
+			continue;		// not in game yet, the main thread sends the old frame
+
+		memcpy (cb->phs, CM_ClusterPHS (clientcluster), (CM_NumClusters()+7)>>3);
+		sv_buildlist[numbuilds++] = i;
+	}
+
+	Com_RunJobs (numbuilds, SV_CullClientJob, NULL, sv_threads->intValue);
+
+	overlap = SV_FramesOverlap (numbuilds);
+	if (!overlap)
+	{
+		for (i=0 ; i<numbuilds ; i++)
+			SV_CommitClientFrame (svs.clients + sv_buildlist[i], svs.clientbuilds + sv_buildlist[i]);
+
+		Com_RunJobs (numbuilds, SV_EncodeClientJob, NULL, sv_threads->intValue);
+	}
+
+	// send everything in client order
+	for (i=0, c = svs.clients ; i<maxclients->intValue; i++, c++)
+	{
+		if (!c->state)
+			continue;
+
+		cb = svs.clientbuilds + i;
+
+		if (c->state == cs_spawned)
+		{
+			if (!cb->send)
+				continue;
+
+			if (!cb->frame)
+				SV_WriteClientDatagram (c);
+			else if (overlap)
+			{
+				SV_CommitClientFrame (c, cb);
+				SV_WriteClientDatagram (c);
+			}
+			else if (cb->rewrite)
+			{
+				c->surpressCount = cb->surpressCount;
+				SV_WriteClientDatagram (c);
+			}
+			else
+				SV_TransmitClientDatagram (c, &cb->msg, true);
+		}
+		else
+		{
+	// just update reliable	if needed
+			if (c->netchan.message.cursize	|| curtime - c->netchan.last_sent > 1000 )
+				Netchan_Transmit (&c->netchan, 0, NULL);
+		}
+	}
+
+	return true;
+}
+
 /*
 =======================
 SV_SendClientMessages
@@ -516,8 +894,8 @@ void SV_SendClientMessages (void)
 		else
 		{
 			// get the next message
-			r = fread (&msglen, 4, 1, sv.demofile);
-			if (r != 1)
+			r = FS_ReadStream (sv.demofile, &msglen, 4);
+			if (r != 4)
 			{
 				SV_DemoCompleted ();
 				return;
@@ -530,8 +908,8 @@ void SV_SendClientMessages (void)
 			}
 			if (msglen > MAX_MSGLEN)
 				Com_Error (ERR_DROP, "SV_SendClientMessages: msglen > MAX_MSGLEN");
-			r = fread (msgbuf, msglen, 1, sv.demofile);
-			if (r != 1)
+			r = FS_ReadStream (sv.demofile, msgbuf, msglen);
+			if (r != msglen)
 			{
 				SV_DemoCompleted ();
 				return;
@@ -539,6 +917,18 @@ void SV_SendClientMessages (void)
 		}
 	}
 
+	// windowed downloads go out in datagrams of their own
+	for (i=0, c = svs.clients ; i<maxclients->value; i++, c++)
+	{
+		if (c->state >= cs_connected && c->download)
+			SV_SendDownload (c);
+	}
+
+	SV_PrepareEntityCull ();
+
+	if (sv_threads->intValue > 1 && SV_SendClientMessagesThreaded ())
+		return;
+
 	// send a message to each connected client
 	for (i=0, c = svs.clients ; i<maxclients->value; i++, c++)
 	{
@@ -552,6 +942,7 @@ void SV_SendClientMessages (void)
 			SZ_Clear (&c->datagram);
 			SV_BroadcastPrintf (PRINT_HIGH, "%s overflowed\n", c->name);
 			SV_DropClient (c);
+			SV_PrepareEntityCull ();		// the game may have changed entities
 		}
 
 		if (sv.state == ss_cinematic 
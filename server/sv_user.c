@@ -40,11 +40,16 @@ SV_BeginDemoServer
 void SV_BeginDemoserver (void)
 {
 	char		name[MAX_OSPATH];
+	FILE		*f;
+	int			len;
 
 	Com_sprintf (name, sizeof(name), "demos/%s", sv.name);
-	FS_FOpenFile (name, &sv.demofile);
-	if (!sv.demofile)
+	len = FS_FOpenFile (name, &f);
+	if (!f)
 		Com_Error (ERR_DROP, "Couldn't open %s\n", name);
+
+	// compressed serverrecord demos are unpacked as they are read
+	sv.demofile = FS_OpenReader (f, len);
 }
 
 /*
@@ -60,6 +65,7 @@ void SV_New_f (void)
 	char		*gamedir;
 	int			playernum;
 	edict_t		*ent;
+	int			start;
 
 	Com_DPrintf(DEVELOPER_MSG_SERVER, "New() from %s\n", sv_client->name);
 
@@ -81,6 +87,7 @@ void SV_New_f (void)
 	// to make sure the protocol is right, and to set the gamedir
 	//
 	gamedir = Cvar_VariableString ("gamedir");
+	start = sv_client->netchan.message.cursize;
 
 	// send the serverdata
 	MSG_WriteByte (&sv_client->netchan.message, svc_serverdata);
@@ -97,6 +104,7 @@ void SV_New_f (void)
 
 	// send full levelname
 	MSG_WriteString (&sv_client->netchan.message, sv.configstrings[CS_NAME]);
+	SV_CountMessage (sv_client, svc_serverdata, sv_client->netchan.message.cursize - start);
 
 	//
 	// game server
@@ -170,6 +178,7 @@ void SV_Configstrings_f (void)
 			MSG_WriteByte (&sv_client->netchan.message, svc_configstring);
 			MSG_WriteShort (&sv_client->netchan.message, start);
 			MSG_WriteString (&sv_client->netchan.message, sv.configstrings[start]);
+			SV_CountMessage (sv_client, svc_configstring, (int)strlen(sv.configstrings[start]) + 4);
 		}
 		start++;
 	}
@@ -199,6 +208,7 @@ void SV_Baselines_f (void)
 	int	max_packet_len; /* FS: Added */
 	entity_state_t	nullstate;
 	entity_state_t	*base;
+	int	size;
 
 	Com_DPrintf(DEVELOPER_MSG_SERVER, "Baselines() from %s\n", sv_client->name);
 
@@ -245,8 +255,10 @@ void SV_Baselines_f (void)
 		base = &sv.baselines[start];
 		if (base->modelindex || base->sound || base->effects)
 		{
+			size = sv_client->netchan.message.cursize;
 			MSG_WriteByte (&sv_client->netchan.message, svc_spawnbaseline);
 			MSG_WriteDeltaEntity (&nullstate, base, &sv_client->netchan.message, true, true);
+			SV_CountMessage (sv_client, svc_spawnbaseline, sv_client->netchan.message.cursize - size);
 		}
 		start++;
 	}
@@ -300,6 +312,240 @@ void SV_Begin_f (void)
 
 //=============================================================================
 
+/*
+==================
+SV_EndDownload
+==================
+*/
+static void SV_EndDownload (client_t *cl)
+{
+	FS_FreeFile (cl->download);
+	cl->download = NULL;
+	cl->downloadwindow = 0;
+}
+
+/*
+==================
+SV_AckDownload
+
+A windowed download client tells how much it has
+==================
+*/
+static void SV_AckDownload (void)
+{
+	int		offset;
+
+	offset = atoi (Cmd_Argv(1));
+	if (offset < 0)
+	{	// the client gave up on it
+		SV_EndDownload (sv_client);
+		return;
+	}
+	if (offset <= sv_client->downloadacked || offset > sv_client->downloadsize)
+		return;
+
+	sv_client->downloadacked = offset;
+	sv_client->downloadacktime = svs.realtime;
+	if (sv_client->downloadcount < offset)
+		sv_client->downloadcount = offset;	// it had what we went back to send again
+
+	if (offset == sv_client->downloadsize)
+	{
+		Com_DPrintf(DEVELOPER_MSG_SERVER, "Finished windowed download to %s\n", sv_client->name);
+		SV_EndDownload (sv_client);
+	}
+}
+
+/*
+==================
+SV_SendDownload
+
+Called every frame to push the next chunks of a windowed download,
+each in its own datagram.  Chunks only go out while the client
+hasn't fallen more than downloadwindow behind and the rate allows,
+and are cut to what is left of the datagram after any reliable
+message the netchan adds to it.
+If nothing is acknowledged for a while the rest is assumed lost
+and sent again from the last acknowledged byte.
+==================
+*/
+void SV_SendDownload (client_t *cl)
+{
+	sizebuf_t	msg;
+	byte		buf[DOWNLOAD_CHUNKSIZE + 16];
+	int			len, room, elapsed;
+
+	if (!cl->download || !cl->downloadwindow)
+		return;
+
+	if (cl->downloadcount > cl->downloadacked
+		&& svs.realtime - cl->downloadacktime > 250 + cl->ping * 2)
+	{
+		cl->downloadcount = cl->downloadacked;
+		cl->downloadacktime = svs.realtime;
+	}
+
+	// credit the time since the last call, whatever the frame rate, and
+	// let up to 100 msec and a chunk build up so low rates still get through
+	elapsed = svs.realtime - cl->downloadcredittime;
+	cl->downloadcredittime = svs.realtime;
+	if (elapsed > 0)
+		cl->downloadcredit += cl->downloadrate * min(elapsed, 1000) * 0.001f;
+	if (cl->downloadcredit > cl->downloadrate / 10 + DOWNLOAD_CHUNKSIZE)
+		cl->downloadcredit = cl->downloadrate / 10 + DOWNLOAD_CHUNKSIZE;
+
+	while (cl->downloadcount < cl->downloadsize)
+	{
+		// the svc_download header, and a reliable message if one goes too
+		room = MAX_MSGLEN_MP - PACKET_HEADER - 9;
+		if (Netchan_NeedReliable (&cl->netchan))
+			room -= cl->netchan.reliable_length ? cl->netchan.reliable_length : cl->netchan.message.cursize;
+		if (room <= 0)
+			break;
+
+		len = min(DOWNLOAD_CHUNKSIZE, cl->downloadsize - cl->downloadcount);
+		len = min(len, room);
+		if (len > cl->downloadcredit
+			|| cl->downloadcount + len - cl->downloadacked > cl->downloadwindow)
+			break;
+
+		SZ_Init (&msg, buf, sizeof(buf));
+		MSG_WriteByte (&msg, svc_download);
+		MSG_WriteShort (&msg, DOWNLOAD_CHUNK);
+		MSG_WriteLong (&msg, cl->downloadcount);
+		MSG_WriteShort (&msg, len);
+		SZ_Write (&msg, cl->download + cl->downloadcount, len);
+		Netchan_Transmit (&cl->netchan, msg.cursize, msg.data);
+		SV_CountMessage (cl, svc_download, msg.cursize);
+
+		cl->downloadcount += len;
+		cl->downloadcredit -= len;
+	}
+}
+
+// packing runs in the server frame, so bigger files go as they are
+#define	DOWNLOAD_MAXPACK	(16*1024*1024)
+
+// the last file packed, as every client joining a map wants the same ones
+static struct
+{
+	char		name[MAX_QPATH];
+	unsigned	stamp;				// FS_FileStamp when it was packed
+	int			rawsize;
+	byte		*packed;			// NULL if it didn't get smaller
+	int			len;
+} sv_packed;
+
+/*
+==================
+SV_FreeDownloadCache
+==================
+*/
+void SV_FreeDownloadCache (void)
+{
+	if (sv_packed.packed)
+		Z_Free (sv_packed.packed);
+	memset (&sv_packed, 0, sizeof(sv_packed));
+}
+
+/*
+==================
+SV_PackDownload
+
+Returns the packed length of the client's download, with a copy of the
+data in *packed, or 0 if it doesn't pack smaller
+==================
+*/
+static int SV_PackDownload (char *name, byte **packed)
+{
+	unsigned	stamp;
+	int			len;
+
+	stamp = FS_FileStamp (name);
+	if (!stamp || stamp != sv_packed.stamp || sv_client->downloadsize != sv_packed.rawsize
+		|| Q_strcasecmp (name, sv_packed.name))
+	{
+		SV_FreeDownloadCache ();
+		len = FS_PackBuffer (sv_client->download, sv_client->downloadsize, packed);
+		if (len >= sv_client->downloadsize)
+		{
+			Z_Free (*packed);
+			len = 0;
+		}
+		if (!stamp)
+			return len;		// no way to tell if it changes
+
+		Q_strncpyz (sv_packed.name, name, sizeof(sv_packed.name));
+		sv_packed.stamp = stamp;
+		sv_packed.rawsize = sv_client->downloadsize;
+		if (len)
+		{
+			sv_packed.packed = Z_Malloc (len);
+			memcpy (sv_packed.packed, *packed, len);
+			sv_packed.len = len;
+		}
+		return len;
+	}
+
+	if (!sv_packed.packed)
+		return 0;
+	*packed = Z_Malloc (sv_packed.len);
+	memcpy (*packed, sv_packed.packed, sv_packed.len);
+	return sv_packed.len;
+}
+
+/*
+==================
+SV_BeginWindowedDownload
+
+The file is loaded and downloadcount holds the resume offset
+==================
+*/
+static void SV_BeginWindowedDownload (char *name, int flags)
+{
+	byte	*packed;
+	int		len;
+
+	if ((flags & DLF_COMPRESSED) && !sv_client->downloadcount && sv_download_compress->intValue
+		&& sv_client->downloadsize <= DOWNLOAD_MAXPACK)
+	{
+		len = SV_PackDownload (name, &packed);
+		if (len)
+		{
+			FS_FreeFile (sv_client->download);
+			sv_client->download = packed;
+			sv_client->downloadsize = len;
+		}
+		else
+			flags &= ~DLF_COMPRESSED;
+	}
+	else
+		flags &= ~DLF_COMPRESSED;
+
+	// the game clamps rate for snapshots, a download can use whatever the client says it has
+	sv_client->downloadrate = atoi (Info_ValueForKey (sv_client->userinfo, "rate"));
+	if (sv_client->downloadrate <= 0)
+		sv_client->downloadrate = 5000;
+	sv_client->downloadrate = max(sv_client->downloadrate, 1000);
+	if (sv_download_maxrate->intValue > 0)
+		sv_client->downloadrate = min(sv_client->downloadrate, sv_download_maxrate->intValue);
+
+	sv_client->downloadwindow = max(sv_download_window->intValue, DOWNLOAD_CHUNKSIZE);
+	sv_client->downloadacked = sv_client->downloadcount;
+	sv_client->downloadacktime = svs.realtime;
+	sv_client->downloadcredit = 0;
+	sv_client->downloadcredittime = svs.realtime;
+
+	MSG_WriteByte (&sv_client->netchan.message, svc_download);
+	MSG_WriteShort (&sv_client->netchan.message, DOWNLOAD_WINDOWED);
+	MSG_WriteByte (&sv_client->netchan.message, flags & (DLF_WINDOWED|DLF_COMPRESSED));
+	MSG_WriteLong (&sv_client->netchan.message, sv_client->downloadsize);
+	MSG_WriteLong (&sv_client->netchan.message, sv_client->downloadcount);
+
+	if (sv_client->downloadcount == sv_client->downloadsize)
+		SV_EndDownload (sv_client);
+}
+
 /*
 ==================
 SV_NextDownload_f
@@ -314,6 +560,12 @@ void SV_NextDownload_f (void)
 	if (!sv_client->download)
 		return;
 
+	if (sv_client->downloadwindow)
+	{
+		SV_AckDownload ();
+		return;
+	}
+
 	r = sv_client->downloadsize - sv_client->downloadcount;
 	if (r > 1024)
 		r = 1024;
@@ -329,12 +581,12 @@ void SV_NextDownload_f (void)
 	MSG_WriteByte (&sv_client->netchan.message, percent);
 	SZ_Write (&sv_client->netchan.message,
 		sv_client->download + sv_client->downloadcount - r, r);
+	SV_CountMessage (sv_client, svc_download, r + 4);
 
 	if (sv_client->downloadcount != sv_client->downloadsize)
 		return;
 
-	FS_FreeFile (sv_client->download);
-	sv_client->download = NULL;
+	SV_EndDownload (sv_client);
 }
 
 /*
@@ -354,11 +606,14 @@ void SV_BeginDownload_f (void)
 	qboolean	valid;
 	extern	int		file_from_pak; // ZOID did file come from pak?
 	int offset = 0;
+	int flags = 0;
 
 	name = Cmd_Argv(1);
 
 	if (Cmd_Argc() > 2)
 		offset = atoi(Cmd_Argv(2)); // downloaded offset
+	if (Cmd_Argc() > 3)
+		flags = atoi(Cmd_Argv(3)); // DLF_* the client can handle
 
 	// r1ch fix: name is always filtered for security reasons
 	StripHighBits (name, 1);
@@ -455,6 +710,7 @@ void SV_BeginDownload_f (void)
 
 	if (sv_client->download)
 		FS_FreeFile (sv_client->download);
+	sv_client->downloadwindow = 0;
 
 	sv_client->downloadsize = FS_LoadFile (name, (void **)&sv_client->download);
 	sv_client->downloadcount = offset;
@@ -479,8 +735,11 @@ void SV_BeginDownload_f (void)
 		return;
 	}
 
-	SV_NextDownload_f ();
 	Com_DPrintf(DEVELOPER_MSG_SERVER, "Downloading %s to %s\n", name, sv_client->name);
+	if ((flags & DLF_WINDOWED) && sv_download_window->intValue > 0)
+		SV_BeginWindowedDownload (name, flags);
+	else
+		SV_NextDownload_f ();
 }
 
 
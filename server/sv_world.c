@@ -41,22 +41,42 @@ typedef struct areanode_s
 {
 	int		axis;		// -1 = leaf node
 	float	dist;
+	float	loose;		// children also take edicts straddling dist by this much
+	int		depth;
 	struct areanode_s	*children[2];
 	link_t	trigger_edicts;
 	link_t	solid_edicts;
+
+	// sv_areastats counters
+	int		visits;		// SV_AreaEdicts_r calls that reached this node
+	int		tested;		// edicts bounds-checked at this node
 } areanode_t;
 
-#define	AREA_DEPTH	4
-#define	AREA_NODES	32
+// the tree is always at least AREA_MIN_DEPTH deep (the original fixed
+// layout), and keeps subdividing big maps until the leafs are smaller
+// than sv_area_cellsize or AREA_MAX_DEPTH is reached
+#define	AREA_MIN_DEPTH	4
+#define	AREA_MAX_DEPTH	8
+#define	AREA_NODES		(1<<(AREA_MAX_DEPTH+1))
+
+// fraction of a node's split axis size that edicts may cross the split
+// plane by and still be pushed down into the child they are centered in
+#define	AREA_LOOSE_FRAC	0.125
 
 areanode_t	sv_areanodes[AREA_NODES];
 int			sv_numareanodes;
+int			sv_areadepth;
 
 float	*area_mins, *area_maxs;
 edict_t	**area_list;
 int		area_count, area_maxcount;
 int		area_type;
 
+// sv_areastats query totals, cleared with the world
+static int	area_queries, area_returned;
+
+entindex_t	sv_entindex;
+
 int SV_HullForEntity (edict_t *ent);
 
 
@@ -84,7 +104,9 @@ void InsertLinkBefore (link_t *l, link_t *before)
 ===============
 SV_CreateAreaNode
 
-Builds a uniformly subdivided tree for the given world size
+Builds a uniformly subdivided tree for the given world size.
+Larger worlds get a deeper tree, so the leafs stay close to
+sv_area_cellsize units across.
 ===============
 */
 areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
@@ -98,21 +120,27 @@ areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 
 	ClearLink (&anode->trigger_edicts);
 	ClearLink (&anode->solid_edicts);
-	
-	if (depth == AREA_DEPTH)
+	anode->depth = depth;
+	if (depth > sv_areadepth)
+		sv_areadepth = depth;
+
+	VectorSubtract (maxs, mins, size);
+
+	if (depth == AREA_MAX_DEPTH || (depth >= AREA_MIN_DEPTH
+	&& size[0] <= sv_area_cellsize->value && size[1] <= sv_area_cellsize->value))
 	{
 		anode->axis = -1;
 		anode->children[0] = anode->children[1] = NULL;
 		return anode;
 	}
 	
-	VectorSubtract (maxs, mins, size);
 	if (size[0] > size[1])
 		anode->axis = 0;
 	else
 		anode->axis = 1;
 	
 	anode->dist = 0.5 * (maxs[anode->axis] + mins[anode->axis]);
+	anode->loose = AREA_LOOSE_FRAC * size[anode->axis];
 	VectorCopy (mins, mins1);	
 	VectorCopy (mins, mins2);	
 	VectorCopy (maxs, maxs1);	
@@ -126,6 +154,130 @@ areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 	return anode;
 }
 
+/*
+===============================================================================
+
+ENTITY CLUSTER INDEX
+
+SV_LinkEdict files every entity under the PVS clusters it touches, so
+frame building can OR together the entity bits of the clusters a client
+can see rather than testing every entity against the client's PVS.
+The per entity side is kept by entity number, apart from the edicts, so
+an entity can be taken out of its old clusters even after the game has
+changed or cleared its edict.
+
+===============================================================================
+*/
+
+/*
+===============
+SV_ClearEntityIndex
+
+Sizes the index for the map that was just loaded
+===============
+*/
+static void SV_ClearEntityIndex (void)
+{
+	entindex_t	*ix = &sv_entindex;
+
+	if (ix->clusterents)
+	{
+		Z_Free (ix->clusterents);
+		Z_Free (ix->clustercount);
+		Z_Free (ix->occupied);
+		Z_Free (ix->occupiedslot);
+	}
+	memset (ix, 0, sizeof(*ix));
+
+	ix->numclusters = CM_NumClusters ();
+	if (ix->numclusters < 1)
+		ix->numclusters = 1;
+	ix->clusterents = Z_Malloc (ix->numclusters * SV_ENTWORDS * sizeof(unsigned));
+	ix->clustercount = Z_Malloc (ix->numclusters * sizeof(int));
+	ix->occupied = Z_Malloc (ix->numclusters * sizeof(int));
+	ix->occupiedslot = Z_Malloc (ix->numclusters * sizeof(int));
+}
+
+/*
+===============
+SV_IndexEntity
+
+Moves entity e from the clusters it was filed under
+to the ones in its edict
+===============
+*/
+static void SV_IndexEntity (int e, edict_t *ent)
+{
+	entindex_t	*ix = &sv_entindex;
+	int			i, c, num, last;
+	unsigned	bit;
+
+	bit = 1u << (e & 31);
+
+	for (i=0 ; i<ix->numentclusters[e] ; i++)
+	{
+		c = ix->entclusters[e][i];
+		if (c < 0 || c >= ix->numclusters)
+			continue;
+		ix->clusterents[c*SV_ENTWORDS + (e>>5)] &= ~bit;
+		if (--ix->clustercount[c])
+			continue;
+
+		// the last occupied cluster takes its place in the list
+		last = ix->occupied[--ix->numoccupied];
+		ix->occupied[ix->occupiedslot[c]] = last;
+		ix->occupiedslot[last] = ix->occupiedslot[c];
+	}
+
+	num = ent->num_clusters;
+	if (num > MAX_ENT_CLUSTERS)
+		num = MAX_ENT_CLUSTERS;
+	ix->numentclusters[e] = num;
+	ix->linkcount[e] = ent->linkcount;
+
+	for (i=0 ; i<num ; i++)
+	{
+		c = ix->entclusters[e][i] = ent->clusternums[i];
+		if (c < 0 || c >= ix->numclusters)
+			continue;		// never in a PVS, so there is nothing to file it under
+		ix->clusterents[c*SV_ENTWORDS + (e>>5)] |= bit;
+		if (ix->clustercount[c]++)
+			continue;
+
+		ix->occupiedslot[c] = ix->numoccupied;
+		ix->occupied[ix->numoccupied++] = c;
+	}
+}
+
+/*
+===============
+SV_SyncEntityIndex
+
+SV_LinkEdict keeps the index current, but the game can also clear an
+edict or load one from a savegame without relinking it.  The link
+count and cluster count catch both, so only those entities are redone.
+===============
+*/
+void SV_SyncEntityIndex (void)
+{
+	entindex_t	*ix = &sv_entindex;
+	edict_t		*ent;
+	int			e, num;
+
+	if (!ix->clusterents)
+		return;
+
+	num = ge->num_edicts;
+	if (num > MAX_EDICTS)
+		num = MAX_EDICTS;
+	for (e=1 ; e<num ; e++)
+	{
+		ent = EDICT_NUM(e);
+		if (ent->linkcount != ix->linkcount[e] || ent->num_clusters != ix->numentclusters[e])
+			SV_IndexEntity (e, ent);
+	}
+}
+
 /*
 ===============
 SV_ClearWorld
@@ -136,7 +288,12 @@ void SV_ClearWorld (void)
 {
 	memset (sv_areanodes, 0, sizeof(sv_areanodes));
 	sv_numareanodes = 0;
+	sv_areadepth = 0;
+	area_queries = area_returned = 0;
+	if (sv_area_cellsize->value < 64)
+		Cvar_ForceSet ("sv_area_cellsize", "64");
 	SV_CreateAreaNode (0, sv.models[1]->mins, sv.models[1]->maxs);
+	SV_ClearEntityIndex ();
 }
 
 
@@ -165,12 +322,16 @@ SV_LinkEdict
 void SV_LinkEdict (edict_t *ent)
 {
 	areanode_t	*node;
+	float		mid;
 	int			leafs[MAX_TOTAL_ENT_LEAFS];
 	int			clusters[MAX_TOTAL_ENT_LEAFS];
 	int			num_leafs;
 	int			i, j, k;
 	int			area;
 	int			topnode;
+	int			e;
+
+	sv_prof.links++;
 
 	if (ent->area.prev)
 		SV_UnlinkEdict (ent);	// unlink from old position
@@ -319,18 +480,24 @@ void SV_LinkEdict (edict_t *ent)
 	}
 	ent->linkcount++;
 
+	e = NUM_FOR_EDICT(ent);
+	if (e < MAX_EDICTS && sv_entindex.clusterents)
+		SV_IndexEntity (e, ent);
+
 	if (ent->solid == SOLID_NOT)
 		return;
 
-// find the first node that the ent's box crosses
+// find the first node that the ent's box crosses by more than the
+// node's slack, using the side the box is centered on
 	node = sv_areanodes;
 	while (1)
 	{
 		if (node->axis == -1)
 			break;
-		if (ent->absmin[node->axis] > node->dist)
+		mid = 0.5 * (ent->absmin[node->axis] + ent->absmax[node->axis]);
+		if (mid >= node->dist && ent->absmin[node->axis] > node->dist - node->loose)
 			node = node->children[0];
-		else if (ent->absmax[node->axis] < node->dist)
+		else if (mid < node->dist && ent->absmax[node->axis] < node->dist + node->loose)
 			node = node->children[1];
 		else
 			break;		// crosses the node
@@ -362,10 +529,13 @@ void SV_AreaEdicts_r (areanode_t *node)
 	else
 		start = &node->trigger_edicts;
 
+	node->visits++;
+
 	for (l=start->next  ; l != start ; l = next)
 	{
 		next = l->next;
 		check = EDICT_FROM_AREA(l);
+		node->tested++;
 
 		if (check->solid == SOLID_NOT)
 			continue;		// deactivated
@@ -390,10 +560,11 @@ void SV_AreaEdicts_r (areanode_t *node)
 	if (node->axis == -1)
 		return;		// terminal node
 
-	// recurse down both sides
-	if ( area_maxs[node->axis] > node->dist )
+	// recurse down both sides, children may hold edicts that
+	// reach back across the split plane by up to node->loose
+	if ( area_maxs[node->axis] > node->dist - node->loose )
 		SV_AreaEdicts_r ( node->children[0] );
-	if ( area_mins[node->axis] < node->dist )
+	if ( area_mins[node->axis] < node->dist + node->loose )
 		SV_AreaEdicts_r ( node->children[1] );
 }
 
@@ -414,9 +585,87 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list,
 
 	SV_AreaEdicts_r (sv_areanodes);
 
+	area_queries++;
+	area_returned += area_count;
+
 	return area_count;
 }
 
+/*
+================
+SV_AreaStats_f
+
+Reports edict occupancy and query cost for each area node.
+"sv_areastats reset" clears the query counters.
+================
+*/
+void SV_AreaStats_f (void)
+{
+	areanode_t	*node;
+	link_t		*l;
+	int			i, solids, triggers;
+	int			maxsolids, maxtriggers, leafs;
+	int			visits, tested;
+
+	if (!svs.initialized || sv.state == ss_dead)
+	{
+		Com_Printf ("No server running.\n");
+		return;
+	}
+
+	if (Cmd_Argc() > 1 && !Q_stricmp(Cmd_Argv(1), "reset"))
+	{
+		for (i=0, node=sv_areanodes ; i<sv_numareanodes ; i++, node++)
+			node->visits = node->tested = 0;
+		area_queries = area_returned = 0;
+		Com_Printf ("Area stats reset.\n");
+		return;
+	}
+
+	maxsolids = maxtriggers = leafs = 0;
+	visits = tested = 0;
+
+	Com_Printf ("node depth axis     dist solid trig   visits   tested\n");
+	Com_Printf ("---- ----- ---- -------- ----- ---- -------- --------\n");
+	for (i=0, node=sv_areanodes ; i<sv_numareanodes ; i++, node++)
+	{
+		solids = triggers = 0;
+		for (l=node->solid_edicts.next ; l != &node->solid_edicts ; l=l->next)
+			solids++;
+		for (l=node->trigger_edicts.next ; l != &node->trigger_edicts ; l=l->next)
+			triggers++;
+
+		if (solids > maxsolids)
+			maxsolids = solids;
+		if (triggers > maxtriggers)
+			maxtriggers = triggers;
+		if (node->axis == -1)
+			leafs++;
+		visits += node->visits;
+		tested += node->tested;
+
+		if (!solids && !triggers && !node->tested)
+			continue;
+
+		if (node->axis == -1)
+			Com_Printf ("%4i %5i leaf          %5i %4i %8i %8i\n", i, node->depth,
+				solids, triggers, node->visits, node->tested);
+		else
+			Com_Printf ("%4i %5i    %c %8.0f %5i %4i %8i %8i\n", i, node->depth,
+				"xy"[node->axis], node->dist, solids, triggers, node->visits, node->tested);
+	}
+
+	Com_Printf ("%i nodes, %i leafs, depth %i, cellsize %g\n",
+		sv_numareanodes, leafs, sv_areadepth, sv_area_cellsize->value);
+	Com_Printf ("most edicts in one node: %i solid, %i trigger\n", maxsolids, maxtriggers);
+	Com_Printf ("%i queries, %i node visits, %i edicts tested, %i returned\n",
+		area_queries, visits, tested, area_returned);
+	if (area_queries)
+		Com_Printf ("per query: %.1f nodes, %.1f tested, %.1f returned\n",
+			(float)visits / area_queries, (float)tested / area_queries,
+			(float)area_returned / area_queries);
+}
+
 
 //===========================================================================
 
@@ -618,6 +867,8 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *p
 {
 	moveclip_t	clip;
 
+	sv_prof.traces++;
+
 	if (!mins)
 		mins = vec3_origin;
 	if (!maxs)
@@ -46,6 +46,8 @@ loopback_t	loopbacks[2];
 SOCKET			ip_sockets[2];
 SOCKET			ipx_sockets[2];
 
+static int	net_syscalls;		// recvfrom and sendto calls, for stats
+
 //=============================================================================
 
 void NetadrToSockadr (netadr_t *a, struct sockaddr *s)
@@ -346,6 +348,7 @@ qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_messag
 			continue;
 
 		fromlen = sizeof(from);
+		net_syscalls++;
 		ret = recvfrom (net_socket, (char *)net_message->data, net_message->maxsize, 0,
 				(struct sockaddr *)&from, &fromlen);
 
@@ -442,6 +445,7 @@ void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 
 	NetadrToSockadr (&to, &addr);
 
+	net_syscalls++;
 	ret = sendto (net_socket, data, length, 0, &addr, sizeof(addr) );
 	if (ret == SOCKET_ERROR)
 	{
@@ -476,6 +480,27 @@ void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 	}
 }
 
+/*
+====================
+NET_BeginBatch / NET_FlushBatch
+
+Winsock has no way to send several packets in one call, so packets go out
+as they are sent
+====================
+*/
+void NET_BeginBatch (netsrc_t sock)
+{
+}
+
+void NET_FlushBatch (netsrc_t sock)
+{
+}
+
+int NET_SystemCalls (void)
+{
+	return net_syscalls;
+}
+
 //=============================================================================
 
 
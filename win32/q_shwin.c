@@ -133,6 +133,23 @@ int Sys_Milliseconds (void)
 	return curtime;
 }
 
+unsigned Sys_Microseconds (void)
+{
+	static LARGE_INTEGER	freq;
+	LARGE_INTEGER			count;
+
+	if (!freq.QuadPart)
+	{
+		if (!QueryPerformanceFrequency (&freq) || !freq.QuadPart)
+			freq.QuadPart = -1;
+	}
+	if (freq.QuadPart < 0)	// no performance counter
+		return (unsigned)timeGetTime() * 1000u;
+
+	QueryPerformanceCounter (&count);
+	return (unsigned)((count.QuadPart / freq.QuadPart) * 1000000 + (count.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart);
+}
+
 void Sys_Mkdir (char *path)
 {
 	_mkdir (path);
@@ -140,6 +157,117 @@ void Sys_Mkdir (char *path)
 
 //============================================
 
+typedef struct
+{
+	HANDLE	handle;
+	void	(*func)(void *arg);
+	void	*arg;
+} systhread_t;
+
+static DWORD WINAPI Sys_ThreadMain (LPVOID arg)
+{
+	systhread_t	*t = (systhread_t *)arg;
+
+	t->func (t->arg);
+	return 0;
+}
+
+void *Sys_CreateThread (void (*func)(void *arg), void *arg)
+{
+	systhread_t	*t;
+	DWORD		id;
+
+	t = malloc (sizeof(*t));
+	if (!t)
+		return NULL;
+	t->func = func;
+	t->arg = arg;
+	t->handle = CreateThread (NULL, 0, Sys_ThreadMain, t, 0, &id);
+	if (!t->handle)
+	{
+		free (t);
+		return NULL;
+	}
+	return t;
+}
+
+void Sys_JoinThread (void *thread)
+{
+	systhread_t	*t = (systhread_t *)thread;
+
+	if (!t)
+		return;
+	WaitForSingleObject (t->handle, INFINITE);
+	CloseHandle (t->handle);
+	free (t);
+}
+
+void *Sys_CreateMutex (void)
+{
+	CRITICAL_SECTION	*cs;
+
+	cs = malloc (sizeof(*cs));
+	if (!cs)
+		return NULL;
+	InitializeCriticalSection (cs);
+	return cs;
+}
+
+void Sys_DestroyMutex (void *mutex)
+{
+	if (!mutex)
+		return;
+	DeleteCriticalSection ((CRITICAL_SECTION *)mutex);
+	free (mutex);
+}
+
+void Sys_LockMutex (void *mutex)
+{
+	if (mutex)
+		EnterCriticalSection ((CRITICAL_SECTION *)mutex);
+}
+
+void Sys_UnlockMutex (void *mutex)
+{
+	if (mutex)
+		LeaveCriticalSection ((CRITICAL_SECTION *)mutex);
+}
+
+void *Sys_CreateSemaphore (int count)
+{
+	return CreateSemaphore (NULL, count, 0x7fffffff, NULL);
+}
+
+void Sys_DestroySemaphore (void *sem)
+{
+	if (sem)
+		CloseHandle ((HANDLE)sem);
+}
+
+void Sys_PostSemaphore (void *sem, int count)
+{
+	if (sem && count > 0)
+		ReleaseSemaphore ((HANDLE)sem, count, NULL);
+}
+
+void Sys_WaitSemaphore (void *sem)
+{
+	if (sem)
+		WaitForSingleObject ((HANDLE)sem, INFINITE);
+}
+
+int Sys_NumCPUs (void)
+{
+	SYSTEM_INFO	info;
+
+	GetSystemInfo (&info);
+	if (info.dwNumberOfProcessors < 1)
+		return 1;
+	return (int)info.dwNumberOfProcessors;
+}
+
+//============================================
+
 char	findbase[MAX_OSPATH];
 char	findpath[MAX_OSPATH];
 intptr_t	findhandle;
@@ -181,8 +309,11 @@ char *Sys_FindFirst (char *path, unsigned musthave, unsigned canthave)
 	findhandle = _findfirst (path, &findinfo);
 	if (findhandle == -1)
 		return NULL;
-	if (!CompareAttributes(findinfo.attrib, musthave, canthave))
-		return NULL;
+	while (!CompareAttributes(findinfo.attrib, musthave, canthave))
+	{	// skip ahead instead of stopping at the first mismatch
+		if (_findnext (findhandle, &findinfo) == -1)
+			return NULL;
+	}
 	Com_sprintf(findpath, sizeof(findpath), "%s/%s", findbase, findinfo.name);
 	return findpath;
 }
@@ -192,10 +323,11 @@ char *Sys_FindNext (unsigned musthave, unsigned canthave)
 	struct _finddata_t findinfo;
 	if (findhandle == -1)
 		return NULL;
-	if (_findnext (findhandle, &findinfo) == -1)
-		return NULL;
-	if (!CompareAttributes(findinfo.attrib, musthave, canthave))
-		return NULL;
+	do
+	{
+		if (_findnext (findhandle, &findinfo) == -1)
+			return NULL;
+	} while (!CompareAttributes(findinfo.attrib, musthave, canthave));
 	Com_sprintf(findpath, sizeof(findpath), "%s/%s", findbase, findinfo.name);
 	return findpath;
 }
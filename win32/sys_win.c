@@ -355,6 +355,49 @@ void Sys_Sleep (unsigned msec)
 	Sleep (msec);
 }
 
+/*
+================
+Sys_MapFile
+
+Maps a whole file copy-on-write
+================
+*/
+void *Sys_MapFile (const char *path, int *length)
+{
+	HANDLE	file, mapping;
+	DWORD	size, high;
+	void	*base;
+
+	file = CreateFileA (path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	size = GetFileSize (file, &high);
+	if (size == INVALID_FILE_SIZE || high || !size || size > 0x7fffffff)
+	{
+		CloseHandle (file);
+		return NULL;
+	}
+
+	mapping = CreateFileMapping (file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	CloseHandle (file);
+	if (!mapping)
+		return NULL;
+
+	base = MapViewOfFile (mapping, FILE_MAP_COPY, 0, 0, 0);
+	CloseHandle (mapping);
+	if (!base)
+		return NULL;
+
+	*length = (int)size;
+	return base;
+}
+
+void Sys_UnmapFile (void *base, int length)
+{
+	UnmapViewOfFile (base);
+}
+
 /*
 ================
 Sys_SendKeyEvents